@@ -1,9 +1,26 @@
 #include "sample.h"
+#include <Util/FrameStatistics.h>
 #include <Windows.h>
 #include <gflags/gflags.h>
+#include <iostream>
+
+DEFINE_bool(headless, false,
+            "Renders offscreen without window nor swap chain.");
+DEFINE_int32(frames, 100, "Number of frames rendered in headless mode.");
 
 void main(int argc, char *argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_headless) {
+    sample tressfx(nullptr);
+    frame_statistics stats;
+    for (int i = 0; i < FLAGS_frames; i++) {
+      stats.begin_frame();
+      tressfx.draw();
+      stats.end_frame();
+    }
+    stats.print(std::cout);
+    return;
+  }
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   auto window = glfwCreateWindow(1280, 1024, "TressFx", nullptr, nullptr);
@@ -46,11 +46,18 @@ auto get_blit_pso(device_t &dev, pipeline_layout_t &layout, render_pass_t &rp) {
 
 DEFINE_bool(uses_debug_marker, false, "Uses debug marker (renderdoc only).");
 DEFINE_bool(uses_debug_layer, false, "Uses debug layer.");
+DEFINE_string(dump_frames, "",
+              "Headless mode only, prefix of the .ppm files written for "
+              "every frame (disabled if empty).");
 
 sample::sample(GLFWwindow *window) {
+  // No window means headless rendering.
   auto dev_swapchain_queue =
-      create_device_swapchain_and_graphic_presentable_queue(
-          window, FLAGS_uses_debug_marker, FLAGS_uses_debug_layer);
+      window != nullptr
+          ? create_device_swapchain_and_graphic_presentable_queue(
+                window, FLAGS_uses_debug_marker, FLAGS_uses_debug_layer)
+          : create_headless_device_swapchain_and_graphic_queue(
+                1280, 1024, 2, FLAGS_dump_frames, FLAGS_uses_debug_layer);
   dev = std::move(std::get<0>(dev_swapchain_queue));
   queue = std::move(std::get<2>(dev_swapchain_queue));
   chain = std::move(std::get<1>(dev_swapchain_queue));
@@ -0,0 +1,157 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+// Compares frustum culling of random boxes with a linear SIMD scan and with
+// the bounding volume hierarchy, and times the other hierarchy queries.
+#include <Scene/BVH.h>
+#include <chrono>
+#include <cmath>
+#include <gflags/gflags.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <random>
+
+DEFINE_int32(items, 100000, "Number of boxes");
+DEFINE_int32(iterations, 100, "Number of repetitions of every query");
+DEFINE_double(world_size, 1000., "Side of the cube containing the boxes");
+DEFINE_double(moved_ratio, .01, "Ratio of boxes moved between refits");
+
+using namespace irr::scene;
+
+namespace {
+template <typename F> double measure_ms(F &&f) {
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++)
+    f(i);
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+             .count() /
+         FLAGS_iterations;
+}
+
+frustum make_view(float angle) {
+  const auto &eye = glm::vec3(0.f);
+  const auto &target = glm::vec3(std::cos(angle), 0.f, std::sin(angle));
+  const auto &view = glm::lookAtLH(eye, target, glm::vec3(0.f, 1.f, 0.f));
+  const auto &projection =
+      glm::perspective(70.f / 180.f * 3.14f, 16.f / 9.f, 1.f,
+                       static_cast<float>(FLAGS_world_size) * .5f);
+  return frustum::from_view_projection(projection * view);
+}
+}
+
+int main(int argc, char *argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  std::mt19937 generator(42);
+  const auto half_size = static_cast<float>(FLAGS_world_size) * .5f;
+  std::uniform_real_distribution<float> position(-half_size, half_size);
+  std::uniform_real_distribution<float> extent(.5f, 5.f);
+  const auto &&random_box = [&]() {
+    const auto &center =
+        glm::vec3(position(generator), position(generator),
+                  position(generator));
+    const auto &half_extents =
+        glm::vec3(extent(generator), extent(generator), extent(generator));
+    aabb box;
+    box.add_point(center - half_extents);
+    box.add_point(center + half_extents);
+    return box;
+  };
+
+  std::vector<aabb> boxes(FLAGS_items);
+  aabb_soa soa;
+  soa.resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    boxes[i] = random_box();
+    soa.set(i, boxes[i]);
+  }
+
+  bvh tree;
+  const auto build_ms = measure_ms([&](int) { tree.build(boxes); });
+
+  std::vector<frustum> views;
+  for (int i = 0; i < 4; i++)
+    views.push_back(make_view(i * 3.14f * .5f));
+
+  std::vector<uint8_t> visibility(boxes.size());
+  culling_statistics stats;
+  const auto linear_ms = measure_ms(
+      [&](int) { stats = cull_boxes(views[0], soa, visibility); });
+
+  std::vector<uint32_t> items;
+  const auto bvh_ms = measure_ms([&](int) {
+    items.clear();
+    tree.query_frustum(views[0], items);
+  });
+  const auto visited = tree.get_last_visited_node_count();
+
+  std::vector<std::vector<uint32_t>> view_items(views.size());
+  const auto multi_view_ms = measure_ms([&](int) {
+    for (auto &v : view_items)
+      v.clear();
+    tree.query_frustums(views, view_items);
+  });
+
+  const auto moved_count = static_cast<size_t>(boxes.size() *
+                                               FLAGS_moved_ratio);
+  std::uniform_int_distribution<uint32_t> item(
+      0, static_cast<uint32_t>(boxes.size() - 1));
+  const auto refit_ms = measure_ms([&](int) {
+    for (size_t i = 0; i < moved_count; i++) {
+      const auto moved = item(generator);
+      boxes[moved] = random_box();
+      tree.update(moved, boxes[moved]);
+    }
+  });
+  const auto refitted_bvh_ms = measure_ms([&](int) {
+    items.clear();
+    tree.query_frustum(views[0], items);
+  });
+
+  uint32_t hits = 0;
+  const auto ray_ms = measure_ms([&](int i) {
+    auto distance = static_cast<float>(FLAGS_world_size);
+    const auto angle = i * .1f;
+    if (tree.query_ray(glm::vec3(0.f),
+                       glm::vec3(std::cos(angle), .1f, std::sin(angle)),
+                       distance) != bvh::invalid_item)
+      hits++;
+  });
+
+  const auto box_ms = measure_ms([&](int) {
+    items.clear();
+    tree.query_aabb(random_box(), items);
+  });
+
+  std::vector<uint32_t> incremental_items;
+  bvh incremental_tree;
+  const auto insert_ms = measure_ms([&](int) {
+    incremental_tree = bvh();
+    for (const auto &box : boxes)
+      incremental_tree.insert(box);
+  });
+  const auto incremental_bvh_ms = measure_ms([&](int) {
+    incremental_items.clear();
+    incremental_tree.query_frustum(views[0], incremental_items);
+  });
+
+  std::cout << boxes.size() << " boxes, " << tree.get_node_count()
+            << " nodes" << std::endl;
+  std::cout << "SAH build            " << build_ms << " ms" << std::endl;
+  std::cout << "linear cull_boxes    " << linear_ms << " ms, "
+            << stats.visible << " visible" << std::endl;
+  std::cout << "bvh frustum query    " << bvh_ms << " ms, " << visited
+            << " nodes visited" << std::endl;
+  std::cout << views.size() << " views query      " << multi_view_ms
+            << " ms" << std::endl;
+  std::cout << "refit " << moved_count << " boxes     " << refit_ms << " ms"
+            << std::endl;
+  std::cout << "query after refits   " << refitted_bvh_ms << " ms"
+            << std::endl;
+  std::cout << "incremental inserts  " << insert_ms << " ms" << std::endl;
+  std::cout << "query after inserts  " << incremental_bvh_ms << " ms"
+            << std::endl;
+  std::cout << "ray query            " << ray_ms << " ms, " << hits
+            << " hits" << std::endl;
+  std::cout << "aabb query           " << box_ms << " ms" << std::endl;
+  return 0;
+}
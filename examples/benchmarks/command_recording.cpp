@@ -0,0 +1,118 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+// Records the same command stream through command_list_t (virtual calls and
+// checked casts) and through gfx<vulkan_backend> and compares CPU time.
+#include <API/gfx.h>
+#include <API/vkapi.h>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <iostream>
+
+DEFINE_int32(iterations, 100, "Number of recorded command lists per path");
+DEFINE_int32(commands, 10000, "Number of bind/barrier groups per command list");
+DEFINE_bool(uses_debug_layer, false, "Enable Vulkan validation layers");
+
+namespace {
+constexpr auto commands_per_group = 4;
+
+// Draws would need a render pass and a pipeline, barriers and binds are
+// enough to exercise the dispatch and the argument casts.
+template <typename Recorder>
+void record(Recorder &&cmd, image_t &img, buffer_t &index_buffer,
+            buffer_t &vertex_buffer) {
+  for (int i = 0; i < FLAGS_commands; i++) {
+    cmd.set_pipeline_barrier(img, RESOURCE_USAGE::undefined,
+                             RESOURCE_USAGE::COPY_DEST, 0,
+                             irr::video::E_ASPECT::EA_COLOR);
+    cmd.bind_index_buffer(index_buffer, 0, 1024,
+                          irr::video::E_INDEX_TYPE::EIT_16BIT);
+    cmd.bind_vertex_buffers(0, {{vertex_buffer, 0ull, 12u, 2048u},
+                                {vertex_buffer, 2048ull, 8u, 2048u}});
+    cmd.set_pipeline_barrier(img, RESOURCE_USAGE::COPY_DEST,
+                             RESOURCE_USAGE::READ_GENERIC, 0,
+                             irr::video::E_ASPECT::EA_COLOR);
+  }
+}
+
+// Forwards to the virtual interface, so that both paths share record().
+struct virtual_recorder {
+  command_list_t &object;
+
+  void set_pipeline_barrier(image_t &resource, RESOURCE_USAGE before,
+                            RESOURCE_USAGE after, uint32_t subresource,
+                            irr::video::E_ASPECT aspect) {
+    object.set_pipeline_barrier(resource, before, after, subresource, aspect);
+  }
+
+  void bind_index_buffer(buffer_t &buffer, uint64_t offset, uint32_t size,
+                         irr::video::E_INDEX_TYPE type) {
+    object.bind_index_buffer(buffer, offset, size, type);
+  }
+
+  void bind_vertex_buffers(
+      uint32_t first_bind,
+      const std::vector<std::tuple<buffer_t &, uint64_t, uint32_t, uint32_t>>
+          &buffer_offset_stride_size) {
+    object.bind_vertex_buffers(first_bind, buffer_offset_stride_size);
+  }
+};
+
+template <typename F>
+double measure(command_list_storage_t &storage, F &&fill) {
+  auto total = std::chrono::duration<double, std::nano>::zero();
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    storage.reset_command_list_storage();
+    auto cmd = storage.create_command_list();
+    cmd->start_command_list_recording(storage);
+    const auto start = std::chrono::high_resolution_clock::now();
+    fill(*cmd);
+    total += std::chrono::high_resolution_clock::now() - start;
+    cmd->make_command_list_executable();
+  }
+  return total.count() /
+         (double(FLAGS_iterations) * FLAGS_commands * commands_per_group);
+}
+}
+
+int main(int argc, char *argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  std::unique_ptr<device_t> dev;
+  std::unique_ptr<swap_chain_t> chain;
+  std::unique_ptr<command_queue_t> queue;
+  uint32_t width, height;
+  irr::video::ECOLOR_FORMAT format;
+  std::tie(dev, chain, queue, width, height, format) =
+      create_headless_device_swapchain_and_graphic_queue(
+          64, 64, 1, "", FLAGS_uses_debug_layer);
+
+  auto img = dev->create_image(
+      irr::video::ECF_R8G8B8A8_UNORM, 64, 64, 1, 1,
+      usage_transfer_dst | usage_sampled, nullptr, memory_category::other,
+      "benchmark image");
+  auto index_buffer = dev->create_buffer(
+      4096, irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL, usage_index,
+      memory_category::other, "benchmark indexes");
+  auto vertex_buffer = dev->create_buffer(
+      4096, irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL, usage_vertex,
+      memory_category::other, "benchmark vertexes");
+  auto storage = dev->create_command_storage();
+
+  const auto virtual_ns = measure(*storage, [&](command_list_t &cmd) {
+    record(virtual_recorder{cmd}, *img, *index_buffer, *vertex_buffer);
+  });
+  const auto static_ns = measure(*storage, [&](command_list_t &cmd) {
+    record(gfx<vulkan_backend>::recorder(cmd), *img, *index_buffer,
+           *vertex_buffer);
+  });
+
+#ifdef YAGF_SINGLE_BACKEND
+  std::cout << "single backend build (static_cast)" << std::endl;
+#else
+  std::cout << "multi backend build (dynamic_cast)" << std::endl;
+#endif
+  std::cout << "command_list_t       " << virtual_ns << " ns/command"
+            << std::endl;
+  std::cout << "gfx<vulkan_backend>  " << static_ns << " ns/command"
+            << std::endl;
+  return 0;
+}
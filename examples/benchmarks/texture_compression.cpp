@@ -0,0 +1,97 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+// Compresses the first level of an uncompressed texture to every supported
+// block format, reports the quality of the decoded blocks and the throughput
+// on one and on every worker thread, then times a full import with mipmaps.
+#include <Scene/textures.h>
+#include <Util/BlockCompression.h>
+#include <Util/WorkerPool.h>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <iostream>
+#include <vector>
+
+DEFINE_string(texture, "..\\..\\..\\examples\\assets\\anchor.DDS",
+              "Uncompressed 8 bits RGBA or BGRA texture");
+DEFINE_int32(iterations, 10, "Number of compressions of every format");
+DEFINE_int32(threads, 0, "Number of worker threads, 0 for every hardware one");
+
+namespace {
+template <typename F> double measure_ms(F &&f) {
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_iterations; i++)
+    f();
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+             .count() /
+         FLAGS_iterations;
+}
+
+struct tested_format {
+  irr::video::ECOLOR_FORMAT format;
+  const char *name;
+  //! Channels kept by the format, see compute_psnr.
+  uint32_t channel_mask;
+};
+}
+
+int main(int argc, char *argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  const auto &texture = decode_texture(FLAGS_texture, false);
+  const auto is_bgra = texture.format == irr::video::ECF_B8G8R8A8_UNORM;
+  if (!is_bgra && texture.format != irr::video::ECF_R8G8B8A8_UNORM) {
+    std::cerr << FLAGS_texture << " isn't 8 bits RGBA or BGRA" << std::endl;
+    return 1;
+  }
+  const auto texel_count = size_t(texture.width) * texture.height;
+  std::vector<uint8_t> rgba(texture.texels, texture.texels + texel_count * 4);
+  if (is_bgra)
+    for (size_t i = 0; i < texel_count; i++)
+      std::swap(rgba[i * 4], rgba[i * 4 + 2]);
+
+  worker_pool workers(FLAGS_threads);
+  const auto megatexels = texel_count / 1000000.;
+  std::cout << FLAGS_texture << ": " << texture.width << "x" << texture.height
+            << ", " << workers.get_thread_count() << " worker threads"
+            << std::endl;
+
+  const tested_format formats[] = {
+      {irr::video::ECF_BC1_UNORM, "BC1", 0x7},
+      {irr::video::ECF_BC3_UNORM, "BC3", 0xF},
+      {irr::video::ECF_BC4_UNORM, "BC4", 0x1},
+      {irr::video::ECF_BC5_UNORM, "BC5", 0x3},
+  };
+  for (const auto &tested : formats) {
+    std::vector<uint8_t> blocks(
+        size_t((texture.width + 3) / 4) * ((texture.height + 3) / 4) *
+        irr::video::formatBlockByteCount(tested.format));
+    const auto single_thread_ms = measure_ms([&]() {
+      compress_blocks(tested.format, rgba.data(), texture.width,
+                      texture.height, texture.width * 4, blocks.data());
+    });
+    const auto workers_ms = measure_ms([&]() {
+      compress_blocks(tested.format, rgba.data(), texture.width,
+                      texture.height, texture.width * 4, blocks.data(),
+                      &workers);
+    });
+    std::vector<uint8_t> decoded(rgba.size());
+    decompress_blocks(tested.format, blocks.data(), texture.width,
+                      texture.height, decoded.data());
+    std::cout << tested.name << "  PSNR "
+              << compute_psnr(rgba.data(), decoded.data(), texel_count,
+                              tested.channel_mask)
+              << " dB, " << megatexels * 1000. / single_thread_ms
+              << " MPix/s on 1 thread, " << megatexels * 1000. / workers_ms
+              << " MPix/s on the workers" << std::endl;
+  }
+
+  const auto block_format = choose_block_format(texture);
+  decoded_texture imported;
+  const auto import_ms = measure_ms([&]() {
+    imported = compress_texture(texture, block_format, &workers);
+  });
+  std::cout << "Import with mipmaps  " << import_ms << " ms, "
+            << imported.mipmap_count << " levels, " << texture.size / 1024
+            << " KiB -> " << imported.size / 1024 << " KiB" << std::endl;
+  return 0;
+}
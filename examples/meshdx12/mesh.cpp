@@ -1,9 +1,12 @@
 #include "mesh.h"
 #include <Scene\IBL.h>
+#include <Scene\MeshCache.h>
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_LEFT_HANDED
+#include <chrono>
 #include <gflags/gflags.h>
 #include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
 #define GLFW_INCLUDE_VULKAN
 #include <glfw/glfw3.h>
 
@@ -16,6 +19,14 @@
 
 #define SAMPLE_PATH "..\\..\\..\\examples\\assets\\"
 
+// Used by Init, defined with the other flags.
+DECLARE_bool(compressed_vertices);
+DECLARE_bool(async_loading);
+DECLARE_bool(direct_texture_reads);
+DECLARE_bool(compress_textures);
+DECLARE_bool(generate_mipmaps);
+DECLARE_bool(stream_textures);
+
 struct SceneData {
   glm::mat4 ViewMatrix;
   glm::mat4 InverseViewMatrix;
@@ -29,11 +40,9 @@ struct SceneData {
 };*/
 
 namespace {
-// (inv)modelmatrix, jointmatrix
+// (inv)modelmatrix of the node, or of the instances of instanced draws
 const auto object_descriptor_set_type = descriptor_set(
-    {range_of_descriptors(RESOURCE_VIEW::CONSTANTS_BUFFER, 0, 1),
-     range_of_descriptors(RESOURCE_VIEW::CONSTANTS_BUFFER, 1, 1)},
-    shader_stage::all);
+    {range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 0, 1)}, shader_stage::all);
 
 const auto model_descriptor_set_type =
     descriptor_set({range_of_descriptors(RESOURCE_VIEW::SHADER_RESOURCE, 2, 1)},
@@ -84,14 +93,17 @@ void MeshSample::Init() {
   auto command_list = command_allocator->create_command_list();
   command_list->start_command_list_recording(*command_allocator);
 
+  // A set and an object buffer per node, see --instances.
   cbv_srv_descriptors_heap = dev->create_descriptor_storage(
-      100, {{RESOURCE_VIEW::CONSTANTS_BUFFER, 10},
-            {RESOURCE_VIEW::SHADER_RESOURCE, 1000},
-            {RESOURCE_VIEW::INPUT_ATTACHMENT, 4},
-            {RESOURCE_VIEW::UAV_BUFFER, 1}});
+      1100, {{RESOURCE_VIEW::CONSTANTS_BUFFER, 10},
+             {RESOURCE_VIEW::SHADER_RESOURCE, 1000},
+             {RESOURCE_VIEW::INPUT_ATTACHMENT, 4},
+             {RESOURCE_VIEW::UAV_BUFFER, 1001}});
   sampler_heap =
       dev->create_descriptor_storage(10, {{RESOURCE_VIEW::SAMPLER, 10}});
   object_sunlight_pass = dev->create_object_sunlight_pass(swap_chain_format);
+  object_sunlight_late_pass =
+      dev->create_object_sunlight_pass(swap_chain_format, true);
   ibl_skyboss_pass = dev->create_ibl_sky_pass(swap_chain_format);
 
   load_program_and_pipeline_layout();
@@ -114,8 +126,11 @@ void MeshSample::Init() {
 #endif // !D3D12
   createTextures();
   std::unique_ptr<buffer_t> upload_buffer;
-  std::tie(skybox_texture, upload_buffer) = load_texture(
-      *dev, SAMPLE_PATH + std::string("w_sky_1BC1.DDS"), *command_list);
+  const auto &skybox_data =
+      decode_texture(SAMPLE_PATH + std::string("w_sky_1BC1.DDS"));
+  std::tie(skybox_texture, upload_buffer) =
+      upload_texture(*dev, skybox_data, *command_list);
+  skybox_view = create_texture_view(*dev, *skybox_texture, skybox_data);
   command_list->set_pipeline_barrier(*depth_buffer, RESOURCE_USAGE::undefined,
                                      RESOURCE_USAGE::DEPTH_WRITE, 0,
                                      irr::video::E_ASPECT::EA_DEPTH_STENCIL);
@@ -157,15 +172,60 @@ void MeshSample::Init() {
       std::vector<const image_view_t *>{back_buffer_view[1].get()}, *depth_view,
       width, height, ibl_skyboss_pass.get());
 
-  Assimp::Importer importer;
-  auto model = importer.ReadFile(std::string(SAMPLE_PATH) + "xue.b3d", 0);
-
+  geometry = std::make_unique<irr::scene::geometry_arena>(
+      *dev, 1 << 18, 1 << 20,
+      FLAGS_compressed_vertices ? irr::scene::vertex_format::compressed
+                                : irr::scene::vertex_format::full);
+  textures = std::make_unique<irr::scene::texture_cache>(
+      *dev, 0, false,
+      FLAGS_direct_texture_reads ? file_access::direct_read
+                                 : file_access::mapped);
+  if (FLAGS_compress_textures)
+    textures->enable_compression();
+  if (FLAGS_generate_mipmaps) {
+    mipmaps = std::make_unique<irr::scene::mipmap_generator>(*dev);
+    textures->enable_mipmap_generation(*mipmaps);
+  }
+  if (FLAGS_stream_textures)
+    textures->enable_streaming();
+  std::shared_ptr<irr::scene::mesh_asset> xue_asset;
+  if (FLAGS_async_loading) {
+    // Every batch of uploads is submitted before the next process_loaded call
+    // hands its assets over.
+    loader = std::make_unique<irr::scene::asset_loader>(
+        *dev, *cbv_srv_descriptors_heap, model_set.get(), geometry.get(),
+        textures.get());
+    loader->load(std::string(SAMPLE_PATH) + "xue.b3d",
+                 [&xue_asset](std::shared_ptr<irr::scene::mesh_asset> asset) {
+                   xue_asset = std::move(asset);
+                 });
+    auto upload_command_list = command_allocator->create_command_list();
+    while (!loader->is_idle()) {
+      loader->wait_for_decoded();
+      upload_command_list->start_command_list_recording(*command_allocator);
+      loader->process_loaded(*upload_command_list);
+      upload_command_list->make_command_list_executable();
+      cmdqueue->submit_executable_command_list(*upload_command_list, nullptr);
+      cmdqueue->wait_for_command_queue_idle();
+    }
+    mesh_loading_ms = loader->get_statistics().front().decoding_ms;
+  } else {
+    // Cooked on the first run, mapped from xue.b3d.ymesh on the next ones.
+    const auto loading_start = std::chrono::high_resolution_clock::now();
+    const auto &model =
+        irr::scene::load_mesh(std::string(SAMPLE_PATH) + "xue.b3d");
+    mesh_loading_ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::high_resolution_clock::now() -
+                          loading_start)
+                          .count();
+    xue_asset = std::make_shared<irr::scene::mesh_asset>(
+        *dev, *model, *command_list, *cbv_srv_descriptors_heap,
+        model_set.get(), geometry.get(), textures.get());
+  }
   scene = std::make_unique<irr::scene::Scene>();
-  xue = scene->addMeshSceneNode(std::make_unique<irr::scene::IMeshSceneNode>(
-                                    *dev, model, *command_list,
-                                    *cbv_srv_descriptors_heap, object_set.get(),
-                                    model_set.get(), nullptr),
-                                nullptr);
+  xue = scene->get_mesh_node(
+      scene->add_mesh_node(*dev, xue_asset, *cbv_srv_descriptors_heap,
+                           object_set.get(), nullptr));
 
   big_triangle = dev->create_buffer(
       4 * 3 * sizeof(float), irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
@@ -183,6 +243,7 @@ void MeshSample::Init() {
   command_list->make_command_list_executable();
   cmdqueue->submit_executable_command_list(*command_list, nullptr);
   cmdqueue->wait_for_command_queue_idle();
+  textures->release_staging_buffers();
   // ibl
   ibl_utility ibl_util(*dev);
   command_list->start_command_list_recording(*command_allocator);
@@ -274,9 +335,6 @@ void MeshSample::fill_descriptor_set() {
   roughness_metalness_view = dev->create_image_view(
       *roughness_metalness, irr::video::ECF_R8G8B8A8_UNORM, 0, 1, 0, 1,
       irr::video::E_TEXTURE_TYPE::ETT_2D);
-  skybox_view =
-      dev->create_image_view(*skybox_texture, irr::video::ECF_BC1_UNORM_SRGB, 0,
-                             11, 0, 6, irr::video::E_TEXTURE_TYPE::ETT_CUBE);
   depth_view = dev->create_image_view(*depth_buffer, irr::video::D24U8, 0, 1, 0,
                                       1, irr::video::E_TEXTURE_TYPE::ETT_2D,
                                       irr::video::E_ASPECT::EA_DEPTH);
@@ -333,8 +391,11 @@ void MeshSample::load_program_and_pipeline_layout() {
       dev->create_pipeline_layout(std::vector<const descriptor_set_layout *>{
           rtt_set.get(), scene_set.get(), ibl_set.get(), sampler_set.get()});
 
-  objectpso = get_skinned_object_pipeline_state(*dev, *object_sig,
-                                                *object_sunlight_pass);
+  objectpso = FLAGS_compressed_vertices
+                  ? get_compressed_object_pipeline_state(
+                        *dev, *object_sig, *object_sunlight_pass)
+                  : get_skinned_object_pipeline_state(*dev, *object_sig,
+                                                      *object_sunlight_pass);
   sunlightpso =
       get_sunlight_pipeline_state(*dev, *sunlight_sig, *object_sunlight_pass);
   skybox_pso = get_skybox_pipeline_state(*dev, *skybox_sig, *ibl_skyboss_pass);
@@ -343,8 +404,78 @@ void MeshSample::load_program_and_pipeline_layout() {
 
 DEFINE_bool(uses_debug_marker, false, "Uses debug marker (renderdoc only).");
 DEFINE_bool(uses_debug_layer, false, "Uses debug layer.");
+DEFINE_bool(headless, false,
+            "Renders offscreen without window nor swap chain.");
+DEFINE_int32(frames, 100, "Number of frames rendered in headless mode.");
+DEFINE_string(dump_frames, "",
+              "Headless mode only, prefix of the .ppm files written for "
+              "every frame (disabled if empty).");
+DEFINE_string(memory_report, "",
+              "Prints GPU memory usage after loading, \"table\" or \"json\".");
+DEFINE_bool(frustum_culling, false,
+            "Culls G-buffer draws against the initial camera frustum (command "
+            "lists are recorded once, the camera then rotates).");
+DEFINE_bool(gpu_culling, false,
+            "Culls G-buffer draws in a compute pass and draws them with "
+            "indirect draws, validated against the CPU in headless mode.");
+DEFINE_bool(occlusion_culling, false,
+            "Adds two phase occlusion culling against a depth pyramid to "
+            "--gpu_culling, matrices are the initial camera ones so the "
+            "camera must not move (headless mode).");
+DEFINE_bool(meshlet_culling, false,
+            "Culls meshlets against the frustum, their normal cone and with "
+            "--occlusion_culling the depth of the previous frame, and draws "
+            "their compacted indices.");
+DEFINE_double(lod_threshold, 0.,
+              "Selects mesh levels of detail whose simplification error stays "
+              "below this many pixels from the initial camera (disabled if "
+              "0).");
+DEFINE_int32(instances, 1,
+             "Number of copies of the model, on a grid behind it and sharing "
+             "its buffers and textures (at most 1000).");
+DEFINE_bool(instancing, false,
+            "Draws the copies of the model with one instanced draw per "
+            "submesh, needs --sort_draws.");
+DEFINE_bool(sort_draws, true,
+            "Sorts G-buffer draws by pipeline, material, geometry and depth "
+            "and skips redundant binds.");
+DEFINE_bool(compressed_vertices, false,
+            "Stores quantized positions, octahedral normals and half float "
+            "texture coordinates, 16 instead of 36 bytes per vertex.");
+DEFINE_bool(async_loading, false,
+            "Loads the model and its textures on worker threads and uploads "
+            "them from the render thread.");
+DEFINE_bool(direct_texture_reads, false,
+            "Reads textures with large unbuffered reads instead of mapping "
+            "them, faster when they aren't in the OS cache.");
+DEFINE_bool(compress_textures, false,
+            "Compresses uncompressed textures to BC1, BC3, BC4 or BC5 when "
+            "they are read.");
+DEFINE_bool(generate_mipmaps, false,
+            "Fills the mipmaps of textures stored with a single level with a "
+            "compute shader when they are uploaded.");
+DEFINE_bool(stream_textures, false,
+            "Loads the levels of at most 64x64 texels first, then the finer "
+            "levels needed from the camera before recording the frames.");
+DEFINE_int32(node_churn, 0,
+             "Adds and removes a node that many times before recording, "
+             "checks that the scene storage doesn't grow.");
+
+namespace {
+bool uses_gpu_culling() {
+  return FLAGS_gpu_culling || FLAGS_occlusion_culling || FLAGS_meshlet_culling;
+}
+}
 
 MeshSample::MeshSample() {
+  if (FLAGS_headless) {
+    std::tie(dev, chain, cmdqueue, width, height, swap_chain_format) =
+        create_headless_device_swapchain_and_graphic_queue(
+            1280, 1024, 2, FLAGS_dump_frames, FLAGS_uses_debug_layer);
+    Init();
+    print_memory_report();
+    return;
+  }
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   window = glfwCreateWindow(1280, 1024, "Window Title", nullptr, nullptr);
@@ -353,9 +484,217 @@ MeshSample::MeshSample() {
       create_device_swapchain_and_graphic_presentable_queue(
           window, FLAGS_uses_debug_marker, FLAGS_uses_debug_layer);
   Init();
+  print_memory_report();
+}
+
+void MeshSample::print_memory_report() {
+  if (FLAGS_memory_report.empty())
+    return;
+  dev->dump_memory_usage(std::cout, FLAGS_memory_report == "json");
+}
+
+void MeshSample::Loop() {
+  if (window == nullptr) {
+    for (int i = 0; i < FLAGS_frames; i++) {
+      stats.begin_frame();
+      Draw();
+      stats.end_frame();
+    }
+    stats.print(std::cout);
+    print_draw_statistics();
+    return;
+  }
+  while (!glfwWindowShouldClose(window)) {
+    glfwPollEvents();
+    Draw();
+    // Keep running
+  }
+  glfwDestroyWindow(window);
+}
+
+void MeshSample::print_draw_statistics() {
+  const auto &asset = *xue->getMeshAsset();
+  const auto &imported = asset.get_unoptimized_cache_statistics();
+  const auto &optimized = asset.get_cache_statistics();
+  std::cout << "Mesh loading: " << mesh_loading_ms << " ms" << std::endl;
+  if (loader)
+    for (const auto &asset_stats : loader->get_statistics())
+      std::cout << "  " << asset_stats.path << ": resident after "
+                << asset_stats.latency_ms << " ms, "
+                << asset_stats.decoding_ms << " ms on a worker" << std::endl;
+  const auto &texture_stats = textures->get_statistics();
+  std::cout << "Texture cache: " << textures->get_texture_count()
+            << " textures, " << textures->get_resident_size() / 1024
+            << " KiB, " << texture_stats.hits << " hits, "
+            << texture_stats.misses << " misses" << std::endl;
+  if (texture_stats.read_ms > 0.)
+    std::cout << "Texture reading: " << texture_stats.read_bytes / 1048576
+              << " MiB at "
+              << texture_stats.read_bytes / 1048.576 / texture_stats.read_ms
+              << " MiB/s" << std::endl;
+  if (texture_stats.compressed > 0)
+    std::cout << "Texture compression: " << texture_stats.compressed
+              << " textures in " << texture_stats.compression_ms << " ms"
+              << std::endl;
+  if (texture_stats.mipmapped > 0)
+    std::cout << "Mipmaps generated on the GPU for "
+              << texture_stats.mipmapped << " textures" << std::endl;
+  if (FLAGS_stream_textures)
+    std::cout << "Texture streaming: " << streamed_texture_count
+              << " textures refined, " << texture_stats.streamed_bytes / 1024
+              << " KiB streamed, " << texture_stats.dropped_bytes / 1024
+              << " KiB dropped" << std::endl;
+  std::cout << "Vertex cache: ACMR " << imported.get_acmr() << " -> "
+            << optimized.get_acmr() << ", ATVR " << imported.get_atvr()
+            << " -> " << optimized.get_atvr() << std::endl;
+  if (FLAGS_compressed_vertices) {
+    const auto &vertices = geometry->get_vertex_ranges();
+    std::cout << "Compressed vertices: "
+              << irr::scene::geometry_arena::get_vertex_size(
+                     geometry->get_format())
+              << " of "
+              << irr::scene::geometry_arena::get_vertex_size(
+                     irr::scene::vertex_format::full)
+              << " bytes for "
+              << vertices.get_capacity() - vertices.get_free_size()
+              << " vertices" << std::endl;
+  }
+  if (FLAGS_lod_threshold > 0.)
+    std::cout << "Levels of detail: " << lod_stats.triangles << " of "
+              << lod_stats.full_triangles << " triangles" << std::endl;
+  if (FLAGS_instancing)
+    std::cout << "Instancing: " << FLAGS_instances << " nodes drawn with "
+              << draw_statistics.draws << " draws in "
+              << command_list_for_back_buffer.size() << " command lists"
+              << std::endl;
+  if (FLAGS_meshlet_culling) {
+    cmdqueue->wait_for_command_queue_idle();
+    const auto culling = scene->get_meshlet_culling();
+    const auto &culling_stats = culling->get_statistics();
+    std::cout << "Meshlet culling: " << culling_stats.triangles << " of "
+              << culling->get_triangle_count() << " triangles drawn, "
+              << culling_stats.meshlets << " of "
+              << culling->get_meshlet_count() << " meshlets in "
+              << culling->get_batch_count() << " indirect draws" << std::endl;
+    return;
+  }
+  if (FLAGS_occlusion_culling) {
+    cmdqueue->wait_for_command_queue_idle();
+    const auto culling = scene->get_gpu_culling();
+    const auto &culling_stats = culling->get_statistics();
+    std::cout << "Occlusion culling: " << culling_stats.triangles << " of "
+              << culling->get_triangle_count() << " triangles drawn, "
+              << culling_stats.draws << " of " << culling->get_draw_count()
+              << " draws" << std::endl;
+    return;
+  }
+  if (FLAGS_gpu_culling) {
+    cmdqueue->wait_for_command_queue_idle();
+    const auto culling = scene->get_gpu_culling();
+    std::cout << "GPU culling: " << culling->get_draw_count() << " draws in "
+              << culling->get_batch_count() << " indirect draws, "
+              << scene->validate_gpu_culling()
+              << " differ from the CPU reference" << std::endl;
+    return;
+  }
+  std::cout << "G-buffer recording: " << gbuffer_recording_ms << " ms for "
+            << command_list_for_back_buffer.size() << " command lists ("
+            << (FLAGS_sort_draws ? "sorted" : "unsorted") << ")" << std::endl;
+  if (!FLAGS_sort_draws)
+    return;
+  std::cout << "  " << draw_statistics.draws << " draws, "
+            << draw_statistics.pipeline_binds << " pipeline, "
+            << draw_statistics.descriptor_binds << " descriptor and "
+            << draw_statistics.buffer_binds << " buffer binds, "
+            << draw_statistics.redundant_binds << " redundant binds avoided"
+            << std::endl;
+  if (!FLAGS_frustum_culling)
+    return;
+  std::cout << "  " << culling_stats.tested << " submeshes tested, "
+            << culling_stats.visible << " visible, " << culling_stats.culled
+            << " culled" << std::endl;
 }
 
 void MeshSample::fill_draw_commands() {
+  scene->sort_draws = FLAGS_sort_draws;
+  for (int i = 1; i < FLAGS_instances; i++)
+    scene->add_mesh_node(
+        *dev, xue->getMeshAsset(), *cbv_srv_descriptors_heap, object_set.get(),
+        nullptr, glm::vec3(1.5f * (i % 8 - 4), 0.f, 1.5f * (i / 8 + 1)));
+  // Removed nodes give their transform and bounds slots to the next ones.
+  size_t transform_slots = 0;
+  size_t bound_slots = 0;
+  for (int i = 0; i < FLAGS_node_churn; i++) {
+    const auto handle = scene->add_mesh_node(
+        *dev, xue->getMeshAsset(), *cbv_srv_descriptors_heap, object_set.get(),
+        nullptr, glm::vec3(0.f, 0.f, -1.5f));
+    scene->update(*dev);
+    scene->remove_mesh_node(handle);
+    if (i == 0) {
+      transform_slots = scene->get_transforms().size();
+      bound_slots = scene->get_world_bound_slot_count();
+    }
+  }
+  if (FLAGS_node_churn > 0) {
+    std::cout << "Node churn: " << scene->get_transforms().size()
+              << " transform slots, " << scene->get_world_bound_slot_count()
+              << " bounds slots after " << FLAGS_node_churn
+              << " adds and removes" << std::endl;
+    if (scene->get_transforms().size() != transform_slots ||
+        scene->get_world_bound_slot_count() != bound_slots)
+      throw "MeshSample: removed node slots aren't reused";
+  }
+  if (FLAGS_instancing)
+    scene->enable_instancing(*dev, *cbv_srv_descriptors_heap,
+                             object_set.get());
+  // Computes world bounds.
+  scene->update(*dev);
+  if (FLAGS_lod_threshold > 0.) {
+    scene->lod_threshold = static_cast<float>(FLAGS_lod_threshold);
+    const auto &projection =
+        glm::perspective(70.f / 180.f * 3.14f, 1.f, 1.f, 1000.f);
+    lod_stats = scene->select_lods(glm::vec3(0., 0., -2.),
+                                   projection[1][1] * height / 2.f);
+  }
+  if (FLAGS_stream_textures) {
+    // Frames are recorded once, the levels seen from the initial camera
+    // position are uploaded before.
+    const auto &projection =
+        glm::perspective(70.f / 180.f * 3.14f, 1.f, 1.f, 1000.f);
+    scene->request_texture_levels(*textures, glm::vec3(0., 0., -2.),
+                                  projection[1][1] * height / 2.f);
+    auto upload_command_list = command_allocator->create_command_list();
+    upload_command_list->start_command_list_recording(*command_allocator);
+    streamed_texture_count = textures->stream(*upload_command_list).size();
+    upload_command_list->make_command_list_executable();
+    cmdqueue->submit_executable_command_list(*upload_command_list, nullptr);
+    cmdqueue->wait_for_command_queue_idle();
+    textures->release_staging_buffers();
+    xue->getMeshAsset()->refresh_materials(*dev);
+  }
+  if (FLAGS_frustum_culling || uses_gpu_culling())
+    scene->set_view_frustum(
+        glm::perspective(70.f / 180.f * 3.14f, 1.f, 1.f, 1000.f) *
+        glm::lookAtLH(glm::vec3(0., 0., -2.), glm::vec3(0., 1., 0.),
+                      glm::vec3(0., 1., 0.)));
+  if (FLAGS_meshlet_culling)
+    scene->enable_meshlet_culling(*dev, FLAGS_headless, 2);
+  else if (uses_gpu_culling())
+    scene->enable_gpu_culling(*dev, FLAGS_headless, 2);
+  if (FLAGS_occlusion_culling)
+    scene->enable_occlusion_culling(*dev, *depth_buffer, irr::video::D24U8,
+                                    width, height);
+  const auto &&bind_object_state = [&](command_list_t &cmd_list) {
+    cmd_list.set_graphic_pipeline_layout(*object_sig);
+    cmd_list.set_descriptor_storage_referenced(*cbv_srv_descriptors_heap,
+                                               sampler_heap.get());
+    cmd_list.set_graphic_pipeline(*objectpso);
+    cmd_list.bind_graphic_descriptor(2, *scene_descriptor, *object_sig);
+    cmd_list.bind_graphic_descriptor(3, *sampler_descriptors, *object_sig);
+    cmd_list.set_viewport(0.f, static_cast<float>(width), 0.f,
+                          static_cast<float>(height), 0.f, 1.f);
+    cmd_list.set_scissor(0, width, 0, height);
+  };
   for (unsigned i = 0; i < 2; i++) {
     command_list_for_back_buffer.push_back(
         command_allocator->create_command_list());
@@ -366,14 +705,16 @@ void MeshSample::fill_draw_commands() {
     // RESOURCE_USAGE::PRESENT, RESOURCE_USAGE::RENDER_TARGET, 0,
     // irr::video::E_ASPECT::EA_COLOR);
 
+    // Runs every frame with the current transforms.
+    if (uses_gpu_culling())
+      scene->fill_gpu_culling_command(*current_cmd_list, i);
+
     const auto &clearColor = std::array<float, 4>{.25f, .25f, 0.35f, 1.0f};
-    current_cmd_list->begin_renderpass(
-        *object_sunlight_pass, *fbo_pass1[i],
-        std::vector<clear_value_t>{
-            std::array<float, 4>{}, std::array<float, 4>{},
-            std::array<float, 4>{}, std::array<float, 4>{},
-            std::make_tuple(1.f, 0)},
-        width, height);
+    auto clear_values = std::vector<clear_value_t>{
+        std::array<float, 4>{}, std::array<float, 4>{}, std::array<float, 4>{},
+        std::array<float, 4>{}, std::make_tuple(1.f, 0)};
+    current_cmd_list->begin_renderpass(*object_sunlight_pass, *fbo_pass1[i],
+                                       clear_values, width, height);
 #ifdef D3D12
     std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> rtt_to_use = {
         CD3DX12_CPU_DESCRIPTOR_HANDLE(
@@ -401,19 +742,29 @@ void MeshSample::fill_draw_commands() {
     current_cmd_list->object->IASetPrimitiveTopology(
         D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 #endif
-    current_cmd_list->set_graphic_pipeline_layout(*object_sig);
-    current_cmd_list->set_descriptor_storage_referenced(
-        *cbv_srv_descriptors_heap, sampler_heap.get());
-    current_cmd_list->set_graphic_pipeline(*objectpso);
-    current_cmd_list->bind_graphic_descriptor(2, *scene_descriptor,
-                                              *object_sig);
-    current_cmd_list->bind_graphic_descriptor(3, *sampler_descriptors,
-                                              *object_sig);
-    current_cmd_list->set_viewport(0.f, static_cast<float>(width), 0.f,
-                                   static_cast<float>(height), 0.f, 1.f);
-    current_cmd_list->set_scissor(0, width, 0, height);
-
-    scene->fill_gbuffer_filling_command(*current_cmd_list, *object_sig);
+    bind_object_state(*current_cmd_list);
+
+    // Command lists are recorded once, from the initial camera position.
+    scene->fill_gbuffer_filling_command(*current_cmd_list, *object_sig,
+                                        glm::vec3(0., 0., -2.));
+    if (FLAGS_occlusion_culling) {
+      // The depth of the early draws builds the pyramid outside of the render
+      // pass, the late draws are added to the same G-buffer.
+      current_cmd_list->next_subpass();
+      current_cmd_list->end_renderpass();
+      scene->fill_occlusion_culling_command(*current_cmd_list, i);
+      current_cmd_list->begin_renderpass(*object_sunlight_late_pass,
+                                         *fbo_pass1[i], clear_values, width,
+                                         height);
+      bind_object_state(*current_cmd_list);
+      // Meshlets are culled once against the pyramid of the previous frame.
+      if (!FLAGS_meshlet_culling)
+        scene->fill_gbuffer_filling_command(*current_cmd_list, *object_sig,
+                                            glm::vec3(0., 0., -2.));
+    }
+    draw_statistics += scene->get_draw_statistics();
+    culling_stats = scene->get_culling_statistics();
+    gbuffer_recording_ms += scene->get_gbuffer_recording_time_ms();
 #ifdef D3D12
     set_pipeline_barrier(
         *current_cmd_list, *diffuse_color, RESOURCE_USAGE::RENDER_TARGET,
@@ -506,7 +857,10 @@ void MeshSample::fill_draw_commands() {
 }
 
 void MeshSample::Draw() {
-  scene->update(*dev);
+  const auto &current_backbuffer =
+      chain->get_next_backbuffer_id(*present_semaphore);
+  // The culling buffers of a back buffer are only read by its command list.
+  scene->update(*dev, current_backbuffer);
 
   auto &&tmp = *static_cast<SceneData *>(scene_matrix->map_buffer());
   const float horizon_angle_in_radian = horizon_angle * 3.14f / 100.f;
@@ -545,8 +899,6 @@ void MeshSample::Draw() {
      loader->AnimatedMesh.JointMatrixes.size() * 16 * sizeof(float));*/
   // unmap_buffer(dev, jointbuffer);
 
-  const auto &current_backbuffer =
-      chain->get_next_backbuffer_id(*present_semaphore);
   cmdqueue->submit_executable_command_list(
       *command_list_for_back_buffer[current_backbuffer],
       present_semaphore.get());
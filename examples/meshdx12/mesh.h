@@ -1,16 +1,17 @@
 #pragma once
-#include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <tuple>
 #include <array>
 #include <unordered_map>
 
+#include <Scene/AssetLoader.h>
 #include <Scene/pso.h>
 #include <Scene/textures.h>
 #include <Scene/Scene.h>
 #include <Scene/ssao.h>
 
 #include <API/GfxApi.h>
+#include <Util/FrameStatistics.h>
 #include <glfw/glfw3.h>
 
 
@@ -28,7 +29,17 @@ struct MeshSample
 
 	float horizon_angle = 0;
 	irr::scene::IMeshSceneNode* xue;
-	GLFWwindow *window;
+	//! nullptr in headless mode.
+	GLFWwindow *window = nullptr;
+	frame_statistics stats;
+	command_stream_statistics draw_statistics;
+	irr::scene::culling_statistics culling_stats;
+	irr::scene::lod_statistics lod_stats;
+	//! Textures whose levels were changed by the streaming pass of --stream_textures.
+	size_t streamed_texture_count = 0;
+	double gbuffer_recording_ms = 0.;
+	//! Import or cache mapping of the model, without texture loading unless loaded asynchronously.
+	double mesh_loading_ms = 0.;
 
 private:
 	uint32_t width;
@@ -91,12 +102,22 @@ private:
 	std::unique_ptr<image_t> normal;
 	std::unique_ptr<image_t> roughness_metalness;
 
+	//! Vertex and index buffers of every mesh, declared before scene so that it outlives the assets.
+	std::unique_ptr<irr::scene::geometry_arena> geometry;
+	//! Only set with --generate_mipmaps, declared before textures that uses it.
+	std::unique_ptr<irr::scene::mipmap_generator> mipmaps;
+	//! Materials of every loaded model.
+	std::unique_ptr<irr::scene::texture_cache> textures;
+	//! Only set with --async_loading.
+	std::unique_ptr<irr::scene::asset_loader> loader;
 	std::unique_ptr<irr::scene::Scene> scene;
 
 
 	std::unique_ptr<ssao_utility> ssao_util;
 
 	std::unique_ptr<render_pass_t> object_sunlight_pass;
+	//! Same pass keeping the G-buffer, for the late draws of occlusion culling.
+	std::unique_ptr<render_pass_t> object_sunlight_late_pass;
 	std::unique_ptr<render_pass_t> ibl_skyboss_pass;
 	std::array<std::unique_ptr<framebuffer_t>, 2> fbo_pass1;
 	std::array<std::unique_ptr<framebuffer_t>, 2> fbo_pass2;
@@ -117,17 +138,10 @@ private:
 
 	void fill_descriptor_set();
 	void load_program_and_pipeline_layout();
+	void print_memory_report();
+	void print_draw_statistics();
 public:
 	void Draw();
-	void Loop() {
-		while (!glfwWindowShouldClose(window))
-		{
-			glfwPollEvents();
-			Draw();
-			// Keep running
-		}
-		glfwDestroyWindow(window);
-		return;
-	}
+	void Loop();
 };
 
@@ -9,7 +9,9 @@
 #include <gsl/gsl>
 #include <variant>
 #include <optional>
+#include <string>
 #include "..\Core\SColor.h"
+#include "MemoryTracker.h"
 
 namespace irr
 {
@@ -90,10 +92,35 @@ namespace irr
 		{
 			ETT_2D,
 			ETT_CUBE,
+			ETT_2D_ARRAY,
 		};
 	}
 }
 
+//! Converts an API object to its backend implementation.
+/** Checked with dynamic_cast unless YAGF_SINGLE_BACKEND is defined : a single
+backend is built then, every object has a single possible implementation and
+static_cast is enough. */
+template<typename Implementation, typename Interface>
+Implementation& backend_cast(Interface& object)
+{
+#ifdef YAGF_SINGLE_BACKEND
+	return static_cast<Implementation&>(object);
+#else
+	return dynamic_cast<Implementation&>(object);
+#endif
+}
+
+template<typename Implementation, typename Interface>
+Implementation* backend_cast(Interface* object)
+{
+#ifdef YAGF_SINGLE_BACKEND
+	return static_cast<Implementation*>(object);
+#else
+	return dynamic_cast<Implementation*>(object);
+#endif
+}
+
 enum class RESOURCE_USAGE
 {
 	PRESENT,
@@ -104,6 +131,10 @@ enum class RESOURCE_USAGE
 	DEPTH_WRITE,
 	undefined,
 	uav,
+	//! Buffers only, read by indirect draws.
+	indirect_argument,
+	//! Buffers only, read as indices by indexed draws.
+	index_buffer,
 };
 
 enum image_flags
@@ -126,6 +157,18 @@ enum buffer_flags
 	usage_uniform = 0x8,
 	usage_index = 0x10,
 	usage_vertex = 0x20,
+	usage_indirect = 0x40,
+	usage_buffer_transfer_dst = 0x80,
+};
+
+//! Layout of the arguments of draw_indexed_indirect, same as VkDrawIndexedIndirectCommand and D3D12_DRAW_INDEXED_ARGUMENTS.
+struct draw_indexed_indirect_arguments
+{
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
 };
 
 enum class SAMPLER_TYPE
@@ -218,15 +261,29 @@ struct color_output
 	blend_factor dst_alpha;
 };
 
+//! Value of a 32 bits scalar declared with layout(constant_id = id) in a shader.
+struct specialization_constant
+{
+	uint32_t id;
+	uint32_t value;
+};
+
 struct compute_pipeline_state_description
 {
 	std::vector<uint32_t> compute_binary;
+	std::vector<specialization_constant> specialization_constants;
 
 	compute_pipeline_state_description set_compute_shader(gsl::span<const uint32_t> code)
 	{
 		std::copy(code.begin(), code.end(), std::back_inserter(compute_binary));
 		return *this;
 	}
+
+	compute_pipeline_state_description set_specialization_constant(uint32_t id, uint32_t value)
+	{
+		specialization_constants.push_back(specialization_constant{ id, value });
+		return *this;
+	}
 };
 
 struct graphic_pipeline_state_description
@@ -237,6 +294,8 @@ struct graphic_pipeline_state_description
 
 	std::vector<pipeline_vertex_attributes> attributes;
 	std::vector<color_output> color_outputs;
+	//! Applied to every stage, constants a stage doesn't declare are ignored.
+	std::vector<specialization_constant> specialization_constants;
 
 	bool rasterization_depth_clamp_enable;
 	bool rasterization_discard_enable;
@@ -420,6 +479,12 @@ struct graphic_pipeline_state_description
 		return *this;
 	}
 
+	graphic_pipeline_state_description set_specialization_constant(uint32_t id, uint32_t value)
+	{
+		specialization_constants.push_back(specialization_constant{ id, value });
+		return *this;
+	}
+
 	graphic_pipeline_state_description()
 	{
 
@@ -519,6 +584,14 @@ struct render_pass_t {
 
 using clear_value_t = std::variant<std::array<float, 4>, std::tuple<float, uint8_t> >;
 
+//! How the commands of a subpass are provided.
+enum class subpass_contents
+{
+	inline_commands,
+	//! Only execute_secondary_command_lists is allowed until the next subpass.
+	secondary_command_lists,
+};
+
 struct image_view_t {
 	virtual ~image_view_t() {}
 };
@@ -558,6 +631,7 @@ struct descriptor_storage_t {
 struct command_list_t {
 	virtual void bind_graphic_descriptor(uint32_t bindpoint, const allocated_descriptor_set& descriptor_set, pipeline_layout_t& sig) = 0;
 	virtual void bind_compute_descriptor(uint32_t bindpoint, const allocated_descriptor_set& descriptor_set, pipeline_layout_t& sig) = 0;
+	//! width and height are the extent of the subresource, row_pitch the bytes between rows of texels or of blocks.
 	virtual void copy_buffer_to_image_subresource(image_t& destination_image, uint32_t destination_subresource, buffer_t& source, uint64_t offset_in_buffer,
 		uint32_t width, uint32_t height, uint32_t row_pitch, irr::video::ECOLOR_FORMAT format) = 0;
 	virtual void set_pipeline_barrier(image_t& resource, RESOURCE_USAGE before, RESOURCE_USAGE after, uint32_t subresource, irr::video::E_ASPECT) = 0;
@@ -576,6 +650,15 @@ struct command_list_t {
 	virtual void draw_non_indexed(uint32_t vertex_count, uint32_t instance_count, int32_t base_vertex, uint32_t base_instance) = 0;
 	virtual void dispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
 	virtual void copy_buffer(buffer_t& src, uint64_t src_offset, buffer_t& dst, uint64_t dst_offset, uint64_t size) = 0;
+	//! Fills size bytes with the 32 bits value, buffer needs usage_buffer_transfer_dst.
+	virtual void fill_buffer(buffer_t& buffer, uint64_t offset, uint64_t size, uint32_t value) = 0;
+	virtual void set_buffer_barrier(buffer_t& buffer, RESOURCE_USAGE before, RESOURCE_USAGE after) = 0;
+	//! Draws draw_count draw_indexed_indirect_arguments read from arguments, stride bytes apart.
+	virtual void draw_indexed_indirect(buffer_t& arguments, uint64_t offset, uint32_t draw_count, uint32_t stride) = 0;
+	//! Same but the number of draws is the uint32_t read in count_buffer, clamped to max_draw_count.
+	/** Requires device_t::supports_draw_indirect_count(). */
+	virtual void draw_indexed_indirect_count(buffer_t& arguments, uint64_t offset, buffer_t& count_buffer, uint64_t count_offset,
+		uint32_t max_draw_count, uint32_t stride) = 0;
 
 	virtual void clear_depth_stencil(image_t &img, float depth) = 0;
 	virtual void clear_depth_stencil(image_t &img, uint8_t stencil) = 0;
@@ -584,12 +667,16 @@ struct command_list_t {
 
 	virtual void begin_renderpass(render_pass_t& rp, framebuffer_t& fbo,
 		gsl::span<clear_value_t> clear_values,
-		uint32_t width, uint32_t height) = 0;
-	virtual void next_subpass() = 0;
+		uint32_t width, uint32_t height, subpass_contents contents = subpass_contents::inline_commands) = 0;
+	virtual void next_subpass(subpass_contents contents = subpass_contents::inline_commands) = 0;
 	virtual void end_renderpass() = 0;
+	virtual void execute_secondary_command_lists(gsl::span<command_list_t* const> command_lists) = 0;
 
 	virtual void make_command_list_executable() = 0;
 	virtual void start_command_list_recording(struct command_list_storage_t& storage) = 0;
+	//! Starts a command list created by create_secondary_command_list, to be executed inside subpass of rp.
+	/** fbo is optional, it only helps the driver. */
+	virtual void start_secondary_command_list_recording(struct command_list_storage_t& storage, render_pass_t& rp, uint32_t subpass, framebuffer_t* fbo) = 0;
 };
 
 struct semaphore_t {
@@ -603,6 +690,7 @@ struct fence_t {
 
 struct command_list_storage_t {
 	virtual std::unique_ptr<command_list_t> create_command_list() = 0;
+	virtual std::unique_ptr<command_list_t> create_secondary_command_list() = 0;
 	virtual void reset_command_list_storage() = 0;
 	virtual ~command_list_storage_t() {}
 };
@@ -621,12 +709,12 @@ struct swap_chain_t {
 
 struct device_t {
 	virtual std::unique_ptr<command_list_storage_t> create_command_storage() = 0;
-	virtual std::unique_ptr<buffer_t> create_buffer(size_t size, irr::video::E_MEMORY_POOL memory_pool, uint32_t flags) = 0;
+	virtual std::unique_ptr<buffer_t> create_buffer(size_t size, irr::video::E_MEMORY_POOL memory_pool, uint32_t flags, memory_category category = memory_category::automatic, const std::string& debug_name = "") = 0;
 	virtual std::unique_ptr<buffer_view_t> create_buffer_view(buffer_t&, irr::video::ECOLOR_FORMAT, uint64_t offset, uint32_t size) = 0;
 	virtual void set_constant_buffer_view(const allocated_descriptor_set& descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_t& buffer, uint32_t buffer_size, uint64_t offset_in_buffer = 0) = 0;
 	virtual void set_uniform_texel_buffer_view(const allocated_descriptor_set& descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_view_t& buffer_view) = 0;
 	virtual void set_uav_buffer_view(const allocated_descriptor_set& descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_t& buffer, uint64_t offset, uint32_t size) = 0;
-	virtual std::unique_ptr<image_t> create_image(irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height, uint16_t mipmap, uint32_t layers, uint32_t flags, clear_value_t *clear_value) = 0;
+	virtual std::unique_ptr<image_t> create_image(irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height, uint16_t mipmap, uint32_t layers, uint32_t flags, clear_value_t *clear_value, memory_category category = memory_category::automatic, const std::string& debug_name = "") = 0;
 	virtual std::unique_ptr<image_view_t> create_image_view(image_t& img, irr::video::ECOLOR_FORMAT fmt, uint16_t base_mipmap, uint16_t mipmap_count, uint16_t base_layer, uint16_t layer_count, irr::video::E_TEXTURE_TYPE texture_type, irr::video::E_ASPECT aspect = irr::video::E_ASPECT::EA_COLOR) = 0;
 	virtual void set_image_view(const allocated_descriptor_set& descriptor_set, uint32_t offset, uint32_t binding_location, image_view_t& img_view) = 0;
 	virtual void set_input_attachment(const allocated_descriptor_set& descriptor_set, uint32_t offset, uint32_t binding_location, image_view_t& img_view) = 0;
@@ -644,10 +732,23 @@ struct device_t {
 	virtual std::unique_ptr<semaphore_t> create_semaphore() = 0;
 
 	virtual std::unique_ptr<render_pass_t> create_ibl_sky_pass(const irr::video::ECOLOR_FORMAT&) = 0;
-	virtual std::unique_ptr<render_pass_t> create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT&) = 0;
+	//! With loads_object_attachments the G-buffer and depth are kept instead of cleared.
+	/** Both variants are compatible, they share pipelines and framebuffers. */
+	virtual std::unique_ptr<render_pass_t> create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT&, bool loads_object_attachments = false) = 0;
 	virtual std::unique_ptr<render_pass_t> create_ssao_pass() = 0;
 	virtual std::unique_ptr<render_pass_t> create_blit_pass(const irr::video::ECOLOR_FORMAT& color_format) = 0;
 
+	//! Bytes that can still be allocated from memory_pool before going over budget.
+	/** Loaders should check it before streaming more assets. */
+	virtual uint64_t get_remaining_memory_budget(irr::video::E_MEMORY_POOL memory_pool) = 0;
+	//! Writes per category and per heap usage, as a table or as JSON.
+	virtual void dump_memory_usage(std::ostream& out, bool json = false) = 0;
+
+	//! True if command_list_t::draw_indexed_indirect_count can be used.
+	virtual bool supports_draw_indirect_count() const = 0;
+	//! True if images of sRGB formats can be created with usage_uav, written through views of the UNORM format.
+	virtual bool supports_srgb_storage_images() const = 0;
+
 	virtual ~device_t() {};
 };
 
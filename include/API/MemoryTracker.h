@@ -0,0 +1,72 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gsl/gsl>
+
+//! What a buffer or an image is used for, only used for reporting.
+enum class memory_category
+{
+	automatic, // deduced from the usage flags and the memory pool
+	texture,
+	render_target,
+	vertex_buffer,
+	index_buffer,
+	uniform_buffer,
+	staging,
+	other,
+	count
+};
+
+const char* get_memory_category_name(memory_category category);
+
+//! State of a memory heap as seen by the driver.
+struct memory_heap_budget
+{
+	uint64_t size;
+	//! Bytes the application can use on this heap, heap size if unknown.
+	uint64_t budget;
+	//! Bytes used by the process on this heap, including allocations not done by the tracker.
+	uint64_t usage;
+	bool device_local;
+};
+
+//! Keeps track of every live allocation done by a device.
+/** Thread safe, allocations are registered on creation and released by the buffer/image destructor. */
+struct memory_tracker
+{
+	//! VK_MAX_MEMORY_HEAPS, heap indexes must be below it.
+	static constexpr uint32_t max_heaps = 16;
+
+	uint64_t register_allocation(uint32_t heap, memory_category category, uint64_t size, const std::string& debug_name);
+	void release_allocation(uint64_t allocation_id);
+
+	uint64_t get_heap_usage(uint32_t heap) const;
+	uint64_t get_category_usage(memory_category category) const;
+
+	void write_table(std::ostream& out, gsl::span<const memory_heap_budget> heaps) const;
+	void write_json(std::ostream& out, gsl::span<const memory_heap_budget> heaps) const;
+
+private:
+	struct allocation
+	{
+		uint32_t heap;
+		memory_category category;
+		uint64_t size;
+		std::string debug_name;
+	};
+
+	mutable std::mutex mutex;
+	uint64_t next_allocation_id = 1;
+	std::unordered_map<uint64_t, allocation> allocations;
+	std::array<uint64_t, max_heaps> heap_usage{};
+	std::array<uint64_t, static_cast<size_t>(memory_category::count)> category_usage{};
+	std::array<uint32_t, static_cast<size_t>(memory_category::count)> category_allocation_count{};
+};
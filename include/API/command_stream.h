@@ -0,0 +1,227 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include "GfxApi.h"
+#include <type_traits>
+
+//! 64 bits key ordering the items of a command stream.
+/** From most to least significant bits : pass (4), pipeline (12), material (14), geometry (14), depth (20).
+Pipelines, materials and geometries are small ids chosen by the caller, depth is a fixed point value
+(see make_depth_key). Items with equal keys keep their recording order. */
+struct sort_key
+{
+	static constexpr uint16_t max_pipeline = 0xFFF;
+	static constexpr uint16_t max_material = 0x3FFF;
+	static constexpr uint16_t max_geometry = 0x3FFF;
+
+	static constexpr uint64_t make(uint8_t pass, uint16_t pipeline, uint16_t material, uint16_t geometry, uint32_t depth)
+	{
+		return (uint64_t(pass & 0xF) << 60) | (uint64_t(pipeline & 0xFFF) << 48) | (uint64_t(material & 0x3FFF) << 34)
+			| (uint64_t(geometry & 0x3FFF) << 20) | (depth & 0xFFFFF);
+	}
+
+	//! Maps a view depth in [0, 1] to 20 bits, reversed is used to draw back to front.
+	static uint32_t make_depth_key(float normalized_depth, bool reversed = false)
+	{
+		const auto clamped = normalized_depth < 0.f ? 0.f : (normalized_depth > 1.f ? 1.f : normalized_depth);
+		const auto depth = static_cast<uint32_t>(clamped * float(0xFFFFF));
+		return reversed ? 0xFFFFF - depth : depth;
+	}
+
+	static constexpr uint8_t get_pass(uint64_t key) { return static_cast<uint8_t>(key >> 60); }
+	static constexpr uint16_t get_pipeline(uint64_t key) { return static_cast<uint16_t>((key >> 48) & 0xFFF); }
+	static constexpr uint16_t get_material(uint64_t key) { return static_cast<uint16_t>((key >> 34) & 0x3FFF); }
+	static constexpr uint16_t get_geometry(uint64_t key) { return static_cast<uint16_t>((key >> 20) & 0x3FFF); }
+};
+
+enum class command_packet_type : uint16_t
+{
+	set_graphic_pipeline,
+	bind_graphic_descriptor,
+	bind_index_buffer,
+	bind_vertex_buffers,
+	draw_indexed,
+	draw_non_indexed,
+};
+
+//! Every packet starts with this header, size includes the header.
+struct command_packet_header
+{
+	command_packet_type type;
+	uint16_t size;
+};
+
+namespace command_packets
+{
+	struct set_graphic_pipeline
+	{
+		static constexpr auto type = command_packet_type::set_graphic_pipeline;
+		command_packet_header header;
+		pipeline_state_t* pipeline;
+	};
+
+	struct bind_graphic_descriptor
+	{
+		static constexpr auto type = command_packet_type::bind_graphic_descriptor;
+		command_packet_header header;
+		uint32_t bindpoint;
+		const allocated_descriptor_set* descriptor_set;
+		pipeline_layout_t* layout;
+	};
+
+	struct bind_index_buffer
+	{
+		static constexpr auto type = command_packet_type::bind_index_buffer;
+		command_packet_header header;
+		irr::video::E_INDEX_TYPE index_type;
+		uint32_t size;
+		buffer_t* buffer;
+		uint64_t offset;
+	};
+
+	struct bind_vertex_buffers
+	{
+		static constexpr auto type = command_packet_type::bind_vertex_buffers;
+		static constexpr uint32_t max_buffers = 8;
+		command_packet_header header;
+		uint32_t first_bind;
+		uint32_t count;
+		buffer_t* buffers[max_buffers];
+		uint64_t offsets[max_buffers];
+		uint32_t strides[max_buffers];
+		uint32_t sizes[max_buffers];
+	};
+
+	struct alignas(8) draw_indexed
+	{
+		static constexpr auto type = command_packet_type::draw_indexed;
+		command_packet_header header;
+		uint32_t index_count;
+		uint32_t instance_count;
+		uint32_t base_index;
+		int32_t base_vertex;
+		uint32_t base_instance;
+	};
+
+	struct alignas(8) draw_non_indexed
+	{
+		static constexpr auto type = command_packet_type::draw_non_indexed;
+		command_packet_header header;
+		uint32_t vertex_count;
+		uint32_t instance_count;
+		int32_t base_vertex;
+		uint32_t base_instance;
+	};
+}
+
+//! Compact list of POD packets grouped in sortable items.
+/** Not thread safe : every recording thread fills its own stream, streams are merged by
+command_stream_translator. An item is the run of packets recorded after begin_item and up to
+the next begin_item ; it must not depend on state set by another item since items are reordered.
+Referenced API objects must outlive the translation. */
+struct command_stream
+{
+	void begin_item(uint64_t key);
+
+	void set_graphic_pipeline(pipeline_state_t& pipeline);
+	void bind_graphic_descriptor(uint32_t bindpoint, const allocated_descriptor_set& descriptor_set, pipeline_layout_t& sig);
+	void bind_index_buffer(buffer_t& buffer, uint64_t offset, uint32_t size, irr::video::E_INDEX_TYPE type);
+	void bind_vertex_buffers(uint32_t first_bind, const std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t> >& buffer_offset_stride_size);
+	void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t base_index, int32_t base_vertex, uint32_t base_instance);
+	void draw_non_indexed(uint32_t vertex_count, uint32_t instance_count, int32_t base_vertex, uint32_t base_instance);
+
+	//! Keeps the allocated memory.
+	void clear();
+
+	size_t get_item_count() const { return items.size(); }
+	size_t get_byte_size() const { return data.size(); }
+
+	struct item
+	{
+		uint64_t key;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	const std::vector<item>& get_items() const { return items; }
+	const uint8_t* get_data() const { return data.data(); }
+
+private:
+	template<typename Packet>
+	Packet& push()
+	{
+		static_assert(std::is_trivially_copyable<Packet>::value, "command packets must be POD");
+		static_assert(sizeof(Packet) % alignof(uint64_t) == 0, "command packets must keep the stream 8 bytes aligned");
+		if (items.empty())
+			throw "command_stream: begin_item must be called before recording";
+		const auto offset = data.size();
+		data.resize(offset + sizeof(Packet));
+		items.back().end = static_cast<uint32_t>(data.size());
+		auto& packet = *reinterpret_cast<Packet*>(data.data() + offset);
+		packet.header = command_packet_header{ Packet::type, static_cast<uint16_t>(sizeof(Packet)) };
+		return packet;
+	}
+
+	std::vector<uint8_t> data;
+	std::vector<item> items;
+};
+
+//! Counters of a translation.
+struct command_stream_statistics
+{
+	uint32_t items = 0;
+	uint32_t packets = 0;
+	uint32_t draws = 0;
+	uint32_t pipeline_binds = 0;
+	uint32_t descriptor_binds = 0;
+	uint32_t buffer_binds = 0;
+	//! Binds of an object already bound in the same command list, not replayed.
+	uint32_t redundant_binds = 0;
+	uint32_t command_lists = 0;
+
+	command_stream_statistics& operator+=(const command_stream_statistics& other);
+};
+
+//! Sorts the items of several command streams and replays them into command lists.
+struct command_stream_translator
+{
+	//! Subpass the translated commands are executed in, viewport and scissor of secondary command lists are set to width x height.
+	struct target
+	{
+		render_pass_t* render_pass;
+		uint32_t subpass;
+		framebuffer_t* framebuffer;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	//! Merges and sorts the items of streams by key, stable across streams in the order of the span.
+	/** Streams are referenced, they must not be modified until the translation is done. */
+	void sort(gsl::span<const command_stream* const> streams);
+
+	//! Replays the sorted items inline, in the current subpass of cmd and with its current viewport.
+	command_stream_statistics translate(command_list_t& cmd) const;
+
+	//! Replays the sorted items into one secondary command list per storage, in parallel.
+	/** Storages are not shared between threads, the returned command lists are in key order and
+	must be executed by a primary command list whose subpass was started with
+	subpass_contents::secondary_command_lists. Empty chunks produce no command list, throws if storages
+	is empty. */
+	std::vector<std::unique_ptr<command_list_t>> translate_parallel(gsl::span<command_list_storage_t* const> storages, const target& tgt,
+		command_stream_statistics* statistics = nullptr) const;
+
+	size_t get_item_count() const { return sorted_items.size(); }
+
+private:
+	struct sorted_item
+	{
+		uint64_t key;
+		const uint8_t* begin;
+		const uint8_t* end;
+	};
+
+	command_stream_statistics replay(command_list_t& cmd, size_t first, size_t last) const;
+
+	std::vector<sorted_item> sorted_items;
+};
@@ -59,6 +59,7 @@ enum class d3d12_texture_type
 {
 	texture2d,
 	texturecube,
+	texture2darray,
 };
 
 struct d3d12_image_view
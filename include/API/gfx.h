@@ -0,0 +1,95 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include "GfxApi.h"
+#include <array>
+
+//! Statically dispatched front end to a backend.
+/** Backend is a traits struct naming the implementation of each API object (see vulkan_backend).
+The recorder holds the concrete command list, every call resolves at compile time and can be inlined
+in the caller instead of going through command_list_t's vtable.
+Arguments are still the abstract API types so that code written against command_list_t can switch
+to gfx<Backend>::recorder without other change. */
+template<typename Backend>
+struct gfx
+{
+	using command_list = typename Backend::command_list;
+
+	struct recorder
+	{
+		//! Vertex buffers a single bind_vertex_buffers call can bind.
+		static constexpr size_t max_vertex_buffers = 16;
+
+		recorder(command_list_t& cmd) : object(backend_cast<command_list>(cmd))
+		{}
+
+		void set_pipeline_barrier(image_t& resource, RESOURCE_USAGE before, RESOURCE_USAGE after, uint32_t subresource, irr::video::E_ASPECT aspect)
+		{
+			object.set_pipeline_barrier(backend_cast<typename Backend::image>(resource), before, after, subresource, aspect);
+		}
+
+		void set_graphic_pipeline(pipeline_state_t& pipeline)
+		{
+			object.set_graphic_pipeline(backend_cast<typename Backend::pipeline_state>(pipeline));
+		}
+
+		void bind_graphic_descriptor(uint32_t bindpoint, const allocated_descriptor_set& descriptor_set, pipeline_layout_t& sig)
+		{
+			object.bind_graphic_descriptor(bindpoint,
+				backend_cast<const typename Backend::allocated_descriptor_set>(descriptor_set),
+				backend_cast<typename Backend::pipeline_layout>(sig));
+		}
+
+		void bind_index_buffer(buffer_t& buffer, uint64_t offset, uint32_t, irr::video::E_INDEX_TYPE type)
+		{
+			object.bind_index_buffer(backend_cast<typename Backend::buffer>(buffer), offset, type);
+		}
+
+		void bind_vertex_buffers(uint32_t first_bind, const std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t>>& buffer_offset_stride_size)
+		{
+			const auto count = buffer_offset_stride_size.size();
+			if (count > max_vertex_buffers)
+				throw "recorder: too many vertex buffers";
+			std::array<typename Backend::buffer*, max_vertex_buffers> buffers;
+			std::array<uint64_t, max_vertex_buffers> offsets;
+			for (size_t i = 0; i < count; i++)
+			{
+				buffers[i] = &backend_cast<typename Backend::buffer>(std::get<0>(buffer_offset_stride_size[i]));
+				offsets[i] = std::get<1>(buffer_offset_stride_size[i]);
+			}
+			object.bind_vertex_buffers(first_bind,
+				gsl::span<typename Backend::buffer* const>(buffers.data(), count),
+				gsl::span<const uint64_t>(offsets.data(), count));
+		}
+
+		void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t base_index, int32_t base_vertex, uint32_t base_instance)
+		{
+			object.draw_indexed(index_count, instance_count, base_index, base_vertex, base_instance);
+		}
+
+		void draw_non_indexed(uint32_t vertex_count, uint32_t instance_count, int32_t base_vertex, uint32_t base_instance)
+		{
+			object.draw_non_indexed(vertex_count, instance_count, base_vertex, base_instance);
+		}
+
+		void dispatch(uint32_t x, uint32_t y, uint32_t z)
+		{
+			object.dispatch(x, y, z);
+		}
+
+		//! Anything not on the hot path goes through the virtual interface.
+		command_list_t& get()
+		{
+			return object;
+		}
+
+		command_list& object;
+	};
+
+	static void submit(command_queue_t& queue, command_list_t& cmd, semaphore_t* wait_sem = nullptr)
+	{
+		backend_cast<typename Backend::command_queue>(queue).submit_executable_command_list(
+			backend_cast<command_list>(cmd), backend_cast<typename Backend::semaphore>(wait_sem));
+	}
+};
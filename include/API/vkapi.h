@@ -16,12 +16,23 @@
 
 #include "..\VKAPI\vulkan_helpers.h"
 
+//! Optional device capabilities command lists depend on.
+struct vk_command_features
+{
+	//! Set when VK_KHR_draw_indirect_count is enabled.
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count = nullptr;
+	//! Indirect draws are issued one at a time without the multiDrawIndirect feature.
+	bool multi_draw_indirect = false;
+};
+
 struct vk_command_list_storage_t final: command_list_storage_t
 {
 	virtual std::unique_ptr<command_list_t> create_command_list() override;
+	virtual std::unique_ptr<command_list_t> create_secondary_command_list() override;
 	virtual void reset_command_list_storage() override;
-	vk_command_list_storage_t(vk::Device _dev, vk::CommandPool _object)
-		: dev(_dev), object(_object)
+	vk_command_list_storage_t(vk::Device _dev, vk::CommandPool _object, vk::ImageLayout _present_layout,
+		const vk_command_features& _features = vk_command_features{})
+		: dev(_dev), object(_object), present_layout(_present_layout), features(_features)
 	{}
 
 	virtual ~vk_command_list_storage_t() override
@@ -31,8 +42,17 @@ struct vk_command_list_storage_t final: command_list_storage_t
 private:
 	vk::Device dev;
 	vk::CommandPool object;
+	vk::ImageLayout present_layout;
+	vk_command_features features;
 };
 
+struct vk_image_t;
+struct vk_buffer_t;
+struct vk_semaphore_t;
+struct vk_pipeline_state_t;
+struct vk_pipeline_layout_t;
+struct vk_allocated_descriptor_set;
+
 struct vk_command_list_t final: command_list_t
 {
 	virtual void bind_graphic_descriptor(uint32_t bindpoint, const allocated_descriptor_set & descriptor_set, pipeline_layout_t& sig) override;
@@ -53,19 +73,39 @@ struct vk_command_list_t final: command_list_t
 	virtual void draw_non_indexed(uint32_t vertex_count, uint32_t instance_count, int32_t base_vertex, uint32_t base_instance) override;
 	virtual void dispatch(uint32_t x, uint32_t y, uint32_t z) override;
 	virtual void copy_buffer(buffer_t & src, uint64_t src_offset, buffer_t & dst, uint64_t dst_offset, uint64_t size) override;
-	virtual void next_subpass() override;
+	virtual void fill_buffer(buffer_t & buffer, uint64_t offset, uint64_t size, uint32_t value) override;
+	virtual void set_buffer_barrier(buffer_t & buffer, RESOURCE_USAGE before, RESOURCE_USAGE after) override;
+	virtual void draw_indexed_indirect(buffer_t & arguments, uint64_t offset, uint32_t draw_count, uint32_t stride) override;
+	virtual void draw_indexed_indirect_count(buffer_t & arguments, uint64_t offset, buffer_t & count_buffer, uint64_t count_offset,
+		uint32_t max_draw_count, uint32_t stride) override;
+	virtual void next_subpass(subpass_contents contents = subpass_contents::inline_commands) override;
 	virtual void end_renderpass() override;
+	virtual void execute_secondary_command_lists(gsl::span<command_list_t* const> command_lists) override;
 	virtual void make_command_list_executable() override;
 	virtual void start_command_list_recording(command_list_storage_t& storage) override;
+	virtual void start_secondary_command_list_recording(command_list_storage_t& storage, render_pass_t& rp, uint32_t subpass, framebuffer_t* fbo) override;
+
+	//! Non virtual overloads taking backend objects, used by gfx<vulkan_backend> (see gfx.h).
+	void set_pipeline_barrier(vk_image_t & resource, RESOURCE_USAGE before, RESOURCE_USAGE after, uint32_t subresource, irr::video::E_ASPECT);
+	void set_graphic_pipeline(vk_pipeline_state_t& pipeline);
+	void bind_graphic_descriptor(uint32_t bindpoint, const vk_allocated_descriptor_set & descriptor_set, vk_pipeline_layout_t& sig);
+	void bind_index_buffer(vk_buffer_t & buffer, uint64_t offset, irr::video::E_INDEX_TYPE type);
+	//! At most 16 buffers.
+	void bind_vertex_buffers(uint32_t first_bind, gsl::span<vk_buffer_t* const> buffers, gsl::span<const uint64_t> offsets);
 
 	vk::Device dev;
 	vk::CommandBuffer object;
-	vk_command_list_t(vk::Device _dev, vk::CommandBuffer _object) : dev(_dev), object(_object)
+	//! Layout used for RESOURCE_USAGE::PRESENT, eTransferSrcOptimal when there is no swap chain.
+	vk::ImageLayout present_layout;
+	vk_command_features features;
+	vk_command_list_t(vk::Device _dev, vk::CommandBuffer _object, vk::ImageLayout _present_layout = vk::ImageLayout::ePresentSrcKHR,
+		const vk_command_features& _features = vk_command_features{})
+		: dev(_dev), object(_object), present_layout(_present_layout), features(_features)
 	{}
 
 	virtual void begin_renderpass(render_pass_t& rp, framebuffer_t &fbo,
 		gsl::span<clear_value_t> clear_values,
-		uint32_t width, uint32_t height) override;
+		uint32_t width, uint32_t height, subpass_contents contents = subpass_contents::inline_commands) override;
 
 	virtual void clear_depth_stencil(image_t & img, float depth) override;
 	virtual void clear_depth_stencil(image_t & img, uint8_t stencil) override;
@@ -79,14 +119,23 @@ struct vk_device_t final: device_t
 	{}
 
 	uint32_t queue_family_index;
+	vk::PhysicalDevice physical_device;
 	vk::PhysicalDeviceMemoryProperties mem_properties;
+	//! Set when VK_EXT_memory_budget is enabled, budgets are the heap sizes otherwise.
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2 = nullptr;
+	memory_tracker memory;
+	//! Layout of presentable images, headless devices don't enable VK_KHR_swapchain and copy from them instead.
+	vk::ImageLayout present_layout = vk::ImageLayout::ePresentSrcKHR;
+	vk_command_features command_features;
+	//! Set when VK_KHR_maintenance2 is enabled, sRGB images may then be created with usage_uav.
+	bool extended_image_usage = false;
 	virtual std::unique_ptr<command_list_storage_t> create_command_storage() override;
-	virtual std::unique_ptr<buffer_t> create_buffer(size_t size, irr::video::E_MEMORY_POOL memory_pool, uint32_t flags) override;
+	virtual std::unique_ptr<buffer_t> create_buffer(size_t size, irr::video::E_MEMORY_POOL memory_pool, uint32_t flags, memory_category category = memory_category::automatic, const std::string& debug_name = "") override;
 	virtual std::unique_ptr<buffer_view_t> create_buffer_view(buffer_t &, irr::video::ECOLOR_FORMAT, uint64_t offset, uint32_t size) override;
 	virtual void set_constant_buffer_view(const allocated_descriptor_set & descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_t & buffer, uint32_t buffer_size, uint64_t offset_in_buffer = 0) override;
 	virtual void set_uniform_texel_buffer_view(const allocated_descriptor_set & descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_view_t & buffer_view) override;
 	virtual void set_uav_buffer_view(const allocated_descriptor_set & descriptor_set, uint32_t offset_in_set, uint32_t binding_location, buffer_t & buffer, uint64_t offset, uint32_t size) override;
-	virtual std::unique_ptr<image_t> create_image(irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height, uint16_t mipmap, uint32_t layers, uint32_t flags, clear_value_t * clear_value) override;
+	virtual std::unique_ptr<image_t> create_image(irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height, uint16_t mipmap, uint32_t layers, uint32_t flags, clear_value_t * clear_value, memory_category category = memory_category::automatic, const std::string& debug_name = "") override;
 	virtual std::unique_ptr<image_view_t> create_image_view(image_t & img, irr::video::ECOLOR_FORMAT fmt, uint16_t base_mipmap, uint16_t mipmap_count, uint16_t base_layer, uint16_t layer_count, irr::video::E_TEXTURE_TYPE texture_type, irr::video::E_ASPECT aspect = irr::video::E_ASPECT::EA_COLOR) override;
 	virtual void set_image_view(const allocated_descriptor_set & descriptor_set, uint32_t offset, uint32_t binding_location, image_view_t & img_view) override;
 	virtual void set_input_attachment(const allocated_descriptor_set & descriptor_set, uint32_t offset, uint32_t binding_location, image_view_t & img_view) override;
@@ -112,11 +161,17 @@ struct vk_device_t final: device_t
 	}
 
 	virtual std::unique_ptr<render_pass_t> create_ibl_sky_pass(const irr::video::ECOLOR_FORMAT&) override;
-	virtual std::unique_ptr<render_pass_t> create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT&) override;
+	virtual std::unique_ptr<render_pass_t> create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT&, bool loads_object_attachments = false) override;
 	virtual std::unique_ptr<render_pass_t> create_ssao_pass() override;
 	virtual std::unique_ptr<render_pass_t> create_blit_pass(const irr::video::ECOLOR_FORMAT& color_format) override;
 	virtual std::unique_ptr<fence_t> create_fence() override;
 	virtual std::unique_ptr<semaphore_t> create_semaphore() override;
+
+	virtual uint64_t get_remaining_memory_budget(irr::video::E_MEMORY_POOL memory_pool) override;
+	virtual void dump_memory_usage(std::ostream& out, bool json = false) override;
+	virtual bool supports_draw_indirect_count() const override { return command_features.draw_indexed_indirect_count != nullptr; }
+	virtual bool supports_srgb_storage_images() const override { return extended_image_usage; }
+	std::vector<memory_heap_budget> get_memory_heap_budgets() const;
 };
 
 struct vk_command_queue_t final: command_queue_t
@@ -127,6 +182,8 @@ struct vk_command_queue_t final: command_queue_t
 	virtual void submit_executable_command_list(command_list_t & command_list, semaphore_t* wait_sem) override;
 	virtual void wait_for_command_queue_idle() override;
 
+	void submit_executable_command_list(vk_command_list_t & command_list, vk_semaphore_t* wait_sem);
+
 	vk::Queue object;
 };
 
@@ -135,37 +192,43 @@ struct vk_buffer_t final: buffer_t
 	virtual void * map_buffer() override;
 	virtual void unmap_buffer() override;
 
-	vk_buffer_t(vk::Device _dev, vk::Buffer _object, vk::DeviceMemory _memory)
-		: object(_object), dev(_dev), memory(_memory)
+	vk_buffer_t(vk::Device _dev, vk::Buffer _object, vk::DeviceMemory _memory, memory_tracker* _tracker = nullptr, uint64_t _allocation_id = 0)
+		: object(_object), dev(_dev), memory(_memory), tracker(_tracker), allocation_id(_allocation_id)
 	{}
 
 	virtual ~vk_buffer_t() override
 	{
 		dev.destroyBuffer(object);
 		dev.freeMemory(memory);
+		if (tracker != nullptr) tracker->release_allocation(allocation_id);
 	}
 
 	vk::Buffer object;
 	vk::DeviceMemory memory;
 	vk::Device dev;
+	memory_tracker* tracker;
+	uint64_t allocation_id;
 };
 
 struct vk_image_t final: image_t
 {
-	vk_image_t(vk::Device _dev, vk::Image _object, vk::DeviceMemory _memory, uint32_t _mip_levels)
-		: object(_object), dev(_dev), memory(_memory), mip_levels(_mip_levels)
+	vk_image_t(vk::Device _dev, vk::Image _object, vk::DeviceMemory _memory, uint32_t _mip_levels, memory_tracker* _tracker = nullptr, uint64_t _allocation_id = 0)
+		: object(_object), dev(_dev), memory(_memory), mip_levels(_mip_levels), tracker(_tracker), allocation_id(_allocation_id)
 	{}
 
 	virtual ~vk_image_t() override  {
 		if (memory.operator VkDeviceMemory() == VK_NULL_HANDLE) return;
 		dev.destroyImage(object);
 		dev.freeMemory(memory);
+		if (tracker != nullptr) tracker->release_allocation(allocation_id);
 	}
 
 	vk::Image object;
 	vk::DeviceMemory memory;
 	vk::Device dev;
 	uint32_t mip_levels;
+	memory_tracker* tracker;
+	uint64_t allocation_id;
 };
 
 struct vk_semaphore_t final: semaphore_t
@@ -271,6 +334,36 @@ struct vk_swap_chain_t final: swap_chain_t
 	virtual void present(command_queue_t & cmdqueue, uint32_t backbuffer_index) override;
 };
 
+//! Swap chain replacement for devices created without a surface.
+/** Rotates between image_count device local images and, when dump_prefix is
+not empty, reads back every presented image and writes it as a .ppm file. */
+struct vk_offscreen_swap_chain_t final: swap_chain_t
+{
+	vk_offscreen_swap_chain_t(vk_device_t& _dev, vk::Queue _queue, irr::video::ECOLOR_FORMAT _format,
+		uint32_t _width, uint32_t _height, uint32_t image_count, const std::string& _dump_prefix);
+	virtual ~vk_offscreen_swap_chain_t() override;
+
+	virtual uint32_t get_next_backbuffer_id(semaphore_t& semaphore) override;
+	virtual std::vector<std::unique_ptr<image_t>> get_image_view_from_swap_chain() override;
+	virtual void present(command_queue_t & cmdqueue, uint32_t backbuffer_index) override;
+
+	vk::Device dev;
+	vk::Queue queue;
+	irr::video::ECOLOR_FORMAT format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t current_image = 0;
+	uint32_t presented_frames = 0;
+	std::vector<std::unique_ptr<image_t>> images;
+
+	std::string dump_prefix;
+	std::unique_ptr<buffer_t> readback_buffer;
+	std::unique_ptr<command_list_storage_t> readback_storage;
+	std::unique_ptr<command_list_t> readback_command_list;
+private:
+	void dump_image(uint32_t backbuffer_index);
+};
+
 struct vk_render_pass_t final: render_pass_t {
 	vk::RenderPass object;
 	vk::Device dev;
@@ -355,9 +448,52 @@ struct vk_framebuffer final: framebuffer_t
 	}
 };
 
+inline void vk_command_list_t::set_graphic_pipeline(vk_pipeline_state_t& pipeline)
+{
+	object.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.object);
+}
+
+inline void vk_command_list_t::bind_graphic_descriptor(uint32_t bindpoint, const vk_allocated_descriptor_set & descriptor_set, vk_pipeline_layout_t& sig)
+{
+	object.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, sig.object, bindpoint, 1, &descriptor_set.object, 0, nullptr);
+}
+
+inline void vk_command_list_t::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t base_index, int32_t base_vertex, uint32_t base_instance)
+{
+	object.drawIndexed(index_count, instance_count, base_index, base_vertex, base_instance);
+}
+
+inline void vk_command_list_t::draw_non_indexed(uint32_t vertex_count, uint32_t instance_count, int32_t base_vertex, uint32_t base_instance)
+{
+	object.draw(vertex_count, instance_count, base_vertex, base_instance);
+}
+
+inline void vk_command_list_t::dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+	object.dispatch(x, y, z);
+}
+
+//! Backend traits for gfx<Backend>, see gfx.h.
+struct vulkan_backend
+{
+	using device = vk_device_t;
+	using command_list = vk_command_list_t;
+	using command_queue = vk_command_queue_t;
+	using buffer = vk_buffer_t;
+	using image = vk_image_t;
+	using semaphore = vk_semaphore_t;
+	using pipeline_state = vk_pipeline_state_t;
+	using pipeline_layout = vk_pipeline_layout_t;
+	using allocated_descriptor_set = vk_allocated_descriptor_set;
+};
 
 #include "../VKAPI/pipeline_helpers.h"
 #include "../VKAPI/pipeline_layout_helpers.h"
 #include "../VKAPI/renderpass_helpers.h"
 
 std::tuple<std::unique_ptr<device_t>, std::unique_ptr<swap_chain_t>, std::unique_ptr<command_queue_t>, uint32_t, uint32_t, irr::video::ECOLOR_FORMAT> create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window, bool debug_marker, bool debug_layer);
+
+//! Creates a device without surface nor VK_KHR_swapchain, for render farms and software ICDs (lavapipe).
+/** The returned swap chain is a vk_offscreen_swap_chain_t rotating image_count images of width x height.
+If dump_prefix is not empty every presented frame is written to dump_prefix + frame index + ".ppm". */
+std::tuple<std::unique_ptr<device_t>, std::unique_ptr<swap_chain_t>, std::unique_ptr<command_queue_t>, uint32_t, uint32_t, irr::video::ECOLOR_FORMAT> create_headless_device_swapchain_and_graphic_queue(uint32_t width, uint32_t height, uint32_t image_count, const std::string &dump_prefix, bool debug_layer);
@@ -8,6 +8,8 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <array>
 
 namespace irr
@@ -43,6 +45,8 @@ namespace irr
 			ECF_R8G8,
 			ECF_R16,
 			ECF_R16G16,
+			ECF_R16G16_SNORM,
+			ECF_R16G16B16A16_UNORM,
 
 			/** Floating Point formats. The following formats may only be used for render target textures. */
 
@@ -73,6 +77,8 @@ namespace irr
 			ECF_BC3_UNORM, ECF_BC3_UNORM_SRGB,
 			ECF_BC4_UNORM, ECF_BC4_SNORM,
 			ECF_BC5_UNORM, ECF_BC5_SNORM,
+			ECF_BC6H_UF16, ECF_BC6H_SF16,
+			ECF_BC7_UNORM, ECF_BC7_UNORM_SRGB,
 
 			//! 24 bits depth and 8 bits stencil
 			D24U8,
@@ -100,6 +106,10 @@ namespace irr
 			case ECF_BC4_SNORM:
 			case ECF_BC5_UNORM:
 			case ECF_BC5_SNORM:
+			case ECF_BC6H_UF16:
+			case ECF_BC6H_SF16:
+			case ECF_BC7_UNORM:
+			case ECF_BC7_UNORM_SRGB:
 				return true;
 			}
 		}
@@ -109,12 +119,31 @@ namespace irr
 			assert(!isCompressed(format));
 			switch (format)
 			{
+			case ECF_R8:
+				return 8;
+			case ECF_R8G8:
+			case ECF_R16:
+			case ECF_R16F:
+				return 16;
+			case ECF_R8G8B8:
+				return 24;
 			case ECF_A8R8G8B8:
 			case ECF_R8G8B8A8_UNORM:
 			case ECF_R8G8B8A8_UNORM_SRGB:
+			case ECF_B8G8R8A8:
+			case ECF_B8G8R8A8_UNORM:
+			case ECF_B8G8R8A8_UNORM_SRGB:
+			case ECF_R16G16:
+			case ECF_R16G16_SNORM:
+			case ECF_R16G16F:
+			case ECF_R32F:
 				return 32;
+			case ECF_R16G16B16A16_UNORM:
 			case ECF_R16G16B16A16F:
+			case ECF_R32G32F:
 				return 64;
+			case ECF_R32G32B32F:
+				return 96;
 			case ECF_R32G32B32A32F:
 				return 128;
 			default:
@@ -122,6 +151,77 @@ namespace irr
 			}
 		}
 
+		//! Side in texels of the blocks a format is stored in, 1 for uncompressed formats.
+		inline uint32_t formatBlockExtent(ECOLOR_FORMAT format)
+		{
+			return isCompressed(format) ? 4 : 1;
+		}
+
+		//! Bytes of a block, see formatBlockExtent, or of a texel for uncompressed formats.
+		inline uint32_t formatBlockByteCount(ECOLOR_FORMAT format)
+		{
+			switch (format)
+			{
+			case ECF_BC1_UNORM:
+			case ECF_BC1_UNORM_SRGB:
+			case ECF_BC4_UNORM:
+			case ECF_BC4_SNORM:
+				return 8;
+			case ECF_BC2_UNORM:
+			case ECF_BC2_UNORM_SRGB:
+			case ECF_BC3_UNORM:
+			case ECF_BC3_UNORM_SRGB:
+			case ECF_BC5_UNORM:
+			case ECF_BC5_SNORM:
+			case ECF_BC6H_UF16:
+			case ECF_BC6H_SF16:
+			case ECF_BC7_UNORM:
+			case ECF_BC7_UNORM_SRGB:
+				return 16;
+			default:
+				return static_cast<uint32_t>(formatBitCount(format) / 8);
+			}
+		}
+
+		//! True for formats stored gamma encoded and sampled as linear values.
+		inline bool isSRGB(ECOLOR_FORMAT format)
+		{
+			switch (format)
+			{
+			case ECF_R8G8B8A8_UNORM_SRGB:
+			case ECF_B8G8R8A8_UNORM_SRGB:
+			case ECF_BC1_UNORM_SRGB:
+			case ECF_BC2_UNORM_SRGB:
+			case ECF_BC3_UNORM_SRGB:
+			case ECF_BC7_UNORM_SRGB:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		//! Format storing the same bits without sRGB encoding, format itself if it isn't sRGB.
+		inline ECOLOR_FORMAT formatWithoutSRGB(ECOLOR_FORMAT format)
+		{
+			switch (format)
+			{
+			case ECF_R8G8B8A8_UNORM_SRGB:
+				return ECF_R8G8B8A8_UNORM;
+			case ECF_B8G8R8A8_UNORM_SRGB:
+				return ECF_B8G8R8A8_UNORM;
+			case ECF_BC1_UNORM_SRGB:
+				return ECF_BC1_UNORM;
+			case ECF_BC2_UNORM_SRGB:
+				return ECF_BC2_UNORM;
+			case ECF_BC3_UNORM_SRGB:
+				return ECF_BC3_UNORM;
+			case ECF_BC7_UNORM_SRGB:
+				return ECF_BC7_UNORM;
+			default:
+				return format;
+			}
+		}
+
 
 		//! Creates a 16 bit A1R5G5B5 color
 		inline short RGBA16(unsigned r, unsigned g, unsigned b, unsigned a = 0xFF)
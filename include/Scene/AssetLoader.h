@@ -0,0 +1,106 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Scene/MeshAsset.h>
+#include <Util/WorkerPool.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Times of a loaded asset, from its load call.
+		struct asset_load_statistics
+		{
+			std::string path;
+			//! Mesh mapping or cooking and texture reading, on a worker.
+			double decoding_ms;
+			//! Until the asset was handed to its callback.
+			double latency_ms;
+		};
+
+		//! Loads mesh assets in parallel without blocking the render thread.
+		/** Meshes are mapped or cooked, see load_mesh, and their textures read through the texture cache on worker
+		threads, concurrent loads of a path share a single mesh load and assets sharing a texture read it once. The
+		render thread creates the device objects of the decoded assets in process_loaded, which records their uploads
+		in a command list like the mesh_asset constructor does. Callers keep drawing placeholders, or nothing, until an asset is handed to its callback. */
+		class asset_loader
+		{
+			using clock = std::chrono::high_resolution_clock;
+
+			struct request
+			{
+				std::string path;
+				std::function<void(std::shared_ptr<mesh_asset>)> on_resident;
+				clock::time_point start;
+				double decoding_ms = 0.;
+				//! Shared with the concurrent requests of the same path.
+				std::shared_ptr<const ymesh> mesh;
+				//! Set if decoding or uploading threw.
+				std::exception_ptr error;
+				std::shared_ptr<mesh_asset> asset;
+			};
+
+			device_t& dev;
+			descriptor_storage_t& heap;
+			descriptor_set_layout* model_set;
+			geometry_arena* arena;
+			//! Only set if no texture cache was given at construction.
+			std::unique_ptr<texture_cache> own_textures;
+			texture_cache* textures;
+
+			//! Meshes being mapped or cooked by a worker, so that a .ymesh file is never cooked twice at once.
+			std::unordered_map<std::string, std::shared_future<std::shared_ptr<const ymesh>>> loading_meshes;
+
+			//! Loads path on the calling worker, or waits for the worker already loading it.
+			std::shared_ptr<const ymesh> get_mesh(const std::string& path);
+
+			std::mutex mutex;
+			std::condition_variable request_decoded;
+			//! Decoded by the workers, waiting for process_loaded.
+			std::vector<std::shared_ptr<request>> decoded;
+			//! Requests not handed to their callback yet.
+			size_t pending_count = 0;
+
+			//! Uploads recorded by the last process_loaded call.
+			std::vector<std::shared_ptr<request>> uploading;
+			std::vector<asset_load_statistics> statistics;
+
+			//! Last member, its threads are joined before the requests they use are destroyed.
+			worker_pool workers;
+		public:
+			//! Assets are allocated from shared_arena and shared_textures, see mesh_asset, the loader has its own
+			//! texture cache if shared_textures is nullptr. thread_count of 0 uses every hardware thread.
+			/** Staging buffers of the texture cache are kept until texture_cache::release_staging_buffers. */
+			asset_loader(device_t& dev, descriptor_storage_t& heap, descriptor_set_layout* model_set,
+				geometry_arena* shared_arena = nullptr, texture_cache* shared_textures = nullptr, size_t thread_count = 0);
+
+			//! Starts decoding path on a worker, on_resident is called by process_loaded once its uploads were submitted.
+			void load(const std::string& path, std::function<void(std::shared_ptr<mesh_asset>)> on_resident);
+
+			//! Hands the assets recorded by the previous call to their callback and records the uploads of at most
+			//! max_assets decoded ones in upload_cmd_list.
+			/** Call it on the render thread, which must submit upload_cmd_list before the next call and before the
+			command lists drawing the assets, on the same queue. Rethrows the errors of the workers. Returns the
+			number of assets whose uploads were recorded. */
+			size_t process_loaded(command_list_t& upload_cmd_list, size_t max_assets = ~size_t(0));
+			//! Blocks until a request is decoded or no request is pending.
+			void wait_for_decoded();
+			//! True once every loaded asset was handed to its callback.
+			bool is_idle();
+
+			const std::vector<asset_load_statistics>& get_statistics() const { return statistics; }
+			texture_cache& get_texture_cache() const { return *textures; }
+		};
+	}
+}
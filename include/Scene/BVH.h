@@ -0,0 +1,69 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <Scene/Culling.h>
+#include <functional>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Binary bounding volume hierarchy over items identified by their index.
+		/** build() gives a binned SAH tree for static content, insert() adds an item next to its best sibling
+		and update() refits the ancestors of a moved item ; both degrade the tree over time, call build()
+		again once in a while if many items move. */
+		class bvh
+		{
+		public:
+			static constexpr uint32_t invalid_item = ~0u;
+
+			//! Item i has bounds boxes[i], replaces the content of the tree.
+			void build(gsl::span<const aabb> boxes);
+			//! Returns the index of the new item (the number of items before the call).
+			uint32_t insert(const aabb& box);
+			void update(uint32_t item, const aabb& box);
+
+			size_t get_item_count() const { return item_leaf.size(); }
+			size_t get_node_count() const { return nodes.size(); }
+
+			void query_frustum(const frustum& view_frustum, std::vector<uint32_t>& items) const;
+			//! Single traversal for several views (camera, shadow cascades...), at most 32.
+			/** items[i] receives the items intersecting views[i]. */
+			void query_frustums(gsl::span<const frustum> views, gsl::span<std::vector<uint32_t>> items) const;
+			void query_aabb(const aabb& box, std::vector<uint32_t>& items) const;
+
+			//! Returns the closest item hit by the ray, invalid_item if none.
+			/** hit_test refines the hit of an item box, it returns false if the item is missed and can
+			lower distance. Without it the distance to the item box is used. */
+			uint32_t query_ray(const glm::vec3& origin, const glm::vec3& direction, float& distance,
+				const std::function<bool(uint32_t item, float& distance)>& hit_test = nullptr) const;
+
+			//! Number of nodes visited by the last query, for statistics.
+			uint32_t get_last_visited_node_count() const { return last_visited_nodes; }
+
+		private:
+			struct node
+			{
+				aabb box;
+				uint32_t parent;
+				//! First child (the second is first_child + 1) for inner nodes, first index in leaf_items for leaves.
+				uint32_t first;
+				//! 0 for inner nodes.
+				uint32_t count;
+			};
+
+			//! Fills nodes[node_index] with the items leaf_items[first, first + count).
+			void build_node(uint32_t node_index, uint32_t first, uint32_t count, const std::vector<glm::vec3>& centroids);
+			void refit_from(uint32_t node_index);
+
+			std::vector<node> nodes;
+			std::vector<uint32_t> leaf_items;
+			std::vector<aabb> item_boxes;
+			//! Leaf of every item.
+			std::vector<uint32_t> item_leaf;
+			uint32_t root = invalid_item;
+			mutable uint32_t last_visited_nodes = 0;
+		};
+	}
+}
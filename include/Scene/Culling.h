@@ -0,0 +1,75 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_LEFT_HANDED
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <gsl/gsl>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Axis aligned bounding box, empty when min > max.
+		struct aabb
+		{
+			glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+			glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+			bool is_empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+			void add_point(const glm::vec3& point);
+			void add_box(const aabb& box);
+			glm::vec3 get_center() const;
+			glm::vec3 get_extents() const;
+			//! Smallest box containing this box transformed by matrix.
+			aabb transform(const glm::mat4& matrix) const;
+		};
+
+		//! The 6 planes of a view frustum, normals pointing inside.
+		struct frustum
+		{
+			//! Planes of a projection with depth in [0, 1] (GLM_FORCE_DEPTH_ZERO_TO_ONE).
+			static frustum from_view_projection(const glm::mat4& view_projection);
+
+			bool intersects(const aabb& box) const;
+
+			//! left, right, bottom, top, near, far ; xyz is the normal, w the distance.
+			std::array<glm::vec4, 6> planes;
+		};
+
+		//! Boxes stored as centers and extents in separate arrays, padded for SIMD loads.
+		struct aabb_soa
+		{
+			void resize(size_t count);
+			void set(size_t index, const aabb& box);
+			size_t size() const { return count; }
+
+			std::vector<float> center_x, center_y, center_z;
+			std::vector<float> extent_x, extent_y, extent_z;
+		private:
+			size_t count = 0;
+		};
+
+		//! Counters of the last culling pass.
+		struct culling_statistics
+		{
+			uint32_t tested = 0;
+			uint32_t visible = 0;
+			uint32_t culled = 0;
+		};
+
+		//! Writes 1 in visibility for every box intersecting the frustum, 0 otherwise.
+		/** Tests 8 boxes at a time with AVX, 4 with SSE. visibility must hold boxes.size() values. */
+		culling_statistics cull_boxes(const frustum& view_frustum, const aabb_soa& boxes, gsl::span<uint8_t> visibility);
+		//! Same for the boxes [first, first + count), visibility is indexed like boxes.
+		culling_statistics cull_boxes(const frustum& view_frustum, const aabb_soa& boxes, size_t first, size_t count,
+			gsl::span<uint8_t> visibility);
+	}
+}
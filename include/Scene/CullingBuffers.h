@@ -0,0 +1,210 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+#include <Scene/Culling.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Storage buffers can't be empty.
+		template<typename T>
+		uint32_t get_storage_buffer_size(size_t count)
+		{
+			return static_cast<uint32_t>(std::max<size_t>(count, 1) * sizeof(T));
+		}
+
+		//! Copies the frustum planes to the vec4 planes[6] of a culling shader constant buffer.
+		inline void set_planes(float (&planes)[6][4], const frustum& view_frustum)
+		{
+			for (size_t i = 0; i < view_frustum.planes.size(); i++)
+			{
+				const auto& plane = view_frustum.planes[i];
+				planes[i][0] = plane.x;
+				planes[i][1] = plane.y;
+				planes[i][2] = plane.z;
+				planes[i][3] = plane.w;
+			}
+		}
+
+		//! Device objects replaced while frames in flight may still use them, destroyed once every frame slot was reused.
+		/** A frame slot is only reused once the previous frame using it completed, so an object retired before every
+		slot was reused again is no longer read by the GPU, whichever slots were in flight. */
+		class retired_objects
+		{
+		public:
+			explicit retired_objects(uint32_t frame_count = 1) : all_frames(get_frame_mask(frame_count)) {}
+
+			//! Keeps object alive until every frame slot was passed to release, nullptr is ignored.
+			void retire(std::shared_ptr<void> object)
+			{
+				if (object != nullptr)
+					objects.push_back(retired_object{ std::move(object), all_frames });
+			}
+
+			//! Destroys the objects no frame in flight can read anymore, when frame slot is reused.
+			void release(uint32_t frame)
+			{
+				for (auto& retired : objects)
+					retired.pending_frames &= ~(uint64_t{ 1 } << frame);
+				objects.erase(std::remove_if(objects.begin(), objects.end(),
+					[](const retired_object& retired) { return retired.pending_frames == 0; }), objects.end());
+			}
+
+		private:
+			struct retired_object
+			{
+				std::shared_ptr<void> object;
+				//! Slots not reused since the object was retired.
+				uint64_t pending_frames;
+			};
+
+			static uint64_t get_frame_mask(uint32_t frame_count)
+			{
+				if (frame_count == 0 || frame_count > 64)
+					throw "retired_objects: frame_count must be in [1, 64]";
+				return frame_count == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << frame_count) - 1;
+			}
+
+			uint64_t all_frames;
+			std::vector<retired_object> objects;
+		};
+
+		//! Items read by compute passes, with a CPU writeable buffer per frame in flight.
+		/** A frame only writes the buffer of its own slot, which the GPU no longer reads once the previous frame
+		using the slot completed. Items changed by set are written to every buffer, each one by the next flush of
+		its frame. */
+		template<typename T>
+		class per_frame_storage
+		{
+		public:
+			//! Removes every item, the buffers are kept until the next upload.
+			void clear()
+			{
+				items.clear();
+				for (auto& indexes : dirty)
+					indexes.clear();
+			}
+
+			uint32_t push_back(const T& item)
+			{
+				items.push_back(item);
+				return static_cast<uint32_t>(items.size() - 1);
+			}
+
+			void set(uint32_t index, const T& item)
+			{
+				items[index] = item;
+				for (auto& indexes : dirty)
+					indexes.push_back(index);
+			}
+
+			const T& operator[](size_t index) const { return items[index]; }
+			size_t size() const { return items.size(); }
+			bool empty() const { return items.empty(); }
+			typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+			typename std::vector<T>::const_iterator end() const { return items.end(); }
+			//! Items can be changed in place before upload, set must be used afterward.
+			std::vector<T>& get_items() { return items; }
+
+			//! Creates frame_count buffers holding every item, the previous ones are kept in retired.
+			void upload(device_t& dev, uint32_t frame_count, const std::string& name, retired_objects& retired)
+			{
+				for (auto& buffer : buffers)
+					retired.retire(std::move(buffer));
+				buffers.clear();
+				dirty.assign(frame_count, {});
+				for (uint32_t frame = 0; frame < frame_count; frame++)
+				{
+					buffers.push_back(dev.create_buffer(get_buffer_size(), irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
+						usage_uav, memory_category::other, name));
+					memcpy(buffers.back()->map_buffer(), items.data(), items.size() * sizeof(T));
+					buffers.back()->unmap_buffer();
+				}
+			}
+
+			//! Writes the items changed since the last flush of frame to its buffer.
+			void flush(uint32_t frame)
+			{
+				if (frame >= buffers.size() || dirty[frame].empty())
+					return;
+				auto* data = static_cast<T*>(buffers[frame]->map_buffer());
+				for (const auto& index : dirty[frame])
+					data[index] = items[index];
+				buffers[frame]->unmap_buffer();
+				dirty[frame].clear();
+			}
+
+			buffer_t& get_buffer(uint32_t frame) const { return *buffers[frame]; }
+			uint32_t get_buffer_size() const { return get_storage_buffer_size<T>(items.size()); }
+
+		private:
+			std::vector<T> items;
+			std::vector<std::unique_ptr<buffer_t>> buffers;
+			//! Indexed by frame, items to write at its next flush.
+			std::vector<std::vector<uint32_t>> dirty;
+		};
+
+		//! Counters incremented by culling passes, T is a struct of uint32_t in the std430 layout of the shader.
+		/** The buffer is in uav state outside of reset and copy_to_readback. */
+		template<typename T>
+		class culling_counters
+		{
+		public:
+			//! With readback, copy_to_readback copies the counters to a CPU readable buffer.
+			/** The previous buffers are kept in retired. */
+			void create(device_t& dev, bool readback, const std::string& name, retired_objects& retired)
+			{
+				retired.retire(std::move(buffer));
+				retired.retire(std::move(readback_buffer));
+				buffer = dev.create_buffer(sizeof(T), irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL,
+					usage_uav | usage_buffer_transfer_dst | usage_buffer_transfer_src, memory_category::other, name);
+				if (readback)
+					readback_buffer = dev.create_buffer(sizeof(T), irr::video::E_MEMORY_POOL::EMP_CPU_READABLE,
+						usage_buffer_transfer_dst, memory_category::staging, name + " readback");
+			}
+
+			//! Zeroes the counters, before the first pass of a frame.
+			void reset(command_list_t& cmd_list)
+			{
+				cmd_list.set_buffer_barrier(*buffer, RESOURCE_USAGE::uav, RESOURCE_USAGE::COPY_DEST);
+				cmd_list.fill_buffer(*buffer, 0, sizeof(T), 0);
+				cmd_list.set_buffer_barrier(*buffer, RESOURCE_USAGE::COPY_DEST, RESOURCE_USAGE::uav);
+			}
+
+			//! After the last pass of a frame, does nothing without readback.
+			void copy_to_readback(command_list_t& cmd_list)
+			{
+				if (readback_buffer == nullptr)
+					return;
+				cmd_list.set_buffer_barrier(*buffer, RESOURCE_USAGE::uav, RESOURCE_USAGE::COPY_SRC);
+				cmd_list.copy_buffer(*buffer, 0, *readback_buffer, 0, sizeof(T));
+				cmd_list.set_buffer_barrier(*buffer, RESOURCE_USAGE::COPY_SRC, RESOURCE_USAGE::uav);
+			}
+
+			bool has_readback() const { return readback_buffer != nullptr; }
+			//! Counters of the last copy_to_readback, once its frame completed ; needs readback.
+			T read() const
+			{
+				T result;
+				memcpy(&result, readback_buffer->map_buffer(), sizeof(T));
+				readback_buffer->unmap_buffer();
+				return result;
+			}
+
+			buffer_t& get_buffer() const { return *buffer; }
+
+		private:
+			std::unique_ptr<buffer_t> buffer;
+			std::unique_ptr<buffer_t> readback_buffer;
+		};
+	}
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! First fit allocator of ranges of [0, capacity).
+		/** Free ranges are kept sorted by offset and merged with their neighbours on release, so that
+		releasing every allocation gives back a single range whatever the order. */
+		class range_allocator
+		{
+		public:
+			static const uint32_t invalid_offset = 0xffffffff;
+
+			explicit range_allocator(uint32_t capacity);
+
+			//! Returns invalid_offset if no free range is large enough, 0 for an empty range.
+			uint32_t allocate(uint32_t size);
+			void release(uint32_t offset, uint32_t size);
+			//! Adds [capacity, new_capacity) to the free ranges, new_capacity can't be smaller.
+			void grow(uint32_t new_capacity);
+
+			uint32_t get_capacity() const { return capacity; }
+			uint32_t get_free_size() const { return free_size; }
+			uint32_t get_largest_free_range() const;
+			size_t get_free_range_count() const { return free_ranges.size(); }
+
+		private:
+			uint32_t capacity;
+			uint32_t free_size;
+			//! Size of every free range, by offset.
+			std::map<uint32_t, uint32_t> free_ranges;
+		};
+
+		//! Vertex and index ranges of a mesh in a geometry_arena.
+		struct geometry_allocation
+		{
+			uint32_t first_vertex = 0;
+			uint32_t vertex_count = 0;
+			uint32_t first_index = 0;
+			uint32_t index_count = 0;
+		};
+
+		//! Layout of the vertex streams of a geometry_arena.
+		enum class vertex_format
+		{
+			//! 3 floats for positions, normals and texture coordinates, 36 bytes per vertex.
+			full,
+			//! 16 bits unorm positions in the bounds of their mesh, octahedral 2 x 16 bits snorm normals and
+			//! half float texture coordinates, 16 bytes per vertex. Decoded by object.vert.
+			compressed,
+		};
+
+		//! Streams of static meshes in a few large buffers, shared by every mesh asset.
+		/** Positions, normals and texture coordinates (3 floats each, like aiVector3D) and 16 bits indices
+		are sub-allocated from fixed capacity buffers. Indices are relative to the first vertex of their mesh,
+		draws pass first_vertex as base vertex. Since every mesh uses the same buffers they are bound once
+		and sorted draws never rebind them. */
+		class geometry_arena
+		{
+		public:
+			geometry_arena(device_t& dev, uint32_t vertex_capacity, uint32_t index_capacity,
+				vertex_format format = vertex_format::full);
+			~geometry_arena();
+
+			//! Throws if the arena is full.
+			geometry_allocation allocate(uint32_t vertex_count, uint32_t index_count);
+			void release(const geometry_allocation& allocation);
+
+			//! Pointers to the start of every stream, valid until unmap().
+			struct mapping
+			{
+				void* positions;
+				void* normals;
+				void* uv0;
+				uint16_t* indices;
+			};
+			mapping map();
+			void unmap();
+
+			buffer_t& get_index_buffer() const { return *index_buffer; }
+			uint32_t get_index_buffer_size() const { return index_capacity * sizeof(uint16_t); }
+			const std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t> >& get_vertex_buffers() const
+			{
+				return vertex_buffers_info;
+			}
+
+			vertex_format get_format() const { return format; }
+			//! Bytes per vertex of the position, normal and texture coordinates streams.
+			static std::tuple<uint32_t, uint32_t, uint32_t> get_strides(vertex_format format);
+			static uint32_t get_vertex_size(vertex_format format);
+
+			const range_allocator& get_vertex_ranges() const { return vertex_ranges; }
+			const range_allocator& get_index_ranges() const { return index_ranges; }
+
+		private:
+			vertex_format format;
+			uint32_t vertex_capacity;
+			uint32_t index_capacity;
+			range_allocator vertex_ranges;
+			range_allocator index_ranges;
+
+			std::unique_ptr<buffer_t> vertex_pos;
+			std::unique_ptr<buffer_t> vertex_normal;
+			std::unique_ptr<buffer_t> vertex_uv0;
+			std::unique_ptr<buffer_t> index_buffer;
+			std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t> > vertex_buffers_info;
+		};
+	}
+}
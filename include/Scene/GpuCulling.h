@@ -0,0 +1,163 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+#include <Scene/Culling.h>
+#include <Scene/CullingBuffers.h>
+#include <Scene/HiZ.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! A submesh draw in the draw records storage buffer, std430 layout of gpu_culling.comp.
+		struct gpu_draw_record
+		{
+			//! Object space bounds.
+			float center[3];
+			uint32_t instance;
+			float extents[3];
+			//! First slot of the batch in the arguments buffer.
+			uint32_t first_argument;
+			uint32_t index_count;
+			uint32_t first_index;
+			int32_t vertex_offset;
+			uint32_t batch;
+		};
+
+		//! Phases of occlusion culling in a frame.
+		enum class culling_phase
+		{
+			//! Draws visible at the end of the previous frame, before the depth pyramid is built.
+			early,
+			//! Draws tested against the depth pyramid built from the early draws.
+			late,
+		};
+
+		//! Counters of the culling passes of the last frame, std430 layout of gpu_culling.comp.
+		struct gpu_culling_statistics
+		{
+			uint32_t draws;
+			uint32_t triangles;
+		};
+
+		//! Frustum culling and draw compaction in a compute pass.
+		/** Draws are grouped in batches whose draws share every state but their index range ; the culling pass
+		appends the visible draws of a batch to its range of the arguments buffer and counts them, a batch is
+		then drawn by a single draw_indexed_indirect_count. Without VK_KHR_draw_indirect_count the arguments
+		are cleared before culling and every slot of the batch is drawn, culled ones with 0 instance.
+
+		Instance matrices, draw records and the frustum live in CPU writeable buffers, like the scene nodes constant
+		buffers, with a copy per frame in flight. Methods taking a frame write the copy of that slot, in
+		[0, frame_count), which must not be read by a frame still executing. Buffers and descriptor sets replaced
+		by upload are kept until release_retired was called for every slot. */
+		class gpu_culling
+		{
+		public:
+			gpu_culling(device_t& dev, uint32_t frame_count);
+			~gpu_culling();
+
+			//! Removes every instance, batch and draw.
+			void clear();
+			uint32_t add_instance(const glm::mat4& world);
+			uint32_t add_batch();
+			//! Returns the draw index for set_draw_range, invalid_draw for empty bounds that are never drawn.
+			uint32_t add_draw(uint32_t batch, uint32_t instance, const aabb& object_bounds, uint32_t index_count,
+				uint32_t first_index, int32_t vertex_offset);
+			//! Creates and fills the storage buffers, must be called after draws are added.
+			/** With readback, every culling pass copies its results to CPU readable buffers for validate(). */
+			void upload(device_t& dev, bool readback = false);
+			//! Destroys the objects replaced by upload that no frame in flight reads anymore, frame is the reused slot.
+			void release_retired(uint32_t frame);
+
+			void set_instance(uint32_t instance, const glm::mat4& world);
+			//! Writes the instances changed by set_instance to the instance buffer of frame.
+			void update_instances(uint32_t frame);
+			//! Changes the indices of a draw, for level of detail switches.
+			void set_draw_range(uint32_t draw, uint32_t index_count, uint32_t first_index);
+			//! Writes the draws changed by set_draw_range to the draw records buffer of frame.
+			void update_draws(uint32_t frame);
+
+			static const uint32_t invalid_draw = 0xffffffff;
+
+			//! Records the culling pass of frame, outside of a render pass.
+			void fill_culling_command(command_list_t& cmd_list, const frustum& view_frustum, uint32_t frame);
+
+			//! Tests draws against pyramid too, in two phases, must be called before upload().
+			/** The early phase draws what was visible at the end of the previous frame without occlusion test,
+			the pyramid is then built from their depth and the late phase tests every draw against it and draws
+			the ones that became visible, so that disoccluded objects never miss a frame. The visibility of a
+			draw is kept in a storage buffer between frames, every draw is visible on the first frame. */
+			void enable_occlusion_culling(device_t& dev, hi_z_pyramid& pyramid);
+			bool uses_occlusion_culling() const { return occlusion_pso != nullptr; }
+			//! Records a phase, outside of a render pass, the late one after the pyramid was built.
+			void fill_occlusion_culling_command(command_list_t& cmd_list, const frustum& view_frustum,
+				const glm::mat4& view_projection, culling_phase phase, uint32_t frame);
+			//! Draws and triangles of the last frame, once it completed, needs readback.
+			gpu_culling_statistics get_statistics() const;
+			//! Triangles of every draw, without culling.
+			uint64_t get_triangle_count() const;
+			//! Draws the visible draws of batch, its state must be bound.
+			void draw_batch(command_list_t& cmd_list, uint32_t batch);
+
+			size_t get_batch_count() const { return batch_sizes.size(); }
+			size_t get_draw_count() const { return draws.size(); }
+
+			//! Same computation as gpu_culling.comp on the CPU, for validation.
+			/** Arguments use the same slots, inside a batch they are in draw order while the GPU writes them in any order. */
+			void cull_reference(const frustum& view_frustum, std::vector<draw_indexed_indirect_arguments>& arguments,
+				std::vector<uint32_t>& counts) const;
+			//! Compares the result of the last culling pass, once it completed, with cull_reference.
+			/** Returns the number of batches whose visible draws differ. Boxes touching a plane may be
+			classified differently because of float precision. Not available with occlusion culling. */
+			size_t validate(const frustum& view_frustum) const;
+
+		private:
+			//! Allocates the descriptor sets of every culling input and of the occlusion input, retiring the previous ones.
+			void create_inputs(device_t& dev);
+			void reset_arguments(command_list_t& cmd_list);
+			void finish_arguments(command_list_t& cmd_list, bool copies_to_readback);
+			//! A dispatch of gpu_culling.comp, with the occlusion test once enabled.
+			void record_culling(command_list_t& cmd_list, const frustum& view_frustum, const glm::mat4& view_projection,
+				culling_phase phase, uint32_t frame);
+
+			std::unique_ptr<descriptor_set_layout> culling_set;
+			std::unique_ptr<pipeline_layout_t> culling_sig;
+			std::unique_ptr<compute_pipeline_state_t> culling_pso;
+			//! Holds the culling inputs and the occlusion input, which are bound together.
+			std::unique_ptr<descriptor_storage_t> heap;
+			uint32_t frame_count;
+			retired_objects retired;
+			//! Indexed by frame * 2 + culling_phase, only the constants differ between phases.
+			/** Allocated by upload. */
+			std::vector<std::unique_ptr<allocated_descriptor_set>> culling_inputs;
+
+			//! A slot of constant_data_stride bytes per culling input.
+			std::unique_ptr<buffer_t> constant_data;
+			std::unique_ptr<buffer_t> argument_buffer;
+			std::unique_ptr<buffer_t> count_buffer;
+			std::unique_ptr<buffer_t> argument_readback;
+			std::unique_ptr<buffer_t> count_readback;
+			culling_counters<gpu_culling_statistics> statistics;
+			bool uses_draw_count;
+
+			std::unique_ptr<descriptor_set_layout> occlusion_set;
+			std::unique_ptr<descriptor_set_layout> occlusion_sampler_set;
+			std::unique_ptr<pipeline_layout_t> occlusion_sig;
+			std::unique_ptr<compute_pipeline_state_t> occlusion_pso;
+			std::unique_ptr<descriptor_storage_t> occlusion_sampler_heap;
+			hi_z_pyramid* occlusion_pyramid = nullptr;
+			std::unique_ptr<allocated_descriptor_set> occlusion_input;
+			std::unique_ptr<allocated_descriptor_set> occlusion_sampler_input;
+			std::unique_ptr<sampler_t> nearest_sampler;
+			std::unique_ptr<buffer_t> visibility_buffer;
+
+			per_frame_storage<glm::mat4> instances;
+			per_frame_storage<gpu_draw_record> draws;
+			std::vector<uint32_t> batch_sizes;
+			//! Filled by upload().
+			std::vector<uint32_t> batch_first_arguments;
+		};
+	}
+}
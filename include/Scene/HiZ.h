@@ -0,0 +1,55 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Hierarchical depth buffer, every mipmap keeps the farthest depth of the texels it covers.
+		/** The first level is half the size of the depth buffer. The pyramid stores the raw depth so that
+		boxes projected with the view projection matrix are compared without linearization. */
+		class hi_z_pyramid
+		{
+		public:
+			//! depth_format is the format depth_buffer was created with.
+			hi_z_pyramid(device_t& dev, image_t& depth_buffer, irr::video::ECOLOR_FORMAT depth_format,
+				uint32_t depth_width, uint32_t depth_height);
+			~hi_z_pyramid();
+
+			//! Records the reduction of the depth buffer, outside of a render pass.
+			/** The depth buffer must be in DEPTH_WRITE state and is returned to it. */
+			void fill_command_list(command_list_t& cmd_list);
+
+			//! View of every level, in READ_GENERIC state once fill_command_list completed.
+			image_view_t& get_pyramid_view() { return *pyramid_view; }
+			uint32_t get_width() const { return width; }
+			uint32_t get_height() const { return height; }
+			uint32_t get_level_count() const { return level_count; }
+
+		private:
+			image_t& depth_buffer;
+			uint32_t width;
+			uint32_t height;
+			uint32_t level_count;
+
+			std::unique_ptr<descriptor_set_layout> reduce_set;
+			std::unique_ptr<descriptor_set_layout> sampler_set;
+			std::unique_ptr<pipeline_layout_t> reduce_sig;
+			std::unique_ptr<compute_pipeline_state_t> reduce_pso;
+			std::unique_ptr<descriptor_storage_t> heap;
+			std::unique_ptr<descriptor_storage_t> sampler_heap;
+			//! Reads level - 1, or the depth buffer, and writes level.
+			std::vector<std::unique_ptr<allocated_descriptor_set>> reduce_inputs;
+			std::unique_ptr<allocated_descriptor_set> sampler_input;
+			std::unique_ptr<sampler_t> nearest_sampler;
+
+			std::unique_ptr<image_view_t> depth_view;
+			std::unique_ptr<image_t> pyramid;
+			std::unique_ptr<image_view_t> pyramid_view;
+			std::vector<std::unique_ptr<image_view_t>> level_views;
+		};
+	}
+}
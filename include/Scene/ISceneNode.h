@@ -18,8 +18,8 @@
 #include <glm/vec3.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/euler_angles.hpp>
-#include <list>
 #include <string>
+#include <Scene/TransformSystem.h>
 //#include "IAttributes.h"
 
 namespace irr
@@ -28,10 +28,6 @@ namespace irr
 	{
 		class ISceneManager;
 
-		//! Typedef for list of scene nodes
-		class ISceneNode;
-		typedef std::list<ISceneNode*> ISceneNodeList;
-
 		//! Scene node interface.
 		/** A scene node is a node in the hierarchical scene graph. Every scene
 		node may have children, which are also scene nodes. Children move
@@ -66,6 +62,7 @@ namespace irr
 			{
 				// delete all children
 				removeAll();
+				remove();
 			}
 
 
@@ -87,9 +84,8 @@ namespace irr
 			{
 				if (IsVisible)
 				{
-					ISceneNodeList::iterator it = Children.begin();
-					for (; it != Children.end(); ++it)
-						(*it)->OnRegisterSceneNode();
+					for (auto child = FirstChild; child; child = child->NextSibling)
+						child->OnRegisterSceneNode();
 				}
 			}
 
@@ -109,9 +105,8 @@ namespace irr
 
 					// perform the post render process on all children
 
-					ISceneNodeList::iterator it = Children.begin();
-					for (; it != Children.end(); ++it)
-						(*it)->OnAnimate(timeMs);
+					for (auto child = FirstChild; child; child = child->NextSibling)
+						child->OnAnimate(timeMs);
 				}
 			}
 
@@ -174,6 +169,8 @@ namespace irr
 				  \return The absolute transformation matrix. */
 			virtual const glm::mat4& getAbsoluteTransformation() const
 			{
+				if (Transforms)
+					return Transforms->get_world_matrix(TransformId);
 				return AbsoluteTransformation;
 			}
 
@@ -233,7 +230,12 @@ namespace irr
 				if (child && (child != this))
 				{
 					child->remove(); // remove from old parent
-					Children.push_back(child);
+					child->PrevSibling = LastChild;
+					if (LastChild)
+						LastChild->NextSibling = child;
+					else
+						FirstChild = child;
+					LastChild = child;
 					child->Parent = this;
 				}
 			}
@@ -247,15 +249,20 @@ namespace irr
 			e.g. because it couldn't be found in the children list. */
 			virtual bool removeChild(ISceneNode* child)
 			{
-				ISceneNodeList::iterator it = Children.begin();
-				for (; it != Children.end(); ++it)
-					if ((*it) == child)
-					{
-						(*it)->Parent = 0;
-						Children.erase(it);
-						return true;
-					}
-				return false;
+				if (!child || child->Parent != this)
+					return false;
+				if (child->PrevSibling)
+					child->PrevSibling->NextSibling = child->NextSibling;
+				else
+					FirstChild = child->NextSibling;
+				if (child->NextSibling)
+					child->NextSibling->PrevSibling = child->PrevSibling;
+				else
+					LastChild = child->PrevSibling;
+				child->Parent = 0;
+				child->PrevSibling = 0;
+				child->NextSibling = 0;
+				return true;
 			}
 
 
@@ -265,13 +272,17 @@ namespace irr
 			*/
 			virtual void removeAll()
 			{
-				ISceneNodeList::iterator it = Children.begin();
-				for (; it != Children.end(); ++it)
+				for (auto child = FirstChild; child;)
 				{
-					(*it)->Parent = 0;
+					const auto next = child->NextSibling;
+					child->Parent = 0;
+					child->PrevSibling = 0;
+					child->NextSibling = 0;
+					child = next;
 				}
 
-				Children.clear();
+				FirstChild = 0;
+				LastChild = 0;
 			}
 
 
@@ -299,6 +310,8 @@ namespace irr
 			virtual void setScale(const glm::vec3& scale)
 			{
 				RelativeScale = scale;
+				if (Transforms)
+					Transforms->set_scale(TransformId, scale);
 			}
 
 
@@ -319,6 +332,8 @@ namespace irr
 			virtual void setRotation(const glm::vec3& rotation)
 			{
 				RelativeRotation = rotation;
+				if (Transforms)
+					Transforms->set_rotation(TransformId, rotation);
 			}
 
 
@@ -337,6 +352,8 @@ namespace irr
 			virtual void setPosition(const glm::vec3& newpos)
 			{
 				RelativeTranslation = newpos;
+				if (Transforms)
+					Transforms->set_translation(TransformId, newpos);
 			}
 
 			//! Gets the absolute position of the node in world coordinates.
@@ -350,7 +367,7 @@ namespace irr
 			\return The current absolute position of the scene node (updated on last call of updateAbsolutePosition). */
 			virtual glm::vec3 getAbsolutePosition() const
 			{
-				return glm::vec3(AbsoluteTransformation[3]);
+				return glm::vec3(getAbsoluteTransformation()[3]);
 			}
 
 
@@ -374,18 +391,18 @@ namespace irr
 				  }*/
 
 
-				  //! Returns a const reference to the list of all children.
-				  /** \return The list of all children of this node. */
-			const std::list<ISceneNode*>& getChildren() const
+				  //! Returns the first child, the others are reached with getNextSibling().
+				  /** \return The first child of this node, 0 if it has none. */
+			ISceneNode* getFirstChild() const
 			{
-				return Children;
+				return FirstChild;
 			}
 
-			//! Returns a reference to the list of all children.
-			/** \return The list of all children of this node. */
-			std::list<ISceneNode*>& getChildren()
+			//! Returns the next child of the parent of this node.
+			/** \return The next sibling, 0 for the last child. */
+			ISceneNode* getNextSibling() const
 			{
-				return Children;
+				return NextSibling;
 			}
 
 
@@ -407,6 +424,9 @@ namespace irr
 			hierarchy you might want to update the parents first.*/
 			virtual void updateAbsolutePosition()
 			{
+				// Done by transform_system::update()
+				if (Transforms)
+					return;
 				if (Parent)
 				{
 					AbsoluteTransformation =
@@ -424,6 +444,24 @@ namespace irr
 				return Parent;
 			}
 
+
+			//! Moves the transformations of the node to a transform system.
+			/** The parent must have been bound to the same system before, otherwise the node is a root
+			of the system. Absolute transformation is then updated by transform_system::update() and the
+			transform parent can't be changed anymore. */
+			void bindTransform(transform_system& transforms)
+			{
+				const auto parent_id = (Parent && Parent->Transforms == &transforms) ? Parent->TransformId : invalid_transform;
+				TransformId = transforms.add(parent_id, RelativeTranslation, RelativeRotation, RelativeScale);
+				Transforms = &transforms;
+			}
+
+			//! invalid_transform if the node is not bound to a transform system.
+			transform_id getTransformId() const
+			{
+				return TransformId;
+			}
+
 		protected:
 			//! Name of the scene node.
 			std::string Name;
@@ -443,14 +481,21 @@ namespace irr
 			//! Pointer to the parent
 			ISceneNode* Parent;
 
-			//! List of all children of this node
-			std::list<ISceneNode*> Children;
+			//! Children of this node, linked through their siblings so that adding and removing is O(1).
+			ISceneNode* FirstChild = 0;
+			ISceneNode* LastChild = 0;
+			ISceneNode* PrevSibling = 0;
+			ISceneNode* NextSibling = 0;
 
 			//! Automatic culling state
 	  //      u32 AutomaticCullingState;
 
 			//! Is the node visible?
 			bool IsVisible;
+
+			//! Owner of the transformations when not null, see bindTransform.
+			transform_system* Transforms = nullptr;
+			transform_id TransformId = invalid_transform;
 		};
 
 
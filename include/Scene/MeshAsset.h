@@ -0,0 +1,134 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+
+#pragma once
+
+#ifdef D3D12
+#include <API/d3dapi.h>
+#else
+#include <API/vkapi.h>
+#endif
+
+#include <assimp/scene.h>
+#include <tuple>
+#include <vector>
+#include <Scene/Culling.h>
+#include <Scene/GeometryArena.h>
+#include <Scene/MeshCache.h>
+#include <Scene/TextureCache.h>
+#include <Util/MeshOptimizer.h>
+#include <Util/Meshlets.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Index range of a submesh level of detail.
+		struct submesh_lod
+		{
+			uint32_t index_count;
+			uint32_t first_index;
+			//! Object space geometric error.
+			float error;
+		};
+
+		//! Geometry, levels of detail and materials of a model, shared by every scene node drawing it.
+		/** Submeshes share one index buffer and one set of vertex buffers, they only differ by their index
+		ranges and vertex offsets. Nodes referencing the same asset can be drawn with a single instanced draw
+		per submesh. */
+		class mesh_asset
+		{
+			//! Only set if no arena was given at construction.
+			std::unique_ptr<geometry_arena> own_arena;
+			geometry_arena* arena;
+			geometry_allocation allocation;
+
+			//! First vertex of every submesh.
+			std::vector<uint32_t> vertex_offsets;
+			std::vector<uint32_t> texture_mapping;
+			//! Only set if no texture cache was given at construction.
+			std::unique_ptr<texture_cache> own_textures;
+			std::vector<std::shared_ptr<const cached_texture> > Textures;
+			std::vector<std::unique_ptr<allocated_descriptor_set>> mesh_descriptor_set;
+			//! Generation of the texture view written in every material, see refresh_materials.
+			std::vector<uint32_t> material_generations;
+			//! Texture coordinate units per object space unit of every submesh, see get_submesh_uv_density.
+			std::vector<float> submesh_uv_densities;
+
+			//! Object space bounds of each submesh and of the whole mesh.
+			std::vector<aabb> submesh_bounds;
+			aabb bounds;
+			//! Object space position of a vertex is offset + position * scale, identity unless the arena is compressed.
+			glm::vec3 position_offset = glm::vec3(0.f);
+			glm::vec3 position_scale = glm::vec3(1.f);
+
+			//! Levels of detail of every submesh, generated at load time in the same index buffer, level 0 is the mesh.
+			std::vector<std::vector<submesh_lod> > submesh_lods;
+			//! Largest submesh error of every level, submeshes with fewer levels draw their last one.
+			std::vector<float> lod_errors;
+			//! Meshlets of level 0 of every submesh, index ranges are absolute in the index buffer.
+			std::vector<std::vector<meshlet> > submesh_meshlets;
+
+			//! Level 0 of every submesh, as imported and after welding and reordering.
+			vertex_cache_statistics unoptimized_cache_statistics;
+			vertex_cache_statistics cache_statistics;
+		public:
+			//! Uploads the cooked submeshes of mesh and loads their diffuse textures, recording the uploads in upload_cmd_list.
+			/** Vertex and index streams are copied as is from mesh, which can be released once constructed.
+			Geometry is allocated from shared_arena, which must outlive the asset, or from an arena of its own if
+			shared_arena is nullptr. Textures come from shared_textures, whose staging buffers must be kept until
+			upload_cmd_list was executed, or from a cache of its own. */
+			mesh_asset(device_t& dev, const ymesh& mesh, command_list_t& upload_cmd_list, descriptor_storage_t& heap,
+				descriptor_set_layout* model_set, geometry_arena* shared_arena = nullptr,
+				texture_cache* shared_textures = nullptr);
+			//! Cooks model in memory first, see ymesh and load_mesh to skip cooking on later runs.
+			/** Identical vertices are welded, triangles are ordered for the post-transform cache and overdraw and
+			vertices in their first use order, see MeshOptimizer.h, then level 0 is cut in meshlets, see Meshlets.h. */
+			mesh_asset(device_t& dev, const aiScene* model, command_list_t& upload_cmd_list, descriptor_storage_t& heap,
+				descriptor_set_layout* model_set, geometry_arena* shared_arena = nullptr,
+				texture_cache* shared_textures = nullptr);
+			~mesh_asset();
+
+			size_t get_submesh_count() const { return vertex_offsets.size(); }
+			const std::vector<aabb>& get_submesh_bounds() const { return submesh_bounds; }
+			//! Object space bounding box.
+			const aabb& get_bounds() const { return bounds; }
+			const glm::vec3& get_position_offset() const { return position_offset; }
+			const glm::vec3& get_position_scale() const { return position_scale; }
+
+			//! Index range of submesh at level, its last level if its chain is shorter.
+			const submesh_lod& get_lod(size_t submesh, size_t level) const;
+			const std::vector<float>& get_lod_errors() const { return lod_errors; }
+			//! Meshlets of at most 64 vertices and 124 triangles partitioning level 0 of submesh.
+			const std::vector<meshlet>& get_meshlets(size_t submesh) const { return submesh_meshlets[submesh]; }
+			const vertex_cache_statistics& get_unoptimized_cache_statistics() const { return unoptimized_cache_statistics; }
+			const vertex_cache_statistics& get_cache_statistics() const { return cache_statistics; }
+			int32_t get_vertex_offset(size_t submesh) const { return vertex_offsets[submesh]; }
+
+			//! Index in the materials of the material of submesh.
+			uint32_t get_material_index(size_t submesh) const { return texture_mapping[submesh]; }
+			size_t get_material_count() const { return mesh_descriptor_set.size(); }
+			const allocated_descriptor_set& get_material(uint32_t material) const { return *mesh_descriptor_set[material]; }
+			const cached_texture& get_material_texture(uint32_t material) const { return *Textures[material]; }
+			//! Writes the texture views replaced by texture_cache::stream to the materials.
+			/** Returns true if a material changed, command lists binding it must be recorded again. Call it while no
+			command list binding the materials is executing. */
+			bool refresh_materials(device_t& dev);
+			//! Square root of the ratio of texture coordinate area to object space area of level 0 of submesh.
+			/** A pixel covering pixels_per_unit object units covers get_submesh_uv_density / pixels_per_unit
+			texture coordinate units, see texture_cache::request_density. */
+			float get_submesh_uv_density(size_t submesh) const { return submesh_uv_densities[submesh]; }
+
+			const geometry_allocation& get_allocation() const { return allocation; }
+			buffer_t& get_index_buffer() const { return arena->get_index_buffer(); }
+			uint32_t get_index_buffer_size() const { return arena->get_index_buffer_size(); }
+			const std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t> >& get_vertex_buffers() const
+			{
+				return arena->get_vertex_buffers();
+			}
+		};
+
+		//! Diffuse texture file of every material of mesh, in material order.
+		std::vector<std::string> get_material_texture_paths(const ymesh& mesh);
+	}
+}
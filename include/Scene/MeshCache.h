@@ -0,0 +1,152 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <assimp/scene.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gsl/gsl>
+#include <Util/MappedFile.h>
+#include <Util/MeshOptimizer.h>
+#include <Util/Meshlets.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Files of another version are cooked again.
+		const uint32_t ymesh_version = 2;
+		//! Written in the byte order of the cooking machine, files from another byte order are cooked again.
+		const uint32_t ymesh_byte_order = 0x01020304;
+
+		//! Size and last modification time of a file, a cheap check before hashing it.
+		struct source_file_key
+		{
+			uint64_t size;
+			int64_t modification_time;
+		};
+
+		//! First bytes of a .ymesh file, offsets are from the start of the file and 16 bytes aligned.
+		/** Every stream covers the vertices or indices of all submeshes, in submesh order, so that it's copied
+		to a geometry_arena allocation at once. Values are in the byte order of the cooking machine, see
+		byte_order. */
+		struct ymesh_header
+		{
+			char magic[4];
+			uint32_t version;
+			//! ymesh_byte_order.
+			uint32_t byte_order;
+			uint32_t padding;
+			//! hash_file of the imported file.
+			uint64_t source_hash;
+			//! get_source_file_key of the imported file, the file is only hashed when it differs.
+			source_file_key source_key;
+			uint32_t vertex_count;
+			uint32_t index_count;
+			uint32_t submesh_count;
+			uint32_t lod_count;
+			uint32_t meshlet_count;
+			uint32_t material_count;
+			//! ymesh_submesh, ymesh_lod, meshlet and ymesh_material tables.
+			uint64_t submeshes;
+			uint64_t lods;
+			uint64_t meshlets;
+			uint64_t materials;
+			//! 3 floats per vertex each, the layout of vertex_format::full.
+			uint64_t positions;
+			uint64_t normals;
+			uint64_t uv0;
+			//! 16 bits indices, every level of detail of a submesh follows the previous one.
+			uint64_t indices;
+			vertex_cache_statistics unoptimized_cache_statistics;
+			vertex_cache_statistics cache_statistics;
+		};
+
+		struct ymesh_submesh
+		{
+			uint32_t material;
+			uint32_t vertex_count;
+			uint32_t first_lod;
+			uint32_t lod_count;
+			uint32_t first_meshlet;
+			uint32_t meshlet_count;
+			//! Object space bounds, min > max if the submesh is empty.
+			float bounds_min[3];
+			float bounds_max[3];
+		};
+
+		struct ymesh_lod
+		{
+			//! Relative to the first index of the mesh, like meshlet::first_index in the meshlet table.
+			uint32_t first_index;
+			uint32_t index_count;
+			//! Object space geometric error.
+			float error;
+		};
+
+		struct ymesh_material
+		{
+			//! Diffuse texture path as found in the imported file, not null terminated.
+			uint64_t diffuse_path;
+			uint32_t diffuse_path_size;
+			uint32_t padding;
+		};
+
+		//! A mesh whose submeshes were welded, reordered, simplified and cut in meshlets, ready for upload.
+		/** Either cooked from an Assimp scene in memory or mapped from a .ymesh file, the tables are read in
+		place in both cases. */
+		class ymesh
+		{
+			std::vector<char> bytes;
+			std::unique_ptr<mapped_file> file;
+			const char* data = nullptr;
+			size_t size = 0;
+
+			template<typename T>
+			gsl::span<const T> get_table(uint64_t offset, size_t count) const
+			{
+				return gsl::span<const T>(reinterpret_cast<const T*>(data + offset), count);
+			}
+			//! Validates the header and every table and range before they are read.
+			bool check() const;
+			bool check_source(const std::string& source_path) const;
+		public:
+			//! Optimizes every submesh of model, see mesh_asset.
+			ymesh(const aiScene& model, uint64_t source_hash = 0, const source_file_key& source_key = {});
+			//! Maps path, is_valid() is false unless it was cooked from the current content of source_path.
+			/** source_path is only hashed when its size or modification time changed since cooking, a missing
+			source_path accepts the file so that caches can be shipped alone. */
+			ymesh(const std::string& path, const std::string& source_path);
+
+			//! False if a mapped file is truncated, inconsistent, of another version or byte order, or from another
+			//! source.
+			bool is_valid() const { return data != nullptr; }
+			//! Writes the cooked mesh, returns false on failure.
+			/** The file is written under a temporary name and renamed to path, concurrent readers and writers never
+			see a partial file. */
+			bool save(const std::string& path) const;
+
+			const ymesh_header& get_header() const { return *reinterpret_cast<const ymesh_header*>(data); }
+			gsl::span<const ymesh_submesh> get_submeshes() const;
+			gsl::span<const ymesh_lod> get_lods(const ymesh_submesh& submesh) const;
+			gsl::span<const meshlet> get_meshlets(const ymesh_submesh& submesh) const;
+			std::string get_diffuse_path(uint32_t material) const;
+			const float* get_positions() const { return reinterpret_cast<const float*>(data + get_header().positions); }
+			const float* get_normals() const { return reinterpret_cast<const float*>(data + get_header().normals); }
+			const float* get_uv0() const { return reinterpret_cast<const float*>(data + get_header().uv0); }
+			const uint16_t* get_indices() const { return reinterpret_cast<const uint16_t*>(data + get_header().indices); }
+		};
+
+		//! 64 bits FNV-1a of the content of path, 8 bytes at a time.
+		uint64_t hash_file(const std::string& path);
+		//! Zero if path can't be read.
+		source_file_key get_source_file_key(const std::string& path);
+
+		//! Maps path + ".ymesh" if it was cooked from the current content of path, or if path doesn't exist.
+		/** Otherwise path is imported with Assimp and cooked, and the result is written next to it for the
+		next runs ; cooking still succeeds if the directory is read only. */
+		std::unique_ptr<ymesh> load_mesh(const std::string& path);
+	}
+}
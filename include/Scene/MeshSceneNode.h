@@ -15,36 +15,50 @@
 #include <assimp/scene.h>
 #include <tuple>
 #include <array>
+#include <functional>
+#include <memory>
 #include <unordered_map>
+#include <API/command_stream.h>
 #include <Core/SColor.h>
 //#include <Core/ISkinnedMesh.h>
 #include <Scene/ISceneNode.h>
+#include <Scene/Culling.h>
+#include <Scene/GpuCulling.h>
+#include <Scene/MeshletCulling.h>
+#include <Scene/MeshAsset.h>
 
 namespace irr
 {
 	namespace scene
 	{
+		//! Per instance data read by object.vert, std430 layout.
+		struct ObjectData
+		{
+			glm::mat4 ModelMatrix;
+			glm::mat4 InverseModelMatrix;
+			//! Dequantization of compressed positions, see mesh_asset::get_position_scale, w is unused.
+			glm::vec4 PositionScale;
+			glm::vec4 PositionOffset;
+		};
+
 		//! A scene node displaying a static mesh
 		class IMeshSceneNode : public ISceneNode
 		{
-			std::vector<std::tuple<uint32_t, uint32_t, uint32_t> > meshOffset;
-			std::vector<std::unique_ptr<buffer_t>> upload_buffers;
+			std::shared_ptr<mesh_asset> asset;
 
-			std::unique_ptr<buffer_t> vertex_pos;
-			std::unique_ptr<buffer_t> vertex_uv0;
-			std::unique_ptr<buffer_t> vertex_normal;
-			std::unique_ptr<buffer_t> index_buffer;
-			uint32_t total_index_cnt;
-			std::vector<std::tuple<buffer_t&, uint64_t, uint32_t, uint32_t> > vertex_buffers_info;
+			//! Storage buffer holding a single ObjectData, drawn as instance 0.
+			std::unique_ptr<buffer_t> object_matrix;
+			std::unique_ptr<allocated_descriptor_set> object_descriptor_set;
 
-			std::vector<uint32_t> texture_mapping;
-			std::vector<std::unique_ptr<image_view_t> > Textures_views;
-			std::vector<std::unique_ptr<image_t>> Textures;
+			pipeline_state_t* pipeline = nullptr;
 
-			std::unique_ptr<buffer_t> object_matrix;
+			//! Batch of gpu_culling or meshlet_culling and index in the asset materials of every material.
+			std::vector<std::pair<uint32_t, uint32_t> > gpu_batches;
+			//! gpu_culling draw of every submesh.
+			std::vector<uint32_t> gpu_draws;
 
-			std::unique_ptr<allocated_descriptor_set> object_descriptor_set;
-			std::vector<std::unique_ptr<allocated_descriptor_set>> mesh_descriptor_set;
+			//! Level of detail drawn, in the chains of the asset.
+			size_t lod = 0;
 		public:
 
 			//! Constructor
@@ -56,11 +70,57 @@ namespace irr
 				const glm::vec3& position = glm::vec3(0, 0, 0),
 				const glm::vec3& rotation = glm::vec3(0, 0, 0),
 				const glm::vec3& scale = glm::vec3(1.f, 1.f, 1.f));
+			//! Another instance of asset, buffers and materials are not copied.
+			IMeshSceneNode(device_t& dev, std::shared_ptr<mesh_asset> asset, descriptor_storage_t& heap,
+				descriptor_set_layout* object_set, ISceneNode* parent,
+				const glm::vec3& position = glm::vec3(0, 0, 0),
+				const glm::vec3& rotation = glm::vec3(0, 0, 0),
+				const glm::vec3& scale = glm::vec3(1.f, 1.f, 1.f));
 
 			~IMeshSceneNode();
 			void render() {}
 
 			void fill_draw_command(command_list_t& cmd_list, pipeline_layout_t& object_sig);
+			//! Records one self contained item per submesh, get_key gives the key of a submesh from its material.
+			/** Submeshes whose submesh_visibility value is 0 are skipped, all are drawn if it's nullptr. */
+			void fill_draw_items(command_stream& stream, pipeline_layout_t& object_sig,
+				const std::function<uint64_t(const allocated_descriptor_set& material)>& get_key,
+				const uint8_t* submesh_visibility = nullptr);
+
+			//! Adds a batch per material and a draw per submesh to culling.
+			void add_gpu_draws(gpu_culling& culling, uint32_t instance);
+			//! Draws the batches added by add_gpu_draws, once culling recorded its culling pass.
+			void fill_indirect_draw_command(command_list_t& cmd_list, pipeline_layout_t& object_sig, gpu_culling& culling);
+
+			//! Adds a batch per material and the meshlets of every submesh to culling, always at level 0.
+			void add_meshlet_draws(meshlet_culling& culling, uint32_t instance);
+			//! Draws the batches added by add_meshlet_draws, once culling recorded its culling pass and bound its indices.
+			void fill_meshlet_draw_command(command_list_t& cmd_list, pipeline_layout_t& object_sig,
+				meshlet_culling& culling);
+
+			//! Selects the level of detail from the number of pixels covered by an object space unit.
+			/** Returns true if the level changed, see select_lod in Util/MeshSimplifier.h. */
+			bool select_lod(float pixels_per_unit, float threshold, float hysteresis);
+			size_t getLod() const { return lod; }
+			size_t getLodCount() const { return asset->get_lod_errors().size(); }
+			//! Writes the index ranges of the current level to the draws added by add_gpu_draws.
+			void update_gpu_draws(gpu_culling& culling) const;
+			//! Triangles of the current level, and of level 0 in full_count.
+			size_t getTriangleCount(size_t& full_count) const;
+
+			const std::shared_ptr<mesh_asset>& getMeshAsset() const { return asset; }
+			size_t getSubmeshCount() const { return asset->get_submesh_count(); }
+			const std::vector<aabb>& getSubmeshBoundingBoxes() const { return asset->get_submesh_bounds(); }
+			//! Object space bounding box.
+			const aabb& getBoundingBox() const { return asset->get_bounds(); }
+
+			//! Pipeline bound before the node draws, nullptr keeps the one bound by the caller.
+			void setPipeline(pipeline_state_t* pso) { pipeline = pso; }
+			pipeline_state_t* getPipeline() const { return pipeline; }
+			//! Identifies the geometry (index and vertex buffers) for state sorting.
+			const buffer_t* getGeometry() const { return &asset->get_index_buffer(); }
+			//! Instance data of the current absolute transformation.
+			ObjectData getObjectData() const;
 			void update_constant_buffers(device_t& dev);
 		};
 
@@ -0,0 +1,142 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+#include <Scene/Culling.h>
+#include <Scene/CullingBuffers.h>
+#include <Scene/HiZ.h>
+#include <Util/Meshlets.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! A meshlet in the meshlet records storage buffer, std430 layout of meshlet_culling.comp.
+		struct gpu_meshlet_record
+		{
+			//! Object space bounding sphere.
+			float center[3];
+			float radius;
+			float cone_axis[3];
+			float cone_cutoff;
+			uint32_t instance;
+			//! Range of 16 bits indices in the source index buffer.
+			uint32_t first_index;
+			uint32_t index_count;
+			int32_t vertex_offset;
+			uint32_t batch;
+			//! First index of the batch in the output index buffer.
+			uint32_t first_output;
+			uint32_t padding[2];
+		};
+
+		//! Meshlets and triangles drawn by the last culling pass, std430 layout of meshlet_culling.comp.
+		struct meshlet_culling_statistics
+		{
+			uint32_t meshlets;
+			uint32_t triangles;
+		};
+
+		//! Culls meshlets in a compute pass and compacts the indices of the visible ones.
+		/** Every meshlet is tested against the frustum, its normal cone and optionally a depth pyramid, the
+		indices of a visible meshlet are copied with its vertex offset added to the range of its batch in a
+		32 bits index buffer. A batch is then drawn by a single draw_indexed_indirect whose index count was
+		accumulated by the culling pass, no mesh shader is needed and the vertex buffers are the usual ones.
+
+		Source indices are read from the 16 bits index buffer given to upload(), which needs usage_uav. The
+		cone test assumes that triangles facing away from the camera are hidden, which holds for closed meshes
+		or pipelines culling back faces ; it's skipped for instances with non uniform scale.
+
+		Instance matrices and the frustum have a copy per frame in flight, and objects replaced by upload are kept
+		until release_retired was called for every slot, as in gpu_culling. */
+		class meshlet_culling
+		{
+		public:
+			meshlet_culling(device_t& dev, uint32_t frame_count);
+			~meshlet_culling();
+
+			//! Removes every instance, batch and meshlet.
+			void clear();
+			uint32_t add_instance(const glm::mat4& world);
+			uint32_t add_batch();
+			//! Adds the meshlets of a submesh, their index ranges are in the index buffer given to upload().
+			void add_meshlets(uint32_t batch, uint32_t instance, const std::vector<meshlet>& meshlets,
+				int32_t vertex_offset);
+			//! Creates and fills the storage buffers, must be called after meshlets are added.
+			/** With readback, every culling pass copies its statistics to a CPU readable buffer. */
+			void upload(device_t& dev, buffer_t& index_buffer, uint32_t index_buffer_size, bool readback = false);
+			//! Destroys the objects replaced by upload that no frame in flight reads anymore, frame is the reused slot.
+			void release_retired(uint32_t frame);
+
+			void set_instance(uint32_t instance, const glm::mat4& world);
+			//! Writes the instances changed by set_instance to the instance buffer of frame.
+			void update_instances(uint32_t frame);
+
+			//! Also tests meshlets against pyramid, as built by the last fill_command_list before the culling pass.
+			/** The pyramid is usually built after the G-buffer pass from the depth of the previous frame, meshlets
+			are not tested until mark_pyramid_built was recorded once. Must be called before upload(). */
+			void enable_occlusion_culling(device_t& dev, hi_z_pyramid& pyramid);
+			bool uses_occlusion_culling() const { return occlusion_pso != nullptr; }
+			//! Records that the pyramid holds a depth buffer, after its fill_command_list.
+			void mark_pyramid_built(command_list_t& cmd_list);
+
+			//! Records the culling pass of frame, outside of a render pass.
+			/** The camera position for the cone test is derived from view_projection. */
+			void fill_culling_command(command_list_t& cmd_list, const frustum& view_frustum,
+				const glm::mat4& view_projection, uint32_t frame);
+			//! Binds the compacted indices, the vertex buffers of the meshlets must be bound too.
+			void bind_index_buffer(command_list_t& cmd_list);
+			//! Draws the visible meshlets of batch, its state and the compacted indices must be bound.
+			void draw_batch(command_list_t& cmd_list, uint32_t batch);
+
+			//! Meshlets and triangles of the last frame, once it completed, needs readback.
+			meshlet_culling_statistics get_statistics() const;
+			//! Triangles of every meshlet, without culling.
+			uint64_t get_triangle_count() const;
+			size_t get_meshlet_count() const { return meshlets.size(); }
+			size_t get_batch_count() const { return batch_sizes.size(); }
+
+		private:
+			//! Allocates the descriptor sets of every culling input and of the occlusion input, retiring the previous ones.
+			void create_inputs(device_t& dev);
+
+			std::unique_ptr<descriptor_set_layout> culling_set;
+			std::unique_ptr<pipeline_layout_t> culling_sig;
+			std::unique_ptr<compute_pipeline_state_t> culling_pso;
+			//! Holds the culling inputs and the occlusion input, which are bound together.
+			std::unique_ptr<descriptor_storage_t> heap;
+			uint32_t frame_count;
+			retired_objects retired;
+			//! Indexed by frame, allocated by upload.
+			std::vector<std::unique_ptr<allocated_descriptor_set>> culling_inputs;
+
+			//! A slot of constant_data_stride bytes per frame.
+			std::unique_ptr<buffer_t> constant_data;
+			std::unique_ptr<buffer_t> meshlet_buffer;
+			//! One draw_indexed_indirect_arguments per batch, reset from initial_arguments every frame.
+			std::unique_ptr<buffer_t> argument_buffer;
+			std::unique_ptr<buffer_t> initial_arguments;
+			std::unique_ptr<buffer_t> output_indices;
+			uint32_t output_index_count = 0;
+			culling_counters<meshlet_culling_statistics> statistics;
+
+			std::unique_ptr<descriptor_set_layout> occlusion_set;
+			std::unique_ptr<descriptor_set_layout> occlusion_sampler_set;
+			std::unique_ptr<pipeline_layout_t> occlusion_sig;
+			std::unique_ptr<compute_pipeline_state_t> occlusion_pso;
+			std::unique_ptr<descriptor_storage_t> occlusion_sampler_heap;
+			hi_z_pyramid* occlusion_pyramid = nullptr;
+			std::unique_ptr<allocated_descriptor_set> occlusion_input;
+			std::unique_ptr<allocated_descriptor_set> occlusion_sampler_input;
+			std::unique_ptr<sampler_t> nearest_sampler;
+			//! A single uint32_t, 0 until mark_pyramid_built.
+			std::unique_ptr<buffer_t> pyramid_state;
+
+			per_frame_storage<glm::mat4> instances;
+			std::vector<gpu_meshlet_record> meshlets;
+			//! Indices of every batch.
+			std::vector<uint32_t> batch_sizes;
+		};
+	}
+}
@@ -0,0 +1,64 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <API/GfxApi.h>
+#include <unordered_map>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! Fills the mipmaps of images from their first level with a compute shader.
+		/** A dispatch writes up to 5 levels of every layer, so 2D, array and cube images need
+		(mipmap_count + 3) / 5 dispatches. Texels are the average of the 2x2 texels of the previous level,
+		sRGB images are filtered as linear values. Images need usage_uav | usage_sampled and an uncompressed
+		float or unorm format, writing them without format qualifier needs the shaderStorageImageWriteWithoutFormat
+		feature in Vulkan. sRGB images need device_t::supports_srgb_storage_images(). */
+		class mipmap_generator
+		{
+		public:
+			mipmap_generator(device_t& dev);
+			~mipmap_generator();
+
+			//! True if images of format can be registered, sRGB formats depend on the device.
+			bool supports_format(irr::video::ECOLOR_FORMAT format) const;
+
+			//! Creates the views and descriptors used by generate_mips, throws for unsupported formats.
+			void add_image(image_t& image, irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height,
+				uint16_t mipmap_count, uint32_t layer_count);
+			void remove_image(image_t& image);
+
+			//! Records the generation of every level but the first one, outside of a render pass.
+			/** The first level of every layer must be in READ_GENERIC state, the whole image is in READ_GENERIC
+			state once the command list completed. */
+			void generate_mips(command_list_t& cmd_list, image_t& image);
+
+		private:
+			struct image_record
+			{
+				uint32_t width;
+				uint32_t height;
+				uint16_t mipmap_count;
+				uint32_t layer_count;
+				std::unique_ptr<descriptor_storage_t> heap;
+				std::unique_ptr<buffer_t> constant_data;
+				//! Sampled view of the source level of each dispatch.
+				std::vector<std::unique_ptr<image_view_t>> source_views;
+				//! Storage view of every level, without sRGB encoding.
+				std::vector<std::unique_ptr<image_view_t>> level_views;
+				std::vector<std::unique_ptr<allocated_descriptor_set>> inputs;
+			};
+
+			device_t& dev;
+			std::unique_ptr<descriptor_set_layout> generate_set;
+			std::unique_ptr<descriptor_set_layout> sampler_set;
+			std::unique_ptr<pipeline_layout_t> generate_sig;
+			std::unique_ptr<compute_pipeline_state_t> generate_pso;
+			std::unique_ptr<descriptor_storage_t> sampler_heap;
+			std::unique_ptr<allocated_descriptor_set> sampler_input;
+			std::unique_ptr<sampler_t> nearest_sampler;
+			std::unordered_map<const image_t*, image_record> images;
+		};
+	}
+}
@@ -6,29 +6,228 @@
 
 #include <Scene\ISceneNode.h>
 #include <Scene\MeshSceneNode.h>
+#include <Scene\BVH.h>
+#include <Scene\GeometryArena.h>
+#include <Scene\GpuCulling.h>
+#include <Scene\MeshletCulling.h>
+#include <API/command_stream.h>
+#include <Util/ObjectPool.h>
+#include <map>
 #include <memory>
+#include <unordered_map>
 
 namespace irr
 {
 	namespace scene
 	{
+		//! Triangles of the levels selected by Scene::select_lods and of the full detail meshes.
+		struct lod_statistics
+		{
+			size_t triangles = 0;
+			size_t full_triangles = 0;
+		};
+
+		//! Identifies a node of a Scene, stays invalid once the node is removed.
+		using scene_node_handle = pool_handle;
+
 		class Scene
 		{
 		private:
-			std::list<std::unique_ptr<irr::scene::IMeshSceneNode> > Nodes;
+			//! Nodes are constructed in place and never move, Scene keeps pointers to them.
+			object_pool<irr::scene::IMeshSceneNode> Nodes;
+			transform_system transforms;
+			//! Indexed by transform_id, nullptr for transforms not owned by a mesh node.
+			std::vector<irr::scene::IMeshSceneNode*> mesh_nodes_by_transform;
+			//! Indexed by transform_id, index of the node first submesh in world_bounds.
+			std::vector<uint32_t> first_bound_by_transform;
+
+			//! World space bounds of every submesh, updated with the transforms.
+			aabb_soa world_bounds;
+			std::vector<uint8_t> submesh_visibility;
+			//! Ranges of world_bounds owned by a node, freed ones are reused by the next added nodes.
+			range_allocator bound_ranges{ 0 };
+			frustum view_frustum;
+			glm::mat4 view_projection;
+			bool culling_enabled = false;
+			culling_statistics culling_stats;
+
+			//! Hierarchy over the world bounds of the mesh nodes, items are indexes in bvh_nodes.
+			bvh node_bvh;
+			std::vector<irr::scene::IMeshSceneNode*> bvh_nodes;
+			//! Indexed by transform_id, bvh::invalid_item until the first update of the node.
+			std::vector<uint32_t> bvh_item_by_transform;
+			//! Items of removed nodes, reused by the next inserted nodes.
+			std::vector<uint32_t> free_bvh_items;
+			std::vector<uint32_t> visible_items;
+
+			aabb get_world_bounds(const irr::scene::IMeshSceneNode& node) const;
+			//! Pixels covered by an object space unit of node at the closest point of its bounds.
+			float get_pixels_per_unit(const irr::scene::IMeshSceneNode& node, const glm::vec3& camera_position,
+				float projection_scale) const;
+
+			std::unique_ptr<gpu_culling> gpu_culler;
+			bool gpu_culling_readback = false;
+			//! Set when nodes were added since the last upload of the GPU draws.
+			bool gpu_draws_dirty = false;
+			//! Indexed by transform_id.
+			std::vector<uint32_t> gpu_instance_by_transform;
+			std::unique_ptr<hi_z_pyramid> occlusion_pyramid;
+			//! Replaces gpu_culler when set, see enable_meshlet_culling.
+			std::unique_ptr<meshlet_culling> meshlet_culler;
+
+			void upload_gpu_draws(device_t& dev);
+
+			//! ObjectData of the instances drawn by the recorded instanced draws, see enable_instancing.
+			std::unique_ptr<buffer_t> instance_buffer;
+			std::unique_ptr<allocated_descriptor_set> instance_descriptor_set;
+			uint32_t instance_capacity = 0;
+			//! Instance buffers replaced by reserve_instances, until frames in flight stopped reading them.
+			retired_objects retired_instance_buffers;
+			//! Indexed by transform_id, slot in instance_buffer or invalid_instance_slot if not drawn instanced.
+			std::vector<uint32_t> instance_slot_by_transform;
+			static const uint32_t invalid_instance_slot = 0xffffffff;
+			//! Visible nodes sharing an asset, a level of detail and a pipeline.
+			std::map<std::tuple<const mesh_asset*, size_t, pipeline_state_t*>, std::vector<irr::scene::IMeshSceneNode*> >
+				instance_groups;
+
+			void reserve_instances(device_t& dev);
+			void fill_instanced_draw_items(pipeline_layout_t& object_sig, const glm::vec3& camera_position,
+				float max_distance);
+
+			command_stream draw_stream;
+			command_stream_translator draw_translator;
+			//! Small ids of the pipelines, materials and geometries used in sort keys, one table per key field.
+			/** Rebuilt by every fill_gbuffer_filling_command so ids stay dense and never refer to removed objects. */
+			struct state_id_table
+			{
+				std::unordered_map<const void*, uint16_t> ids;
+				uint16_t max_id;
+			};
+			state_id_table pipeline_ids{ {}, sort_key::max_pipeline };
+			state_id_table material_ids{ {}, sort_key::max_material };
+			state_id_table geometry_ids{ {}, sort_key::max_geometry };
+			command_stream_statistics draw_statistics;
+			double gbuffer_recording_ms = 0.;
+
+			//! 0 for nullptr, objects past the capacity of the field share its last id.
+			static uint16_t get_state_id(state_id_table& table, const void* object);
+			IMeshSceneNode& register_mesh_node(IMeshSceneNode& node);
 		public:
 			Scene();
 			~Scene();
 
-			void update(device_t &dev);
-			void fill_gbuffer_filling_command(command_list_t& cmd_list, pipeline_layout_t& object_sig);
+			//! When false nodes record their draws in insertion order, without removing redundant binds.
+			bool sort_draws = true;
+			//! Largest simplification error of a selected level, in pixels.
+			float lod_threshold = 1.f;
+			//! Fraction of lod_threshold a node must gain before moving to a coarser level.
+			float lod_hysteresis = .2f;
+
+			//! Updates moved transforms and uploads the constant buffers of the nodes they belong to.
+			/** With GPU culling, frame is the slot of the frame in flight whose culling buffers are written, see
+			enable_gpu_culling. Buffers replaced after nodes were added or removed are kept until every slot was
+			updated again, so that frames still in flight can read them. */
+			void update(device_t &dev, uint32_t frame = 0);
+			//! camera_position is used to draw front to back inside a pipeline, material and geometry.
+			void fill_gbuffer_filling_command(command_list_t& cmd_list, pipeline_layout_t& object_sig,
+				const glm::vec3& camera_position = glm::vec3(0, 0, 0));
+			//! Selects the level of detail of every node from its distance to camera_position.
+			/** projection_scale converts a size at unit distance to pixels, projection[1][1] * viewport height / 2
+			for a perspective matrix. Command lists recorded before a level change must be recorded again, except
+			with GPU culling where the draws are updated by the next update(). */
+			lod_statistics select_lods(const glm::vec3& camera_position, float projection_scale);
+			//! Requests the texture levels every submesh needs from its distance to camera_position, see select_lods.
+			/** Once culling is enabled, only the submeshes drawn by the last fill_gbuffer_filling_command request
+			levels. Follow with texture_cache::stream and mesh_asset::refresh_materials. */
+			void request_texture_levels(texture_cache& textures, const glm::vec3& camera_position,
+				float projection_scale) const;
+
+			//! Submeshes outside of the frustum are skipped by the next fill_gbuffer_filling_command calls.
+			/** Only used when sort_draws is true. */
+			void set_view_frustum(const glm::mat4& view_projection);
+			void disable_culling() { culling_enabled = false; }
+			const culling_statistics& get_culling_statistics() const { return culling_stats; }
+
+			//! Culls in a compute pass and draws the G-buffer with indirect draws.
+			/** fill_gbuffer_filling_command then records one indirect draw per node material instead of one
+			draw per submesh, fill_gpu_culling_command must be recorded before its render pass. Adding nodes
+			reallocates the GPU buffers at the next update(), command lists must be recorded again. The buffers
+			written by the CPU have a copy per frame in flight : update and the culling commands take the slot of
+			the frame, in [0, frame_count), and a slot must not be reused before the frame that last used it
+			completed. */
+			void enable_gpu_culling(device_t& dev, bool readback = false, uint32_t frame_count = 2);
+			//! Culls meshlets in a compute pass and draws the G-buffer from their compacted indices.
+			/** Replaces enable_gpu_culling, fill_gbuffer_filling_command then records one indirect draw per
+			node material, always at level of detail 0. Every node must share the index buffer of a single
+			geometry_arena. With readback, the statistics of the last frame are available from
+			get_meshlet_culling. Frames in flight are handled as with enable_gpu_culling. */
+			void enable_meshlet_culling(device_t& dev, bool readback = false, uint32_t frame_count = 2);
+			meshlet_culling* get_meshlet_culling() { return meshlet_culler.get(); }
+			//! Culls against the frustum of set_view_frustum, outside of a render pass.
+			/** With occlusion culling this is the early phase. */
+			void fill_gpu_culling_command(command_list_t& cmd_list, uint32_t frame = 0);
+			//! Adds two phase occlusion culling against a pyramid built from depth_buffer, after enable_gpu_culling.
+			/** The G-buffer is then drawn twice per frame : fill_gbuffer_filling_command draws the early phase,
+			fill_occlusion_culling_command builds the pyramid outside of the render pass and culls the late
+			phase, and a render pass loading the G-buffer and depth draws it with fill_gbuffer_filling_command.
+			After enable_meshlet_culling there is a single phase : meshlets are tested against the pyramid of
+			the previous frame, which fill_occlusion_culling_command only builds. */
+			void enable_occlusion_culling(device_t& dev, image_t& depth_buffer, irr::video::ECOLOR_FORMAT depth_format,
+				uint32_t width, uint32_t height);
+			bool uses_occlusion_culling() const { return occlusion_pyramid != nullptr; }
+			void fill_occlusion_culling_command(command_list_t& cmd_list, uint32_t frame = 0);
+			gpu_culling* get_gpu_culling() { return gpu_culler.get(); }
+
+			//! Draws the visible nodes sharing a mesh asset with one instanced draw per submesh.
+			/** The instance data is gathered in a storage buffer bound to set 1 of object_sig, with the
+			object_set layout of the nodes. Submeshes are culled for the whole group, a submesh is drawn for
+			every visible instance if one of them sees it. Only used when sort_draws is true and without GPU
+			culling ; adding nodes may reallocate the buffer at the next update(), command lists must be
+			recorded again. The previous buffer is kept until update() was called for each of the frame_count
+			slots of the frames in flight, as with enable_gpu_culling. */
+			void enable_instancing(device_t& dev, descriptor_storage_t& heap, descriptor_set_layout* object_set,
+				uint32_t frame_count = 2);
+			bool uses_instancing() const { return instance_descriptor_set != nullptr; }
+			//! Number of batches whose last GPU culling result differs from the CPU reference, needs readback.
+			size_t validate_gpu_culling() const { return gpu_culler->validate(view_frustum); }
+
+			//! Counters of the last fill_gbuffer_filling_command call, zero when sort_draws is false.
+			const command_stream_statistics& get_draw_statistics() const { return draw_statistics; }
+			//! CPU time spent in the last fill_gbuffer_filling_command call.
+			double get_gbuffer_recording_time_ms() const { return gbuffer_recording_ms; }
+
+			transform_system& get_transforms() { return transforms; }
+
+			//! Rebuilds the node hierarchy with SAH, nodes added or moved since the last build are only refitted.
+			void rebuild_bvh();
+			void get_nodes_in_frustum(const glm::mat4& view_projection, std::vector<irr::scene::IMeshSceneNode*>& nodes) const;
+			//! One traversal for every view, nodes[i] receives the nodes visible from view_projections[i].
+			void get_nodes_in_frustums(gsl::span<const glm::mat4> view_projections,
+				gsl::span<std::vector<irr::scene::IMeshSceneNode*>> nodes) const;
+			void get_nodes_in_box(const aabb& box, std::vector<irr::scene::IMeshSceneNode*>& nodes) const;
+			//! Closest node whose bounding box is hit by the ray, nullptr if none.
+			/** distance is the maximum distance on input and the hit distance on output. */
+			irr::scene::IMeshSceneNode* pick(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+			const bvh& get_bvh() const { return node_bvh; }
 
-			irr::scene::IMeshSceneNode *addMeshSceneNode(
-				std::unique_ptr<irr::scene::IMeshSceneNode> &&mesh,
-				irr::scene::ISceneNode* parent,
-				const glm::vec3& position = glm::vec3(0, 0, 0),
-				const glm::vec3& rotation = glm::vec3(0, 0, 0),
-				const glm::vec3& scale = glm::vec3(1.f, 1.f, 1.f));
+			//! Constructs a node in the scene with the arguments of an IMeshSceneNode constructor.
+			/** The node parent, if any, must be a node of this scene added before. */
+			template<typename... Args>
+			scene_node_handle add_mesh_node(Args&&... args)
+			{
+				const auto handle = Nodes.emplace(std::forward<Args>(args)...);
+				register_mesh_node(*Nodes.get(handle));
+				return handle;
+			}
+			//! nullptr once the node was removed.
+			irr::scene::IMeshSceneNode* get_mesh_node(scene_node_handle handle) const { return Nodes.get(handle); }
+			//! Destroys the node, in constant time.
+			/** Its children are detached and become roots. Its transform and world bounds slots are reused by the next
+			added nodes, GPU draws are uploaded again by the next update(). */
+			void remove_mesh_node(scene_node_handle handle);
+			size_t get_mesh_node_count() const { return Nodes.size(); }
+			//! Slots of the submesh world bounds, free ones included.
+			size_t get_world_bound_slot_count() const { return world_bounds.size(); }
 		};
 
 	}
@@ -0,0 +1,177 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <API/GfxApi.h>
+#include <Scene/MipmapGenerator.h>
+#include <Scene/textures.h>
+
+namespace irr
+{
+	namespace scene
+	{
+		//! A texture of a texture_cache, shared by every holder of a handle to it.
+		struct cached_texture
+		{
+			std::unique_ptr<image_t> image;
+			//! Every resident mipmap level, face and layer, see create_texture_view.
+			std::unique_ptr<image_view_t> view;
+			//! Bytes of the resident levels.
+			uint64_t size;
+			//! Size and levels of the file, the image starts at resident_level, see texture_cache::enable_streaming.
+			uint32_t width;
+			uint32_t height;
+			uint16_t mipmap_count;
+			uint16_t resident_level = 0;
+			//! Incremented whenever stream replaces image and view.
+			uint32_t generation = 0;
+		};
+
+		//! A texture decoded by texture_cache::read.
+		struct read_texture
+		{
+			decoded_texture texture;
+			//! Hash of the texels, only computed when the cache deduplicates content.
+			uint64_t content_hash = 0;
+		};
+
+		struct texture_cache_statistics
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			//! Files whose content was already resident under another path.
+			uint64_t content_hits = 0;
+			uint64_t evictions = 0;
+			//! Bytes of texture data read by read, and the time spent reading them summed over the reading threads.
+			uint64_t read_bytes = 0;
+			double read_ms = 0.;
+			//! Uncompressed textures compressed by read, see enable_compression, and the time spent on it.
+			uint64_t compressed = 0;
+			double compression_ms = 0.;
+			//! Single level textures given a mipmap chain on upload, see enable_mipmap_generation.
+			uint64_t mipmapped = 0;
+			//! Bytes uploaded by stream, and bytes of the levels it dropped to stay in the budgets.
+			uint64_t streamed_bytes = 0;
+			uint64_t dropped_bytes = 0;
+		};
+
+		//! Textures of a device shared by path, a file is read and uploaded once however many assets use it.
+		/** Paths are made canonical first, with dedup_content files of identical content are shared too. Textures
+		stay resident while a handle references them, released ones are evicted least recently used first when the
+		cache goes over budget bytes or the device over its memory budget. read can be called from any thread and
+		concurrent reads of a path share a single file read ; get creates device objects and must be called from the
+		thread recording the uploads. */
+		class texture_cache
+		{
+			struct entry
+			{
+				std::shared_ptr<cached_texture> texture;
+				//! Until the uploads were executed, see release_staging_buffers.
+				std::unique_ptr<buffer_t> upload_buffer;
+				//! Until the uploads were executed, the image is registered in mipmaps.
+				bool generating_mipmaps = false;
+				//! Levels are uploaded from source by stream, see enable_streaming.
+				bool streamed = false;
+				decoded_texture source;
+				//! Finest level of at most streaming_extent texels, and the level asked for by the last stream call.
+				uint16_t tail_level = 0;
+				uint16_t wanted_level = 0;
+				//! Zero without dedup_content.
+				uint64_t content_hash;
+				//! Canonical paths resolving to this entry.
+				std::vector<std::string> paths;
+				//! Position in lru.
+				std::list<entry*>::iterator use;
+			};
+
+			device_t& dev;
+			uint64_t budget;
+			bool dedup_content;
+			file_access access;
+			bool compresses = false;
+			worker_pool* compression_workers = nullptr;
+			mipmap_generator* mipmaps = nullptr;
+			bool streams = false;
+			uint32_t streaming_extent = 0;
+			//! Finest level asked for every texture since the last stream call.
+			std::unordered_map<const cached_texture*, uint16_t> requested_levels;
+			//! Replaced by stream, kept until the recorded uploads were executed.
+			std::vector<std::unique_ptr<image_t>> retired_images;
+			std::vector<std::unique_ptr<image_view_t>> retired_views;
+			std::vector<std::unique_ptr<buffer_t>> streaming_buffers;
+
+			std::mutex mutex;
+			//! Reads started by read and not uploaded yet.
+			std::unordered_map<std::string, std::shared_future<read_texture>> in_flight;
+			std::vector<std::unique_ptr<entry>> entries;
+			std::unordered_map<std::string, entry*> by_path;
+			std::unordered_map<uint64_t, entry*> by_content;
+			//! Most recently used first.
+			std::list<entry*> lru;
+			uint64_t resident_size = 0;
+			//! read_bytes, read_ms, compressed and compression_ms are guarded by statistics_mutex, the other counters
+			//! by mutex.
+			texture_cache_statistics statistics;
+			//! Taken by read instead of mutex, so that a read never waits for a get blocked on it.
+			std::mutex statistics_mutex;
+
+			void touch(entry& e);
+			bool is_over_budget(uint64_t incoming_size);
+			//! Uploads levels level and coarser of a streamed entry to a new image, the previous one is retired.
+			void set_resident_level(entry& e, uint16_t level, command_list_t& upload_cmd_list);
+			//! Destroys the entry at use, returns the next position in lru.
+			std::list<entry*>::iterator remove(std::list<entry*>::iterator use);
+			//! Evicts released entries until incoming_size more bytes fit in the budgets.
+			void evict(uint64_t incoming_size);
+		public:
+			//! budget of 0 only evicts when the device memory budget is exceeded, files are read with access.
+			texture_cache(device_t& dev, uint64_t budget = 0, bool dedup_content = false,
+				file_access access = file_access::mapped);
+			texture_cache(const texture_cache&) = delete;
+			texture_cache& operator=(const texture_cache&) = delete;
+
+			//! Reads path on the calling thread unless it's resident, then the future is invalid, or already being read.
+			/** Callers reading the same path wait for the first one, the file is read once. With dedup_content the
+			content is hashed here too, so that get doesn't. */
+			std::shared_future<read_texture> read(const std::string& path);
+			//! Handle to the texture at path, read if needed and uploaded with upload_cmd_list on a miss.
+			std::shared_ptr<const cached_texture> get(const std::string& path, command_list_t& upload_cmd_list);
+			//! Textures with 8 bits channels are compressed by read to the format of choose_block_format.
+			/** Blocks of a texture are compressed by workers too if not nullptr. */
+			void enable_compression(worker_pool* workers = nullptr);
+			//! Textures with a single level of a format supported by generator get a full mipmap chain on upload.
+			/** generator must outlive the cache. Compressed textures already have their mipmaps. */
+			void enable_mipmap_generation(mipmap_generator& generator);
+			//! Textures read afterwards with a single layer and a mipmap chain only get their levels of at most initial_extent texels.
+			/** Finer levels are uploaded by stream once requested, and dropped again when the cache is over budget. Entries
+			keep their decoded texture to upload them, DDS files stay mapped. */
+			void enable_streaming(uint32_t initial_extent = 64);
+			//! Asks for the levels of texture needed when a pixel covers uv_per_pixel texture coordinate units.
+			/** The finest request since the last stream call wins, unrequested textures go back to their initial levels
+			when the cache needs room. */
+			void request_density(const cached_texture& texture, float uv_per_pixel);
+			//! Uploads the missing requested levels, most missing levels first, and drops unneeded ones to fit in the budgets.
+			/** Stops uploading once max_upload_bytes were recorded, 0 for no limit. Returns the textures whose image and view
+			were replaced : descriptors referencing them must be written again, see mesh_asset::refresh_materials, and the
+			previous images are kept until release_staging_buffers. */
+			std::vector<const cached_texture*> stream(command_list_t& upload_cmd_list, uint64_t max_upload_bytes = 0);
+			//! Frees the staging buffers, mipmap generation descriptors and images replaced by stream, call it once the
+			//! recorded uploads were executed.
+			void release_staging_buffers();
+			//! Evicts every texture without handles.
+			void trim();
+
+			uint64_t get_resident_size() const { return resident_size; }
+			size_t get_texture_count() const { return entries.size(); }
+			texture_cache_statistics get_statistics();
+		};
+	}
+}
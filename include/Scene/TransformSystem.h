@@ -0,0 +1,83 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_LEFT_HANDED
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstdint>
+#include <vector>
+#include <gsl/gsl>
+
+namespace irr
+{
+	namespace scene
+	{
+		using transform_id = uint32_t;
+		constexpr transform_id invalid_transform = ~0u;
+
+		//! Relative and absolute transformations of a hierarchy, stored as structure of arrays.
+		/** Ids of removed transforms are reused by the next add(), a parent may then have a larger id than its
+		children. Changing a transform marks it and its descendants dirty, update() only recomputes dirty transforms,
+		one hierarchy level after the other and in parallel inside a level. A frame without change costs nothing. */
+		class transform_system
+		{
+		public:
+			transform_id add(transform_id parent,
+				const glm::vec3& translation = glm::vec3(0, 0, 0),
+				const glm::vec3& rotation = glm::vec3(0, 0, 0),
+				const glm::vec3& scale = glm::vec3(1.f, 1.f, 1.f));
+			//! Frees id for a later add(), its children become roots and keep their local transformation.
+			void remove(transform_id id);
+
+			void set_translation(transform_id id, const glm::vec3& translation);
+			//! Euler angles in radians, applied in Y X Z order like ISceneNode.
+			void set_rotation(transform_id id, const glm::vec3& rotation);
+			void set_scale(transform_id id, const glm::vec3& scale);
+
+			const glm::vec3& get_translation(transform_id id) const { return translations[id]; }
+			const glm::vec3& get_rotation(transform_id id) const { return rotations[id]; }
+			const glm::vec3& get_scale(transform_id id) const { return scales[id]; }
+			transform_id get_parent(transform_id id) const { return parents[id]; }
+
+			//! Absolute transformation as of the last update().
+			const glm::mat4& get_world_matrix(transform_id id) const { return world_matrices[id]; }
+
+			//! Recomputes dirty transforms and returns how many were.
+			size_t update();
+
+			//! Transforms recomputed by the last update(), parents before children.
+			gsl::span<const transform_id> get_changed() const { return changed; }
+
+			//! Upper bound of the ids in use, free ids included.
+			size_t size() const { return parents.size(); }
+			size_t get_free_count() const { return free_ids.size(); }
+
+		private:
+			void mark_dirty(transform_id id);
+			//! Sets the level of id and of its descendants.
+			void set_level(transform_id id, uint32_t level);
+
+			// Per transform data, indexed by transform_id.
+			std::vector<glm::vec3> translations;
+			std::vector<glm::vec3> rotations;
+			std::vector<glm::vec3> scales;
+			std::vector<glm::mat4> local_matrices;
+			std::vector<glm::mat4> world_matrices;
+			std::vector<transform_id> parents;
+			std::vector<transform_id> first_children;
+			std::vector<transform_id> next_siblings;
+			std::vector<uint32_t> levels;
+			//! The world matrix has to be recomputed.
+			std::vector<uint8_t> dirty;
+			//! The local matrix has to be recomputed too.
+			std::vector<uint8_t> local_dirty;
+
+			std::vector<transform_id> dirty_list;
+			std::vector<transform_id> changed;
+			//! Removed ids, reused by add().
+			std::vector<transform_id> free_ids;
+		};
+	}
+}
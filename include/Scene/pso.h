@@ -5,6 +5,8 @@
 #include <API/GfxApi.h>
 
 std::unique_ptr<pipeline_state_t> get_skinned_object_pipeline_state(device_t& dev, pipeline_layout_t& layout, render_pass_t& rp);
+//! Same as get_skinned_object_pipeline_state for meshes of a vertex_format::compressed geometry_arena.
+std::unique_ptr<pipeline_state_t> get_compressed_object_pipeline_state(device_t& dev, pipeline_layout_t& layout, render_pass_t& rp);
 std::unique_ptr<pipeline_state_t> get_sunlight_pipeline_state(device_t& dev, pipeline_layout_t& layout, render_pass_t& rp);
 std::unique_ptr<pipeline_state_t> get_skybox_pipeline_state(device_t& dev, pipeline_layout_t& layout, render_pass_t& rp);
 std::unique_ptr<pipeline_state_t> get_ibl_pipeline_state(device_t& dev, pipeline_layout_t& layout, render_pass_t& rp);
@@ -8,5 +8,59 @@
 #include <array>
 #include <unordered_map>
 #include <API/GfxApi.h>
+#include <Util/MappedFile.h>
 
+class worker_pool;
+
+//! A texture file in memory, without any device object.
+struct decoded_texture
+{
+	std::string name;
+	//! Format of the image, every layer, face and level is stored in it.
+	irr::video::ECOLOR_FORMAT format;
+	uint32_t width;
+	uint32_t height;
+	uint16_t mipmap_count;
+	//! Array layers times faces.
+	uint16_t layer_count;
+	bool is_cubemap;
+	//! Tightly packed rows of texels or blocks of every level of every face of every layer, in this order.
+	const char* texels;
+	//! Bytes of texels.
+	uint64_t size;
+	//! Keeps the memory texels points to alive, a mapping of the file or a decoded copy.
+	std::shared_ptr<const void> storage;
+};
+
+//! Reads texture_name, can be called from any thread.
+/** DDS files are mapped with access and their header parsed in place, upload_texture copies their levels from the
+mapping straight to the staging buffer ; other files are read with gli. Pages of mappings are loaded here, so that
+the upload doesn't wait for the disk. DDS files without DX10 header don't tell whether they hold colors, with
+is_color the formats having an sRGB variant (BC1, BC2, BC3, BC7 and 8 bits RGBA) are read as sRGB. Throws on formats
+without ECOLOR_FORMAT and on volume textures. */
+decoded_texture decode_texture(const std::string& texture_name, bool is_color = true,
+	file_access access = file_access::mapped);
+//! Block format for an uncompressed texture with 8 bits channels, ECF_UNKNOWN for others.
+/** BC1 if every texel is opaque and BC3 otherwise for colors, keeping sRGB, BC4 for R8 and BC5 for R8G8 textures
+like normal maps. */
+irr::video::ECOLOR_FORMAT choose_block_format(const decoded_texture& texture);
+//! Compresses a texture with 8 bits channels to BC1, BC3, BC4 or BC5, see compress_blocks.
+/** Textures with a single level get a full mipmap chain, box filtered in linear space for sRGB formats. Rows of
+blocks are shared with workers if not nullptr, can be called from any thread. Throws for other formats. */
+decoded_texture compress_texture(const decoded_texture& texture, irr::video::ECOLOR_FORMAT format,
+	worker_pool* workers = nullptr);
+//! Bytes of a level of width x height texels, whole blocks for compressed formats.
+uint64_t get_level_size(irr::video::ECOLOR_FORMAT format, uint32_t width, uint32_t height);
+//! Levels of a mipmap chain going down to 1x1 texel.
+uint16_t get_full_mipmap_count(uint32_t width, uint32_t height);
+//! Creates the image and its staging buffer, recording the copies in upload_command_list.
+/** Uses the device, call it from the thread recording upload_command_list. The staging buffer must be kept until
+the copies were executed. If image_mipmap_count is greater than the texture levels, the image has that many levels
+and usage_uav, the ones without texels are left for a mipmap_generator to fill. */
+std::tuple<std::unique_ptr<image_t>, std::unique_ptr<buffer_t>> upload_texture(device_t& dev, const decoded_texture& texture, command_list_t& upload_command_list,
+	uint16_t image_mipmap_count = 0);
+//! View of every level, face and layer of an image created by upload_texture, cube or 2D array if several layers.
+/** mipmap_count is the image_mipmap_count given to upload_texture. */
+std::unique_ptr<image_view_t> create_texture_view(device_t& dev, image_t& image, const decoded_texture& texture,
+	uint16_t mipmap_count = 0);
 std::tuple<std::unique_ptr<image_t>, std::unique_ptr<buffer_t>> load_texture(device_t& dev, std::string &&texture_name, command_list_t& upload_command_list);
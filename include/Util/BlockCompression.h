@@ -0,0 +1,23 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <Core/SColor.h>
+
+class worker_pool;
+
+//! Compresses a width x height image of 8 bits RGBA texels, rows row_pitch bytes apart, to BC1, BC3, BC4 or BC5.
+/** Blocks are written in row major order, partial blocks on the right and bottom edges repeat the last texels.
+BC1 blocks are opaque, BC4 keeps the red channel and BC5 red and green. Endpoints follow the principal axis of the
+block and are refined with a least squares fit, texels are projected on them 4 or 8 at a time with SSE or AVX2.
+Rows of blocks are shared with workers if not nullptr. Throws for other formats. */
+void compress_blocks(irr::video::ECOLOR_FORMAT format, const uint8_t* texels, uint32_t width, uint32_t height,
+	size_t row_pitch, uint8_t* blocks, worker_pool* workers = nullptr);
+//! Decodes BC1, BC3, BC4 or BC5 blocks to tightly packed 8 bits RGBA texels, missing channels are 0 and alpha 255.
+void decompress_blocks(irr::video::ECOLOR_FORMAT format, const uint8_t* blocks, uint32_t width, uint32_t height,
+	uint8_t* texels);
+//! Peak signal to noise ratio in dB of tightly packed 8 bits RGBA images, over the channels set in channel_mask.
+/** Bit 0 is red, 3 is alpha. Infinite for identical images. */
+double compute_psnr(const uint8_t* reference, const uint8_t* texels, size_t texel_count, uint32_t channel_mask = 0xF);
@@ -0,0 +1,48 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <ostream>
+#include <vector>
+
+//! Collects per frame CPU times, used by samples running in headless mode.
+struct frame_statistics
+{
+	using clock = std::chrono::high_resolution_clock;
+
+	void begin_frame()
+	{
+		frame_start = clock::now();
+	}
+
+	void end_frame()
+	{
+		frame_times_ms.push_back(std::chrono::duration<double, std::milli>(clock::now() - frame_start).count());
+	}
+
+	//! The first frames are usually much slower (pipeline and driver caches warmup).
+	void print(std::ostream& out, size_t skipped_frames = 1) const
+	{
+		if (frame_times_ms.size() <= skipped_frames)
+		{
+			out << "No frame recorded" << std::endl;
+			return;
+		}
+		auto sorted = std::vector<double>(frame_times_ms.begin() + skipped_frames, frame_times_ms.end());
+		std::sort(sorted.begin(), sorted.end());
+		const auto total = std::accumulate(sorted.begin(), sorted.end(), 0.);
+		const auto average = total / sorted.size();
+		const auto p95 = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+		out << sorted.size() << " frames in " << total << " ms" << std::endl
+			<< "  min " << sorted.front() << " ms, avg " << average << " ms, p95 " << p95
+			<< " ms, max " << sorted.back() << " ms" << std::endl
+			<< "  " << 1000. / average << " fps" << std::endl;
+	}
+
+	std::vector<double> frame_times_ms;
+private:
+	clock::time_point frame_start;
+};
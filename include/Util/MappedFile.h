@@ -0,0 +1,46 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//! How mapped_file brings a file in memory.
+enum class file_access
+{
+	//! Pages are loaded by the OS on first access, from its cache if the file was read recently.
+	mapped,
+	//! The whole file is read at construction with large reads bypassing the OS cache, faster for files that
+	//! aren't cached yet.
+	direct_read,
+};
+
+//! Read only memory mapping of a whole file.
+class mapped_file
+{
+	const char* bytes = nullptr;
+	size_t byte_count = 0;
+	file_access access;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int descriptor = -1;
+#endif
+
+public:
+	//! Throws if path can't be opened or read, an empty file maps to nullptr.
+	/** direct_read falls back to buffered reads on file systems without unbuffered IO. */
+	mapped_file(const std::string& path, file_access access = file_access::mapped);
+	~mapped_file();
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	const char* data() const { return bytes; }
+	size_t size() const { return byte_count; }
+	//! Loads every page of a mapping on the calling thread, so that later accesses don't wait for the disk.
+	void prefetch() const;
+
+	//! False if path can't be opened, without throwing.
+	static bool exists(const std::string& path);
+};
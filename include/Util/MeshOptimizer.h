@@ -0,0 +1,56 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! Post-transform vertex cache efficiency of a triangle list, simulated with a FIFO cache.
+struct vertex_cache_statistics
+{
+	uint32_t triangles = 0;
+	//! Distinct vertices referenced by the indices.
+	uint32_t vertices = 0;
+	//! Vertices transformed by the vertex shader.
+	uint32_t misses = 0;
+
+	//! Average cache miss ratio, transformed vertices per triangle : 3 at worst, around 0.5 for regular meshes.
+	float get_acmr() const { return triangles == 0 ? 0.f : static_cast<float>(misses) / triangles; }
+	//! Average transform to vertex ratio, 1 if every vertex is transformed once.
+	float get_atvr() const { return vertices == 0 ? 0.f : static_cast<float>(misses) / vertices; }
+
+	vertex_cache_statistics& operator+=(const vertex_cache_statistics& other)
+	{
+		triangles += other.triangles;
+		vertices += other.vertices;
+		misses += other.misses;
+		return *this;
+	}
+};
+
+vertex_cache_statistics analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+	size_t cache_size = 16);
+
+//! Maps vertices whose vertex_size floats are bitwise identical to a single vertex.
+/** New indices follow the first occurrence of every vertex, unique_vertex_count receives their count. */
+std::vector<uint32_t> weld_vertices(const float* vertices, size_t vertex_count, size_t vertex_size,
+	size_t& unique_vertex_count);
+
+//! Reorders triangles so that they reuse the vertices in the post-transform cache (Tipsify).
+/** Triangles are emitted in fans around vertices chosen to stay in a FIFO of cache_size entries, dead ends
+restart from recently used vertices with remaining triangles. Linear in the index count. */
+std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count,
+	size_t cache_size = 16);
+
+//! Reorders clusters of a vertex cache optimized triangle list to reduce overdraw from any view point.
+/** The list is cut where the cache is cold anyway, and where starting cold keeps the cluster cache miss ratio
+below threshold times the original one. Clusters facing away from the mesh center come first since they are
+the most likely to occlude the others. positions are 3 floats every position_stride bytes. */
+std::vector<uint32_t> optimize_overdraw(const std::vector<uint32_t>& indices, const float* positions,
+	size_t position_stride, size_t vertex_count, size_t cache_size = 16, float threshold = 1.05f);
+
+//! Renumbers vertices in the order of their first use by indices, which are rewritten.
+/** Returns the new index of every vertex, ~0u for vertices no index references. */
+std::vector<uint32_t> optimize_vertex_fetch(std::vector<uint32_t>& indices, size_t vertex_count,
+	size_t& used_vertex_count);
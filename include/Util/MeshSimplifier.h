@@ -0,0 +1,52 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! Vertex data read by simplify_mesh, nothing is written.
+struct simplifier_mesh
+{
+	//! 3 floats every position_stride bytes.
+	const float* positions = nullptr;
+	size_t position_stride = 3 * sizeof(float);
+	size_t vertex_count = 0;
+	//! Optional, attribute_weights.size() floats every attribute_stride bytes (normals, texture coordinates...).
+	const float* attributes = nullptr;
+	size_t attribute_stride = 0;
+	std::vector<float> attribute_weights;
+};
+
+//! A level of detail, errors are relative to the largest side of the mesh bounding box.
+struct mesh_lod
+{
+	std::vector<uint32_t> indices;
+	float error;
+};
+
+//! Quadric error metric simplification of a triangle list.
+/** Edges are collapsed to one of their vertices so the result indexes a subset of the original vertices and
+can share their vertex buffer. Vertices sharing a position with different attributes (UV seams, hard edges)
+only move along the seam, together; border vertices only move along the border and vertices where more than
+two attribute sets meet never move. Attribute differences between merged vertices are added to the
+geometric error with attribute_weights.
+
+Stops when the index count reaches target_index_count or when the next collapse would exceed target_error,
+relative to the largest side of the bounding box. result_error receives the error of the returned mesh. */
+std::vector<uint32_t> simplify_mesh(const simplifier_mesh& mesh, const std::vector<uint32_t>& indices,
+	size_t target_index_count, float target_error, float* result_error = nullptr);
+
+//! Level 0 is indices, every next level targets ratio times the indices of the previous one.
+/** Levels are simplified from the original mesh so that their errors are measured against it. The chain
+stops after level_count levels, when max_error is reached or when simplification stalls. */
+std::vector<mesh_lod> build_lod_chain(const simplifier_mesh& mesh, const std::vector<uint32_t>& indices,
+	size_t level_count = 5, float ratio = .5f, float max_error = .05f);
+
+//! Index of the coarsest level whose error projected on screen stays below threshold.
+/** errors are increasing and pixels_per_unit converts an error to pixels at the object distance. Moving to a
+coarser level requires its error to be below threshold * (1 - hysteresis), so that a node near a switching
+distance doesn't alternate between levels every frame. */
+size_t select_lod(const std::vector<float>& errors, size_t current_level, float pixels_per_unit, float threshold,
+	float hysteresis);
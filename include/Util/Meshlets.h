@@ -0,0 +1,34 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! A contiguous range of a triangle list referencing few vertices, culled as a whole.
+struct meshlet
+{
+	//! Range in the triangle list given to build_meshlets.
+	uint32_t first_index;
+	uint32_t index_count;
+	//! Distinct vertices referenced by the range.
+	uint32_t vertex_count;
+
+	//! Object space bounding sphere.
+	float center[3];
+	float radius;
+
+	//! Average normal of the triangles, every triangle faces away from a camera for which
+	/** dot(center - camera, cone_axis) >= cone_cutoff * length(center - camera) + radius.
+	cone_cutoff is the sine of the cone half angle, 1 if the normals spread too much for the test to succeed. */
+	float cone_axis[3];
+	float cone_cutoff;
+};
+
+//! Cuts a triangle list into meshlets of at most max_vertices vertices and max_triangles triangles.
+/** Triangles are kept in order, a meshlet ends when the next triangle doesn't fit, so a cache optimized list
+gives meshlets of neighbouring triangles. positions and normals are 3 floats every stride bytes ; face normals
+are oriented like the vertex normals rather than by the winding, normals may be nullptr to use the winding. */
+std::vector<meshlet> build_meshlets(const std::vector<uint32_t>& indices, const float* positions,
+	const float* normals, size_t stride, size_t vertex_count, size_t max_vertices = 64, size_t max_triangles = 124);
@@ -0,0 +1,171 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+//! Reference to an object of an object_pool, detects objects removed since it was created.
+struct pool_handle
+{
+	uint32_t index = ~0u;
+	uint32_t generation = 0;
+
+	bool operator==(const pool_handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const pool_handle& other) const { return !(*this == other); }
+};
+
+//! Objects of a single type allocated in fixed size slabs.
+/** Objects never move so pointers to them stay valid until they are removed. emplace and remove are O(1) : removed
+slots go to a free list and are reused by the next emplace, their generation is incremented so that handles to the
+removed object become invalid. Iteration visits the live objects in slot order, which is contiguous memory inside
+a slab. Not thread safe. */
+template<typename T, size_t slab_size = 64>
+class object_pool
+{
+	struct slab
+	{
+		alignas(T) unsigned char storage[slab_size * sizeof(T)];
+	};
+
+	std::vector<std::unique_ptr<slab>> slabs;
+	std::vector<uint32_t> generations;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> free_slots;
+	size_t count = 0;
+
+	T* slot(uint32_t index) const
+	{
+		return reinterpret_cast<T*>(slabs[index / slab_size]->storage) + index % slab_size;
+	}
+
+public:
+	object_pool() = default;
+	object_pool(const object_pool&) = delete;
+	object_pool& operator=(const object_pool&) = delete;
+
+	~object_pool()
+	{
+		clear();
+	}
+
+	template<typename... Args>
+	pool_handle emplace(Args&&... args)
+	{
+		uint32_t index;
+		if (!free_slots.empty())
+		{
+			index = free_slots.back();
+			free_slots.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(generations.size());
+			if (index % slab_size == 0)
+				slabs.push_back(std::make_unique<slab>());
+			generations.push_back(0);
+			alive.push_back(0);
+		}
+		// The slot is only marked used once the constructor succeeded.
+		try
+		{
+			new (slot(index)) T(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			free_slots.push_back(index);
+			throw;
+		}
+		alive[index] = 1;
+		count++;
+		return pool_handle{ index, generations[index] };
+	}
+
+	//! Destroys the object, does nothing if handle is not valid anymore.
+	void remove(pool_handle handle)
+	{
+		if (!is_valid(handle))
+			return;
+		alive[handle.index] = 0;
+		generations[handle.index]++;
+		count--;
+		slot(handle.index)->~T();
+		free_slots.push_back(handle.index);
+	}
+
+	void clear()
+	{
+		for (uint32_t index = 0; index < alive.size(); index++)
+		{
+			if (!alive[index])
+				continue;
+			remove(pool_handle{ index, generations[index] });
+		}
+	}
+
+	bool is_valid(pool_handle handle) const
+	{
+		return handle.index < alive.size() && alive[handle.index] && generations[handle.index] == handle.generation;
+	}
+
+	//! nullptr if the object was removed.
+	T* get(pool_handle handle) const
+	{
+		return is_valid(handle) ? slot(handle.index) : nullptr;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	template<typename Pool, typename Value>
+	class basic_iterator
+	{
+		Pool* pool;
+		uint32_t index;
+
+		void skip_free_slots()
+		{
+			while (index < pool->alive.size() && !pool->alive[index])
+				index++;
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Value*;
+		using reference = Value&;
+
+		basic_iterator(Pool* p, uint32_t i) : pool(p), index(i) { skip_free_slots(); }
+
+		reference operator*() const { return *pool->slot(index); }
+		pointer operator->() const { return pool->slot(index); }
+		basic_iterator& operator++()
+		{
+			index++;
+			skip_free_slots();
+			return *this;
+		}
+		basic_iterator operator++(int)
+		{
+			auto result = *this;
+			++*this;
+			return result;
+		}
+		bool operator==(const basic_iterator& other) const { return index == other.index; }
+		bool operator!=(const basic_iterator& other) const { return index != other.index; }
+	};
+
+	using iterator = basic_iterator<object_pool, T>;
+	using const_iterator = basic_iterator<const object_pool, const T>;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, static_cast<uint32_t>(alive.size())); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, static_cast<uint32_t>(alive.size())); }
+};
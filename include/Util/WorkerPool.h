@@ -0,0 +1,37 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fixed set of threads running queued tasks in submission order.
+/** Tasks must not throw, they report their errors themselves. submit is thread safe. */
+class worker_pool
+{
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable task_added;
+	bool stopping = false;
+
+	void run();
+public:
+	//! thread_count of 0 starts one thread per hardware thread.
+	worker_pool(size_t thread_count = 0);
+	//! Waits for the running tasks, tasks not started yet are dropped.
+	~worker_pool();
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator=(const worker_pool&) = delete;
+
+	void submit(std::function<void()> task);
+	//! Runs f(i) for every i below count on the workers and the calling thread, returns once every call returned.
+	/** The calling thread takes part, so a task can call it on its own pool without deadlocking. f must not throw. */
+	void parallel_for(size_t count, std::function<void(size_t)> f);
+	size_t get_thread_count() const { return workers.size(); }
+};
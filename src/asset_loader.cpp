@@ -0,0 +1,145 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/AssetLoader.h>
+#include <algorithm>
+
+namespace irr {
+namespace scene {
+asset_loader::asset_loader(device_t &_dev, descriptor_storage_t &_heap,
+                           descriptor_set_layout *_model_set,
+                           geometry_arena *shared_arena,
+                           texture_cache *shared_textures, size_t thread_count)
+    : dev(_dev), heap(_heap), model_set(_model_set), arena(shared_arena),
+      textures(shared_textures), workers(thread_count) {
+  if (textures == nullptr) {
+    own_textures = std::make_unique<texture_cache>(dev);
+    textures = own_textures.get();
+  }
+}
+
+std::shared_ptr<const ymesh> asset_loader::get_mesh(const std::string &path) {
+  std::promise<std::shared_ptr<const ymesh>> promise;
+  std::shared_future<std::shared_ptr<const ymesh>> result;
+  bool loads = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto &loading = loading_meshes.find(path);
+    if (loading != loading_meshes.end()) {
+      result = loading->second;
+    } else {
+      result = promise.get_future().share();
+      loading_meshes.emplace(path, result);
+      loads = true;
+    }
+  }
+  // The worker loading it already runs, waiting for it can't starve the pool.
+  // The lock is released first, that worker takes it once done.
+  if (!loads)
+    return result.get();
+  try {
+    promise.set_value(load_mesh(path));
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+  {
+    // Later loads map the cooked file.
+    std::lock_guard<std::mutex> lock(mutex);
+    loading_meshes.erase(path);
+  }
+  return result.get();
+}
+
+void asset_loader::load(
+    const std::string &path,
+    std::function<void(std::shared_ptr<mesh_asset>)> on_resident) {
+  auto r = std::make_shared<request>();
+  r->path = path;
+  r->on_resident = std::move(on_resident);
+  r->start = clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_count++;
+  }
+  workers.submit([this, r]() {
+    const auto decoding_start = clock::now();
+    try {
+      r->mesh = get_mesh(r->path);
+      // Read errors are rethrown by texture_cache::get.
+      for (const auto &texture_path : get_material_texture_paths(*r->mesh))
+        textures->read(texture_path);
+    } catch (...) {
+      r->error = std::current_exception();
+    }
+    r->decoding_ms =
+        std::chrono::duration<double, std::milli>(clock::now() - decoding_start)
+            .count();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      decoded.push_back(r);
+    }
+    request_decoded.notify_all();
+  });
+}
+
+size_t asset_loader::process_loaded(command_list_t &upload_cmd_list,
+                                    size_t max_assets) {
+  // Uploads recorded by the previous call were submitted since then, they run
+  // before any later submission of the queue.
+  for (const auto &r : uploading) {
+    statistics.push_back(asset_load_statistics{
+        r->path, r->decoding_ms,
+        std::chrono::duration<double, std::milli>(clock::now() - r->start)
+            .count()});
+    r->on_resident(std::move(r->asset));
+  }
+  std::vector<std::shared_ptr<request>> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_count -= uploading.size();
+    const auto count = std::min(max_assets, decoded.size());
+    ready.assign(decoded.begin(), decoded.begin() + count);
+    decoded.erase(decoded.begin(), decoded.begin() + count);
+  }
+  uploading.clear();
+
+  std::exception_ptr error;
+  for (const auto &r : ready) {
+    if (r->error) {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending_count--;
+      if (!error)
+        error = r->error;
+      continue;
+    }
+    try {
+      r->asset = std::make_shared<mesh_asset>(
+          dev, *r->mesh, upload_cmd_list, heap, model_set, arena, textures);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending_count--;
+      if (!error)
+        error = std::current_exception();
+      continue;
+    }
+    // The streams were copied to the arena.
+    r->mesh.reset();
+    uploading.push_back(r);
+  }
+  if (error)
+    std::rethrow_exception(error);
+  return uploading.size();
+}
+
+void asset_loader::wait_for_decoded() {
+  std::unique_lock<std::mutex> lock(mutex);
+  request_decoded.wait(lock, [this]() {
+    return !decoded.empty() || pending_count == uploading.size();
+  });
+}
+
+bool asset_loader::is_idle() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending_count == 0;
+}
+}
+}
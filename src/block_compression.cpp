@@ -0,0 +1,560 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\BlockCompression.h>
+#include <Util\WorkerPool.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define YAGF_AVX2_BLOCK_COMPRESSION
+#define YAGF_SSE_BLOCK_COMPRESSION
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define YAGF_SSE_BLOCK_COMPRESSION
+#endif
+
+namespace {
+// Channels of the 16 texels of a block, in row major order.
+struct block_texels {
+  alignas(32) float channels[4][16];
+};
+
+alignas(32) const float ones[16] = {1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f,
+                                    1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+
+void load_block(const uint8_t *texels, uint32_t width, uint32_t height,
+                size_t row_pitch, uint32_t block_x, uint32_t block_y,
+                block_texels &block) {
+  if (block_x * 4 + 4 <= width && block_y * 4 + 4 <= height) {
+    for (uint32_t y = 0; y < 4; y++) {
+      const auto row = texels + (block_y * 4 + y) * row_pitch + block_x * 16;
+      for (uint32_t i = 0; i < 16; i++)
+        block.channels[i % 4][y * 4 + i / 4] = row[i];
+    }
+    return;
+  }
+  for (uint32_t y = 0; y < 4; y++) {
+    const auto row = std::min(block_y * 4 + y, height - 1);
+    for (uint32_t x = 0; x < 4; x++) {
+      const auto column = std::min(block_x * 4 + x, width - 1);
+      const auto texel = texels + row * row_pitch + column * 4;
+      for (int c = 0; c < 4; c++)
+        block.channels[c][y * 4 + x] = texel[c];
+    }
+  }
+}
+
+// Sum of a[i] * b[i] over the block.
+float dot(const float *a, const float *b) {
+#if defined(YAGF_AVX2_BLOCK_COMPRESSION)
+  const auto products = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_load_ps(a), _mm256_load_ps(b)),
+      _mm256_mul_ps(_mm256_load_ps(a + 8), _mm256_load_ps(b + 8)));
+  auto sum = _mm_add_ps(_mm256_castps256_ps128(products),
+                        _mm256_extractf128_ps(products, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+#elif defined(YAGF_SSE_BLOCK_COMPRESSION)
+  auto sum = _mm_setzero_ps();
+  for (int i = 0; i < 16; i += 4)
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+#else
+  float sum = 0.f;
+  for (int i = 0; i < 16; i++)
+    sum += a[i] * b[i];
+  return sum;
+#endif
+}
+
+void get_range(const float *a, float &lowest, float &highest) {
+#if defined(YAGF_SSE_BLOCK_COMPRESSION)
+  auto low = _mm_load_ps(a);
+  auto high = low;
+  for (int i = 4; i < 16; i += 4) {
+    const auto values = _mm_load_ps(a + i);
+    low = _mm_min_ps(low, values);
+    high = _mm_max_ps(high, values);
+  }
+  low = _mm_min_ps(low, _mm_movehl_ps(low, low));
+  high = _mm_max_ps(high, _mm_movehl_ps(high, high));
+  lowest = _mm_cvtss_f32(_mm_min_ss(low, _mm_shuffle_ps(low, low, 1)));
+  highest = _mm_cvtss_f32(_mm_max_ss(high, _mm_shuffle_ps(high, high, 1)));
+#else
+  const auto range = std::minmax_element(a, a + 16);
+  lowest = *range.first;
+  highest = *range.second;
+#endif
+}
+
+// projected[i] = dot(texel i - origin, axis) over channel_count channels.
+void project(const float *const *channels, int channel_count,
+             const float *origin, const float *axis, float *projected) {
+#if defined(YAGF_AVX2_BLOCK_COMPRESSION)
+  for (int i = 0; i < 16; i += 8) {
+    auto distance = _mm256_setzero_ps();
+    for (int c = 0; c < channel_count; c++)
+      distance = _mm256_add_ps(
+          distance, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(channels[c] + i),
+                                                _mm256_set1_ps(origin[c])),
+                                  _mm256_set1_ps(axis[c])));
+    _mm256_store_ps(projected + i, distance);
+  }
+#elif defined(YAGF_SSE_BLOCK_COMPRESSION)
+  for (int i = 0; i < 16; i += 4) {
+    auto distance = _mm_setzero_ps();
+    for (int c = 0; c < channel_count; c++)
+      distance = _mm_add_ps(
+          distance, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(channels[c] + i),
+                                          _mm_set1_ps(origin[c])),
+                               _mm_set1_ps(axis[c])));
+    _mm_store_ps(projected + i, distance);
+  }
+#else
+  for (int i = 0; i < 16; i++) {
+    projected[i] = 0.f;
+    for (int c = 0; c < channel_count; c++)
+      projected[i] += (channels[c][i] - origin[c]) * axis[c];
+  }
+#endif
+}
+
+// Rounds projected to the nearest integer between 0 and max_index.
+void quantize(const float *projected, float max_index, uint8_t *t) {
+#if defined(YAGF_AVX2_BLOCK_COMPRESSION)
+  const auto zero = _mm256_setzero_ps();
+  const auto top = _mm256_set1_ps(max_index);
+  const auto low = _mm256_cvtps_epi32(
+      _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(projected), zero), top));
+  const auto high = _mm256_cvtps_epi32(
+      _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(projected + 8), zero), top));
+  // Packing works within 128 bits lanes, the permutation restores the order.
+  const auto words =
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(t),
+                   _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                    _mm256_extracti128_si256(words, 1)));
+#elif defined(YAGF_SSE_BLOCK_COMPRESSION)
+  const auto zero = _mm_setzero_ps();
+  const auto top = _mm_set1_ps(max_index);
+  __m128i q[4];
+  for (int i = 0; i < 4; i++)
+    q[i] = _mm_cvtps_epi32(
+        _mm_min_ps(_mm_max_ps(_mm_load_ps(projected + i * 4), zero), top));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(t),
+                   _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]),
+                                    _mm_packs_epi32(q[2], q[3])));
+#else
+  for (int i = 0; i < 16; i++)
+    t[i] = static_cast<uint8_t>(
+        std::nearbyint(std::min(std::max(projected[i], 0.f), max_index)));
+#endif
+}
+
+// Sum over the texels of their squared distance to e0 + (e1 - e0) * t / steps.
+float get_squared_error(const float *const *channels, int channel_count,
+                        const float *e0, const float *e1, const uint8_t *t,
+                        float steps) {
+#if defined(YAGF_AVX2_BLOCK_COMPRESSION)
+  auto sum = _mm256_setzero_ps();
+  for (int i = 0; i < 16; i += 8) {
+    const auto weight = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(t + i)))),
+        _mm256_set1_ps(1.f / steps));
+    for (int c = 0; c < channel_count; c++) {
+      const auto decoded = _mm256_add_ps(
+          _mm256_set1_ps(e0[c]),
+          _mm256_mul_ps(_mm256_set1_ps(e1[c] - e0[c]), weight));
+      const auto difference =
+          _mm256_sub_ps(_mm256_load_ps(channels[c] + i), decoded);
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(difference, difference));
+    }
+  }
+  auto half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                         _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+#elif defined(YAGF_SSE_BLOCK_COMPRESSION)
+  const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t));
+  const auto zero = _mm_setzero_si128();
+  const __m128i words[] = {_mm_unpacklo_epi8(bytes, zero),
+                           _mm_unpackhi_epi8(bytes, zero)};
+  auto sum = _mm_setzero_ps();
+  for (int i = 0; i < 16; i += 4) {
+    const auto &word = words[i / 8];
+    const auto weight = _mm_mul_ps(
+        _mm_cvtepi32_ps(i % 8 == 0 ? _mm_unpacklo_epi16(word, zero)
+                                   : _mm_unpackhi_epi16(word, zero)),
+        _mm_set1_ps(1.f / steps));
+    for (int c = 0; c < channel_count; c++) {
+      const auto decoded =
+          _mm_add_ps(_mm_set1_ps(e0[c]),
+                     _mm_mul_ps(_mm_set1_ps(e1[c] - e0[c]), weight));
+      const auto difference = _mm_sub_ps(_mm_load_ps(channels[c] + i), decoded);
+      sum = _mm_add_ps(sum, _mm_mul_ps(difference, difference));
+    }
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+#else
+  float error = 0.f;
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < channel_count; c++) {
+      const auto decoded = e0[c] + (e1[c] - e0[c]) * t[i] / steps;
+      error += (channels[c][i] - decoded) * (channels[c][i] - decoded);
+    }
+  }
+  return error;
+#endif
+}
+
+uint16_t pack_565(const float *color) {
+  const auto &&quantize_channel = [](float value, float levels) {
+    return static_cast<uint16_t>(
+        std::nearbyint(std::min(std::max(value, 0.f), 255.f) * levels / 255.f));
+  };
+  return quantize_channel(color[0], 31.f) << 11 |
+         quantize_channel(color[1], 63.f) << 5 |
+         quantize_channel(color[2], 31.f);
+}
+
+void unpack_565(uint16_t packed, float *color) {
+  const auto r = packed >> 11;
+  const auto g = (packed >> 5) & 63;
+  const auto b = packed & 31;
+  color[0] = static_cast<float>(r << 3 | r >> 2);
+  color[1] = static_cast<float>(g << 2 | g >> 4);
+  color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+// Places the texels on the segment from e0 to e1 in thirds, t of 0 is e0 and
+// 3 is e1. Returns the squared error.
+float fit_color_indices(const block_texels &block, const float *e0,
+                        const float *e1, uint8_t *t) {
+  const float *const rgb[] = {block.channels[0], block.channels[1],
+                              block.channels[2]};
+  float axis[3];
+  float length = 0.f;
+  for (int c = 0; c < 3; c++) {
+    axis[c] = e1[c] - e0[c];
+    length += axis[c] * axis[c];
+  }
+  if (length < 1e-4f)
+    memset(t, 0, 16);
+  else {
+    for (int c = 0; c < 3; c++)
+      axis[c] *= 3.f / length;
+    alignas(32) float projected[16];
+    project(rgb, 3, e0, axis, projected);
+    quantize(projected, 3.f, t);
+  }
+  return get_squared_error(rgb, 3, e0, e1, t, 3.f);
+}
+
+void write_color_block(uint16_t c0, uint16_t c1, const uint8_t *t,
+                       uint8_t *out) {
+  static const uint8_t index_of_third[] = {0, 2, 3, 1};
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    // Decoders use the 4 colors palette only if c0 > c1.
+    const uint32_t flip = c0 < c1 ? 1 : 0;
+    if (flip)
+      std::swap(c0, c1);
+    for (int i = 0; i < 16; i++)
+      indices |= (index_of_third[t[i]] ^ flip) << (i * 2);
+  }
+  out[0] = static_cast<uint8_t>(c0);
+  out[1] = static_cast<uint8_t>(c0 >> 8);
+  out[2] = static_cast<uint8_t>(c1);
+  out[3] = static_cast<uint8_t>(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+void encode_color_block(const block_texels &block, uint8_t *out) {
+  const float *const rgb[] = {block.channels[0], block.channels[1],
+                              block.channels[2]};
+  float mean[3];
+  for (int c = 0; c < 3; c++)
+    mean[c] = dot(rgb[c], ones) / 16.f;
+  float covariance[3][3];
+  for (int a = 0; a < 3; a++)
+    for (int b = a; b < 3; b++)
+      covariance[a][b] = covariance[b][a] =
+          dot(rgb[a], rgb[b]) / 16.f - mean[a] * mean[b];
+
+  // Principal axis by power iteration, from the row of the widest channel.
+  int widest = 0;
+  for (int c = 1; c < 3; c++)
+    if (covariance[c][c] > covariance[widest][widest])
+      widest = c;
+  float axis[3] = {covariance[widest][0], covariance[widest][1],
+                   covariance[widest][2]};
+  float e0[3] = {mean[0], mean[1], mean[2]};
+  float e1[3] = {mean[0], mean[1], mean[2]};
+  if (covariance[widest][widest] > 1e-2f) {
+    for (int iteration = 0; iteration < 4; iteration++) {
+      float next[3];
+      for (int c = 0; c < 3; c++)
+        next[c] = covariance[c][0] * axis[0] + covariance[c][1] * axis[1] +
+                  covariance[c][2] * axis[2];
+      const auto norm = std::max(
+          std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+      for (int c = 0; c < 3; c++)
+        axis[c] = next[c] / norm;
+    }
+    const auto length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+                                  axis[2] * axis[2]);
+    for (int c = 0; c < 3; c++)
+      axis[c] /= length;
+    alignas(32) float projected[16];
+    project(rgb, 3, mean, axis, projected);
+    float lowest, highest;
+    get_range(projected, lowest, highest);
+    for (int c = 0; c < 3; c++) {
+      e0[c] = mean[c] + axis[c] * lowest;
+      e1[c] = mean[c] + axis[c] * highest;
+    }
+  }
+
+  uint16_t c0 = pack_565(e0);
+  uint16_t c1 = pack_565(e1);
+  unpack_565(c0, e0);
+  unpack_565(c1, e1);
+  uint8_t t[16];
+  const auto error = fit_color_indices(block, e0, e1, t);
+
+  // Least squares endpoints for these indices, kept if closer once quantized.
+  float aa = 0.f, ab = 0.f, bb = 0.f;
+  float ax[3] = {}, bx[3] = {};
+  for (int i = 0; i < 16; i++) {
+    const auto beta = t[i] / 3.f;
+    const auto alpha = 1.f - beta;
+    aa += alpha * alpha;
+    ab += alpha * beta;
+    bb += beta * beta;
+    for (int c = 0; c < 3; c++) {
+      ax[c] += alpha * rgb[c][i];
+      bx[c] += beta * rgb[c][i];
+    }
+  }
+  const auto determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) > 1e-3f) {
+    float refined0[3], refined1[3];
+    for (int c = 0; c < 3; c++) {
+      refined0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+      refined1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+    }
+    const auto refined_c0 = pack_565(refined0);
+    const auto refined_c1 = pack_565(refined1);
+    unpack_565(refined_c0, refined0);
+    unpack_565(refined_c1, refined1);
+    uint8_t refined_t[16];
+    if (fit_color_indices(block, refined0, refined1, refined_t) < error) {
+      c0 = refined_c0;
+      c1 = refined_c1;
+      memcpy(t, refined_t, 16);
+    }
+  }
+  write_color_block(c0, c1, t, out);
+}
+
+// 8 values mode, a0 > a1 : the projection t from a1 to a0 in sevenths is
+// index 1 for t = 0, 0 for t = 7 and 8 - t between.
+void encode_channel_block(const float *channel, uint8_t *out) {
+  float lowest, highest;
+  get_range(channel, lowest, highest);
+  const auto a0 = static_cast<uint8_t>(std::nearbyint(highest));
+  const auto a1 = static_cast<uint8_t>(std::nearbyint(lowest));
+  out[0] = a0;
+  out[1] = a1;
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    const float origin = a1;
+    const float axis = 7.f / (a0 - a1);
+    alignas(32) float projected[16];
+    project(&channel, 1, &origin, &axis, projected);
+    uint8_t t[16];
+    quantize(projected, 7.f, t);
+    for (int i = 0; i < 16; i++) {
+      const uint64_t index = t[i] == 7 ? 0 : (t[i] == 0 ? 1 : 8 - t[i]);
+      indices |= index << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+void decode_color_block(const uint8_t *block, bool always_four_colors,
+                        uint8_t palette_indices[16], uint8_t palette[4][4]) {
+  const uint16_t c0 = block[0] | block[1] << 8;
+  const uint16_t c1 = block[2] | block[3] << 8;
+  float e0[3], e1[3];
+  unpack_565(c0, e0);
+  unpack_565(c1, e1);
+  const auto four_colors = always_four_colors || c0 > c1;
+  for (int c = 0; c < 3; c++) {
+    const auto a = static_cast<int>(e0[c]);
+    const auto b = static_cast<int>(e1[c]);
+    palette[0][c] = static_cast<uint8_t>(a);
+    palette[1][c] = static_cast<uint8_t>(b);
+    palette[2][c] =
+        static_cast<uint8_t>(four_colors ? (2 * a + b) / 3 : (a + b) / 2);
+    palette[3][c] = static_cast<uint8_t>(four_colors ? (a + 2 * b) / 3 : 0);
+  }
+  palette[0][3] = palette[1][3] = palette[2][3] = 255;
+  palette[3][3] = four_colors ? 255 : 0;
+  const uint32_t indices =
+      block[4] | block[5] << 8 | block[6] << 16 | uint32_t(block[7]) << 24;
+  for (int i = 0; i < 16; i++)
+    palette_indices[i] = (indices >> (i * 2)) & 3;
+}
+
+void decode_channel_block(const uint8_t *block, uint8_t values[16]) {
+  const int a0 = block[0];
+  const int a1 = block[1];
+  int palette[8] = {a0, a1};
+  if (a0 > a1) {
+    for (int i = 2; i < 8; i++)
+      palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+  } else {
+    for (int i = 2; i < 6; i++)
+      palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; i++)
+    indices |= uint64_t(block[2 + i]) << (i * 8);
+  for (int i = 0; i < 16; i++)
+    values[i] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+}
+}
+
+void compress_blocks(irr::video::ECOLOR_FORMAT format, const uint8_t *texels,
+                     uint32_t width, uint32_t height, size_t row_pitch,
+                     uint8_t *blocks, worker_pool *workers) {
+  switch (format) {
+  case irr::video::ECF_BC1_UNORM:
+  case irr::video::ECF_BC1_UNORM_SRGB:
+  case irr::video::ECF_BC3_UNORM:
+  case irr::video::ECF_BC3_UNORM_SRGB:
+  case irr::video::ECF_BC4_UNORM:
+  case irr::video::ECF_BC5_UNORM:
+    break;
+  default:
+    throw "compress_blocks: unsupported format";
+  }
+  const auto block_size = irr::video::formatBlockByteCount(format);
+  const auto blocks_x = (width + 3) / 4;
+  const auto blocks_y = (height + 3) / 4;
+  const auto &&compress_row = [&](size_t block_y) {
+    block_texels block;
+    for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+      load_block(texels, width, height, row_pitch, block_x,
+                 static_cast<uint32_t>(block_y), block);
+      auto out = blocks + (block_y * blocks_x + block_x) * block_size;
+      switch (format) {
+      case irr::video::ECF_BC1_UNORM:
+      case irr::video::ECF_BC1_UNORM_SRGB:
+        encode_color_block(block, out);
+        break;
+      case irr::video::ECF_BC3_UNORM:
+      case irr::video::ECF_BC3_UNORM_SRGB:
+        encode_channel_block(block.channels[3], out);
+        encode_color_block(block, out + 8);
+        break;
+      case irr::video::ECF_BC4_UNORM:
+        encode_channel_block(block.channels[0], out);
+        break;
+      default:
+        encode_channel_block(block.channels[0], out);
+        encode_channel_block(block.channels[1], out + 8);
+        break;
+      }
+    }
+  };
+  if (workers != nullptr)
+    workers->parallel_for(blocks_y, compress_row);
+  else
+    for (size_t block_y = 0; block_y < blocks_y; block_y++)
+      compress_row(block_y);
+}
+
+void decompress_blocks(irr::video::ECOLOR_FORMAT format, const uint8_t *blocks,
+                       uint32_t width, uint32_t height, uint8_t *texels) {
+  const auto block_size = irr::video::formatBlockByteCount(format);
+  const auto blocks_x = (width + 3) / 4;
+  const auto blocks_y = (height + 3) / 4;
+  for (uint32_t block_y = 0; block_y < blocks_y; block_y++) {
+    for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+      const auto block = blocks + (block_y * blocks_x + block_x) * block_size;
+      uint8_t decoded[16][4] = {};
+      uint8_t indices[16];
+      uint8_t palette[4][4];
+      uint8_t values[16];
+      switch (format) {
+      case irr::video::ECF_BC1_UNORM:
+      case irr::video::ECF_BC1_UNORM_SRGB:
+        decode_color_block(block, false, indices, palette);
+        for (int i = 0; i < 16; i++)
+          memcpy(decoded[i], palette[indices[i]], 4);
+        break;
+      case irr::video::ECF_BC3_UNORM:
+      case irr::video::ECF_BC3_UNORM_SRGB:
+        decode_color_block(block + 8, true, indices, palette);
+        decode_channel_block(block, values);
+        for (int i = 0; i < 16; i++) {
+          memcpy(decoded[i], palette[indices[i]], 3);
+          decoded[i][3] = values[i];
+        }
+        break;
+      case irr::video::ECF_BC4_UNORM:
+        decode_channel_block(block, values);
+        for (int i = 0; i < 16; i++) {
+          decoded[i][0] = values[i];
+          decoded[i][3] = 255;
+        }
+        break;
+      case irr::video::ECF_BC5_UNORM:
+        decode_channel_block(block, values);
+        for (int i = 0; i < 16; i++) {
+          decoded[i][0] = values[i];
+          decoded[i][3] = 255;
+        }
+        decode_channel_block(block + 8, values);
+        for (int i = 0; i < 16; i++)
+          decoded[i][1] = values[i];
+        break;
+      default:
+        throw "decompress_blocks: unsupported format";
+      }
+      for (uint32_t y = 0; y < 4 && block_y * 4 + y < height; y++)
+        for (uint32_t x = 0; x < 4 && block_x * 4 + x < width; x++)
+          memcpy(texels + ((block_y * 4 + y) * width + block_x * 4 + x) * 4,
+                 decoded[y * 4 + x], 4);
+    }
+  }
+}
+
+double compute_psnr(const uint8_t *reference, const uint8_t *texels,
+                    size_t texel_count, uint32_t channel_mask) {
+  double squared_error = 0.;
+  size_t sample_count = 0;
+  for (int c = 0; c < 4; c++) {
+    if (!(channel_mask & (1 << c)))
+      continue;
+    for (size_t i = 0; i < texel_count; i++) {
+      const double difference = reference[i * 4 + c] - texels[i * 4 + c];
+      squared_error += difference * difference;
+    }
+    sample_count += texel_count;
+  }
+  if (squared_error == 0.)
+    return std::numeric_limits<double>::infinity();
+  return 10. * std::log10(255. * 255. * sample_count / squared_error);
+}
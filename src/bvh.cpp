@@ -0,0 +1,344 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/BVH.h>
+#include <algorithm>
+#include <cmath>
+
+namespace irr {
+namespace scene {
+namespace {
+constexpr uint32_t max_leaf_size = 4;
+constexpr uint32_t bin_count = 12;
+
+float surface_area(const aabb &box) {
+  if (box.is_empty())
+    return 0.f;
+  const auto dx = box.max.x - box.min.x;
+  const auto dy = box.max.y - box.min.y;
+  const auto dz = box.max.z - box.min.z;
+  return 2.f * (dx * dy + dy * dz + dz * dx);
+}
+
+aabb merge(const aabb &a, const aabb &b) {
+  auto result = a;
+  result.add_box(b);
+  return result;
+}
+
+bool overlaps(const aabb &a, const aabb &b) {
+  return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y &&
+         a.max.y >= b.min.y && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Slab test, returns the entry distance or a negative value if missed.
+float intersect_ray(const aabb &box, const glm::vec3 &origin,
+                    const glm::vec3 &inverse_direction, float max_distance) {
+  float t_min = 0.f;
+  float t_max = max_distance;
+  for (int axis = 0; axis < 3; axis++) {
+    auto t0 = (box.min[axis] - origin[axis]) * inverse_direction[axis];
+    auto t1 = (box.max[axis] - origin[axis]) * inverse_direction[axis];
+    if (t0 > t1)
+      std::swap(t0, t1);
+    t_min = std::max(t_min, t0);
+    t_max = std::min(t_max, t1);
+    if (t_min > t_max)
+      return -1.f;
+  }
+  return t_min;
+}
+}
+
+void bvh::build(gsl::span<const aabb> boxes) {
+  nodes.clear();
+  item_boxes.assign(boxes.begin(), boxes.end());
+  leaf_items.resize(boxes.size());
+  item_leaf.assign(boxes.size(), invalid_item);
+  root = invalid_item;
+  if (boxes.empty())
+    return;
+
+  std::vector<glm::vec3> centroids(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    leaf_items[i] = static_cast<uint32_t>(i);
+    centroids[i] = boxes[i].get_center();
+  }
+  nodes.reserve(2 * boxes.size());
+  nodes.push_back(node{aabb{}, invalid_item, 0, 0});
+  root = 0;
+  build_node(root, 0, static_cast<uint32_t>(boxes.size()), centroids);
+}
+
+void bvh::build_node(uint32_t node_index, uint32_t first, uint32_t count,
+                     const std::vector<glm::vec3> &centroids) {
+  aabb box;
+  aabb centroid_box;
+  for (uint32_t i = first; i < first + count; i++) {
+    box.add_box(item_boxes[leaf_items[i]]);
+    centroid_box.add_point(centroids[leaf_items[i]]);
+  }
+  nodes[node_index].box = box;
+
+  const auto &&make_leaf = [&]() {
+    nodes[node_index].first = first;
+    nodes[node_index].count = count;
+    for (uint32_t i = first; i < first + count; i++)
+      item_leaf[leaf_items[i]] = node_index;
+  };
+  if (count <= max_leaf_size) {
+    make_leaf();
+    return;
+  }
+
+  const auto &extents = centroid_box.get_extents();
+  const auto axis =
+      extents.x >= extents.y && extents.x >= extents.z
+          ? 0
+          : (extents.y >= extents.z ? 1 : 2);
+  const auto axis_min = centroid_box.min[axis];
+  const auto axis_length = centroid_box.max[axis] - axis_min;
+
+  auto middle = first + count / 2;
+  if (axis_length > 0.f) {
+    // Binned SAH
+    std::array<aabb, bin_count> bin_boxes;
+    std::array<uint32_t, bin_count> bin_sizes{};
+    const auto &&get_bin = [&](uint32_t item) {
+      const auto bin = static_cast<uint32_t>(
+          (centroids[item][axis] - axis_min) / axis_length * bin_count);
+      return std::min(bin, bin_count - 1);
+    };
+    for (uint32_t i = first; i < first + count; i++) {
+      const auto bin = get_bin(leaf_items[i]);
+      bin_boxes[bin].add_box(item_boxes[leaf_items[i]]);
+      bin_sizes[bin]++;
+    }
+
+    std::array<float, bin_count - 1> costs{};
+    aabb left_box;
+    uint32_t left_count = 0;
+    for (uint32_t split = 0; split < bin_count - 1; split++) {
+      left_box.add_box(bin_boxes[split]);
+      left_count += bin_sizes[split];
+      costs[split] = surface_area(left_box) * left_count;
+    }
+    aabb right_box;
+    uint32_t right_count = 0;
+    for (uint32_t split = bin_count - 1; split > 0; split--) {
+      right_box.add_box(bin_boxes[split]);
+      right_count += bin_sizes[split];
+      costs[split - 1] += surface_area(right_box) * right_count;
+    }
+    const auto best = static_cast<uint32_t>(
+        std::min_element(costs.begin(), costs.end()) - costs.begin());
+
+    // Traversal cost ~ 1 box test, costs are relative to the parent area.
+    const auto leaf_cost = static_cast<float>(count);
+    const auto split_cost = 1.f + costs[best] / surface_area(box);
+    if (split_cost >= leaf_cost && count <= 4 * max_leaf_size) {
+      make_leaf();
+      return;
+    }
+    middle = static_cast<uint32_t>(
+        std::partition(leaf_items.begin() + first,
+                       leaf_items.begin() + first + count,
+                       [&](uint32_t item) { return get_bin(item) <= best; }) -
+        leaf_items.begin());
+  }
+  // Every centroid in the same bin (or at the same place), median split.
+  if (middle == first || middle == first + count) {
+    middle = first + count / 2;
+    std::nth_element(leaf_items.begin() + first, leaf_items.begin() + middle,
+                     leaf_items.begin() + first + count,
+                     [&](uint32_t a, uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+  }
+
+  const auto first_child = static_cast<uint32_t>(nodes.size());
+  nodes.push_back(node{aabb{}, node_index, 0, 0});
+  nodes.push_back(node{aabb{}, node_index, 0, 0});
+  nodes[node_index].first = first_child;
+  nodes[node_index].count = 0;
+  build_node(first_child, first, middle - first, centroids);
+  build_node(first_child + 1, middle, first + count - middle, centroids);
+}
+
+uint32_t bvh::insert(const aabb &box) {
+  const auto item = static_cast<uint32_t>(item_boxes.size());
+  item_boxes.push_back(box);
+  leaf_items.push_back(item);
+  const auto leaf_first = static_cast<uint32_t>(leaf_items.size() - 1);
+
+  if (root == invalid_item) {
+    root = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(node{box, invalid_item, leaf_first, 1});
+    item_leaf.push_back(root);
+    return item;
+  }
+
+  // Descends toward the child whose area grows the least.
+  auto sibling = root;
+  while (nodes[sibling].count == 0) {
+    const auto &left = nodes[nodes[sibling].first];
+    const auto &right = nodes[nodes[sibling].first + 1];
+    const auto left_growth =
+        surface_area(merge(left.box, box)) - surface_area(left.box);
+    const auto right_growth =
+        surface_area(merge(right.box, box)) - surface_area(right.box);
+    sibling = nodes[sibling].first + (left_growth <= right_growth ? 0 : 1);
+  }
+
+  // The sibling node becomes the parent of a copy of itself and of the new
+  // leaf, so that the link from its own parent stays valid.
+  const auto first_child = static_cast<uint32_t>(nodes.size());
+  auto moved = nodes[sibling];
+  moved.parent = sibling;
+  nodes.push_back(moved);
+  nodes.push_back(node{box, sibling, leaf_first, 1});
+  item_leaf.push_back(first_child + 1);
+  for (uint32_t i = moved.first; i < moved.first + moved.count; i++)
+    item_leaf[leaf_items[i]] = first_child;
+  nodes[sibling].first = first_child;
+  nodes[sibling].count = 0;
+  refit_from(sibling);
+  return item;
+}
+
+void bvh::update(uint32_t item, const aabb &box) {
+  item_boxes[item] = box;
+  refit_from(item_leaf[item]);
+}
+
+void bvh::refit_from(uint32_t node_index) {
+  for (auto current = node_index; current != invalid_item;
+       current = nodes[current].parent) {
+    auto &n = nodes[current];
+    aabb box;
+    if (n.count > 0) {
+      for (uint32_t i = n.first; i < n.first + n.count; i++)
+        box.add_box(item_boxes[leaf_items[i]]);
+    } else {
+      box = merge(nodes[n.first].box, nodes[n.first + 1].box);
+    }
+    n.box = box;
+  }
+}
+
+void bvh::query_frustum(const frustum &view_frustum,
+                        std::vector<uint32_t> &items) const {
+  query_frustums(gsl::span<const frustum>(&view_frustum, 1),
+                 gsl::span<std::vector<uint32_t>>(&items, 1));
+}
+
+void bvh::query_frustums(gsl::span<const frustum> views,
+                         gsl::span<std::vector<uint32_t>> items) const {
+  last_visited_nodes = 0;
+  if (root == invalid_item || views.empty())
+    return;
+  if (views.size() > 32)
+    throw "bvh: too many views";
+  // Views a node may still be visible in.
+  std::vector<std::pair<uint32_t, uint32_t>> stack{
+      {root, static_cast<uint32_t>((uint64_t(1) << views.size()) - 1)}};
+  while (!stack.empty()) {
+    const auto current = stack.back();
+    stack.pop_back();
+    last_visited_nodes++;
+    const auto &n = nodes[current.first];
+    auto view_mask = current.second;
+    for (uint32_t view = 0; view < views.size(); view++) {
+      if ((view_mask & (1u << view)) && !views[view].intersects(n.box))
+        view_mask &= ~(1u << view);
+    }
+    if (view_mask == 0)
+      continue;
+    if (n.count == 0) {
+      stack.push_back({n.first, view_mask});
+      stack.push_back({n.first + 1, view_mask});
+      continue;
+    }
+    for (uint32_t i = n.first; i < n.first + n.count; i++) {
+      const auto item = leaf_items[i];
+      for (uint32_t view = 0; view < views.size(); view++) {
+        if ((view_mask & (1u << view)) &&
+            (n.count == 1 || views[view].intersects(item_boxes[item])))
+          items[view].push_back(item);
+      }
+    }
+  }
+}
+
+void bvh::query_aabb(const aabb &box, std::vector<uint32_t> &items) const {
+  last_visited_nodes = 0;
+  if (root == invalid_item)
+    return;
+  std::vector<uint32_t> stack{root};
+  while (!stack.empty()) {
+    const auto &n = nodes[stack.back()];
+    stack.pop_back();
+    last_visited_nodes++;
+    if (!overlaps(n.box, box))
+      continue;
+    if (n.count == 0) {
+      stack.push_back(n.first);
+      stack.push_back(n.first + 1);
+      continue;
+    }
+    for (uint32_t i = n.first; i < n.first + n.count; i++) {
+      if (overlaps(item_boxes[leaf_items[i]], box))
+        items.push_back(leaf_items[i]);
+    }
+  }
+}
+
+uint32_t bvh::query_ray(
+    const glm::vec3 &origin, const glm::vec3 &direction, float &distance,
+    const std::function<bool(uint32_t, float &)> &hit_test) const {
+  last_visited_nodes = 0;
+  auto closest_item = invalid_item;
+  if (root == invalid_item)
+    return closest_item;
+  const auto &inverse_direction =
+      glm::vec3(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+  auto closest = distance;
+  std::vector<uint32_t> stack{root};
+  while (!stack.empty()) {
+    const auto &n = nodes[stack.back()];
+    stack.pop_back();
+    last_visited_nodes++;
+    if (intersect_ray(n.box, origin, inverse_direction, closest) < 0.f)
+      continue;
+    if (n.count == 0) {
+      // The nearest child is visited first.
+      const auto near_distance = intersect_ray(
+          nodes[n.first].box, origin, inverse_direction, closest);
+      const auto far_distance = intersect_ray(
+          nodes[n.first + 1].box, origin, inverse_direction, closest);
+      const auto left_first = far_distance < 0.f ||
+                              (near_distance >= 0.f &&
+                               near_distance <= far_distance);
+      stack.push_back(left_first ? n.first + 1 : n.first);
+      stack.push_back(left_first ? n.first : n.first + 1);
+      continue;
+    }
+    for (uint32_t i = n.first; i < n.first + n.count; i++) {
+      const auto item = leaf_items[i];
+      auto item_distance =
+          intersect_ray(item_boxes[item], origin, inverse_direction, closest);
+      if (item_distance < 0.f)
+        continue;
+      if (hit_test && !hit_test(item, item_distance))
+        continue;
+      if (item_distance <= closest) {
+        closest = item_distance;
+        closest_item = item;
+      }
+    }
+  }
+  if (closest_item != invalid_item)
+    distance = closest;
+  return closest_item;
+}
+}
+}
@@ -0,0 +1,300 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include "../include/API/command_stream.h"
+#include <algorithm>
+#include <future>
+
+void command_stream::begin_item(uint64_t key) {
+  const auto offset = static_cast<uint32_t>(data.size());
+  items.push_back(item{key, offset, offset});
+}
+
+void command_stream::set_graphic_pipeline(pipeline_state_t &pipeline) {
+  push<command_packets::set_graphic_pipeline>().pipeline = &pipeline;
+}
+
+void command_stream::bind_graphic_descriptor(
+    uint32_t bindpoint, const allocated_descriptor_set &descriptor_set,
+    pipeline_layout_t &sig) {
+  auto &packet = push<command_packets::bind_graphic_descriptor>();
+  packet.bindpoint = bindpoint;
+  packet.descriptor_set = &descriptor_set;
+  packet.layout = &sig;
+}
+
+void command_stream::bind_index_buffer(buffer_t &buffer, uint64_t offset,
+                                       uint32_t size,
+                                       irr::video::E_INDEX_TYPE type) {
+  auto &packet = push<command_packets::bind_index_buffer>();
+  packet.index_type = type;
+  packet.size = size;
+  packet.buffer = &buffer;
+  packet.offset = offset;
+}
+
+void command_stream::bind_vertex_buffers(
+    uint32_t first_bind,
+    const std::vector<std::tuple<buffer_t &, uint64_t, uint32_t, uint32_t>>
+        &buffer_offset_stride_size) {
+  if (buffer_offset_stride_size.size() >
+      command_packets::bind_vertex_buffers::max_buffers)
+    throw "command_stream: too many vertex buffers";
+  auto &packet = push<command_packets::bind_vertex_buffers>();
+  packet.first_bind = first_bind;
+  packet.count = static_cast<uint32_t>(buffer_offset_stride_size.size());
+  for (uint32_t i = 0; i < packet.count; i++) {
+    const auto &infos = buffer_offset_stride_size[i];
+    packet.buffers[i] = &std::get<0>(infos);
+    packet.offsets[i] = std::get<1>(infos);
+    packet.strides[i] = std::get<2>(infos);
+    packet.sizes[i] = std::get<3>(infos);
+  }
+}
+
+void command_stream::draw_indexed(uint32_t index_count,
+                                  uint32_t instance_count, uint32_t base_index,
+                                  int32_t base_vertex, uint32_t base_instance) {
+  auto &packet = push<command_packets::draw_indexed>();
+  packet.index_count = index_count;
+  packet.instance_count = instance_count;
+  packet.base_index = base_index;
+  packet.base_vertex = base_vertex;
+  packet.base_instance = base_instance;
+}
+
+void command_stream::draw_non_indexed(uint32_t vertex_count,
+                                      uint32_t instance_count,
+                                      int32_t base_vertex,
+                                      uint32_t base_instance) {
+  auto &packet = push<command_packets::draw_non_indexed>();
+  packet.vertex_count = vertex_count;
+  packet.instance_count = instance_count;
+  packet.base_vertex = base_vertex;
+  packet.base_instance = base_instance;
+}
+
+void command_stream::clear() {
+  data.clear();
+  items.clear();
+}
+
+command_stream_statistics &command_stream_statistics::
+operator+=(const command_stream_statistics &other) {
+  items += other.items;
+  packets += other.packets;
+  draws += other.draws;
+  pipeline_binds += other.pipeline_binds;
+  descriptor_binds += other.descriptor_binds;
+  buffer_binds += other.buffer_binds;
+  redundant_binds += other.redundant_binds;
+  command_lists += other.command_lists;
+  return *this;
+}
+
+void command_stream_translator::sort(
+    gsl::span<const command_stream *const> streams) {
+  sorted_items.clear();
+  for (const auto &stream : streams) {
+    const auto &data = stream->get_data();
+    for (const auto &it : stream->get_items())
+      sorted_items.push_back(
+          sorted_item{it.key, data + it.begin, data + it.end});
+  }
+  std::stable_sort(sorted_items.begin(), sorted_items.end(),
+                   [](const sorted_item &a, const sorted_item &b) {
+                     return a.key < b.key;
+                   });
+}
+
+namespace {
+// What is currently bound in the command list being recorded, used to skip
+// binds that would not change anything.
+struct bound_state {
+  static constexpr size_t max_descriptor_sets = 8;
+
+  pipeline_state_t *pipeline = nullptr;
+  pipeline_layout_t *layout = nullptr;
+  std::array<const allocated_descriptor_set *, max_descriptor_sets>
+      descriptor_sets{};
+  buffer_t *index_buffer = nullptr;
+  uint64_t index_offset = 0;
+  irr::video::E_INDEX_TYPE index_type{};
+  std::array<buffer_t *, command_packets::bind_vertex_buffers::max_buffers>
+      vertex_buffers{};
+  std::array<uint64_t, command_packets::bind_vertex_buffers::max_buffers>
+      vertex_offsets{};
+};
+
+void replay_packet(command_list_t &cmd, const command_packet_header &header,
+                   bound_state &state, command_stream_statistics &stats) {
+  switch (header.type) {
+  case command_packet_type::set_graphic_pipeline: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::set_graphic_pipeline &>(
+            header);
+    if (packet.pipeline == state.pipeline) {
+      stats.redundant_binds++;
+      return;
+    }
+    cmd.set_graphic_pipeline(*packet.pipeline);
+    state.pipeline = packet.pipeline;
+    stats.pipeline_binds++;
+    return;
+  }
+  case command_packet_type::bind_graphic_descriptor: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::bind_graphic_descriptor &>(
+            header);
+    // A different layout may disturb every set bound so far.
+    if (packet.layout != state.layout) {
+      state.descriptor_sets.fill(nullptr);
+      state.layout = packet.layout;
+    }
+    const auto tracked = packet.bindpoint < bound_state::max_descriptor_sets;
+    if (tracked &&
+        state.descriptor_sets[packet.bindpoint] == packet.descriptor_set) {
+      stats.redundant_binds++;
+      return;
+    }
+    cmd.bind_graphic_descriptor(packet.bindpoint, *packet.descriptor_set,
+                                *packet.layout);
+    if (tracked)
+      state.descriptor_sets[packet.bindpoint] = packet.descriptor_set;
+    stats.descriptor_binds++;
+    return;
+  }
+  case command_packet_type::bind_index_buffer: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::bind_index_buffer &>(header);
+    if (packet.buffer == state.index_buffer &&
+        packet.offset == state.index_offset &&
+        packet.index_type == state.index_type) {
+      stats.redundant_binds++;
+      return;
+    }
+    cmd.bind_index_buffer(*packet.buffer, packet.offset, packet.size,
+                          packet.index_type);
+    state.index_buffer = packet.buffer;
+    state.index_offset = packet.offset;
+    state.index_type = packet.index_type;
+    stats.buffer_binds++;
+    return;
+  }
+  case command_packet_type::bind_vertex_buffers: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::bind_vertex_buffers &>(
+            header);
+    bool redundant =
+        packet.first_bind + packet.count <= state.vertex_buffers.size();
+    for (uint32_t i = 0; redundant && i < packet.count; i++)
+      redundant = state.vertex_buffers[packet.first_bind + i] ==
+                      packet.buffers[i] &&
+                  state.vertex_offsets[packet.first_bind + i] ==
+                      packet.offsets[i];
+    if (redundant) {
+      stats.redundant_binds++;
+      return;
+    }
+    std::vector<std::tuple<buffer_t &, uint64_t, uint32_t, uint32_t>>
+        buffer_offset_stride_size;
+    buffer_offset_stride_size.reserve(packet.count);
+    for (uint32_t i = 0; i < packet.count; i++) {
+      buffer_offset_stride_size.emplace_back(*packet.buffers[i],
+                                             packet.offsets[i],
+                                             packet.strides[i],
+                                             packet.sizes[i]);
+      if (packet.first_bind + i < state.vertex_buffers.size()) {
+        state.vertex_buffers[packet.first_bind + i] = packet.buffers[i];
+        state.vertex_offsets[packet.first_bind + i] = packet.offsets[i];
+      }
+    }
+    cmd.bind_vertex_buffers(packet.first_bind, buffer_offset_stride_size);
+    stats.buffer_binds++;
+    return;
+  }
+  case command_packet_type::draw_indexed: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::draw_indexed &>(header);
+    cmd.draw_indexed(packet.index_count, packet.instance_count,
+                     packet.base_index, packet.base_vertex,
+                     packet.base_instance);
+    stats.draws++;
+    return;
+  }
+  case command_packet_type::draw_non_indexed: {
+    const auto &packet =
+        reinterpret_cast<const command_packets::draw_non_indexed &>(header);
+    cmd.draw_non_indexed(packet.vertex_count, packet.instance_count,
+                         packet.base_vertex, packet.base_instance);
+    stats.draws++;
+    return;
+  }
+  }
+  throw;
+}
+}
+
+command_stream_statistics
+command_stream_translator::replay(command_list_t &cmd, size_t first,
+                                  size_t last) const {
+  command_stream_statistics stats;
+  bound_state state;
+  for (size_t i = first; i < last; i++) {
+    const auto &it = sorted_items[i];
+    for (auto ptr = it.begin; ptr < it.end;) {
+      const auto &header =
+          *reinterpret_cast<const command_packet_header *>(ptr);
+      replay_packet(cmd, header, state, stats);
+      stats.packets++;
+      ptr += header.size;
+    }
+    stats.items++;
+  }
+  return stats;
+}
+
+command_stream_statistics
+command_stream_translator::translate(command_list_t &cmd) const {
+  return replay(cmd, 0, sorted_items.size());
+}
+
+std::vector<std::unique_ptr<command_list_t>>
+command_stream_translator::translate_parallel(
+    gsl::span<command_list_storage_t *const> storages, const target &tgt,
+    command_stream_statistics *statistics) const {
+  if (storages.empty())
+    throw "command_stream_translator: no command list storage to record to";
+  const auto chunk_count =
+      std::min<size_t>(storages.size(), sorted_items.size());
+  std::vector<std::unique_ptr<command_list_t>> result(chunk_count);
+  std::vector<std::future<command_stream_statistics>> tasks;
+  tasks.reserve(chunk_count);
+  for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+    const auto first = sorted_items.size() * chunk / chunk_count;
+    const auto last = sorted_items.size() * (chunk + 1) / chunk_count;
+    auto &storage = *storages[chunk];
+    auto &cmd = result[chunk];
+    tasks.push_back(std::async(std::launch::async, [&, first, last]() {
+      cmd = storage.create_secondary_command_list();
+      cmd->start_secondary_command_list_recording(storage, *tgt.render_pass,
+                                                  tgt.subpass,
+                                                  tgt.framebuffer);
+      // Viewport and scissor are dynamic states, not inherited by secondary
+      // command lists.
+      cmd->set_viewport(0, static_cast<float>(tgt.width), 0.,
+                        static_cast<float>(tgt.height), 0., 1.);
+      cmd->set_scissor(0, tgt.width, 0, tgt.height);
+      const auto &stats = replay(*cmd, first, last);
+      cmd->make_command_list_executable();
+      return stats;
+    }));
+  }
+
+  command_stream_statistics total;
+  for (auto &task : tasks)
+    total += task.get();
+  total.command_lists = static_cast<uint32_t>(chunk_count);
+  if (statistics != nullptr)
+    *statistics = total;
+  return result;
+}
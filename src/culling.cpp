@@ -0,0 +1,206 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/Culling.h>
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#define YAGF_AVX_CULLING
+#elif defined(_M_X64) || defined(__SSE__)
+#include <emmintrin.h>
+#define YAGF_SSE_CULLING
+#endif
+
+namespace irr {
+namespace scene {
+void aabb::add_point(const glm::vec3 &point) {
+  min = glm::vec3(std::min(min.x, point.x), std::min(min.y, point.y),
+                  std::min(min.z, point.z));
+  max = glm::vec3(std::max(max.x, point.x), std::max(max.y, point.y),
+                  std::max(max.z, point.z));
+}
+
+void aabb::add_box(const aabb &box) {
+  if (box.is_empty())
+    return;
+  add_point(box.min);
+  add_point(box.max);
+}
+
+glm::vec3 aabb::get_center() const {
+  return glm::vec3((min.x + max.x) * .5f, (min.y + max.y) * .5f,
+                   (min.z + max.z) * .5f);
+}
+
+glm::vec3 aabb::get_extents() const {
+  return glm::vec3((max.x - min.x) * .5f, (max.y - min.y) * .5f,
+                   (max.z - min.z) * .5f);
+}
+
+aabb aabb::transform(const glm::mat4 &matrix) const {
+  if (is_empty())
+    return *this;
+  // Arvo : the new extents are the extents projected on the absolute value
+  // of the rotation/scale part.
+  const auto &center = get_center();
+  const auto &extents = get_extents();
+  aabb result;
+  for (int row = 0; row < 3; row++) {
+    float new_center = matrix[3][row];
+    float new_extent = 0.f;
+    for (int col = 0; col < 3; col++) {
+      new_center += matrix[col][row] * center[col];
+      new_extent += std::abs(matrix[col][row]) * extents[col];
+    }
+    result.min[row] = new_center - new_extent;
+    result.max[row] = new_center + new_extent;
+  }
+  return result;
+}
+
+frustum frustum::from_view_projection(const glm::mat4 &view_projection) {
+  const auto &&row = [&](int i) {
+    return glm::vec4(view_projection[0][i], view_projection[1][i],
+                     view_projection[2][i], view_projection[3][i]);
+  };
+  const auto &row0 = row(0);
+  const auto &row1 = row(1);
+  const auto &row2 = row(2);
+  const auto &row3 = row(3);
+  frustum result;
+  result.planes = {row3 + row0, row3 - row0, row3 + row1,
+                   row3 - row1, row2,        row3 - row2};
+  for (auto &plane : result.planes) {
+    const auto length =
+        std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if (length > 0.f)
+      plane = plane * (1.f / length);
+  }
+  return result;
+}
+
+bool frustum::intersects(const aabb &box) const {
+  const auto &center = box.get_center();
+  const auto &extents = box.get_extents();
+  for (const auto &plane : planes) {
+    const auto distance = plane.x * center.x + plane.y * center.y +
+                          plane.z * center.z + plane.w;
+    const auto radius = std::abs(plane.x) * extents.x +
+                        std::abs(plane.y) * extents.y +
+                        std::abs(plane.z) * extents.z;
+    if (distance + radius < 0.f)
+      return false;
+  }
+  return true;
+}
+
+void aabb_soa::resize(size_t new_count) {
+  count = new_count;
+  // SIMD loads may read up to 8 values past count (ranges starting at any
+  // index), results of padding lanes are dropped.
+  const auto padded = (new_count + 15) & ~size_t(7);
+  for (auto *v :
+       {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z})
+    v->resize(padded, 0.f);
+}
+
+void aabb_soa::set(size_t index, const aabb &box) {
+  const auto &center = box.get_center();
+  const auto &extents = box.get_extents();
+  center_x[index] = center.x;
+  center_y[index] = center.y;
+  center_z[index] = center.z;
+  extent_x[index] = extents.x;
+  extent_y[index] = extents.y;
+  extent_z[index] = extents.z;
+}
+
+culling_statistics cull_boxes(const frustum &view_frustum,
+                              const aabb_soa &boxes,
+                              gsl::span<uint8_t> visibility) {
+  return cull_boxes(view_frustum, boxes, 0, boxes.size(), visibility);
+}
+
+culling_statistics cull_boxes(const frustum &view_frustum,
+                              const aabb_soa &boxes, size_t first,
+                              size_t count, gsl::span<uint8_t> visibility) {
+  culling_statistics stats;
+  const auto last = first + count;
+  size_t i = first;
+#if defined(YAGF_AVX_CULLING)
+  const auto abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  for (; i < last; i += 8) {
+    const auto cx = _mm256_loadu_ps(&boxes.center_x[i]);
+    const auto cy = _mm256_loadu_ps(&boxes.center_y[i]);
+    const auto cz = _mm256_loadu_ps(&boxes.center_z[i]);
+    const auto ex = _mm256_loadu_ps(&boxes.extent_x[i]);
+    const auto ey = _mm256_loadu_ps(&boxes.extent_y[i]);
+    const auto ez = _mm256_loadu_ps(&boxes.extent_z[i]);
+    auto outside = _mm256_setzero_ps();
+    for (const auto &plane : view_frustum.planes) {
+      const auto nx = _mm256_set1_ps(plane.x);
+      const auto ny = _mm256_set1_ps(plane.y);
+      const auto nz = _mm256_set1_ps(plane.z);
+      auto distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+          _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+      const auto radius = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(nx, abs_mask), ex),
+                        _mm256_mul_ps(_mm256_and_ps(ny, abs_mask), ey)),
+          _mm256_mul_ps(_mm256_and_ps(nz, abs_mask), ez));
+      distance = _mm256_add_ps(distance, radius);
+      outside = _mm256_or_ps(
+          outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    const auto mask = _mm256_movemask_ps(outside);
+    for (size_t lane = 0; lane < 8 && i + lane < last; lane++)
+      visibility[i + lane] = !(mask & (1 << lane));
+  }
+#elif defined(YAGF_SSE_CULLING)
+  const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  for (; i < last; i += 4) {
+    const auto cx = _mm_loadu_ps(&boxes.center_x[i]);
+    const auto cy = _mm_loadu_ps(&boxes.center_y[i]);
+    const auto cz = _mm_loadu_ps(&boxes.center_z[i]);
+    const auto ex = _mm_loadu_ps(&boxes.extent_x[i]);
+    const auto ey = _mm_loadu_ps(&boxes.extent_y[i]);
+    const auto ez = _mm_loadu_ps(&boxes.extent_z[i]);
+    auto outside = _mm_setzero_ps();
+    for (const auto &plane : view_frustum.planes) {
+      const auto nx = _mm_set1_ps(plane.x);
+      const auto ny = _mm_set1_ps(plane.y);
+      const auto nz = _mm_set1_ps(plane.z);
+      auto distance =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                     _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+      const auto radius =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, abs_mask), ex),
+                                _mm_mul_ps(_mm_and_ps(ny, abs_mask), ey)),
+                     _mm_mul_ps(_mm_and_ps(nz, abs_mask), ez));
+      distance = _mm_add_ps(distance, radius);
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+    }
+    const auto mask = _mm_movemask_ps(outside);
+    for (size_t lane = 0; lane < 4 && i + lane < last; lane++)
+      visibility[i + lane] = !(mask & (1 << lane));
+  }
+#else
+  for (; i < last; i++) {
+    aabb box;
+    box.min = glm::vec3(boxes.center_x[i] - boxes.extent_x[i],
+                        boxes.center_y[i] - boxes.extent_y[i],
+                        boxes.center_z[i] - boxes.extent_z[i]);
+    box.max = glm::vec3(boxes.center_x[i] + boxes.extent_x[i],
+                        boxes.center_y[i] + boxes.extent_y[i],
+                        boxes.center_z[i] + boxes.extent_z[i]);
+    visibility[i] = view_frustum.intersects(box);
+  }
+#endif
+  stats.tested = static_cast<uint32_t>(count);
+  stats.visible = static_cast<uint32_t>(std::count(
+      visibility.begin() + first, visibility.begin() + last, 1));
+  stats.culled = stats.tested - stats.visible;
+  return stats;
+}
+}
+}
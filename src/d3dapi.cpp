@@ -55,6 +55,10 @@ DXGI_FORMAT get_dxgi_format(irr::video::ECOLOR_FORMAT fmt) {
     return DXGI_FORMAT_R16_FLOAT;
   case irr::video::ECF_R16G16F:
     return DXGI_FORMAT_R16G16_FLOAT;
+  case irr::video::ECF_R16G16_SNORM:
+    return DXGI_FORMAT_R16G16_SNORM;
+  case irr::video::ECF_R16G16B16A16_UNORM:
+    return DXGI_FORMAT_R16G16B16A16_UNORM;
   case irr::video::ECF_R16G16B16A16F:
     return DXGI_FORMAT_R16G16B16A16_FLOAT;
   case irr::video::ECF_R32F:
@@ -83,6 +87,14 @@ DXGI_FORMAT get_dxgi_format(irr::video::ECOLOR_FORMAT fmt) {
     return DXGI_FORMAT_BC5_UNORM;
   case irr::video::ECF_BC5_SNORM:
     return DXGI_FORMAT_BC5_SNORM;
+  case irr::video::ECF_BC6H_UF16:
+    return DXGI_FORMAT_BC6H_UF16;
+  case irr::video::ECF_BC6H_SF16:
+    return DXGI_FORMAT_BC6H_SF16;
+  case irr::video::ECF_BC7_UNORM:
+    return DXGI_FORMAT_BC7_UNORM;
+  case irr::video::ECF_BC7_UNORM_SRGB:
+    return DXGI_FORMAT_BC7_UNORM_SRGB;
   case irr::video::D24U8:
     return DXGI_FORMAT_D24_UNORM_S8_UINT;
   }
@@ -151,6 +163,14 @@ DXGI_FORMAT get_dxgi_samplable_format(irr::video::ECOLOR_FORMAT fmt) {
     return DXGI_FORMAT_BC5_UNORM;
   case irr::video::ECF_BC5_SNORM:
     return DXGI_FORMAT_BC5_SNORM;
+  case irr::video::ECF_BC6H_UF16:
+    return DXGI_FORMAT_BC6H_UF16;
+  case irr::video::ECF_BC6H_SF16:
+    return DXGI_FORMAT_BC6H_SF16;
+  case irr::video::ECF_BC7_UNORM:
+    return DXGI_FORMAT_BC7_UNORM;
+  case irr::video::ECF_BC7_UNORM_SRGB:
+    return DXGI_FORMAT_BC7_UNORM_SRGB;
   case irr::video::D24U8:
     return DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
   }
@@ -339,6 +359,9 @@ create_image_view(device_t &dev, image_t &img, irr::video::ECOLOR_FORMAT fmt,
   if (texture_type == irr::video::E_TEXTURE_TYPE::ETT_2D) {
     desc.texture_type = d3d12_texture_type::texture2d;
   }
+  if (texture_type == irr::video::E_TEXTURE_TYPE::ETT_2D_ARRAY) {
+    desc.texture_type = d3d12_texture_type::texture2darray;
+  }
   return std::make_unique<image_view_t>(desc);
 }
 
@@ -356,6 +379,13 @@ void set_image_view(device_t &dev,
     desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
     desc.Texture2D.MipLevels = img_view.mipmap_count;
   }
+  if (img_view.texture_type == d3d12_texture_type::texture2darray) {
+    desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    desc.Texture2DArray.MostDetailedMip = img_view.base_mipmap;
+    desc.Texture2DArray.MipLevels = img_view.mipmap_count;
+    desc.Texture2DArray.FirstArraySlice = img_view.base_layer;
+    desc.Texture2DArray.ArraySize = img_view.layer_count;
+  }
   dev->CreateShaderResourceView(
       img_view.image, &desc,
       CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptor_set)
@@ -461,13 +491,18 @@ void copy_buffer_to_image_subresource(command_list_t &list,
                                       uint64_t offset_in_buffer, uint32_t width,
                                       uint32_t height, uint32_t row_pitch,
                                       irr::video::ECOLOR_FORMAT format) {
+  // Footprints of compressed formats cover whole blocks.
+  const auto &block = irr::video::formatBlockExtent(format);
+  const auto &footprint_width = (width + block - 1) / block * block;
+  const auto &footprint_height = (height + block - 1) / block * block;
   list->CopyTextureRegion(
       &CD3DX12_TEXTURE_COPY_LOCATION(destination_image,
                                      destination_subresource),
       0, 0, 0,
       &CD3DX12_TEXTURE_COPY_LOCATION(
           source, {offset_in_buffer,
-                   {get_dxgi_format(format), width, height, 1, row_pitch}}),
+                   {get_dxgi_format(format), footprint_width, footprint_height,
+                    1, row_pitch}}),
       &CD3DX12_BOX(0, 0, width, height));
 }
 
@@ -0,0 +1,151 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/GeometryArena.h>
+#include <algorithm>
+
+namespace irr {
+namespace scene {
+range_allocator::range_allocator(uint32_t size)
+    : capacity(size), free_size(size) {
+  if (size > 0)
+    free_ranges.emplace(0, size);
+}
+
+uint32_t range_allocator::allocate(uint32_t size) {
+  if (size == 0)
+    return 0;
+  for (auto It = free_ranges.begin(); It != free_ranges.end(); ++It) {
+    if (It->second < size)
+      continue;
+    const auto offset = It->first;
+    const auto remaining = It->second - size;
+    free_ranges.erase(It);
+    if (remaining > 0)
+      free_ranges.emplace(offset + size, remaining);
+    free_size -= size;
+    return offset;
+  }
+  return invalid_offset;
+}
+
+void range_allocator::release(uint32_t offset, uint32_t size) {
+  if (size == 0)
+    return;
+  free_size += size;
+  auto next = free_ranges.lower_bound(offset);
+  if (next != free_ranges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      size += previous->second;
+      free_ranges.erase(previous);
+    }
+  }
+  if (next != free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    free_ranges.erase(next);
+  }
+  free_ranges.emplace(offset, size);
+}
+
+void range_allocator::grow(uint32_t new_capacity) {
+  if (new_capacity < capacity)
+    throw "range_allocator: capacity can't shrink";
+  const auto added = new_capacity - capacity;
+  capacity = new_capacity;
+  release(capacity - added, added);
+}
+
+uint32_t range_allocator::get_largest_free_range() const {
+  uint32_t result = 0;
+  for (const auto &range : free_ranges)
+    result = std::max(result, range.second);
+  return result;
+}
+
+std::tuple<uint32_t, uint32_t, uint32_t>
+geometry_arena::get_strides(vertex_format format) {
+  switch (format) {
+  case vertex_format::full:
+    return std::make_tuple(12, 12, 12);
+  case vertex_format::compressed:
+    return std::make_tuple(8, 4, 4);
+  }
+  throw "geometry_arena: unknown vertex format";
+}
+
+uint32_t geometry_arena::get_vertex_size(vertex_format format) {
+  const auto strides = get_strides(format);
+  return std::get<0>(strides) + std::get<1>(strides) + std::get<2>(strides);
+}
+
+geometry_arena::geometry_arena(device_t &dev, uint32_t vertices,
+                               uint32_t indices, vertex_format fmt)
+    : format(fmt), vertex_capacity(vertices), index_capacity(indices),
+      vertex_ranges(vertices), index_ranges(indices) {
+  uint32_t position_stride, normal_stride, uv0_stride;
+  std::tie(position_stride, normal_stride, uv0_stride) = get_strides(format);
+  vertex_pos = dev.create_buffer(
+      vertex_capacity * position_stride,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_vertex,
+      memory_category::vertex_buffer, "arena positions");
+  vertex_normal = dev.create_buffer(
+      vertex_capacity * normal_stride,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_vertex,
+      memory_category::vertex_buffer, "arena normals");
+  vertex_uv0 = dev.create_buffer(
+      vertex_capacity * uv0_stride,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_vertex,
+      memory_category::vertex_buffer, "arena uv0");
+  // Compute passes read the indices as 32 bits words, see meshlet_culling.
+  index_buffer = dev.create_buffer(
+      (index_capacity * sizeof(uint16_t) + 3) & ~3u,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_index | usage_uav,
+      memory_category::index_buffer, "arena indexes");
+  // TODO: Upload to GPUmem
+
+  vertex_buffers_info.emplace_back(*vertex_pos, 0, position_stride,
+                                   vertex_capacity * position_stride);
+  vertex_buffers_info.emplace_back(*vertex_normal, 0, normal_stride,
+                                   vertex_capacity * normal_stride);
+  vertex_buffers_info.emplace_back(*vertex_uv0, 0, uv0_stride,
+                                   vertex_capacity * uv0_stride);
+}
+
+geometry_arena::~geometry_arena() {}
+
+geometry_allocation geometry_arena::allocate(uint32_t vertex_count,
+                                             uint32_t index_count) {
+  geometry_allocation result;
+  result.first_vertex = vertex_ranges.allocate(vertex_count);
+  if (result.first_vertex == range_allocator::invalid_offset)
+    throw "geometry_arena: out of vertex memory";
+  result.first_index = index_ranges.allocate(index_count);
+  if (result.first_index == range_allocator::invalid_offset) {
+    vertex_ranges.release(result.first_vertex, vertex_count);
+    throw "geometry_arena: out of index memory";
+  }
+  result.vertex_count = vertex_count;
+  result.index_count = index_count;
+  return result;
+}
+
+void geometry_arena::release(const geometry_allocation &allocation) {
+  vertex_ranges.release(allocation.first_vertex, allocation.vertex_count);
+  index_ranges.release(allocation.first_index, allocation.index_count);
+}
+
+geometry_arena::mapping geometry_arena::map() {
+  return mapping{vertex_pos->map_buffer(), vertex_normal->map_buffer(),
+                 vertex_uv0->map_buffer(),
+                 static_cast<uint16_t *>(index_buffer->map_buffer())};
+}
+
+void geometry_arena::unmap() {
+  vertex_pos->unmap_buffer();
+  vertex_normal->unmap_buffer();
+  vertex_uv0->unmap_buffer();
+  index_buffer->unmap_buffer();
+}
+}
+}
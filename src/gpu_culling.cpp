@@ -0,0 +1,462 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene\GpuCulling.h>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+const auto gpu_culling_code = std::vector<uint32_t>
+#include <generatedShaders\gpu_culling.h>
+    ;
+
+namespace irr {
+namespace scene {
+namespace {
+constexpr uint32_t group_size = 64;
+// Satisfies every minUniformBufferOffsetAlignment and D3D12 constant buffer
+// placement.
+constexpr uint32_t constant_data_stride = 256;
+constexpr auto argument_stride =
+    static_cast<uint32_t>(sizeof(draw_indexed_indirect_arguments));
+// constant_id of gpu_culling.comp.
+constexpr uint32_t occlusion_culling_constant = 0;
+
+struct culling_constant_data {
+  float planes[6][4];
+  float view_projection[16];
+  uint32_t draw_count;
+  uint32_t phase;
+  uint32_t padding[2];
+};
+
+const auto culling_set_type =
+    descriptor_set({range_of_descriptors(RESOURCE_VIEW::CONSTANTS_BUFFER, 0, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 1, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 2, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 3, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 4, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 5, 1)},
+                   shader_stage::all);
+
+const auto occlusion_set_type =
+    descriptor_set({range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 6, 1),
+                    range_of_descriptors(RESOURCE_VIEW::SHADER_RESOURCE, 7, 1)},
+                   shader_stage::all);
+
+const auto occlusion_sampler_set_type = descriptor_set(
+    {range_of_descriptors(RESOURCE_VIEW::SAMPLER, 8, 1)}, shader_stage::all);
+
+auto get_draw_key(const draw_indexed_indirect_arguments &arguments) {
+  return std::make_tuple(arguments.first_index, arguments.vertex_offset,
+                         arguments.index_count, arguments.instance_count);
+}
+}
+
+gpu_culling::gpu_culling(device_t &dev, uint32_t _frame_count)
+    : frame_count(_frame_count), retired(_frame_count),
+      uses_draw_count(dev.supports_draw_indirect_count()) {
+  culling_set = dev.get_object_descriptor_set(culling_set_type);
+  culling_sig = dev.create_pipeline_layout(
+      std::vector<const descriptor_set_layout *>{culling_set.get()});
+  culling_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}
+          .set_compute_shader(gpu_culling_code)
+          .set_specialization_constant(occlusion_culling_constant, 0),
+      *culling_sig);
+  constant_data = dev.create_buffer(
+      constant_data_stride * 2 * frame_count,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uniform);
+}
+
+gpu_culling::~gpu_culling() {}
+
+void gpu_culling::clear() {
+  instances.clear();
+  draws.clear();
+  batch_sizes.clear();
+  batch_first_arguments.clear();
+}
+
+uint32_t gpu_culling::add_instance(const glm::mat4 &world) {
+  return instances.push_back(world);
+}
+
+uint32_t gpu_culling::add_batch() {
+  batch_sizes.push_back(0);
+  return static_cast<uint32_t>(batch_sizes.size() - 1);
+}
+
+uint32_t gpu_culling::add_draw(uint32_t batch, uint32_t instance,
+                               const aabb &object_bounds, uint32_t index_count,
+                               uint32_t first_index, int32_t vertex_offset) {
+  // Empty submeshes are never visible.
+  if (object_bounds.is_empty())
+    return invalid_draw;
+  const auto &center = object_bounds.get_center();
+  const auto &extents = object_bounds.get_extents();
+  batch_sizes[batch]++;
+  return draws.push_back(gpu_draw_record{{center.x, center.y, center.z},
+                                         instance,
+                                         {extents.x, extents.y, extents.z},
+                                         0,
+                                         index_count,
+                                         first_index,
+                                         vertex_offset,
+                                         batch});
+}
+
+void gpu_culling::create_inputs(device_t &dev) {
+  // Sets read by frames in flight are never written again, they are retired
+  // with their heap and replaced.
+  for (auto &input : culling_inputs)
+    retired.retire(std::move(input));
+  culling_inputs.clear();
+  retired.retire(std::move(occlusion_input));
+  retired.retire(std::move(heap));
+
+  // The occlusion set is allocated from the same heap, they are bound
+  // together.
+  const auto input_count = 2 * frame_count;
+  heap = dev.create_descriptor_storage(
+      input_count + 1, {{RESOURCE_VIEW::CONSTANTS_BUFFER, input_count},
+                        {RESOURCE_VIEW::UAV_BUFFER, 5 * input_count + 1},
+                        {RESOURCE_VIEW::SHADER_RESOURCE, 1}});
+  for (uint32_t slot = 0; slot < input_count; slot++) {
+    culling_inputs.push_back(
+        heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+            6 * slot, {culling_set.get()}, 6));
+    dev.set_constant_buffer_view(*culling_inputs.back(), 0, 0, *constant_data,
+                                 sizeof(culling_constant_data),
+                                 constant_data_stride * slot);
+  }
+  if (occlusion_pyramid == nullptr)
+    return;
+  occlusion_input = heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+      6 * input_count, {occlusion_set.get()}, 2);
+  dev.set_image_view(*occlusion_input, 1, 7,
+                     occlusion_pyramid->get_pyramid_view());
+}
+
+void gpu_culling::upload(device_t &dev, bool readback) {
+  batch_first_arguments.resize(batch_sizes.size());
+  uint32_t argument_count = 0;
+  for (size_t batch = 0; batch < batch_sizes.size(); batch++) {
+    batch_first_arguments[batch] = argument_count;
+    argument_count += batch_sizes[batch];
+  }
+  for (auto &draw : draws.get_items())
+    draw.first_argument = batch_first_arguments[draw.batch];
+
+  create_inputs(dev);
+  instances.upload(dev, frame_count, "culling instances", retired);
+  draws.upload(dev, frame_count, "culling draw records", retired);
+  const auto instances_size = instances.get_buffer_size();
+  const auto draws_size = draws.get_buffer_size();
+
+  const auto arguments_size =
+      get_storage_buffer_size<draw_indexed_indirect_arguments>(argument_count);
+  retired.retire(std::move(argument_buffer));
+  retired.retire(std::move(count_buffer));
+  retired.retire(std::move(argument_readback));
+  retired.retire(std::move(count_readback));
+  argument_buffer = dev.create_buffer(
+      arguments_size, irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL,
+      usage_uav | usage_indirect | usage_buffer_transfer_dst |
+          usage_buffer_transfer_src,
+      memory_category::other, "culled draw arguments");
+  const auto counts_size =
+      get_storage_buffer_size<uint32_t>(batch_sizes.size());
+  count_buffer = dev.create_buffer(
+      counts_size, irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL,
+      usage_uav | usage_indirect | usage_buffer_transfer_dst |
+          usage_buffer_transfer_src,
+      memory_category::other, "culled draw counts");
+  statistics.create(dev, readback, "culling statistics", retired);
+  if (readback) {
+    argument_readback = dev.create_buffer(
+        arguments_size, irr::video::E_MEMORY_POOL::EMP_CPU_READABLE,
+        usage_buffer_transfer_dst, memory_category::staging,
+        "culled draw arguments readback");
+    count_readback = dev.create_buffer(
+        counts_size, irr::video::E_MEMORY_POOL::EMP_CPU_READABLE,
+        usage_buffer_transfer_dst, memory_category::staging,
+        "culled draw counts readback");
+  }
+
+  for (uint32_t slot = 0; slot < culling_inputs.size(); slot++) {
+    auto &input = *culling_inputs[slot];
+    const auto frame = slot / 2;
+    dev.set_uav_buffer_view(input, 1, 1, instances.get_buffer(frame), 0,
+                            instances_size);
+    dev.set_uav_buffer_view(input, 2, 2, draws.get_buffer(frame), 0,
+                            draws_size);
+    dev.set_uav_buffer_view(input, 3, 3, *argument_buffer, 0, arguments_size);
+    dev.set_uav_buffer_view(input, 4, 4, *count_buffer, 0, counts_size);
+    dev.set_uav_buffer_view(input, 5, 5, statistics.get_buffer(), 0,
+                            sizeof(gpu_culling_statistics));
+  }
+  if (!uses_occlusion_culling())
+    return;
+
+  // Every draw is visible before the first frame.
+  const auto visibility_size = get_storage_buffer_size<uint32_t>(draws.size());
+  retired.retire(std::move(visibility_buffer));
+  visibility_buffer = dev.create_buffer(
+      visibility_size, irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uav,
+      memory_category::other, "culling visibility");
+  auto *visibility = static_cast<uint32_t *>(visibility_buffer->map_buffer());
+  std::fill(visibility, visibility + draws.size(), 1);
+  visibility_buffer->unmap_buffer();
+  dev.set_uav_buffer_view(*occlusion_input, 0, 6, *visibility_buffer, 0,
+                          visibility_size);
+}
+
+void gpu_culling::set_instance(uint32_t instance, const glm::mat4 &world) {
+  instances.set(instance, world);
+}
+
+void gpu_culling::release_retired(uint32_t frame) { retired.release(frame); }
+
+void gpu_culling::update_instances(uint32_t frame) { instances.flush(frame); }
+
+void gpu_culling::set_draw_range(uint32_t draw, uint32_t index_count,
+                                 uint32_t first_index) {
+  auto record = draws[draw];
+  record.index_count = index_count;
+  record.first_index = first_index;
+  draws.set(draw, record);
+}
+
+void gpu_culling::update_draws(uint32_t frame) { draws.flush(frame); }
+
+void gpu_culling::reset_arguments(command_list_t &cmd_list) {
+  const auto &&reset = [&](buffer_t &buffer, uint64_t size) {
+    cmd_list.set_buffer_barrier(buffer, RESOURCE_USAGE::indirect_argument,
+                                RESOURCE_USAGE::COPY_DEST);
+    cmd_list.fill_buffer(buffer, 0, size, 0);
+    cmd_list.set_buffer_barrier(buffer, RESOURCE_USAGE::COPY_DEST,
+                                RESOURCE_USAGE::uav);
+  };
+  reset(*count_buffer, get_storage_buffer_size<uint32_t>(batch_sizes.size()));
+  // Without a draw count every slot is drawn, unused ones must have no
+  // instance.
+  if (uses_draw_count)
+    cmd_list.set_buffer_barrier(*argument_buffer,
+                                RESOURCE_USAGE::indirect_argument,
+                                RESOURCE_USAGE::uav);
+  else
+    reset(*argument_buffer,
+          get_storage_buffer_size<draw_indexed_indirect_arguments>(
+              draws.size()));
+}
+
+void gpu_culling::finish_arguments(command_list_t &cmd_list,
+                                   bool copies_to_readback) {
+  const auto &&finish = [&](buffer_t &buffer, buffer_t *readback,
+                            uint64_t size) {
+    if (readback == nullptr || !copies_to_readback) {
+      cmd_list.set_buffer_barrier(buffer, RESOURCE_USAGE::uav,
+                                  RESOURCE_USAGE::indirect_argument);
+      return;
+    }
+    cmd_list.set_buffer_barrier(buffer, RESOURCE_USAGE::uav,
+                                RESOURCE_USAGE::COPY_SRC);
+    cmd_list.copy_buffer(buffer, 0, *readback, 0, size);
+    cmd_list.set_buffer_barrier(buffer, RESOURCE_USAGE::COPY_SRC,
+                                RESOURCE_USAGE::indirect_argument);
+  };
+  finish(*count_buffer, count_readback.get(),
+         get_storage_buffer_size<uint32_t>(batch_sizes.size()));
+  finish(*argument_buffer, argument_readback.get(),
+         get_storage_buffer_size<draw_indexed_indirect_arguments>(
+             draws.size()));
+  if (copies_to_readback)
+    statistics.copy_to_readback(cmd_list);
+}
+
+void gpu_culling::record_culling(command_list_t &cmd_list,
+                                 const frustum &view_frustum,
+                                 const glm::mat4 &view_projection,
+                                 culling_phase phase, uint32_t frame) {
+  const auto phase_index = static_cast<uint32_t>(phase);
+  const auto slot = 2 * frame + phase_index;
+  auto *constants = reinterpret_cast<culling_constant_data *>(
+      static_cast<char *>(constant_data->map_buffer()) +
+      constant_data_stride * slot);
+  set_planes(constants->planes, view_frustum);
+  memcpy(constants->view_projection, &view_projection, sizeof(glm::mat4));
+  constants->draw_count = static_cast<uint32_t>(draws.size());
+  constants->phase = phase_index;
+  constant_data->unmap_buffer();
+  if (draws.empty())
+    return;
+
+  // The early phase starts the statistics of the frame, the late phase of the
+  // previous frame wrote the visibility.
+  if (phase == culling_phase::early) {
+    statistics.reset(cmd_list);
+    if (uses_occlusion_culling())
+      cmd_list.set_buffer_barrier(*visibility_buffer, RESOURCE_USAGE::uav,
+                                  RESOURCE_USAGE::uav);
+  }
+  reset_arguments(cmd_list);
+  if (uses_occlusion_culling()) {
+    cmd_list.set_compute_pipeline_layout(*occlusion_sig);
+    cmd_list.set_descriptor_storage_referenced(*heap,
+                                               occlusion_sampler_heap.get());
+    cmd_list.set_compute_pipeline(*occlusion_pso);
+    cmd_list.bind_compute_descriptor(0, *culling_inputs[slot],
+                                     *occlusion_sig);
+    cmd_list.bind_compute_descriptor(1, *occlusion_input, *occlusion_sig);
+    cmd_list.bind_compute_descriptor(2, *occlusion_sampler_input,
+                                     *occlusion_sig);
+  } else {
+    cmd_list.set_compute_pipeline_layout(*culling_sig);
+    cmd_list.set_descriptor_storage_referenced(*heap);
+    cmd_list.set_compute_pipeline(*culling_pso);
+    cmd_list.bind_compute_descriptor(0, *culling_inputs[slot], *culling_sig);
+  }
+  cmd_list.dispatch(
+      static_cast<uint32_t>((draws.size() + group_size - 1) / group_size), 1,
+      1);
+  // The readbacks hold the last phase of the frame.
+  finish_arguments(cmd_list, phase == culling_phase::late ||
+                                 !uses_occlusion_culling());
+}
+
+void gpu_culling::fill_culling_command(command_list_t &cmd_list,
+                                       const frustum &view_frustum,
+                                       uint32_t frame) {
+  if (uses_occlusion_culling())
+    throw "gpu_culling: occlusion culling records its phases with "
+          "fill_occlusion_culling_command";
+  record_culling(cmd_list, view_frustum, glm::mat4(), culling_phase::early,
+                 frame);
+}
+
+void gpu_culling::enable_occlusion_culling(device_t &dev,
+                                           hi_z_pyramid &pyramid) {
+  occlusion_set = dev.get_object_descriptor_set(occlusion_set_type);
+  occlusion_sampler_set =
+      dev.get_object_descriptor_set(occlusion_sampler_set_type);
+  occlusion_sig =
+      dev.create_pipeline_layout(std::vector<const descriptor_set_layout *>{
+          culling_set.get(), occlusion_set.get(), occlusion_sampler_set.get()});
+  occlusion_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}
+          .set_compute_shader(gpu_culling_code)
+          .set_specialization_constant(occlusion_culling_constant, 1),
+      *occlusion_sig);
+  // The occlusion input is allocated with the culling inputs by upload.
+  occlusion_pyramid = &pyramid;
+  occlusion_sampler_heap =
+      dev.create_descriptor_storage(1, {{RESOURCE_VIEW::SAMPLER, 1}});
+  occlusion_sampler_input =
+      occlusion_sampler_heap->allocate_descriptor_set_from_sampler_heap(
+          0, {occlusion_sampler_set.get()}, 1);
+  nearest_sampler = dev.create_sampler(SAMPLER_TYPE::NEAREST);
+  dev.set_sampler(*occlusion_sampler_input, 0, 8, *nearest_sampler);
+}
+
+void gpu_culling::fill_occlusion_culling_command(
+    command_list_t &cmd_list, const frustum &view_frustum,
+    const glm::mat4 &view_projection, culling_phase phase, uint32_t frame) {
+  if (!uses_occlusion_culling())
+    throw "gpu_culling: occlusion culling isn't enabled";
+  record_culling(cmd_list, view_frustum, view_projection, phase, frame);
+}
+
+gpu_culling_statistics gpu_culling::get_statistics() const {
+  if (!statistics.has_readback())
+    throw "gpu_culling: statistics require a readback upload";
+  return statistics.read();
+}
+
+uint64_t gpu_culling::get_triangle_count() const {
+  uint64_t result = 0;
+  for (const auto &draw : draws)
+    result += draw.index_count / 3;
+  return result;
+}
+
+void gpu_culling::draw_batch(command_list_t &cmd_list, uint32_t batch) {
+  if (batch_sizes[batch] == 0)
+    return;
+  const auto offset =
+      uint64_t(batch_first_arguments[batch]) * argument_stride;
+  if (uses_draw_count)
+    cmd_list.draw_indexed_indirect_count(*argument_buffer, offset,
+                                         *count_buffer,
+                                         uint64_t(batch) * sizeof(uint32_t),
+                                         batch_sizes[batch], argument_stride);
+  else
+    cmd_list.draw_indexed_indirect(*argument_buffer, offset,
+                                   batch_sizes[batch], argument_stride);
+}
+
+void gpu_culling::cull_reference(
+    const frustum &view_frustum,
+    std::vector<draw_indexed_indirect_arguments> &arguments,
+    std::vector<uint32_t> &counts) const {
+  arguments.assign(draws.size(), draw_indexed_indirect_arguments{});
+  counts.assign(batch_sizes.size(), 0);
+  for (const auto &draw : draws) {
+    aabb box;
+    box.min = glm::vec3(draw.center[0] - draw.extents[0],
+                        draw.center[1] - draw.extents[1],
+                        draw.center[2] - draw.extents[2]);
+    box.max = glm::vec3(draw.center[0] + draw.extents[0],
+                        draw.center[1] + draw.extents[1],
+                        draw.center[2] + draw.extents[2]);
+    if (!view_frustum.intersects(box.transform(instances[draw.instance])))
+      continue;
+    arguments[draw.first_argument + counts[draw.batch]++] =
+        draw_indexed_indirect_arguments{draw.index_count, 1, draw.first_index,
+                                        draw.vertex_offset, 0};
+  }
+}
+
+size_t gpu_culling::validate(const frustum &view_frustum) const {
+  if (count_readback == nullptr)
+    throw "gpu_culling: validate requires a readback upload";
+  if (uses_occlusion_culling())
+    throw "gpu_culling: validate does not support occlusion culling";
+  std::vector<draw_indexed_indirect_arguments> arguments;
+  std::vector<uint32_t> counts;
+  cull_reference(view_frustum, arguments, counts);
+
+  const auto *gpu_counts =
+      static_cast<const uint32_t *>(count_readback->map_buffer());
+  const auto *gpu_arguments =
+      static_cast<const draw_indexed_indirect_arguments *>(
+          argument_readback->map_buffer());
+  size_t mismatches = 0;
+  for (size_t batch = 0; batch < batch_sizes.size(); batch++) {
+    if (gpu_counts[batch] != counts[batch]) {
+      mismatches++;
+      continue;
+    }
+    const auto first = batch_first_arguments[batch];
+    std::vector<draw_indexed_indirect_arguments> expected(
+        arguments.begin() + first, arguments.begin() + first + counts[batch]);
+    std::vector<draw_indexed_indirect_arguments> result(
+        gpu_arguments + first, gpu_arguments + first + counts[batch]);
+    const auto &&less = [](const draw_indexed_indirect_arguments &a,
+                           const draw_indexed_indirect_arguments &b) {
+      return get_draw_key(a) < get_draw_key(b);
+    };
+    std::sort(expected.begin(), expected.end(), less);
+    std::sort(result.begin(), result.end(), less);
+    if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                    [](const draw_indexed_indirect_arguments &a,
+                       const draw_indexed_indirect_arguments &b) {
+                      return get_draw_key(a) == get_draw_key(b);
+                    }))
+      mismatches++;
+  }
+  argument_readback->unmap_buffer();
+  count_readback->unmap_buffer();
+  return mismatches;
+}
+}
+}
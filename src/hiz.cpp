@@ -0,0 +1,111 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene\HiZ.h>
+#include <algorithm>
+
+const auto hiz_reduce_code = std::vector<uint32_t>
+#include <generatedShaders\hiz_reduce.h>
+    ;
+
+namespace irr {
+namespace scene {
+namespace {
+constexpr uint32_t group_size = 8;
+
+const auto reduce_set_type =
+    descriptor_set({range_of_descriptors(RESOURCE_VIEW::SHADER_RESOURCE, 0, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 1, 1)},
+                   shader_stage::all);
+
+const auto sampler_set_type = descriptor_set(
+    {range_of_descriptors(RESOURCE_VIEW::SAMPLER, 2, 1)}, shader_stage::all);
+
+uint32_t get_mip_count(uint32_t width, uint32_t height) {
+  uint32_t result = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+    result++;
+  }
+  return result;
+}
+}
+
+hi_z_pyramid::hi_z_pyramid(device_t &dev, image_t &depth,
+                           irr::video::ECOLOR_FORMAT depth_format,
+                           uint32_t depth_width, uint32_t depth_height)
+    : depth_buffer(depth), width(std::max(depth_width / 2, 1u)),
+      height(std::max(depth_height / 2, 1u)),
+      level_count(get_mip_count(width, height)) {
+  reduce_set = dev.get_object_descriptor_set(reduce_set_type);
+  sampler_set = dev.get_object_descriptor_set(sampler_set_type);
+  reduce_sig =
+      dev.create_pipeline_layout(std::vector<const descriptor_set_layout *>{
+          reduce_set.get(), sampler_set.get()});
+  reduce_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}.set_compute_shader(hiz_reduce_code),
+      *reduce_sig);
+
+  heap = dev.create_descriptor_storage(
+      level_count, {{RESOURCE_VIEW::SHADER_RESOURCE, level_count},
+                    {RESOURCE_VIEW::UAV_IMAGE, level_count}});
+  sampler_heap =
+      dev.create_descriptor_storage(1, {{RESOURCE_VIEW::SAMPLER, 1}});
+  sampler_input = sampler_heap->allocate_descriptor_set_from_sampler_heap(
+      0, {sampler_set.get()}, 1);
+  nearest_sampler = dev.create_sampler(SAMPLER_TYPE::NEAREST);
+  dev.set_sampler(*sampler_input, 0, 2, *nearest_sampler);
+
+  pyramid = dev.create_image(irr::video::ECF_R32F, width, height,
+                             static_cast<uint16_t>(level_count), 1,
+                             usage_uav | usage_sampled, nullptr,
+                             memory_category::render_target, "hi-z pyramid");
+  pyramid_view = dev.create_image_view(
+      *pyramid, irr::video::ECF_R32F, 0, static_cast<uint16_t>(level_count), 0,
+      1, irr::video::E_TEXTURE_TYPE::ETT_2D);
+  depth_view = dev.create_image_view(
+      depth_buffer, depth_format, 0, 1, 0, 1,
+      irr::video::E_TEXTURE_TYPE::ETT_2D, irr::video::E_ASPECT::EA_DEPTH);
+
+  for (uint32_t level = 0; level < level_count; level++) {
+    level_views.push_back(dev.create_image_view(
+        *pyramid, irr::video::ECF_R32F, static_cast<uint16_t>(level), 1, 0, 1,
+        irr::video::E_TEXTURE_TYPE::ETT_2D));
+    reduce_inputs.push_back(heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+        2 * level, {reduce_set.get()}, 2));
+    auto &source = level == 0 ? *depth_view : *level_views[level - 1];
+    dev.set_image_view(*reduce_inputs.back(), 0, 0, source);
+    dev.set_uav_image_view(*reduce_inputs.back(), 1, 1, *level_views.back());
+  }
+}
+
+hi_z_pyramid::~hi_z_pyramid() {}
+
+void hi_z_pyramid::fill_command_list(command_list_t &cmd_list) {
+  cmd_list.set_pipeline_barrier(depth_buffer, RESOURCE_USAGE::DEPTH_WRITE,
+                                RESOURCE_USAGE::READ_GENERIC, 0,
+                                irr::video::E_ASPECT::EA_DEPTH_STENCIL);
+  cmd_list.set_compute_pipeline_layout(*reduce_sig);
+  cmd_list.set_descriptor_storage_referenced(*heap, sampler_heap.get());
+  cmd_list.set_compute_pipeline(*reduce_pso);
+  cmd_list.bind_compute_descriptor(1, *sampler_input, *reduce_sig);
+  for (uint32_t level = 0; level < level_count; level++) {
+    const auto level_width = std::max(width >> level, 1u);
+    const auto level_height = std::max(height >> level, 1u);
+    // Every texel of the level is written, previous content is discarded.
+    cmd_list.set_pipeline_barrier(*pyramid, RESOURCE_USAGE::undefined,
+                                  RESOURCE_USAGE::uav, level,
+                                  irr::video::E_ASPECT::EA_COLOR);
+    cmd_list.bind_compute_descriptor(0, *reduce_inputs[level], *reduce_sig);
+    cmd_list.dispatch((level_width + group_size - 1) / group_size,
+                      (level_height + group_size - 1) / group_size, 1);
+    cmd_list.set_pipeline_barrier(*pyramid, RESOURCE_USAGE::uav,
+                                  RESOURCE_USAGE::READ_GENERIC, level,
+                                  irr::video::E_ASPECT::EA_COLOR);
+  }
+  cmd_list.set_pipeline_barrier(depth_buffer, RESOURCE_USAGE::READ_GENERIC,
+                                RESOURCE_USAGE::DEPTH_WRITE, 0,
+                                irr::video::E_ASPECT::EA_DEPTH_STENCIL);
+}
+}
+}
@@ -0,0 +1,177 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\MappedFile.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Unbuffered reads need sector aligned buffers, offsets and sizes.
+constexpr size_t direct_read_alignment = 4096;
+// Large enough to keep the drive queue full.
+constexpr size_t direct_read_chunk = 8 * 1024 * 1024;
+
+size_t align_to_sector(size_t size) {
+  return (size + direct_read_alignment - 1) & ~(direct_read_alignment - 1);
+}
+}
+
+#ifdef _WIN32
+mapped_file::mapped_file(const std::string &path, file_access _access)
+    : access(_access) {
+  const DWORD flags = access == file_access::direct_read
+                          ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN
+                          : FILE_ATTRIBUTE_NORMAL;
+  file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, flags, nullptr);
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    file_handle = nullptr;
+    throw "mapped_file: can't open file";
+  }
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file_handle, &file_size);
+  byte_count = static_cast<size_t>(file_size.QuadPart);
+  if (byte_count == 0)
+    return;
+  if (access == file_access::direct_read) {
+    const auto buffer_size = align_to_sector(byte_count);
+    char *buffer = static_cast<char *>(
+        _aligned_malloc(buffer_size, direct_read_alignment));
+    if (buffer == nullptr) {
+      CloseHandle(file_handle);
+      file_handle = nullptr;
+      throw "mapped_file: can't allocate read buffer";
+    }
+    size_t read_count = 0;
+    while (read_count < byte_count) {
+      const auto chunk = std::min(direct_read_chunk, buffer_size - read_count);
+      DWORD chunk_read = 0;
+      if (!ReadFile(file_handle, buffer + read_count,
+                    static_cast<DWORD>(chunk), &chunk_read, nullptr) ||
+          chunk_read == 0)
+        break;
+      read_count += chunk_read;
+    }
+    CloseHandle(file_handle);
+    file_handle = nullptr;
+    if (read_count < byte_count) {
+      _aligned_free(buffer);
+      throw "mapped_file: can't read file";
+    }
+    bytes = buffer;
+    return;
+  }
+  mapping_handle =
+      CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_handle != nullptr)
+    bytes = static_cast<const char *>(
+        MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+  if (bytes == nullptr) {
+    if (mapping_handle != nullptr)
+      CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    throw "mapped_file: can't map file";
+  }
+}
+
+mapped_file::~mapped_file() {
+  if (bytes != nullptr) {
+    if (access == file_access::direct_read)
+      _aligned_free(const_cast<char *>(bytes));
+    else
+      UnmapViewOfFile(bytes);
+  }
+  if (mapping_handle != nullptr)
+    CloseHandle(mapping_handle);
+  if (file_handle != nullptr)
+    CloseHandle(file_handle);
+}
+#else
+mapped_file::mapped_file(const std::string &path, file_access _access)
+    : access(_access) {
+  if (access == file_access::direct_read) {
+#ifdef O_DIRECT
+    descriptor = open(path.c_str(), O_RDONLY | O_DIRECT);
+#endif
+    // tmpfs and some network file systems refuse O_DIRECT.
+    if (descriptor < 0)
+      descriptor = open(path.c_str(), O_RDONLY);
+  } else
+    descriptor = open(path.c_str(), O_RDONLY);
+  if (descriptor < 0)
+    throw "mapped_file: can't open file";
+  struct stat status;
+  fstat(descriptor, &status);
+  byte_count = static_cast<size_t>(status.st_size);
+  if (byte_count == 0)
+    return;
+  if (access == file_access::direct_read) {
+    const auto buffer_size = align_to_sector(byte_count);
+    char *buffer = static_cast<char *>(
+        std::aligned_alloc(direct_read_alignment, buffer_size));
+    if (buffer == nullptr) {
+      close(descriptor);
+      descriptor = -1;
+      throw "mapped_file: can't allocate read buffer";
+    }
+    size_t read_count = 0;
+    while (read_count < byte_count) {
+      const auto chunk = std::min(direct_read_chunk, buffer_size - read_count);
+      const auto chunk_read = read(descriptor, buffer + read_count, chunk);
+      if (chunk_read <= 0)
+        break;
+      read_count += static_cast<size_t>(chunk_read);
+    }
+    close(descriptor);
+    descriptor = -1;
+    if (read_count < byte_count) {
+      std::free(buffer);
+      throw "mapped_file: can't read file";
+    }
+    bytes = buffer;
+    return;
+  }
+  void *address =
+      mmap(nullptr, byte_count, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  if (address == MAP_FAILED) {
+    close(descriptor);
+    throw "mapped_file: can't map file";
+  }
+  madvise(address, byte_count, MADV_SEQUENTIAL);
+  bytes = static_cast<const char *>(address);
+}
+
+mapped_file::~mapped_file() {
+  if (bytes != nullptr) {
+    if (access == file_access::direct_read)
+      std::free(const_cast<char *>(bytes));
+    else
+      munmap(const_cast<char *>(bytes), byte_count);
+  }
+  if (descriptor >= 0)
+    close(descriptor);
+}
+#endif
+
+void mapped_file::prefetch() const {
+  if (access == file_access::direct_read)
+    return;
+  // Reading a byte per page faults the whole file in.
+  volatile char sink = 0;
+  for (size_t i = 0; i < byte_count; i += direct_read_alignment)
+    sink = sink + bytes[i];
+}
+
+bool mapped_file::exists(const std::string &path) {
+  return std::ifstream(path, std::ios::binary).good();
+}
@@ -0,0 +1,152 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include "../include/API/MemoryTracker.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+namespace {
+constexpr auto mib = 1024. * 1024.;
+
+std::string escape_json(const std::string &str) {
+  auto &&result = std::string{};
+  for (const auto &c : str) {
+    if (c == '"' || c == '\\')
+      result.push_back('\\');
+    if (static_cast<unsigned char>(c) < 0x20)
+      continue;
+    result.push_back(c);
+  }
+  return result;
+}
+}
+
+const char *get_memory_category_name(memory_category category) {
+  switch (category) {
+  case memory_category::automatic:
+    return "automatic";
+  case memory_category::texture:
+    return "texture";
+  case memory_category::render_target:
+    return "render_target";
+  case memory_category::vertex_buffer:
+    return "vertex_buffer";
+  case memory_category::index_buffer:
+    return "index_buffer";
+  case memory_category::uniform_buffer:
+    return "uniform_buffer";
+  case memory_category::staging:
+    return "staging";
+  case memory_category::other:
+    return "other";
+  }
+  throw;
+}
+
+uint64_t memory_tracker::register_allocation(uint32_t heap,
+                                             memory_category category,
+                                             uint64_t size,
+                                             const std::string &debug_name) {
+  if (heap >= max_heaps)
+    throw "memory_tracker: heap index out of range";
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto id = next_allocation_id++;
+  allocations.emplace(id, allocation{heap, category, size, debug_name});
+  heap_usage[heap] += size;
+  category_usage[static_cast<size_t>(category)] += size;
+  category_allocation_count[static_cast<size_t>(category)]++;
+  return id;
+}
+
+void memory_tracker::release_allocation(uint64_t allocation_id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto &It = allocations.find(allocation_id);
+  if (It == allocations.end())
+    return;
+  const auto &alloc = It->second;
+  heap_usage[alloc.heap] -= alloc.size;
+  category_usage[static_cast<size_t>(alloc.category)] -= alloc.size;
+  category_allocation_count[static_cast<size_t>(alloc.category)]--;
+  allocations.erase(It);
+}
+
+uint64_t memory_tracker::get_heap_usage(uint32_t heap) const {
+  if (heap >= max_heaps)
+    throw "memory_tracker: heap index out of range";
+  std::lock_guard<std::mutex> lock(mutex);
+  return heap_usage[heap];
+}
+
+uint64_t memory_tracker::get_category_usage(memory_category category) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return category_usage[static_cast<size_t>(category)];
+}
+
+void memory_tracker::write_table(
+    std::ostream &out, gsl::span<const memory_heap_budget> heaps) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  // Restored on return, the caller's stream is left as it was.
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::fixed << std::setprecision(2);
+  out << std::left << std::setw(16) << "category" << std::right
+      << std::setw(8) << "count" << std::setw(12) << "MiB" << std::endl;
+  for (size_t i = 1; i < category_usage.size(); i++) {
+    out << std::left << std::setw(16)
+        << get_memory_category_name(static_cast<memory_category>(i))
+        << std::right << std::setw(8) << category_allocation_count[i]
+        << std::setw(12) << category_usage[i] / mib << std::endl;
+  }
+  out << std::endl;
+  out << std::left << std::setw(16) << "heap" << std::right << std::setw(12)
+      << "tracked" << std::setw(12) << "usage" << std::setw(12) << "budget"
+      << std::setw(12) << "size" << std::endl;
+  const auto heap_count = std::min<size_t>(heaps.size(), max_heaps);
+  for (size_t i = 0; i < heap_count; i++) {
+    const auto &heap = heaps[i];
+    out << std::left << std::setw(16)
+        << (std::to_string(i) +
+            (heap.device_local ? " (device)" : " (host)"))
+        << std::right << std::setw(12) << heap_usage[i] / mib << std::setw(12)
+        << heap.usage / mib << std::setw(12) << heap.budget / mib
+        << std::setw(12) << heap.size / mib << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void memory_tracker::write_json(
+    std::ostream &out, gsl::span<const memory_heap_budget> heaps) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  out << "{\"categories\":{";
+  for (size_t i = 1; i < category_usage.size(); i++) {
+    out << (i > 1 ? "," : "") << "\""
+        << get_memory_category_name(static_cast<memory_category>(i))
+        << "\":{\"count\":" << category_allocation_count[i]
+        << ",\"bytes\":" << category_usage[i] << "}";
+  }
+  out << "},\"heaps\":[";
+  const auto heap_count = std::min<size_t>(heaps.size(), max_heaps);
+  for (size_t i = 0; i < heap_count; i++) {
+    const auto &heap = heaps[i];
+    out << (i > 0 ? "," : "") << "{\"index\":" << i
+        << ",\"device_local\":" << (heap.device_local ? "true" : "false")
+        << ",\"size\":" << heap.size << ",\"budget\":" << heap.budget
+        << ",\"usage\":" << heap.usage << ",\"tracked\":" << heap_usage[i]
+        << "}";
+  }
+  out << "],\"allocations\":[";
+  // Sorted by id so that successive dumps can be diffed.
+  const auto &sorted_allocations =
+      std::map<uint64_t, allocation>(allocations.begin(), allocations.end());
+  bool first = true;
+  for (const auto &id_alloc : sorted_allocations) {
+    const auto &alloc = id_alloc.second;
+    out << (first ? "" : ",") << "{\"id\":" << id_alloc.first
+        << ",\"name\":\"" << escape_json(alloc.debug_name)
+        << "\",\"category\":\"" << get_memory_category_name(alloc.category)
+        << "\",\"heap\":" << alloc.heap << ",\"bytes\":" << alloc.size << "}";
+    first = false;
+  }
+  out << "]}" << std::endl;
+}
@@ -0,0 +1,237 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/MeshAsset.h>
+#include <Scene/textures.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <tuple>
+
+#define SAMPLE_PATH "..\\..\\..\\examples\\assets\\"
+
+namespace irr {
+namespace scene {
+namespace {
+// Octahedral mapping of a unit vector to [-1, 1]^2, the lower hemisphere is
+// folded over the diagonals.
+glm::vec2 encode_octahedral(glm::vec3 n) {
+  n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (n.z >= 0.f)
+    return glm::vec2(n.x, n.y);
+  return glm::vec2((1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+                   (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+}
+
+// Streams of vertex_format::compressed, positions are stored as
+// (position - offset) / scale.
+void write_compressed_vertices(const geometry_arena::mapping &map,
+                               uint32_t first_vertex, const ymesh &mesh,
+                               const glm::vec3 &offset,
+                               const glm::vec3 &scale) {
+  auto positions = static_cast<uint64_t *>(map.positions) + first_vertex;
+  auto normals = static_cast<uint32_t *>(map.normals) + first_vertex;
+  auto uv0 = static_cast<uint32_t *>(map.uv0) + first_vertex;
+  for (size_t v = 0; v < mesh.get_header().vertex_count; v++) {
+    const auto *position = mesh.get_positions() + v * 3;
+    const auto *normal = mesh.get_normals() + v * 3;
+    const auto *uv = mesh.get_uv0() + v * 3;
+    *positions++ = glm::packUnorm4x16(
+        glm::vec4((glm::make_vec3(position) - offset) / scale, 0.f));
+    *normals++ = glm::packSnorm2x16(encode_octahedral(glm::make_vec3(normal)));
+    *uv0++ = glm::packHalf2x16(glm::vec2(uv[0], uv[1]));
+  }
+}
+
+// Triangles of level 0 of submesh, whose vertices start at first_vertex in the
+// streams of mesh.
+float get_uv_density(const ymesh &mesh, const ymesh_submesh &submesh,
+                     uint32_t first_vertex) {
+  const auto &lods = mesh.get_lods(submesh);
+  if (lods.empty())
+    return 0.f;
+  const auto *indices = mesh.get_indices() + lods[0].first_index;
+  double object_area = 0.;
+  double uv_area = 0.;
+  for (uint32_t i = 0; i + 2 < lods[0].index_count; i += 3) {
+    glm::vec3 positions[3];
+    const float *uvs[3];
+    for (int corner = 0; corner < 3; corner++) {
+      const auto vertex = first_vertex + indices[i + corner];
+      positions[corner] = glm::make_vec3(mesh.get_positions() + vertex * 3);
+      uvs[corner] = mesh.get_uv0() + vertex * 3;
+    }
+    object_area += glm::length(glm::cross(positions[1] - positions[0],
+                                          positions[2] - positions[0]));
+    uv_area += std::abs((uvs[1][0] - uvs[0][0]) * (uvs[2][1] - uvs[0][1]) -
+                        (uvs[1][1] - uvs[0][1]) * (uvs[2][0] - uvs[0][0]));
+  }
+  return object_area > 0.
+             ? static_cast<float>(std::sqrt(uv_area / object_area))
+             : 0.f;
+}
+}
+
+mesh_asset::mesh_asset(device_t &dev, const aiScene *model,
+                       command_list_t &upload_cmd_list,
+                       descriptor_storage_t &heap,
+                       descriptor_set_layout *model_set,
+                       geometry_arena *shared_arena,
+                       texture_cache *shared_textures)
+    : mesh_asset(dev, ymesh(*model), upload_cmd_list, heap, model_set,
+                 shared_arena, shared_textures) {}
+
+mesh_asset::mesh_asset(device_t &dev, const ymesh &mesh,
+                       command_list_t &upload_cmd_list,
+                       descriptor_storage_t &heap,
+                       descriptor_set_layout *model_set,
+                       geometry_arena *shared_arena,
+                       texture_cache *shared_textures)
+    : arena(shared_arena) {
+  // Format Weight
+
+  /*        std::vector<std::vector<irr::video::SkinnedVertexData> >
+  weightsList;
+  for (auto weightbuffer : loader->AnimatedMesh.WeightBuffers)
+  {
+  std::vector<irr::video::SkinnedVertexData> weights;
+  for (unsigned j = 0; j < weightbuffer.size(); j += 4)
+  {
+  irr::video::SkinnedVertexData tmp = {
+  weightbuffer[j].Index, weightbuffer[j].Weight,
+  weightbuffer[j + 1].Index, weightbuffer[j + 1].Weight,
+  weightbuffer[j + 2].Index, weightbuffer[j + 2].Weight,
+  weightbuffer[j + 3].Index, weightbuffer[j + 3].Weight,
+  };
+  weights.push_back(tmp);
+  }
+  weightsList.push_back(weights);
+  }*/
+
+  const auto &header = mesh.get_header();
+  unoptimized_cache_statistics = header.unoptimized_cache_statistics;
+  cache_statistics = header.cache_statistics;
+
+  if (arena == nullptr) {
+    own_arena = std::make_unique<geometry_arena>(dev, header.vertex_count,
+                                                 header.index_count);
+    arena = own_arena.get();
+  }
+  allocation = arena->allocate(header.vertex_count, header.index_count);
+
+  for (const auto &submesh : mesh.get_submeshes()) {
+    aabb submesh_box;
+    if (submesh.vertex_count > 0) {
+      submesh_box.add_point(glm::make_vec3(submesh.bounds_min));
+      submesh_box.add_point(glm::make_vec3(submesh.bounds_max));
+    }
+    submesh_bounds.push_back(submesh_box);
+    bounds.add_box(submesh_box);
+  }
+
+  // Cooked streams have the layout of the arena, they are copied from the
+  // mapped file without going through Assimp.
+  const auto map = arena->map();
+  if (arena->get_format() == vertex_format::compressed) {
+    if (!bounds.is_empty()) {
+      position_offset = bounds.min;
+      position_scale = bounds.max - bounds.min;
+      // Flat meshes quantize their flat axis to 0.
+      for (int axis = 0; axis < 3; axis++)
+        if (position_scale[axis] == 0.f)
+          position_scale[axis] = 1.f;
+    }
+    write_compressed_vertices(map, allocation.first_vertex, mesh,
+                              position_offset, position_scale);
+  } else {
+    const auto stream_size = header.vertex_count * 3 * sizeof(float);
+    memcpy(static_cast<float *>(map.positions) + allocation.first_vertex * 3,
+           mesh.get_positions(), stream_size);
+    memcpy(static_cast<float *>(map.normals) + allocation.first_vertex * 3,
+           mesh.get_normals(), stream_size);
+    memcpy(static_cast<float *>(map.uv0) + allocation.first_vertex * 3,
+           mesh.get_uv0(), stream_size);
+  }
+  memcpy(map.indices + allocation.first_index, mesh.get_indices(),
+         header.index_count * sizeof(uint16_t));
+
+  uint32_t basevertex = allocation.first_vertex;
+  for (const auto &submesh : mesh.get_submeshes()) {
+    submesh_uv_densities.push_back(
+        get_uv_density(mesh, submesh, basevertex - allocation.first_vertex));
+    vertex_offsets.push_back(basevertex);
+    basevertex += submesh.vertex_count;
+    texture_mapping.push_back(submesh.material);
+
+    const auto &meshlets = mesh.get_meshlets(submesh);
+    submesh_meshlets.emplace_back(meshlets.begin(), meshlets.end());
+    for (auto &m : submesh_meshlets.back())
+      m.first_index += allocation.first_index;
+    submesh_lods.emplace_back();
+    for (const auto &level : mesh.get_lods(submesh))
+      submesh_lods.back().push_back(
+          submesh_lod{level.index_count,
+                      allocation.first_index + level.first_index,
+                      level.error});
+    lod_errors.resize(std::max<size_t>(lod_errors.size(), submesh.lod_count),
+                      0.f);
+  }
+  for (size_t level = 0; level < lod_errors.size(); level++)
+    for (const auto &lods : submesh_lods)
+      lod_errors[level] = std::max(
+          lod_errors[level], lods[std::min(level, lods.size() - 1)].error);
+  arena->unmap();
+
+  // Texture
+  if (shared_textures == nullptr) {
+    own_textures = std::make_unique<texture_cache>(dev);
+    shared_textures = own_textures.get();
+  }
+  const auto &texture_paths = get_material_texture_paths(mesh);
+  for (uint32_t texture_id = 0; texture_id < header.material_count;
+       ++texture_id) {
+    Textures.push_back(
+        shared_textures->get(texture_paths[texture_id], upload_cmd_list));
+    auto &&mesh_descriptor = heap.allocate_descriptor_set_from_cbv_srv_uav_heap(
+        13 + texture_id, {model_set}, 1);
+    mesh_descriptor_set.push_back(std::move(mesh_descriptor));
+    dev.set_image_view(*mesh_descriptor_set.back(), 0, 2,
+                       *Textures.back()->view);
+    material_generations.push_back(Textures.back()->generation);
+  }
+}
+
+bool mesh_asset::refresh_materials(device_t &dev) {
+  bool changed = false;
+  for (size_t material = 0; material < Textures.size(); material++) {
+    const auto &texture = *Textures[material];
+    if (texture.generation == material_generations[material])
+      continue;
+    dev.set_image_view(*mesh_descriptor_set[material], 0, 2, *texture.view);
+    material_generations[material] = texture.generation;
+    changed = true;
+  }
+  return changed;
+}
+
+mesh_asset::~mesh_asset() { arena->release(allocation); }
+
+std::vector<std::string> get_material_texture_paths(const ymesh &mesh) {
+  std::vector<std::string> result;
+  for (uint32_t material = 0; material < mesh.get_header().material_count;
+       ++material) {
+    const auto &texture_path = mesh.get_diffuse_path(material);
+    result.push_back(SAMPLE_PATH +
+                     texture_path.substr(0, texture_path.find_last_of('.')) +
+                     ".DDS");
+  }
+  return result;
+}
+
+const submesh_lod &mesh_asset::get_lod(size_t submesh, size_t level) const {
+  const auto &lods = submesh_lods[submesh];
+  return lods[std::min(level, lods.size() - 1)];
+}
+}
+}
@@ -0,0 +1,414 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/Culling.h>
+#include <Scene/MeshCache.h>
+#include <Util/MeshSimplifier.h>
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/type_ptr.hpp>
+#include <thread>
+
+namespace irr {
+namespace scene {
+namespace {
+const char ymesh_magic[4] = {'Y', 'M', 'S', 'H'};
+
+// True if count items of T at offset are inside the size bytes of a file and
+// aligned for T, so that they can be read in place.
+template <typename T>
+bool fits_table(size_t size, uint64_t offset, uint64_t count) {
+  return offset % alignof(T) == 0 && offset <= size &&
+         count * sizeof(T) <= size - offset;
+}
+
+// Interleaved position, normal and texture coordinates of an
+// optimized_submesh.
+constexpr size_t vertex_size = 8;
+
+struct optimized_submesh {
+  std::vector<float> vertices;
+  std::vector<mesh_lod> lods;
+  //! Of level 0, index ranges are relative to its first index.
+  std::vector<meshlet> meshlets;
+  vertex_cache_statistics before;
+  vertex_cache_statistics after;
+
+  uint32_t get_vertex_count() const {
+    return static_cast<uint32_t>(vertices.size() / vertex_size);
+  }
+  const float *get_vertex(size_t vertex) const {
+    return &vertices[vertex * vertex_size];
+  }
+};
+
+std::vector<uint32_t> optimize_triangle_order(
+    const std::vector<uint32_t> &indices, const std::vector<float> &vertices) {
+  const auto vertex_count = vertices.size() / vertex_size;
+  return optimize_overdraw(optimize_vertex_cache(indices, vertex_count),
+                           vertices.data(), vertex_size * sizeof(float),
+                           vertex_count);
+}
+
+// Welds identical vertices, orders triangles for the post-transform cache
+// then for overdraw and vertices in their first use order before building
+// levels of detail and the meshlets of level 0. Levels index a subset of the
+// vertices and get their own triangle order. Normals then texture coordinates
+// are weighted against the relative geometric error so that UV seams and hard
+// edges are kept.
+optimized_submesh optimize_submesh(const aiMesh &mesh) {
+  std::vector<uint32_t> indices;
+  indices.reserve(mesh.mNumFaces * 3);
+  for (unsigned int f = 0; f < mesh.mNumFaces; f++)
+    indices.insert(indices.end(), mesh.mFaces[f].mIndices,
+                   mesh.mFaces[f].mIndices + 3);
+
+  std::vector<float> vertices;
+  vertices.reserve(mesh.mNumVertices * vertex_size);
+  for (unsigned int v = 0; v < mesh.mNumVertices; v++) {
+    vertices.insert(vertices.end(), {mesh.mVertices[v].x, mesh.mVertices[v].y,
+                                     mesh.mVertices[v].z});
+    if (mesh.HasNormals())
+      vertices.insert(vertices.end(), {mesh.mNormals[v].x, mesh.mNormals[v].y,
+                                       mesh.mNormals[v].z});
+    else
+      vertices.insert(vertices.end(), {0.f, 0.f, 1.f});
+    if (mesh.HasTextureCoords(0))
+      vertices.insert(vertices.end(), {mesh.mTextureCoords[0][v].x,
+                                       mesh.mTextureCoords[0][v].y});
+    else
+      vertices.insert(vertices.end(), {0.f, 0.f});
+  }
+
+  optimized_submesh result;
+  result.before = analyze_vertex_cache(indices, mesh.mNumVertices);
+
+  size_t welded_count;
+  const auto &welded_index = weld_vertices(
+      vertices.data(), mesh.mNumVertices, vertex_size, welded_count);
+  std::vector<float> welded(welded_count * vertex_size);
+  for (size_t v = 0; v < mesh.mNumVertices; v++)
+    std::copy_n(&vertices[v * vertex_size], vertex_size,
+                &welded[welded_index[v] * vertex_size]);
+  for (auto &index : indices)
+    index = welded_index[index];
+  indices = optimize_triangle_order(indices, welded);
+
+  size_t used_count;
+  const auto &fetch_index =
+      optimize_vertex_fetch(indices, welded_count, used_count);
+  result.vertices.resize(used_count * vertex_size);
+  for (size_t v = 0; v < welded_count; v++)
+    if (fetch_index[v] != ~0u)
+      std::copy_n(&welded[v * vertex_size], vertex_size,
+                  &result.vertices[fetch_index[v] * vertex_size]);
+  result.after = analyze_vertex_cache(indices, used_count);
+  result.meshlets = build_meshlets(indices, result.vertices.data(),
+                                   result.vertices.data() + 3,
+                                   vertex_size * sizeof(float), used_count);
+
+  simplifier_mesh input;
+  input.positions = result.vertices.data();
+  input.position_stride = vertex_size * sizeof(float);
+  input.vertex_count = used_count;
+  input.attributes = result.vertices.data() + 3;
+  input.attribute_stride = vertex_size * sizeof(float);
+  input.attribute_weights = {.5f, .5f, .5f, 1.f, 1.f};
+  result.lods = build_lod_chain(input, indices);
+  for (size_t level = 1; level < result.lods.size(); level++)
+    result.lods[level].indices =
+        optimize_triangle_order(result.lods[level].indices, result.vertices);
+  return result;
+}
+
+// Appends tables to a byte buffer, every table starts 16 bytes aligned.
+class blob_writer {
+  std::vector<char> &bytes;
+
+public:
+  blob_writer(std::vector<char> &b) : bytes(b) {}
+
+  uint64_t reserve(size_t size) {
+    const auto offset = (bytes.size() + 15) & ~size_t(15);
+    bytes.resize(offset + size, 0);
+    return offset;
+  }
+
+  template <typename T> uint64_t append(const T *data, size_t count) {
+    const auto offset = reserve(count * sizeof(T));
+    if (count > 0)
+      memcpy(bytes.data() + offset, data, count * sizeof(T));
+    return offset;
+  }
+
+  template <typename T> T *get(uint64_t offset) {
+    return reinterpret_cast<T *>(bytes.data() + offset);
+  }
+};
+}
+
+ymesh::ymesh(const aiScene &model, uint64_t source_hash,
+             const source_file_key &source_key) {
+  std::vector<optimized_submesh> optimized;
+  for (unsigned int i = 0; i < model.mNumMeshes; ++i)
+    optimized.push_back(optimize_submesh(*model.mMeshes[i]));
+
+  ymesh_header header{};
+  memcpy(header.magic, ymesh_magic, sizeof(header.magic));
+  header.version = ymesh_version;
+  header.byte_order = ymesh_byte_order;
+  header.source_hash = source_hash;
+  header.source_key = source_key;
+  header.submesh_count = model.mNumMeshes;
+  header.material_count = model.mNumMaterials;
+
+  std::vector<ymesh_submesh> submeshes;
+  std::vector<ymesh_lod> lods;
+  std::vector<meshlet> meshlets;
+  std::vector<float> positions, normals, uv0;
+  std::vector<uint16_t> indices;
+  for (unsigned int i = 0; i < model.mNumMeshes; ++i) {
+    const auto &submesh = optimized[i];
+    aabb box;
+    for (size_t v = 0; v < submesh.get_vertex_count(); v++) {
+      const auto *vertex = submesh.get_vertex(v);
+      box.add_point(glm::make_vec3(vertex));
+      positions.insert(positions.end(), vertex, vertex + 3);
+      normals.insert(normals.end(), vertex + 3, vertex + 6);
+      uv0.insert(uv0.end(), {vertex[6], vertex[7], 0.f});
+    }
+    // Simplifier errors are relative to the largest side of the submesh.
+    const auto extents =
+        box.is_empty() ? glm::vec3(0.f) : box.get_extents() * 2.f;
+    const auto largest_side =
+        std::max(std::max(extents.x, extents.y), extents.z);
+
+    submeshes.push_back(ymesh_submesh{
+        model.mMeshes[i]->mMaterialIndex, submesh.get_vertex_count(),
+        static_cast<uint32_t>(lods.size()),
+        static_cast<uint32_t>(submesh.lods.size()),
+        static_cast<uint32_t>(meshlets.size()),
+        static_cast<uint32_t>(submesh.meshlets.size()),
+        {box.min.x, box.min.y, box.min.z},
+        {box.max.x, box.max.y, box.max.z}});
+    const auto first_index = static_cast<uint32_t>(indices.size());
+    for (auto m : submesh.meshlets) {
+      m.first_index += first_index;
+      meshlets.push_back(m);
+    }
+    for (const auto &level : submesh.lods) {
+      lods.push_back(ymesh_lod{static_cast<uint32_t>(indices.size()),
+                               static_cast<uint32_t>(level.indices.size()),
+                               level.error * largest_side});
+      for (const auto &index : level.indices)
+        indices.push_back(static_cast<uint16_t>(index));
+    }
+    header.unoptimized_cache_statistics += submesh.before;
+    header.cache_statistics += submesh.after;
+  }
+  header.vertex_count = static_cast<uint32_t>(positions.size() / 3);
+  header.index_count = static_cast<uint32_t>(indices.size());
+  header.lod_count = static_cast<uint32_t>(lods.size());
+  header.meshlet_count = static_cast<uint32_t>(meshlets.size());
+
+  blob_writer writer(bytes);
+  const auto header_offset = writer.reserve(sizeof(ymesh_header));
+  header.submeshes = writer.append(submeshes.data(), submeshes.size());
+  header.lods = writer.append(lods.data(), lods.size());
+  header.meshlets = writer.append(meshlets.data(), meshlets.size());
+  header.materials =
+      writer.reserve(model.mNumMaterials * sizeof(ymesh_material));
+  for (unsigned int material = 0; material < model.mNumMaterials;
+       ++material) {
+    aiString path;
+    model.mMaterials[material]->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+    const auto path_offset = writer.append(path.C_Str(), path.length);
+    *writer.get<ymesh_material>(header.materials +
+                                material * sizeof(ymesh_material)) =
+        ymesh_material{path_offset, static_cast<uint32_t>(path.length), 0};
+  }
+  header.positions = writer.append(positions.data(), positions.size());
+  header.normals = writer.append(normals.data(), normals.size());
+  header.uv0 = writer.append(uv0.data(), uv0.size());
+  header.indices = writer.append(indices.data(), indices.size());
+  *writer.get<ymesh_header>(header_offset) = header;
+
+  data = bytes.data();
+  size = bytes.size();
+}
+
+ymesh::ymesh(const std::string &path, const std::string &source_path) {
+  if (!mapped_file::exists(path))
+    return;
+  file = std::make_unique<mapped_file>(path);
+  data = file->data();
+  size = file->size();
+  if (!check() || !check_source(source_path)) {
+    file.reset();
+    data = nullptr;
+    size = 0;
+  }
+}
+
+bool ymesh::check() const {
+  if (size < sizeof(ymesh_header))
+    return false;
+  const auto &header = get_header();
+  if (memcmp(header.magic, ymesh_magic, sizeof(header.magic)) != 0 ||
+      header.version != ymesh_version ||
+      header.byte_order != ymesh_byte_order)
+    return false;
+  // A truncated file must not be read past its end.
+  if (!fits_table<ymesh_submesh>(size, header.submeshes,
+                                 header.submesh_count) ||
+      !fits_table<ymesh_lod>(size, header.lods, header.lod_count) ||
+      !fits_table<meshlet>(size, header.meshlets, header.meshlet_count) ||
+      !fits_table<ymesh_material>(size, header.materials,
+                                  header.material_count) ||
+      !fits_table<float>(size, header.positions, header.vertex_count * 3) ||
+      !fits_table<float>(size, header.normals, header.vertex_count * 3) ||
+      !fits_table<float>(size, header.uv0, header.vertex_count * 3) ||
+      !fits_table<uint16_t>(size, header.indices, header.index_count))
+    return false;
+  for (const auto &material : get_table<ymesh_material>(
+           header.materials, header.material_count))
+    if (!fits_table<char>(size, material.diffuse_path,
+                          material.diffuse_path_size))
+      return false;
+
+  // Ranges are summed in 64 bits so that they can't wrap.
+  const auto &&in_table = [](uint64_t first, uint64_t count, uint64_t total) {
+    return first + count <= total;
+  };
+  uint64_t vertex_count = 0;
+  for (const auto &submesh : get_submeshes()) {
+    vertex_count += submesh.vertex_count;
+    if ((header.material_count > 0 &&
+         submesh.material >= header.material_count) ||
+        !in_table(submesh.first_lod, submesh.lod_count, header.lod_count) ||
+        !in_table(submesh.first_meshlet, submesh.meshlet_count,
+                  header.meshlet_count))
+      return false;
+  }
+  if (vertex_count > header.vertex_count)
+    return false;
+  for (const auto &lod : get_table<ymesh_lod>(header.lods, header.lod_count))
+    if (!in_table(lod.first_index, lod.index_count, header.index_count))
+      return false;
+  for (const auto &m :
+       get_table<meshlet>(header.meshlets, header.meshlet_count))
+    if (!in_table(m.first_index, m.index_count, header.index_count))
+      return false;
+  return true;
+}
+
+bool ymesh::check_source(const std::string &source_path) const {
+  // Shipped caches are used without their source.
+  std::error_code error;
+  if (!std::filesystem::exists(source_path, error))
+    return true;
+  const auto &header = get_header();
+  const auto &key = get_source_file_key(source_path);
+  if (key.size == header.source_key.size &&
+      key.modification_time == header.source_key.modification_time)
+    return true;
+  // The file was touched, its content may still be the same.
+  return key.size == header.source_key.size &&
+         hash_file(source_path) == header.source_hash;
+}
+
+bool ymesh::save(const std::string &path) const {
+  // Unique per thread, the rename is atomic.
+  const auto &temporary_path =
+      path + "." +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) +
+      ".tmp";
+  {
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    out.write(data, static_cast<std::streamsize>(size));
+    if (!out.good()) {
+      out.close();
+      std::error_code error;
+      std::filesystem::remove(temporary_path, error);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary_path, path, error);
+  if (!error)
+    return true;
+  // Windows refuses to replace a file mapped by another reader.
+  std::filesystem::remove(temporary_path, error);
+  return false;
+}
+
+gsl::span<const ymesh_submesh> ymesh::get_submeshes() const {
+  return get_table<ymesh_submesh>(get_header().submeshes,
+                                  get_header().submesh_count);
+}
+
+gsl::span<const ymesh_lod> ymesh::get_lods(const ymesh_submesh &submesh) const {
+  return get_table<ymesh_lod>(get_header().lods +
+                                  submesh.first_lod * sizeof(ymesh_lod),
+                              submesh.lod_count);
+}
+
+gsl::span<const meshlet>
+ymesh::get_meshlets(const ymesh_submesh &submesh) const {
+  return get_table<meshlet>(get_header().meshlets +
+                                submesh.first_meshlet * sizeof(meshlet),
+                            submesh.meshlet_count);
+}
+
+std::string ymesh::get_diffuse_path(uint32_t material) const {
+  const auto &entry = get_table<ymesh_material>(
+      get_header().materials, get_header().material_count)[material];
+  return std::string(data + entry.diffuse_path, entry.diffuse_path_size);
+}
+
+uint64_t hash_file(const std::string &path) {
+  const mapped_file file(path);
+  uint64_t hash = 14695981039346656037ull;
+  const auto word_count = file.size() / sizeof(uint64_t);
+  for (size_t i = 0; i < word_count; i++) {
+    uint64_t word;
+    memcpy(&word, file.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+    hash = (hash ^ word) * 1099511628211ull;
+  }
+  for (auto i = word_count * sizeof(uint64_t); i < file.size(); i++)
+    hash = (hash ^ static_cast<unsigned char>(file.data()[i])) *
+           1099511628211ull;
+  return hash;
+}
+
+source_file_key get_source_file_key(const std::string &path) {
+  std::error_code error;
+  const auto file_size = std::filesystem::file_size(path, error);
+  if (error)
+    return source_file_key{};
+  const auto time = std::filesystem::last_write_time(path, error);
+  if (error)
+    return source_file_key{};
+  return source_file_key{
+      static_cast<uint64_t>(file_size),
+      static_cast<int64_t>(time.time_since_epoch().count())};
+}
+
+std::unique_ptr<ymesh> load_mesh(const std::string &path) {
+  auto cached = std::make_unique<ymesh>(path + ".ymesh", path);
+  if (cached->is_valid())
+    return cached;
+
+  Assimp::Importer importer;
+  const auto *model = importer.ReadFile(path, 0);
+  if (model == nullptr)
+    throw "load_mesh: import failed";
+  auto cooked = std::make_unique<ymesh>(*model, hash_file(path),
+                                        get_source_file_key(path));
+  cooked->save(path + ".ymesh");
+  return cooked;
+}
+}
+}
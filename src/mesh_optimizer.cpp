@@ -0,0 +1,306 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\MeshOptimizer.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+constexpr uint32_t invalid_vertex = std::numeric_limits<uint32_t>::max();
+
+using vec3 = std::array<double, 3>;
+
+//! FIFO post-transform cache, a vertex stays cached for cache_size misses.
+class fifo_cache {
+  std::vector<uint32_t> cache_time;
+  uint32_t time;
+  uint32_t cache_size;
+
+public:
+  fifo_cache(size_t vertex_count, size_t size)
+      : cache_time(vertex_count, 0), time(static_cast<uint32_t>(size) + 1),
+        cache_size(static_cast<uint32_t>(size)) {}
+
+  //! Returns true if vertex had to be transformed.
+  bool access(uint32_t vertex) {
+    if (time - cache_time[vertex] <= cache_size)
+      return false;
+    cache_time[vertex] = time++;
+    return true;
+  }
+
+  uint32_t get_misses(const uint32_t *triangle) {
+    return uint32_t(access(triangle[0])) + uint32_t(access(triangle[1])) +
+           uint32_t(access(triangle[2]));
+  }
+
+  //! Misses since vertex entered the cache, it is cached up to cache_size.
+  uint32_t get_age(uint32_t vertex) const { return time - cache_time[vertex]; }
+
+  void flush() { time += cache_size + 1; }
+};
+
+struct vertex_hasher {
+  const float *vertices;
+  size_t vertex_size;
+
+  size_t operator()(uint32_t vertex) const {
+    // FNV-1a of the vertex bits.
+    const auto *bytes = reinterpret_cast<const unsigned char *>(
+        vertices + vertex * vertex_size);
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < vertex_size * sizeof(float); i++)
+      hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+  }
+};
+
+struct vertex_equal {
+  const float *vertices;
+  size_t vertex_size;
+
+  bool operator()(uint32_t a, uint32_t b) const {
+    return memcmp(vertices + a * vertex_size, vertices + b * vertex_size,
+                  vertex_size * sizeof(float)) == 0;
+  }
+};
+}
+
+vertex_cache_statistics analyze_vertex_cache(
+    const std::vector<uint32_t> &indices, size_t vertex_count,
+    size_t cache_size) {
+  vertex_cache_statistics result;
+  result.triangles = static_cast<uint32_t>(indices.size() / 3);
+  fifo_cache cache(vertex_count, cache_size);
+  std::vector<uint8_t> used(vertex_count, 0);
+  for (const auto &index : indices) {
+    result.misses += cache.access(index) ? 1 : 0;
+    result.vertices += used[index] ? 0 : 1;
+    used[index] = 1;
+  }
+  return result;
+}
+
+std::vector<uint32_t> weld_vertices(const float *vertices, size_t vertex_count,
+                                    size_t vertex_size,
+                                    size_t &unique_vertex_count) {
+  std::unordered_map<uint32_t, uint32_t, vertex_hasher, vertex_equal> unique(
+      vertex_count, vertex_hasher{vertices, vertex_size},
+      vertex_equal{vertices, vertex_size});
+  std::vector<uint32_t> remap(vertex_count);
+  for (uint32_t vertex = 0; vertex < vertex_count; vertex++)
+    remap[vertex] =
+        unique.emplace(vertex, static_cast<uint32_t>(unique.size()))
+            .first->second;
+  unique_vertex_count = unique.size();
+  return remap;
+}
+
+std::vector<uint32_t> optimize_vertex_cache(
+    const std::vector<uint32_t> &indices, size_t vertex_count,
+    size_t cache_size) {
+  const auto triangle_count = indices.size() / 3;
+
+  // Triangles of every vertex, the live count drops as they are emitted.
+  std::vector<uint32_t> live(vertex_count, 0);
+  for (const auto &index : indices)
+    live[index]++;
+  std::vector<uint32_t> first_triangle(vertex_count + 1, 0);
+  for (size_t vertex = 0; vertex < vertex_count; vertex++)
+    first_triangle[vertex + 1] = first_triangle[vertex] + live[vertex];
+  std::vector<uint32_t> adjacency(triangle_count * 3);
+  {
+    std::vector<uint32_t> fill(first_triangle.begin(),
+                               first_triangle.end() - 1);
+    for (uint32_t triangle = 0; triangle < triangle_count; triangle++)
+      for (size_t k = 0; k < 3; k++)
+        adjacency[fill[indices[triangle * 3 + k]]++] = triangle;
+  }
+
+  fifo_cache cache(vertex_count, cache_size);
+  std::vector<uint8_t> emitted(triangle_count, 0);
+  std::vector<uint32_t> dead_end;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(triangle_count * 3);
+  uint32_t cursor = 0;
+
+  // Recently emitted vertices first, then the next one in index order.
+  const auto &&skip_dead_end = [&]() {
+    while (!dead_end.empty()) {
+      const auto vertex = dead_end.back();
+      dead_end.pop_back();
+      if (live[vertex] > 0)
+        return vertex;
+    }
+    for (; cursor < vertex_count; cursor++)
+      if (live[cursor] > 0)
+        return cursor;
+    return invalid_vertex;
+  };
+
+  auto fanning = skip_dead_end();
+  while (fanning != invalid_vertex) {
+    candidates.clear();
+    for (auto a = first_triangle[fanning]; a < first_triangle[fanning + 1];
+         a++) {
+      const auto triangle = adjacency[a];
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = 1;
+      for (size_t k = 0; k < 3; k++) {
+        const auto vertex = indices[triangle * 3 + k];
+        result.push_back(vertex);
+        dead_end.push_back(vertex);
+        candidates.push_back(vertex);
+        live[vertex]--;
+        cache.access(vertex);
+      }
+    }
+
+    // The oldest candidate that stays in cache while its fan is emitted.
+    auto next = invalid_vertex;
+    int64_t best_priority = -1;
+    for (const auto &vertex : candidates) {
+      if (live[vertex] == 0)
+        continue;
+      int64_t priority = 0;
+      if (cache.get_age(vertex) + 2 * live[vertex] <= cache_size)
+        priority = cache.get_age(vertex);
+      if (priority > best_priority) {
+        best_priority = priority;
+        next = vertex;
+      }
+    }
+    fanning = next != invalid_vertex ? next : skip_dead_end();
+  }
+  return result;
+}
+
+std::vector<uint32_t> optimize_overdraw(const std::vector<uint32_t> &indices,
+                                        const float *positions,
+                                        size_t position_stride,
+                                        size_t vertex_count, size_t cache_size,
+                                        float threshold) {
+  const auto triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return indices;
+
+  // Hard boundaries, the cache is cold when a triangle misses every vertex.
+  fifo_cache cache(vertex_count, cache_size);
+  std::vector<size_t> hard_clusters;
+  for (size_t triangle = 0; triangle < triangle_count; triangle++)
+    if (cache.get_misses(&indices[triangle * 3]) == 3 || triangle == 0)
+      hard_clusters.push_back(triangle);
+  hard_clusters.push_back(triangle_count);
+
+  // Soft boundaries, wherever restarting cold keeps the cluster efficient.
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hard_clusters.size(); h++) {
+    const auto begin = hard_clusters[h];
+    const auto end = hard_clusters[h + 1];
+    cache.flush();
+    uint32_t misses = 0;
+    for (auto triangle = begin; triangle < end; triangle++)
+      misses += cache.get_misses(&indices[triangle * 3]);
+    const auto target = threshold * misses / (end - begin);
+
+    cache.flush();
+    clusters.push_back(begin);
+    uint32_t cluster_misses = 0;
+    for (auto triangle = begin; triangle < end; triangle++) {
+      cluster_misses += cache.get_misses(&indices[triangle * 3]);
+      if (triangle + 1 < end &&
+          cluster_misses <= target * (triangle + 1 - clusters.back())) {
+        clusters.push_back(triangle + 1);
+        cluster_misses = 0;
+        cache.flush();
+      }
+    }
+  }
+  clusters.push_back(triangle_count);
+
+  const auto &&get_position = [&](uint32_t vertex) {
+    const auto *p = reinterpret_cast<const float *>(
+        reinterpret_cast<const char *>(positions) + vertex * position_stride);
+    return vec3{p[0], p[1], p[2]};
+  };
+
+  // Area weighted centroids and normals, the normal length is twice the area.
+  const auto cluster_count = clusters.size() - 1;
+  std::vector<vec3> centroids(cluster_count, vec3{0., 0., 0.});
+  std::vector<vec3> normals(cluster_count, vec3{0., 0., 0.});
+  std::vector<double> areas(cluster_count, 0.);
+  vec3 mesh_centroid{0., 0., 0.};
+  double mesh_area = 0.;
+  for (size_t c = 0; c < cluster_count; c++) {
+    for (auto triangle = clusters[c]; triangle < clusters[c + 1];
+         triangle++) {
+      const auto a = get_position(indices[triangle * 3]);
+      const auto b = get_position(indices[triangle * 3 + 1]);
+      const auto d = get_position(indices[triangle * 3 + 2]);
+      const vec3 ab{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      const vec3 ad{d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+      const vec3 normal{ab[1] * ad[2] - ab[2] * ad[1],
+                        ab[2] * ad[0] - ab[0] * ad[2],
+                        ab[0] * ad[1] - ab[1] * ad[0]};
+      const auto area = std::sqrt(normal[0] * normal[0] +
+                                  normal[1] * normal[1] +
+                                  normal[2] * normal[2]) /
+                        2.;
+      for (size_t axis = 0; axis < 3; axis++) {
+        centroids[c][axis] += (a[axis] + b[axis] + d[axis]) / 3. * area;
+        normals[c][axis] += normal[axis];
+      }
+      areas[c] += area;
+    }
+    for (size_t axis = 0; axis < 3; axis++)
+      mesh_centroid[axis] += centroids[c][axis];
+    mesh_area += areas[c];
+  }
+  for (auto &axis : mesh_centroid)
+    axis = mesh_area > 0. ? axis / mesh_area : 0.;
+
+  std::vector<double> sort_keys(cluster_count, 0.);
+  for (size_t c = 0; c < cluster_count; c++) {
+    const auto length = std::sqrt(normals[c][0] * normals[c][0] +
+                                  normals[c][1] * normals[c][1] +
+                                  normals[c][2] * normals[c][2]);
+    if (areas[c] == 0. || length == 0.)
+      continue;
+    for (size_t axis = 0; axis < 3; axis++)
+      sort_keys[c] += (centroids[c][axis] / areas[c] - mesh_centroid[axis]) *
+                      normals[c][axis] / length;
+  }
+
+  std::vector<size_t> order(cluster_count);
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sort_keys[a] > sort_keys[b];
+  });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const auto &c : order)
+    result.insert(result.end(), indices.begin() + clusters[c] * 3,
+                  indices.begin() + clusters[c + 1] * 3);
+  return result;
+}
+
+std::vector<uint32_t> optimize_vertex_fetch(std::vector<uint32_t> &indices,
+                                            size_t vertex_count,
+                                            size_t &used_vertex_count) {
+  std::vector<uint32_t> remap(vertex_count, invalid_vertex);
+  uint32_t next = 0;
+  for (auto &index : indices) {
+    if (remap[index] == invalid_vertex)
+      remap[index] = next++;
+    index = remap[index];
+  }
+  used_vertex_count = next;
+  return remap;
+}
@@ -0,0 +1,559 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\MeshSimplifier.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+constexpr uint32_t invalid_vertex = std::numeric_limits<uint32_t>::max();
+// Keeps borders in place, relative to the area weight of triangle planes.
+constexpr double border_weight = 10.;
+
+using vec3 = std::array<double, 3>;
+
+vec3 sub(const vec3 &a, const vec3 &b) {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+vec3 cross(const vec3 &a, const vec3 &b) {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+          a[0] * b[1] - a[1] * b[0]};
+}
+
+double dot(const vec3 &a, const vec3 &b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+uint64_t get_edge_key(uint32_t a, uint32_t b) {
+  return (uint64_t(a) << 32) | b;
+}
+
+uint64_t get_undirected_edge_key(uint32_t a, uint32_t b) {
+  return get_edge_key(std::min(a, b), std::max(a, b));
+}
+
+//! Sum of squared distances to weighted planes.
+struct quadric {
+  double a00 = 0., a11 = 0., a22 = 0., a01 = 0., a12 = 0., a02 = 0.;
+  double b0 = 0., b1 = 0., b2 = 0., c = 0.;
+  double weight = 0.;
+
+  //! normal must be normalized, the plane is dot(normal, p) + d = 0.
+  void add_plane(const vec3 &normal, double d, double w) {
+    a00 += w * normal[0] * normal[0];
+    a11 += w * normal[1] * normal[1];
+    a22 += w * normal[2] * normal[2];
+    a01 += w * normal[0] * normal[1];
+    a12 += w * normal[1] * normal[2];
+    a02 += w * normal[0] * normal[2];
+    b0 += w * normal[0] * d;
+    b1 += w * normal[1] * d;
+    b2 += w * normal[2] * d;
+    c += w * d * d;
+    weight += w;
+  }
+
+  void add(const quadric &q) {
+    a00 += q.a00;
+    a11 += q.a11;
+    a22 += q.a22;
+    a01 += q.a01;
+    a12 += q.a12;
+    a02 += q.a02;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+  }
+
+  //! Weighted average of the squared distances.
+  double evaluate(const vec3 &p) const {
+    if (weight == 0.)
+      return 0.;
+    const auto result = a00 * p[0] * p[0] + a11 * p[1] * p[1] +
+                        a22 * p[2] * p[2] + 2. * a01 * p[0] * p[1] +
+                        2. * a12 * p[1] * p[2] + 2. * a02 * p[0] * p[2] +
+                        2. * (b0 * p[0] + b1 * p[1] + b2 * p[2]) + c;
+    return std::max(result, 0.) / weight;
+  }
+};
+
+enum class vertex_kind {
+  manifold,
+  //! Moves along its two open edges only.
+  border,
+  //! Two attribute sets, moves along the seam only.
+  seam,
+  locked,
+};
+
+struct collapse {
+  uint32_t vertex;
+  uint32_t target;
+  //! Geometric and attribute errors orders collapses, only the geometric one
+  //! is reported.
+  double cost;
+  double geometric_cost;
+};
+
+class simplifier {
+public:
+  simplifier(const simplifier_mesh &m, const std::vector<uint32_t> &i)
+      : mesh(m), indices(i) {
+    load_positions();
+    build_position_groups();
+    classify_vertices();
+    build_quadrics();
+  }
+
+  float run(size_t target_index_count, float target_error) {
+    const auto max_cost = double(target_error) * target_error;
+    double result_cost = 0.;
+    while (indices.size() > target_index_count) {
+      build_adjacency();
+      const auto &&candidates = get_candidates(max_cost);
+      if (candidates.empty())
+        break;
+      // A collapse removes two triangles of a manifold mesh.
+      const auto wanted = (indices.size() - target_index_count + 5) / 6;
+      const auto applied = apply(candidates, wanted, result_cost);
+      if (applied == 0)
+        break;
+      rewrite_indices();
+      update_open_edges();
+    }
+    return static_cast<float>(std::sqrt(result_cost));
+  }
+
+  std::vector<uint32_t> &get_indices() { return indices; }
+
+private:
+  const simplifier_mesh &mesh;
+  std::vector<uint32_t> indices;
+
+  //! Positions scaled to the unit cube.
+  std::vector<vec3> positions;
+  //! First vertex of every position, and next vertex with the same position.
+  std::vector<uint32_t> group;
+  std::vector<uint32_t> wedge_next;
+  std::vector<vertex_kind> kinds;
+  std::unordered_set<uint64_t> open_edges;
+  //! Indexed by position group.
+  std::vector<quadric> quadrics;
+
+  std::vector<uint32_t> remap;
+  std::vector<uint32_t> triangle_offsets;
+  std::vector<uint32_t> vertex_triangles;
+
+  const float *get_attributes(uint32_t vertex) const {
+    return reinterpret_cast<const float *>(
+        reinterpret_cast<const uint8_t *>(mesh.attributes) +
+        vertex * mesh.attribute_stride);
+  }
+
+  void load_positions() {
+    positions.resize(mesh.vertex_count);
+    vec3 low{std::numeric_limits<double>::max(),
+             std::numeric_limits<double>::max(),
+             std::numeric_limits<double>::max()};
+    vec3 high{-low[0], -low[1], -low[2]};
+    for (size_t v = 0; v < mesh.vertex_count; v++) {
+      const auto *p = reinterpret_cast<const float *>(
+          reinterpret_cast<const uint8_t *>(mesh.positions) +
+          v * mesh.position_stride);
+      for (int k = 0; k < 3; k++) {
+        positions[v][k] = p[k];
+        low[k] = std::min(low[k], positions[v][k]);
+        high[k] = std::max(high[k], positions[v][k]);
+      }
+    }
+    const auto extent = std::max(std::max(high[0] - low[0], high[1] - low[1]),
+                                 high[2] - low[2]);
+    const auto scale = extent > 0. ? 1. / extent : 1.;
+    for (auto &p : positions)
+      for (int k = 0; k < 3; k++)
+        p[k] = (p[k] - low[k]) * scale;
+  }
+
+  void build_position_groups() {
+    group.resize(mesh.vertex_count);
+    wedge_next.resize(mesh.vertex_count);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    const auto &&hash = [&](uint32_t v) {
+      uint64_t result = 0;
+      for (int k = 0; k < 3; k++) {
+        float f = static_cast<float>(positions[v][k]);
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        result = result * 73856093 ^ bits;
+      }
+      return result;
+    };
+    for (uint32_t v = 0; v < mesh.vertex_count; v++) {
+      group[v] = v;
+      wedge_next[v] = v;
+      auto &bucket = buckets[hash(v)];
+      for (const auto &other : bucket) {
+        if (positions[other] != positions[v])
+          continue;
+        group[v] = group[other];
+        wedge_next[v] = wedge_next[other];
+        wedge_next[other] = v;
+        break;
+      }
+      if (group[v] == v)
+        bucket.push_back(v);
+    }
+    remap.resize(mesh.vertex_count);
+    for (uint32_t v = 0; v < mesh.vertex_count; v++)
+      remap[v] = v;
+  }
+
+  //! Collapses along borders create open edges between new vertex pairs.
+  void update_open_edges() {
+    std::unordered_set<uint64_t> position_edges;
+    for (size_t i = 0; i < indices.size(); i += 3)
+      for (int e = 0; e < 3; e++)
+        position_edges.insert(get_edge_key(group[indices[i + e]],
+                                           group[indices[i + (e + 1) % 3]]));
+    open_edges.clear();
+    for (const auto &edge : position_edges) {
+      const auto a = static_cast<uint32_t>(edge >> 32);
+      const auto b = static_cast<uint32_t>(edge & 0xffffffff);
+      if (position_edges.count(get_edge_key(b, a)) == 0)
+        open_edges.insert(get_undirected_edge_key(a, b));
+    }
+  }
+
+  void classify_vertices() {
+    std::unordered_map<uint64_t, uint32_t> position_edges;
+    std::vector<uint8_t> referenced(mesh.vertex_count, 0);
+    for (size_t i = 0; i < indices.size(); i += 3)
+      for (int e = 0; e < 3; e++) {
+        const auto a = indices[i + e];
+        const auto b = indices[i + (e + 1) % 3];
+        referenced[a] = 1;
+        position_edges[get_edge_key(group[a], group[b])]++;
+      }
+
+    std::vector<uint32_t> open_edge_count(mesh.vertex_count, 0);
+    std::vector<uint8_t> non_manifold(mesh.vertex_count, 0);
+    for (const auto &edge : position_edges) {
+      const auto a = static_cast<uint32_t>(edge.first >> 32);
+      const auto b = static_cast<uint32_t>(edge.first & 0xffffffff);
+      if (edge.second > 1) {
+        non_manifold[a] = 1;
+        non_manifold[b] = 1;
+      }
+      if (position_edges.count(get_edge_key(b, a)) != 0)
+        continue;
+      open_edge_count[a]++;
+      open_edge_count[b]++;
+      open_edges.insert(get_undirected_edge_key(a, b));
+    }
+
+    kinds.resize(mesh.vertex_count, vertex_kind::locked);
+    for (uint32_t v = 0; v < mesh.vertex_count; v++) {
+      if (group[v] != v)
+        continue;
+      uint32_t wedges = 0;
+      auto w = v;
+      do {
+        wedges += referenced[w];
+        w = wedge_next[w];
+      } while (w != v);
+      auto kind = vertex_kind::locked;
+      if (non_manifold[v])
+        kind = vertex_kind::locked;
+      else if (open_edge_count[v] != 0)
+        kind = open_edge_count[v] == 2 && wedges == 1 ? vertex_kind::border
+                                                      : vertex_kind::locked;
+      else if (wedges == 1)
+        kind = vertex_kind::manifold;
+      else if (wedges == 2)
+        kind = vertex_kind::seam;
+      kinds[v] = kind;
+    }
+    for (uint32_t v = 0; v < mesh.vertex_count; v++)
+      kinds[v] = kinds[group[v]];
+  }
+
+  void build_quadrics() {
+    quadrics.resize(mesh.vertex_count);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const auto &p0 = positions[indices[i]];
+      const auto &p1 = positions[indices[i + 1]];
+      const auto &p2 = positions[indices[i + 2]];
+      auto normal = cross(sub(p1, p0), sub(p2, p0));
+      const auto length = std::sqrt(dot(normal, normal));
+      if (length == 0.)
+        continue;
+      for (auto &n : normal)
+        n /= length;
+      const auto area = length * .5;
+      for (int k = 0; k < 3; k++)
+        quadrics[group[indices[i + k]]].add_plane(normal, -dot(normal, p0),
+                                                   area);
+
+      // Planes orthogonal to the triangle through its open edges.
+      for (int e = 0; e < 3; e++) {
+        const auto a = group[indices[i + e]];
+        const auto b = group[indices[i + (e + 1) % 3]];
+        if (open_edges.count(get_undirected_edge_key(a, b)) == 0)
+          continue;
+        const auto &&edge = sub(positions[b], positions[a]);
+        const auto edge_length = std::sqrt(dot(edge, edge));
+        if (edge_length == 0.)
+          continue;
+        auto side = cross(edge, normal);
+        for (auto &s : side)
+          s /= edge_length;
+        const auto w = border_weight * edge_length * edge_length;
+        quadrics[a].add_plane(side, -dot(side, positions[a]), w);
+        quadrics[b].add_plane(side, -dot(side, positions[a]), w);
+      }
+    }
+  }
+
+  void build_adjacency() {
+    triangle_offsets.assign(mesh.vertex_count + 1, 0);
+    for (const auto &index : indices)
+      triangle_offsets[index + 1]++;
+    for (size_t v = 0; v < mesh.vertex_count; v++)
+      triangle_offsets[v + 1] += triangle_offsets[v];
+    vertex_triangles.resize(indices.size());
+    auto fill = triangle_offsets;
+    for (size_t i = 0; i < indices.size(); i++)
+      vertex_triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  template <typename F> void for_each_triangle(uint32_t vertex, F &&f) const {
+    for (auto t = triangle_offsets[vertex]; t < triangle_offsets[vertex + 1];
+         t++)
+      f(vertex_triangles[t]);
+  }
+
+  bool is_referenced(uint32_t vertex) const {
+    return triangle_offsets[vertex] != triangle_offsets[vertex + 1];
+  }
+
+  //! Wedge of target_group sharing a triangle with wedge, or invalid_vertex.
+  uint32_t get_partner(uint32_t wedge, uint32_t target_group) const {
+    auto result = invalid_vertex;
+    bool ambiguous = false;
+    for_each_triangle(wedge, [&](uint32_t triangle) {
+      for (int k = 0; k < 3; k++) {
+        const auto other = indices[3 * triangle + k];
+        if (group[other] != target_group)
+          continue;
+        if (result != invalid_vertex && result != other)
+          ambiguous = true;
+        result = other;
+      }
+    });
+    return ambiguous ? invalid_vertex : result;
+  }
+
+  bool flips_triangle(uint32_t vertex, uint32_t target_group,
+                      const vec3 &target) const {
+    bool result = false;
+    auto w = vertex;
+    do {
+      for_each_triangle(w, [&](uint32_t triangle) {
+        std::array<vec3, 3> corners;
+        for (int k = 0; k < 3; k++) {
+          const auto index = indices[3 * triangle + k];
+          // Triangles along the collapsed edge disappear.
+          if (group[index] == target_group) {
+            return;
+          }
+          corners[k] = positions[index];
+        }
+        const auto &&before = cross(sub(corners[1], corners[0]),
+                                    sub(corners[2], corners[0]));
+        for (int k = 0; k < 3; k++)
+          if (indices[3 * triangle + k] == w)
+            corners[k] = target;
+        const auto &&after = cross(sub(corners[1], corners[0]),
+                                   sub(corners[2], corners[0]));
+        if (dot(before, after) <= 0.)
+          result = true;
+      });
+      w = wedge_next[w];
+    } while (w != vertex && !result);
+    return result;
+  }
+
+  double get_attribute_cost(uint32_t wedge, uint32_t partner) const {
+    if (mesh.attributes == nullptr)
+      return 0.;
+    const auto *a = get_attributes(wedge);
+    const auto *b = get_attributes(partner);
+    double result = 0.;
+    for (size_t k = 0; k < mesh.attribute_weights.size(); k++) {
+      const double difference = a[k] - b[k];
+      result += mesh.attribute_weights[k] * difference * difference;
+    }
+    return result;
+  }
+
+  //! Cost of moving every wedge of vertex to its partner in target_group.
+  double get_cost(uint32_t vertex, uint32_t target_group,
+                  double &geometric_cost) const {
+    double attribute_cost = 0.;
+    auto w = vertex;
+    do {
+      if (is_referenced(w)) {
+        const auto partner = get_partner(w, target_group);
+        if (partner == invalid_vertex)
+          return std::numeric_limits<double>::max();
+        attribute_cost += get_attribute_cost(w, partner);
+      }
+      w = wedge_next[w];
+    } while (w != vertex);
+    if (flips_triangle(vertex, target_group, positions[target_group]))
+      return std::numeric_limits<double>::max();
+    geometric_cost = quadrics[vertex].evaluate(positions[target_group]);
+    return geometric_cost + attribute_cost;
+  }
+
+  std::vector<collapse> get_candidates(double max_cost) const {
+    std::vector<collapse> result;
+    std::vector<uint32_t> targets;
+    for (uint32_t v = 0; v < mesh.vertex_count; v++) {
+      if (group[v] != v || kinds[v] == vertex_kind::locked)
+        continue;
+      targets.clear();
+      auto w = v;
+      do {
+        for_each_triangle(w, [&](uint32_t triangle) {
+          for (int k = 0; k < 3; k++) {
+            const auto target = group[indices[3 * triangle + k]];
+            if (target != v)
+              targets.push_back(target);
+          }
+        });
+        w = wedge_next[w];
+      } while (w != v);
+      std::sort(targets.begin(), targets.end());
+      targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+      auto best = collapse{v, invalid_vertex, max_cost, 0.};
+      for (const auto &target : targets) {
+        if (kinds[v] == vertex_kind::border &&
+            open_edges.count(get_undirected_edge_key(v, target)) == 0)
+          continue;
+        double geometric_cost = 0.;
+        const auto cost = get_cost(v, target, geometric_cost);
+        if (cost <= best.cost)
+          best = collapse{v, target, cost, geometric_cost};
+      }
+      if (best.target != invalid_vertex)
+        result.push_back(best);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const collapse &a, const collapse &b) {
+                return a.cost < b.cost;
+              });
+    return result;
+  }
+
+  size_t apply(const std::vector<collapse> &candidates, size_t wanted,
+               double &result_cost) {
+    // Collapses modify the triangles around the vertex, their vertices are
+    // not touched again in this pass.
+    std::vector<uint8_t> locked(mesh.vertex_count, 0);
+    size_t applied = 0;
+    for (const auto &candidate : candidates) {
+      if (applied == wanted)
+        break;
+      if (locked[candidate.vertex] || locked[candidate.target])
+        continue;
+      auto w = candidate.vertex;
+      do {
+        for_each_triangle(w, [&](uint32_t triangle) {
+          for (int k = 0; k < 3; k++)
+            locked[group[indices[3 * triangle + k]]] = 1;
+        });
+        if (is_referenced(w))
+          remap[w] = get_partner(w, candidate.target);
+        w = wedge_next[w];
+      } while (w != candidate.vertex);
+      quadrics[candidate.target].add(quadrics[candidate.vertex]);
+      result_cost = std::max(result_cost, candidate.geometric_cost);
+      applied++;
+    }
+    return applied;
+  }
+
+  void rewrite_indices() {
+    size_t count = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const auto a = remap[indices[i]];
+      const auto b = remap[indices[i + 1]];
+      const auto c = remap[indices[i + 2]];
+      if (a == b || b == c || a == c)
+        continue;
+      indices[count++] = a;
+      indices[count++] = b;
+      indices[count++] = c;
+    }
+    indices.resize(count);
+  }
+};
+}
+
+std::vector<uint32_t> simplify_mesh(const simplifier_mesh &mesh,
+                                    const std::vector<uint32_t> &indices,
+                                    size_t target_index_count,
+                                    float target_error, float *result_error) {
+  simplifier s(mesh, indices);
+  const auto error = s.run(target_index_count, target_error);
+  if (result_error != nullptr)
+    *result_error = error;
+  return std::move(s.get_indices());
+}
+
+std::vector<mesh_lod> build_lod_chain(const simplifier_mesh &mesh,
+                                      const std::vector<uint32_t> &indices,
+                                      size_t level_count, float ratio,
+                                      float max_error) {
+  std::vector<mesh_lod> result;
+  result.push_back(mesh_lod{indices, 0.f});
+  auto target = static_cast<double>(indices.size());
+  while (result.size() < level_count) {
+    target *= ratio;
+    float error;
+    auto &&level_indices = simplify_mesh(
+        mesh, indices, static_cast<size_t>(target) / 3 * 3, max_error, &error);
+    // Not worth a level, borders and seams may prevent any reduction.
+    if (level_indices.empty() ||
+        level_indices.size() > result.back().indices.size() * 9 / 10)
+      break;
+    result.push_back(mesh_lod{std::move(level_indices), error});
+  }
+  return result;
+}
+
+size_t select_lod(const std::vector<float> &errors, size_t current_level,
+                  float pixels_per_unit, float threshold, float hysteresis) {
+  const auto &&coarsest_below = [&](float limit) {
+    size_t level = 0;
+    while (level + 1 < errors.size() &&
+           errors[level + 1] * pixels_per_unit <= limit)
+      level++;
+    return level;
+  };
+  const auto level = coarsest_below(threshold);
+  // Finer levels are selected as soon as they are needed.
+  if (level <= current_level)
+    return level;
+  return std::max(current_level,
+                  coarsest_below(threshold * (1.f - hysteresis)));
+}
@@ -0,0 +1,351 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene\MeshletCulling.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/matrix.hpp>
+
+const auto meshlet_culling_code = std::vector<uint32_t>
+#include <generatedShaders\meshlet_culling.h>
+    ;
+
+namespace irr {
+namespace scene {
+namespace {
+// A workgroup per meshlet, spread over y past the dispatch size limit.
+constexpr uint32_t max_group_count = 65535;
+// Satisfies every minUniformBufferOffsetAlignment and D3D12 constant buffer
+// placement.
+constexpr uint32_t constant_data_stride = 256;
+// Descriptors of a culling input.
+constexpr uint32_t culling_set_size = 7;
+// constant_id of meshlet_culling.comp.
+constexpr uint32_t occlusion_culling_constant = 0;
+constexpr auto argument_stride =
+    static_cast<uint32_t>(sizeof(draw_indexed_indirect_arguments));
+
+struct culling_constant_data {
+  float planes[6][4];
+  float view_projection[16];
+  //! w is 0 if the camera is at infinity, the cone test is then skipped.
+  float camera_position[4];
+  uint32_t meshlet_count;
+  uint32_t padding[3];
+};
+
+const auto culling_set_type =
+    descriptor_set({range_of_descriptors(RESOURCE_VIEW::CONSTANTS_BUFFER, 0, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 1, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 2, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 3, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 4, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 5, 1),
+                    range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 6, 1)},
+                   shader_stage::all);
+
+const auto occlusion_set_type =
+    descriptor_set({range_of_descriptors(RESOURCE_VIEW::UAV_BUFFER, 7, 1),
+                    range_of_descriptors(RESOURCE_VIEW::SHADER_RESOURCE, 8, 1)},
+                   shader_stage::all);
+
+const auto occlusion_sampler_set_type = descriptor_set(
+    {range_of_descriptors(RESOURCE_VIEW::SAMPLER, 9, 1)}, shader_stage::all);
+}
+
+meshlet_culling::meshlet_culling(device_t &dev, uint32_t _frame_count)
+    : frame_count(_frame_count), retired(_frame_count) {
+  culling_set = dev.get_object_descriptor_set(culling_set_type);
+  culling_sig = dev.create_pipeline_layout(
+      std::vector<const descriptor_set_layout *>{culling_set.get()});
+  culling_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}
+          .set_compute_shader(meshlet_culling_code)
+          .set_specialization_constant(occlusion_culling_constant, 0),
+      *culling_sig);
+  constant_data = dev.create_buffer(
+      constant_data_stride * frame_count,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uniform);
+}
+
+meshlet_culling::~meshlet_culling() {}
+
+void meshlet_culling::clear() {
+  instances.clear();
+  meshlets.clear();
+  batch_sizes.clear();
+}
+
+uint32_t meshlet_culling::add_instance(const glm::mat4 &world) {
+  return instances.push_back(world);
+}
+
+uint32_t meshlet_culling::add_batch() {
+  batch_sizes.push_back(0);
+  return static_cast<uint32_t>(batch_sizes.size() - 1);
+}
+
+void meshlet_culling::add_meshlets(uint32_t batch, uint32_t instance,
+                                   const std::vector<meshlet> &source,
+                                   int32_t vertex_offset) {
+  for (const auto &m : source) {
+    meshlets.push_back(gpu_meshlet_record{
+        {m.center[0], m.center[1], m.center[2]},
+        m.radius,
+        {m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]},
+        m.cone_cutoff,
+        instance,
+        m.first_index,
+        m.index_count,
+        vertex_offset,
+        batch,
+        0,
+        {0, 0}});
+    batch_sizes[batch] += m.index_count;
+  }
+}
+
+void meshlet_culling::create_inputs(device_t &dev) {
+  // Sets read by frames in flight are never written again, they are retired
+  // with their heap and replaced.
+  for (auto &input : culling_inputs)
+    retired.retire(std::move(input));
+  culling_inputs.clear();
+  retired.retire(std::move(occlusion_input));
+  retired.retire(std::move(heap));
+
+  // The occlusion set is allocated from the same heap, they are bound
+  // together.
+  heap = dev.create_descriptor_storage(
+      frame_count + 1,
+      {{RESOURCE_VIEW::CONSTANTS_BUFFER, frame_count},
+       {RESOURCE_VIEW::UAV_BUFFER, (culling_set_size - 1) * frame_count + 1},
+       {RESOURCE_VIEW::SHADER_RESOURCE, 1}});
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    culling_inputs.push_back(
+        heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+            culling_set_size * frame, {culling_set.get()}, culling_set_size));
+    dev.set_constant_buffer_view(*culling_inputs.back(), 0, 0, *constant_data,
+                                 sizeof(culling_constant_data),
+                                 constant_data_stride * frame);
+  }
+  if (occlusion_pyramid == nullptr)
+    return;
+  occlusion_input = heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+      culling_set_size * frame_count, {occlusion_set.get()}, 2);
+  dev.set_uav_buffer_view(*occlusion_input, 0, 7, *pyramid_state, 0,
+                          sizeof(uint32_t));
+  dev.set_image_view(*occlusion_input, 1, 8,
+                     occlusion_pyramid->get_pyramid_view());
+}
+
+void meshlet_culling::upload(device_t &dev, buffer_t &index_buffer,
+                             uint32_t index_buffer_size, bool readback) {
+  std::vector<draw_indexed_indirect_arguments> arguments;
+  output_index_count = 0;
+  for (const auto &size : batch_sizes) {
+    arguments.push_back(
+        draw_indexed_indirect_arguments{0, 1, output_index_count, 0, 0});
+    output_index_count += size;
+  }
+  for (auto &m : meshlets)
+    m.first_output = arguments[m.batch].first_index;
+
+  create_inputs(dev);
+  instances.upload(dev, frame_count, "meshlet culling instances", retired);
+  retired.retire(std::move(meshlet_buffer));
+  retired.retire(std::move(initial_arguments));
+  retired.retire(std::move(argument_buffer));
+  retired.retire(std::move(output_indices));
+  // Meshlets don't change after upload, the GPU only reads them.
+  const auto meshlets_size =
+      get_storage_buffer_size<gpu_meshlet_record>(meshlets.size());
+  meshlet_buffer = dev.create_buffer(
+      meshlets_size, irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uav,
+      memory_category::other, "meshlet records");
+  memcpy(meshlet_buffer->map_buffer(), meshlets.data(),
+         meshlets.size() * sizeof(gpu_meshlet_record));
+  meshlet_buffer->unmap_buffer();
+
+  const auto arguments_size =
+      get_storage_buffer_size<draw_indexed_indirect_arguments>(
+          arguments.size());
+  initial_arguments = dev.create_buffer(
+      arguments_size, irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
+      usage_buffer_transfer_src, memory_category::staging,
+      "meshlet initial arguments");
+  memcpy(initial_arguments->map_buffer(), arguments.data(),
+         arguments.size() * sizeof(draw_indexed_indirect_arguments));
+  initial_arguments->unmap_buffer();
+  argument_buffer = dev.create_buffer(
+      arguments_size, irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL,
+      usage_uav | usage_indirect | usage_buffer_transfer_dst,
+      memory_category::other, "meshlet arguments");
+  output_indices = dev.create_buffer(
+      get_storage_buffer_size<uint32_t>(output_index_count),
+      irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL, usage_uav | usage_index,
+      memory_category::index_buffer, "meshlet compacted indices");
+  statistics.create(dev, readback, "meshlet culling statistics", retired);
+
+  // The source indices are read as words, the last one may be half used.
+  const auto index_words_size = (index_buffer_size + 3) & ~3u;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    auto &input = *culling_inputs[frame];
+    dev.set_uav_buffer_view(input, 1, 1, instances.get_buffer(frame), 0,
+                            instances.get_buffer_size());
+    dev.set_uav_buffer_view(input, 2, 2, *meshlet_buffer, 0, meshlets_size);
+    dev.set_uav_buffer_view(input, 3, 3, index_buffer, 0, index_words_size);
+    dev.set_uav_buffer_view(input, 4, 4, *argument_buffer, 0, arguments_size);
+    dev.set_uav_buffer_view(
+        input, 5, 5, *output_indices, 0,
+        get_storage_buffer_size<uint32_t>(output_index_count));
+    dev.set_uav_buffer_view(input, 6, 6, statistics.get_buffer(), 0,
+                            sizeof(meshlet_culling_statistics));
+  }
+}
+
+void meshlet_culling::set_instance(uint32_t instance, const glm::mat4 &world) {
+  instances.set(instance, world);
+}
+
+void meshlet_culling::release_retired(uint32_t frame) {
+  retired.release(frame);
+}
+
+void meshlet_culling::update_instances(uint32_t frame) {
+  instances.flush(frame);
+}
+
+void meshlet_culling::enable_occlusion_culling(device_t &dev,
+                                               hi_z_pyramid &pyramid) {
+  occlusion_set = dev.get_object_descriptor_set(occlusion_set_type);
+  occlusion_sampler_set =
+      dev.get_object_descriptor_set(occlusion_sampler_set_type);
+  occlusion_sig =
+      dev.create_pipeline_layout(std::vector<const descriptor_set_layout *>{
+          culling_set.get(), occlusion_set.get(),
+          occlusion_sampler_set.get()});
+  occlusion_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}
+          .set_compute_shader(meshlet_culling_code)
+          .set_specialization_constant(occlusion_culling_constant, 1),
+      *occlusion_sig);
+  // The occlusion input is allocated with the culling inputs by upload.
+  occlusion_pyramid = &pyramid;
+  occlusion_sampler_heap =
+      dev.create_descriptor_storage(1, {{RESOURCE_VIEW::SAMPLER, 1}});
+  occlusion_sampler_input =
+      occlusion_sampler_heap->allocate_descriptor_set_from_sampler_heap(
+          0, {occlusion_sampler_set.get()}, 1);
+  nearest_sampler = dev.create_sampler(SAMPLER_TYPE::NEAREST);
+  dev.set_sampler(*occlusion_sampler_input, 0, 9, *nearest_sampler);
+
+  pyramid_state = dev.create_buffer(
+      sizeof(uint32_t), irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
+      usage_uav | usage_buffer_transfer_dst, memory_category::other,
+      "meshlet culling pyramid state");
+  *static_cast<uint32_t *>(pyramid_state->map_buffer()) = 0;
+  pyramid_state->unmap_buffer();
+}
+
+void meshlet_culling::mark_pyramid_built(command_list_t &cmd_list) {
+  cmd_list.set_buffer_barrier(*pyramid_state, RESOURCE_USAGE::uav,
+                              RESOURCE_USAGE::COPY_DEST);
+  cmd_list.fill_buffer(*pyramid_state, 0, sizeof(uint32_t), 1);
+  cmd_list.set_buffer_barrier(*pyramid_state, RESOURCE_USAGE::COPY_DEST,
+                              RESOURCE_USAGE::uav);
+}
+
+void meshlet_culling::fill_culling_command(command_list_t &cmd_list,
+                                           const frustum &view_frustum,
+                                           const glm::mat4 &view_projection,
+                                           uint32_t frame) {
+  auto *constants = reinterpret_cast<culling_constant_data *>(
+      static_cast<char *>(constant_data->map_buffer()) +
+      constant_data_stride * frame);
+  set_planes(constants->planes, view_frustum);
+  memcpy(constants->view_projection, &view_projection, sizeof(glm::mat4));
+  // The camera projects to x = y = w = 0.
+  const auto &camera = glm::inverse(view_projection) * glm::vec4(0, 0, 1, 0);
+  const auto has_position = std::abs(camera.w) > 1e-6f;
+  constants->camera_position[0] = has_position ? camera.x / camera.w : 0.f;
+  constants->camera_position[1] = has_position ? camera.y / camera.w : 0.f;
+  constants->camera_position[2] = has_position ? camera.z / camera.w : 0.f;
+  constants->camera_position[3] = has_position ? 1.f : 0.f;
+  constants->meshlet_count = static_cast<uint32_t>(meshlets.size());
+  constant_data->unmap_buffer();
+  if (meshlets.empty())
+    return;
+
+  cmd_list.set_buffer_barrier(*argument_buffer,
+                              RESOURCE_USAGE::indirect_argument,
+                              RESOURCE_USAGE::COPY_DEST);
+  cmd_list.copy_buffer(
+      *initial_arguments, 0, *argument_buffer, 0,
+      get_storage_buffer_size<draw_indexed_indirect_arguments>(
+          batch_sizes.size()));
+  cmd_list.set_buffer_barrier(*argument_buffer, RESOURCE_USAGE::COPY_DEST,
+                              RESOURCE_USAGE::uav);
+  statistics.reset(cmd_list);
+  cmd_list.set_buffer_barrier(*output_indices, RESOURCE_USAGE::index_buffer,
+                              RESOURCE_USAGE::uav);
+
+  if (uses_occlusion_culling()) {
+    cmd_list.set_compute_pipeline_layout(*occlusion_sig);
+    cmd_list.set_descriptor_storage_referenced(*heap,
+                                               occlusion_sampler_heap.get());
+    cmd_list.set_compute_pipeline(*occlusion_pso);
+    cmd_list.bind_compute_descriptor(0, *culling_inputs[frame],
+                                     *occlusion_sig);
+    cmd_list.bind_compute_descriptor(1, *occlusion_input, *occlusion_sig);
+    cmd_list.bind_compute_descriptor(2, *occlusion_sampler_input,
+                                     *occlusion_sig);
+  } else {
+    cmd_list.set_compute_pipeline_layout(*culling_sig);
+    cmd_list.set_descriptor_storage_referenced(*heap);
+    cmd_list.set_compute_pipeline(*culling_pso);
+    cmd_list.bind_compute_descriptor(0, *culling_inputs[frame], *culling_sig);
+  }
+  const auto meshlet_count = static_cast<uint32_t>(meshlets.size());
+  const auto group_count_y =
+      (meshlet_count + max_group_count - 1) / max_group_count;
+  cmd_list.dispatch(std::min(meshlet_count, max_group_count), group_count_y,
+                    1);
+
+  cmd_list.set_buffer_barrier(*argument_buffer, RESOURCE_USAGE::uav,
+                              RESOURCE_USAGE::indirect_argument);
+  cmd_list.set_buffer_barrier(*output_indices, RESOURCE_USAGE::uav,
+                              RESOURCE_USAGE::index_buffer);
+  statistics.copy_to_readback(cmd_list);
+}
+
+void meshlet_culling::bind_index_buffer(command_list_t &cmd_list) {
+  if (output_indices == nullptr)
+    return;
+  cmd_list.bind_index_buffer(
+      *output_indices, 0, get_storage_buffer_size<uint32_t>(output_index_count),
+      irr::video::E_INDEX_TYPE::EIT_32BIT);
+}
+
+void meshlet_culling::draw_batch(command_list_t &cmd_list, uint32_t batch) {
+  if (batch_sizes[batch] == 0)
+    return;
+  cmd_list.draw_indexed_indirect(*argument_buffer,
+                                 uint64_t(batch) * argument_stride, 1,
+                                 argument_stride);
+}
+
+meshlet_culling_statistics meshlet_culling::get_statistics() const {
+  if (!statistics.has_readback())
+    throw "meshlet_culling: statistics require a readback upload";
+  return statistics.read();
+}
+
+uint64_t meshlet_culling::get_triangle_count() const {
+  uint64_t result = 0;
+  for (const auto &m : meshlets)
+    result += m.index_count / 3;
+  return result;
+}
+}
+}
@@ -0,0 +1,178 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\Meshlets.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace {
+using vec3 = std::array<float, 3>;
+
+float dot(const vec3 &a, const vec3 &b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+float length(const vec3 &a) { return std::sqrt(dot(a, a)); }
+
+vec3 sub(const vec3 &a, const vec3 &b) {
+  return vec3{a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+// Normals below this cosine to the axis leave no cone worth testing.
+constexpr float min_cone_cosine = .1f;
+
+class meshlet_builder {
+  const std::vector<uint32_t> &indices;
+  const float *positions;
+  const float *normals;
+  size_t stride;
+
+  vec3 get(const float *data, uint32_t vertex) const {
+    const auto *p = reinterpret_cast<const float *>(
+        reinterpret_cast<const char *>(data) + vertex * stride);
+    return vec3{p[0], p[1], p[2]};
+  }
+
+  // Unit face normal, zero for degenerate triangles.
+  vec3 get_face_normal(size_t triangle) const {
+    const auto &a = get(positions, indices[triangle * 3]);
+    const auto &ab = sub(get(positions, indices[triangle * 3 + 1]), a);
+    const auto &ac = sub(get(positions, indices[triangle * 3 + 2]), a);
+    vec3 normal{ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2],
+                ab[0] * ac[1] - ab[1] * ac[0]};
+    const auto normal_length = length(normal);
+    if (normal_length == 0.f)
+      return vec3{0.f, 0.f, 0.f};
+    float sign = 1.f;
+    if (normals != nullptr) {
+      vec3 vertex_normals{0.f, 0.f, 0.f};
+      for (size_t k = 0; k < 3; k++) {
+        const auto &n = get(normals, indices[triangle * 3 + k]);
+        for (size_t axis = 0; axis < 3; axis++)
+          vertex_normals[axis] += n[axis];
+      }
+      sign = dot(vertex_normals, normal) < 0.f ? -1.f : 1.f;
+    }
+    for (auto &axis : normal)
+      axis *= sign / normal_length;
+    return normal;
+  }
+
+public:
+  meshlet_builder(const std::vector<uint32_t> &i, const float *p,
+                  const float *n, size_t s)
+      : indices(i), positions(p), normals(n), stride(s) {}
+
+  void compute_bounds(meshlet &result) const {
+    const auto first_triangle = result.first_index / 3;
+    const auto triangle_count = result.index_count / 3;
+
+    // Sphere around the box center, looser than a minimal one but stable.
+    vec3 low{std::numeric_limits<float>::max(),
+             std::numeric_limits<float>::max(),
+             std::numeric_limits<float>::max()};
+    vec3 high{-low[0], -low[1], -low[2]};
+    for (auto i = result.first_index;
+         i < result.first_index + result.index_count; i++) {
+      const auto &p = get(positions, indices[i]);
+      for (size_t axis = 0; axis < 3; axis++) {
+        low[axis] = std::min(low[axis], p[axis]);
+        high[axis] = std::max(high[axis], p[axis]);
+      }
+    }
+    vec3 center;
+    for (size_t axis = 0; axis < 3; axis++)
+      center[axis] = (low[axis] + high[axis]) / 2.f;
+    float radius = 0.f;
+    for (auto i = result.first_index;
+         i < result.first_index + result.index_count; i++)
+      radius =
+          std::max(radius, length(sub(get(positions, indices[i]), center)));
+
+    vec3 axis{0.f, 0.f, 0.f};
+    for (auto triangle = first_triangle;
+         triangle < first_triangle + triangle_count; triangle++) {
+      const auto &normal = get_face_normal(triangle);
+      for (size_t k = 0; k < 3; k++)
+        axis[k] += normal[k];
+    }
+    const auto axis_length = length(axis);
+    float min_cosine = axis_length > 0.f ? 1.f : -1.f;
+    if (axis_length > 0.f) {
+      for (auto &k : axis)
+        k /= axis_length;
+      for (auto triangle = first_triangle;
+           triangle < first_triangle + triangle_count; triangle++) {
+        const auto &normal = get_face_normal(triangle);
+        if (dot(normal, normal) > 0.f)
+          min_cosine = std::min(min_cosine, dot(normal, axis));
+      }
+    }
+
+    std::copy(center.begin(), center.end(), result.center);
+    result.radius = radius;
+    std::copy(axis.begin(), axis.end(), result.cone_axis);
+    // A triangle faces away from every point of the sphere when the view
+    // direction is within 90 degrees minus the cone half angle of the axis.
+    result.cone_cutoff = min_cosine < min_cone_cosine
+                             ? 1.f
+                             : std::sqrt(1.f - min_cosine * min_cosine);
+  }
+};
+}
+
+std::vector<meshlet> build_meshlets(const std::vector<uint32_t> &indices,
+                                    const float *positions,
+                                    const float *normals, size_t stride,
+                                    size_t vertex_count, size_t max_vertices,
+                                    size_t max_triangles) {
+  std::vector<meshlet> result;
+  const auto triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return result;
+
+  // Meshlet that last referenced every vertex, a vertex is new to the current
+  // meshlet when it differs.
+  constexpr auto unused = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> owner(vertex_count, unused);
+  meshlet current{};
+  const auto &&close = [&]() {
+    result.push_back(current);
+    current = meshlet{};
+    current.first_index = result.back().first_index + result.back().index_count;
+  };
+
+  const auto &&count_new_vertices = [&](const uint32_t *triangle) {
+    const auto id = static_cast<uint32_t>(result.size());
+    uint32_t count = 0;
+    for (size_t k = 0; k < 3; k++) {
+      // Repeated vertices of a degenerate triangle are counted once.
+      const auto repeated = (k > 0 && triangle[k] == triangle[0]) ||
+                            (k > 1 && triangle[k] == triangle[1]);
+      count += owner[triangle[k]] != id && !repeated ? 1 : 0;
+    }
+    return count;
+  };
+
+  for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+    const auto *vertices = &indices[triangle * 3];
+    auto new_vertices = count_new_vertices(vertices);
+    if (current.index_count > 0 &&
+        (current.vertex_count + new_vertices > max_vertices ||
+         current.index_count / 3 + 1 > max_triangles)) {
+      close();
+      new_vertices = count_new_vertices(vertices);
+    }
+    for (size_t k = 0; k < 3; k++)
+      owner[vertices[k]] = static_cast<uint32_t>(result.size());
+    current.vertex_count += new_vertices;
+    current.index_count += 3;
+  }
+  close();
+
+  const meshlet_builder builder(indices, positions, normals, stride);
+  for (auto &m : result)
+    builder.compute_bounds(m);
+  return result;
+}
@@ -1,21 +1,10 @@
 // Copyright (C) 2015 Vincent Lejeune
 // For conditions of distribution and use, see copyright notice in License.txt
 #include <Scene/MeshSceneNode.h>
-#include <Scene/textures.h>
-#include <array>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <range\v3\all.hpp>
-#include <tuple>
+#include <Util/MeshSimplifier.h>
+#include <algorithm>
 #include <unordered_map>
 
-#define SAMPLE_PATH "..\\..\\..\\examples\\assets\\"
-
-struct ObjectData {
-  glm::mat4 ModelMatrix;
-  glm::mat4 InverseModelMatrix;
-};
-
 namespace irr {
 namespace scene {
 //! Constructor
@@ -29,172 +18,178 @@ IMeshSceneNode::IMeshSceneNode(device_t &dev, const aiScene *model,
                                ISceneNode *parent, const glm::vec3 &position,
                                const glm::vec3 &rotation,
                                const glm::vec3 &scale)
-    : ISceneNode(parent, position, rotation, scale) {
+    : IMeshSceneNode(dev,
+                     std::make_shared<mesh_asset>(dev, model, upload_cmd_list,
+                                                  heap, model_set),
+                     heap, object_set, parent, position, rotation, scale) {}
+
+IMeshSceneNode::IMeshSceneNode(device_t &dev,
+                               std::shared_ptr<mesh_asset> mesh_data,
+                               descriptor_storage_t &heap,
+                               descriptor_set_layout *object_set,
+                               ISceneNode *parent, const glm::vec3 &position,
+                               const glm::vec3 &rotation,
+                               const glm::vec3 &scale)
+    : ISceneNode(parent, position, rotation, scale),
+      asset(std::move(mesh_data)) {
   object_matrix = dev.create_buffer(
       sizeof(ObjectData), irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
-      usage_uniform);
+      usage_uav, memory_category::uniform_buffer, "object matrix");
   object_descriptor_set =
-      heap.allocate_descriptor_set_from_cbv_srv_uav_heap(3, {object_set}, 2);
-  dev.set_constant_buffer_view(*object_descriptor_set, 0, 0, *object_matrix,
-                               sizeof(ObjectData));
-  dev.set_constant_buffer_view(*object_descriptor_set, 1, 1, *object_matrix,
-                               sizeof(ObjectData));
-
-  // Format Weight
-
-  /*        std::vector<std::vector<irr::video::SkinnedVertexData> >
-  weightsList;
-  for (auto weightbuffer : loader->AnimatedMesh.WeightBuffers)
-  {
-  std::vector<irr::video::SkinnedVertexData> weights;
-  for (unsigned j = 0; j < weightbuffer.size(); j += 4)
-  {
-  irr::video::SkinnedVertexData tmp = {
-  weightbuffer[j].Index, weightbuffer[j].Weight,
-  weightbuffer[j + 1].Index, weightbuffer[j + 1].Weight,
-  weightbuffer[j + 2].Index, weightbuffer[j + 2].Weight,
-  weightbuffer[j + 3].Index, weightbuffer[j + 3].Weight,
-  };
-  weights.push_back(tmp);
-  }
-  weightsList.push_back(weights);
-  }*/
+      heap.allocate_descriptor_set_from_cbv_srv_uav_heap(3, {object_set}, 1);
+  dev.set_uav_buffer_view(*object_descriptor_set, 0, 0, *object_matrix, 0,
+                          sizeof(ObjectData));
+}
 
-  const auto &meshes =
-      ranges::make_range(model->mMeshes, model->mMeshes + model->mNumMeshes);
-  const auto &total_vertex_cnt =
-      ranges::accumulate(meshes | ranges::view::transform([](const auto &mesh) {
-                           return mesh->mNumVertices;
-                         }),
-                         0);
-  total_index_cnt =
-      ranges::accumulate(meshes | ranges::view::transform([](const auto &mesh) {
-                           return mesh->mNumFaces * 3;
-                         }),
-                         0);
+IMeshSceneNode::~IMeshSceneNode() {}
 
-  index_buffer = dev.create_buffer(total_index_cnt * sizeof(uint16_t),
-                                   irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
-                                   usage_index);
-  uint16_t *indexmap = static_cast<uint16_t *>(index_buffer->map_buffer());
-  vertex_pos = dev.create_buffer(total_vertex_cnt * sizeof(aiVector3D),
-                                 irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
-                                 usage_vertex);
-  aiVector3D *vertex_pos_map =
-      static_cast<aiVector3D *>(vertex_pos->map_buffer());
-  vertex_normal = dev.create_buffer(
-      total_vertex_cnt * sizeof(aiVector3D),
-      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_vertex);
-  aiVector3D *vertex_normal_map =
-      static_cast<aiVector3D *>(vertex_normal->map_buffer());
-  vertex_uv0 = dev.create_buffer(total_vertex_cnt * sizeof(aiVector3D),
-                                 irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
-                                 usage_vertex);
-  aiVector3D *vertex_uv_map =
-      static_cast<aiVector3D *>(vertex_uv0->map_buffer());
+void IMeshSceneNode::fill_draw_command(command_list_t &current_cmd_list,
+                                       pipeline_layout_t &object_sig) {
+  current_cmd_list.bind_graphic_descriptor(1, *object_descriptor_set,
+                                           object_sig);
+  current_cmd_list.bind_index_buffer(asset->get_index_buffer(), 0,
+                                     asset->get_index_buffer_size(),
+                                     irr::video::E_INDEX_TYPE::EIT_16BIT);
+  current_cmd_list.bind_vertex_buffers(0, asset->get_vertex_buffers());
 
-  uint32_t basevertex = 0;
-  uint32_t baseindex = 0;
+  for (unsigned i = 0; i < asset->get_submesh_count(); i++) {
+    current_cmd_list.bind_graphic_descriptor(
+        0, asset->get_material(asset->get_material_index(i)), object_sig);
+    const auto &level = asset->get_lod(i, lod);
+    current_cmd_list.draw_indexed(level.index_count, 1, level.first_index,
+                                  asset->get_vertex_offset(i), 0);
+  }
+}
 
-  auto meshes_model = ranges::make_range(model->mMeshes, model->mMeshes + model->mNumMeshes);
-  auto index_input = meshes_model |
-      ranges::view::transform([](const auto mesh) { return ranges::make_range(mesh->mFaces, mesh->mFaces + mesh->mNumFaces); }) |
-      ranges::view::join |
-      ranges::view::transform([](const auto& face) { return ranges::make_range(face.mIndices, face.mIndices + 3); }) |
-      ranges::view::join;
-  ranges::copy(index_input, indexmap);
-  ranges::copy(meshes_model |
-      ranges::view::transform([](const auto mesh) { return ranges::make_range(mesh->mVertices, mesh->mVertices + mesh->mNumVertices); }) |
-      ranges::view::join,
-      vertex_pos_map);
-  ranges::copy(meshes_model |
-      ranges::view::transform([](const auto mesh) { return ranges::make_range(mesh->mNormals, mesh->mNormals + mesh->mNumVertices); }) |
-      ranges::view::join,
-      vertex_normal_map);
-  ranges::copy(meshes_model |
-      ranges::view::transform([](const auto mesh) { return ranges::make_range(mesh->mTextureCoords[0], mesh->mTextureCoords[0] + mesh->mNumVertices); }) |
-      ranges::view::join,
-      vertex_uv_map);
+void IMeshSceneNode::fill_draw_items(
+    command_stream &stream, pipeline_layout_t &object_sig,
+    const std::function<uint64_t(const allocated_descriptor_set &)> &get_key,
+    const uint8_t *submesh_visibility) {
+  // Every item carries all its state, binds that end up redundant after
+  // sorting are dropped by the translator.
+  for (unsigned i = 0; i < asset->get_submesh_count(); i++) {
+    if (submesh_visibility != nullptr && !submesh_visibility[i])
+      continue;
+    const auto &material = asset->get_material(asset->get_material_index(i));
+    stream.begin_item(get_key(material));
+    if (pipeline != nullptr)
+      stream.set_graphic_pipeline(*pipeline);
+    stream.bind_graphic_descriptor(1, *object_descriptor_set, object_sig);
+    stream.bind_index_buffer(asset->get_index_buffer(), 0,
+                             asset->get_index_buffer_size(),
+                             irr::video::E_INDEX_TYPE::EIT_16BIT);
+    stream.bind_vertex_buffers(0, asset->get_vertex_buffers());
+    stream.bind_graphic_descriptor(0, material, object_sig);
+    const auto &level = asset->get_lod(i, lod);
+    stream.draw_indexed(level.index_count, 1, level.first_index,
+                        asset->get_vertex_offset(i), 0);
+  }
+}
 
-  for (unsigned int i = 0; i < model->mNumMeshes; ++i) {
-    const aiMesh *mesh = model->mMeshes[i];
-    meshOffset.push_back(
-        std::make_tuple(mesh->mNumFaces * 3, basevertex, baseindex));
-    basevertex += mesh->mNumVertices;
-    baseindex += mesh->mNumFaces * 3;
-    texture_mapping.push_back(mesh->mMaterialIndex);
+void IMeshSceneNode::add_gpu_draws(gpu_culling &culling, uint32_t instance) {
+  gpu_batches.clear();
+  gpu_draws.clear();
+  std::unordered_map<uint32_t, uint32_t> batch_by_material;
+  for (unsigned i = 0; i < asset->get_submesh_count(); i++) {
+    const auto material = asset->get_material_index(i);
+    auto It = batch_by_material.find(material);
+    if (It == batch_by_material.end()) {
+      It = batch_by_material.emplace(material, culling.add_batch()).first;
+      gpu_batches.emplace_back(It->second, material);
+    }
+    const auto &level = asset->get_lod(i, lod);
+    gpu_draws.push_back(culling.add_draw(
+        It->second, instance, asset->get_submesh_bounds()[i],
+        level.index_count, level.first_index, asset->get_vertex_offset(i)));
   }
-  index_buffer->unmap_buffer();
-  vertex_pos->unmap_buffer();
-  vertex_normal->unmap_buffer();
-  vertex_uv0->unmap_buffer();
-  // TODO: Upload to GPUmem
+}
 
-  vertex_buffers_info.emplace_back(
-      *vertex_pos, 0, static_cast<uint32_t>(sizeof(aiVector3D)),
-      static_cast<uint32_t>(total_vertex_cnt * sizeof(aiVector3D)));
-  vertex_buffers_info.emplace_back(
-      *vertex_normal, 0, static_cast<uint32_t>(sizeof(aiVector3D)),
-      static_cast<uint32_t>(total_vertex_cnt * sizeof(aiVector3D)));
-  vertex_buffers_info.emplace_back(
-      *vertex_uv0, 0, static_cast<uint32_t>(sizeof(aiVector3D)),
-      static_cast<uint32_t>(total_vertex_cnt * sizeof(aiVector3D)));
+void IMeshSceneNode::add_meshlet_draws(meshlet_culling &culling,
+                                       uint32_t instance) {
+  gpu_batches.clear();
+  gpu_draws.clear();
+  std::unordered_map<uint32_t, uint32_t> batch_by_material;
+  for (unsigned i = 0; i < asset->get_submesh_count(); i++) {
+    const auto material = asset->get_material_index(i);
+    auto It = batch_by_material.find(material);
+    if (It == batch_by_material.end()) {
+      It = batch_by_material.emplace(material, culling.add_batch()).first;
+      gpu_batches.emplace_back(It->second, material);
+    }
+    culling.add_meshlets(It->second, instance, asset->get_meshlets(i),
+                         asset->get_vertex_offset(i));
+  }
+}
 
-  // Texture
-  for (unsigned int texture_id = 0; texture_id < model->mNumMaterials;
-       ++texture_id) {
-    aiString path;
-    model->mMaterials[texture_id]->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-    std::string texture_path(path.C_Str());
+void IMeshSceneNode::fill_meshlet_draw_command(command_list_t &cmd_list,
+                                               pipeline_layout_t &object_sig,
+                                               meshlet_culling &culling) {
+  if (pipeline != nullptr)
+    cmd_list.set_graphic_pipeline(*pipeline);
+  cmd_list.bind_graphic_descriptor(1, *object_descriptor_set, object_sig);
+  cmd_list.bind_vertex_buffers(0, asset->get_vertex_buffers());
+  for (const auto &batch : gpu_batches) {
+    cmd_list.bind_graphic_descriptor(0, asset->get_material(batch.second),
+                                     object_sig);
+    culling.draw_batch(cmd_list, batch.first);
+  }
+}
 
-    std::unique_ptr<image_t> texture;
-    std::unique_ptr<buffer_t> upload_buffer;
-    std::tie(texture, upload_buffer) = load_texture(
-        dev,
-        SAMPLE_PATH + texture_path.substr(0, texture_path.find_last_of('.')) +
-            ".DDS",
-        upload_cmd_list);
-    auto &&mesh_descriptor = heap.allocate_descriptor_set_from_cbv_srv_uav_heap(
-        13 + texture_id, {model_set}, 1);
-    mesh_descriptor_set.push_back(std::move(mesh_descriptor));
+bool IMeshSceneNode::select_lod(float pixels_per_unit, float threshold,
+                                float hysteresis) {
+  const auto previous = lod;
+  lod = ::select_lod(asset->get_lod_errors(), lod, pixels_per_unit, threshold,
+                     hysteresis);
+  return lod != previous;
+}
 
-    Textures_views.push_back(
-        dev.create_image_view(*texture, irr::video::ECF_BC1_UNORM_SRGB, 0, 9, 0,
-                              1, irr::video::E_TEXTURE_TYPE::ETT_2D));
-    dev.set_image_view(*mesh_descriptor_set.back(), 0, 2,
-                       *Textures_views.back());
-    upload_buffers.push_back(std::move(upload_buffer));
-    Textures.push_back(std::move(texture));
+void IMeshSceneNode::update_gpu_draws(gpu_culling &culling) const {
+  for (size_t i = 0; i < gpu_draws.size(); i++) {
+    if (gpu_draws[i] == gpu_culling::invalid_draw)
+      continue;
+    const auto &level = asset->get_lod(i, lod);
+    culling.set_draw_range(gpu_draws[i], level.index_count, level.first_index);
   }
 }
 
-IMeshSceneNode::~IMeshSceneNode() {}
-
-void IMeshSceneNode::fill_draw_command(command_list_t &current_cmd_list,
-                                       pipeline_layout_t &object_sig) {
-  current_cmd_list.bind_graphic_descriptor(1, *object_descriptor_set,
-                                           object_sig);
-  current_cmd_list.bind_index_buffer(*index_buffer, 0,
-                                     total_index_cnt * sizeof(uint16_t),
-                                     irr::video::E_INDEX_TYPE::EIT_16BIT);
-  current_cmd_list.bind_vertex_buffers(0, vertex_buffers_info);
+size_t IMeshSceneNode::getTriangleCount(size_t &full_count) const {
+  size_t result = 0;
+  for (size_t i = 0; i < asset->get_submesh_count(); i++) {
+    result += asset->get_lod(i, lod).index_count / 3;
+    full_count += asset->get_lod(i, 0).index_count / 3;
+  }
+  return result;
+}
 
-  for (unsigned i = 0; i < meshOffset.size(); i++) {
-    current_cmd_list.bind_graphic_descriptor(
-        0, *mesh_descriptor_set[texture_mapping[i]], object_sig);
-    current_cmd_list.draw_indexed(std::get<0>(meshOffset[i]), 1,
-                                  std::get<2>(meshOffset[i]),
-                                  std::get<1>(meshOffset[i]), 0);
+void IMeshSceneNode::fill_indirect_draw_command(command_list_t &cmd_list,
+                                                pipeline_layout_t &object_sig,
+                                                gpu_culling &culling) {
+  if (pipeline != nullptr)
+    cmd_list.set_graphic_pipeline(*pipeline);
+  cmd_list.bind_graphic_descriptor(1, *object_descriptor_set, object_sig);
+  cmd_list.bind_index_buffer(asset->get_index_buffer(), 0,
+                             asset->get_index_buffer_size(),
+                             irr::video::E_INDEX_TYPE::EIT_16BIT);
+  cmd_list.bind_vertex_buffers(0, asset->get_vertex_buffers());
+  for (const auto &batch : gpu_batches) {
+    cmd_list.bind_graphic_descriptor(0, asset->get_material(batch.second),
+                                     object_sig);
+    culling.draw_batch(cmd_list, batch.first);
   }
 }
 
+ObjectData IMeshSceneNode::getObjectData() const {
+  const auto &Model = getAbsoluteTransformation();
+  return ObjectData{Model, glm::inverse(Model),
+                    glm::vec4(asset->get_position_scale(), 0.f),
+                    glm::vec4(asset->get_position_offset(), 0.f)};
+}
+
 void IMeshSceneNode::update_constant_buffers(device_t &dev) {
   ObjectData *cbufdata = static_cast<ObjectData *>(object_matrix->map_buffer());
   updateAbsolutePosition();
-  const auto &Model = getAbsoluteTransformation();
-  cbufdata->ModelMatrix = Model;
-  cbufdata->InverseModelMatrix = glm::inverse(Model);
+  *cbufdata = getObjectData();
   object_matrix->unmap_buffer();
 }
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,183 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene\MipmapGenerator.h>
+#include <algorithm>
+#include <cstring>
+
+const auto generate_mips_code = std::vector<uint32_t>
+#include <generatedShaders\generate_mips.h>
+    ;
+
+namespace irr {
+namespace scene {
+namespace {
+constexpr uint32_t group_size = 16;
+constexpr uint32_t levels_per_dispatch = 5;
+// Satisfies every minUniformBufferOffsetAlignment and D3D12 constant buffer
+// placement.
+constexpr uint32_t constant_data_stride = 256;
+
+struct generate_constant_data {
+  uint32_t level_count;
+  uint32_t srgb;
+  uint32_t padding[2];
+};
+
+const auto generate_set_type = descriptor_set(
+    {range_of_descriptors(RESOURCE_VIEW::SHADER_RESOURCE, 0, 1),
+     range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 1, 1),
+     range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 2, 1),
+     range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 3, 1),
+     range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 4, 1),
+     range_of_descriptors(RESOURCE_VIEW::UAV_IMAGE, 5, 1),
+     range_of_descriptors(RESOURCE_VIEW::CONSTANTS_BUFFER, 6, 1)},
+    shader_stage::all);
+
+const auto sampler_set_type = descriptor_set(
+    {range_of_descriptors(RESOURCE_VIEW::SAMPLER, 7, 1)}, shader_stage::all);
+}
+
+mipmap_generator::mipmap_generator(device_t &_dev) : dev(_dev) {
+  generate_set = dev.get_object_descriptor_set(generate_set_type);
+  sampler_set = dev.get_object_descriptor_set(sampler_set_type);
+  generate_sig =
+      dev.create_pipeline_layout(std::vector<const descriptor_set_layout *>{
+          generate_set.get(), sampler_set.get()});
+  generate_pso = dev.create_compute_pso(
+      compute_pipeline_state_description{}.set_compute_shader(
+          generate_mips_code),
+      *generate_sig);
+  sampler_heap =
+      dev.create_descriptor_storage(1, {{RESOURCE_VIEW::SAMPLER, 1}});
+  sampler_input = sampler_heap->allocate_descriptor_set_from_sampler_heap(
+      0, {sampler_set.get()}, 1);
+  nearest_sampler = dev.create_sampler(SAMPLER_TYPE::NEAREST);
+  dev.set_sampler(*sampler_input, 0, 7, *nearest_sampler);
+}
+
+mipmap_generator::~mipmap_generator() {}
+
+bool mipmap_generator::supports_format(irr::video::ECOLOR_FORMAT format) const {
+  // BGRA formats have no storage support on many Vulkan devices.
+  switch (format) {
+  case irr::video::ECF_R8G8B8A8_UNORM_SRGB:
+    return dev.supports_srgb_storage_images();
+  case irr::video::ECF_R8G8B8A8_UNORM:
+  case irr::video::ECF_R8:
+  case irr::video::ECF_R8G8:
+  case irr::video::ECF_R16G16B16A16_UNORM:
+  case irr::video::ECF_R16F:
+  case irr::video::ECF_R16G16F:
+  case irr::video::ECF_R16G16B16A16F:
+  case irr::video::ECF_R32F:
+  case irr::video::ECF_R32G32F:
+  case irr::video::ECF_R32G32B32A32F:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void mipmap_generator::add_image(image_t &image,
+                                 irr::video::ECOLOR_FORMAT format,
+                                 uint32_t width, uint32_t height,
+                                 uint16_t mipmap_count, uint32_t layer_count) {
+  if (!supports_format(format))
+    throw "mipmap_generator: format can't be written by compute shaders";
+  const auto dispatch_count =
+      (std::max<uint32_t>(mipmap_count, 1) + levels_per_dispatch - 2) /
+      levels_per_dispatch;
+  const auto layers = static_cast<uint16_t>(layer_count);
+  auto &record = images[&image];
+  record = image_record{width, height, mipmap_count, layer_count};
+  if (dispatch_count == 0)
+    return;
+
+  record.heap = dev.create_descriptor_storage(
+      dispatch_count,
+      {{RESOURCE_VIEW::SHADER_RESOURCE, dispatch_count},
+       {RESOURCE_VIEW::UAV_IMAGE, levels_per_dispatch * dispatch_count},
+       {RESOURCE_VIEW::CONSTANTS_BUFFER, dispatch_count}});
+  record.constant_data = dev.create_buffer(
+      constant_data_stride * dispatch_count,
+      irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uniform);
+  for (uint16_t level = 0; level < mipmap_count; level++)
+    record.level_views.push_back(dev.create_image_view(
+        image, irr::video::formatWithoutSRGB(format), level, 1, 0, layers,
+        irr::video::E_TEXTURE_TYPE::ETT_2D_ARRAY));
+
+  auto *constants = static_cast<char *>(record.constant_data->map_buffer());
+  constexpr auto set_size = levels_per_dispatch + 2;
+  for (uint32_t dispatch = 0; dispatch < dispatch_count; dispatch++) {
+    const auto source_level = dispatch * levels_per_dispatch;
+    const auto level_count = std::min(
+        levels_per_dispatch, uint32_t{mipmap_count} - 1 - source_level);
+    const generate_constant_data data{level_count,
+                                      irr::video::isSRGB(format) ? 1u : 0u};
+    memcpy(constants + constant_data_stride * dispatch, &data, sizeof(data));
+
+    record.source_views.push_back(dev.create_image_view(
+        image, format, static_cast<uint16_t>(source_level), 1, 0, layers,
+        irr::video::E_TEXTURE_TYPE::ETT_2D_ARRAY));
+    record.inputs.push_back(
+        record.heap->allocate_descriptor_set_from_cbv_srv_uav_heap(
+            set_size * dispatch, {generate_set.get()}, set_size));
+    auto &input = *record.inputs.back();
+    dev.set_image_view(input, 0, 0, *record.source_views.back());
+    // Bindings past the last level repeat it, the shader never writes them.
+    for (uint32_t i = 1; i <= levels_per_dispatch; i++)
+      dev.set_uav_image_view(
+          input, i, i,
+          *record.level_views[source_level + std::min(i, level_count)]);
+    dev.set_constant_buffer_view(input, set_size - 1, set_size - 1,
+                                 *record.constant_data,
+                                 sizeof(generate_constant_data),
+                                 constant_data_stride * dispatch);
+  }
+  record.constant_data->unmap_buffer();
+}
+
+void mipmap_generator::remove_image(image_t &image) { images.erase(&image); }
+
+void mipmap_generator::generate_mips(command_list_t &cmd_list,
+                                     image_t &image) {
+  const auto found = images.find(&image);
+  if (found == images.end())
+    throw "mipmap_generator: image wasn't added";
+  auto &record = found->second;
+  if (record.inputs.empty())
+    return;
+
+  const auto &set_level_barrier = [&](uint32_t level, RESOURCE_USAGE before,
+                                      RESOURCE_USAGE after) {
+    for (uint32_t layer = 0; layer < record.layer_count; layer++)
+      cmd_list.set_pipeline_barrier(image, before, after,
+                                    layer * record.mipmap_count + level,
+                                    irr::video::E_ASPECT::EA_COLOR);
+  };
+
+  cmd_list.set_compute_pipeline_layout(*generate_sig);
+  cmd_list.set_descriptor_storage_referenced(*record.heap, sampler_heap.get());
+  cmd_list.set_compute_pipeline(*generate_pso);
+  cmd_list.bind_compute_descriptor(1, *sampler_input, *generate_sig);
+  for (uint32_t dispatch = 0; dispatch < record.inputs.size(); dispatch++) {
+    const auto source_level = dispatch * levels_per_dispatch;
+    const auto last_level = std::min(source_level + levels_per_dispatch,
+                                     uint32_t{record.mipmap_count} - 1);
+    // Every texel of the levels is written, previous content is discarded.
+    for (uint32_t level = source_level + 1; level <= last_level; level++)
+      set_level_barrier(level, RESOURCE_USAGE::undefined, RESOURCE_USAGE::uav);
+    cmd_list.bind_compute_descriptor(0, *record.inputs[dispatch],
+                                     *generate_sig);
+    const auto first_width = std::max(record.width >> (source_level + 1), 1u);
+    const auto first_height = std::max(record.height >> (source_level + 1), 1u);
+    cmd_list.dispatch((first_width + group_size - 1) / group_size,
+                      (first_height + group_size - 1) / group_size,
+                      record.layer_count);
+    for (uint32_t level = source_level + 1; level <= last_level; level++)
+      set_level_barrier(level, RESOURCE_USAGE::uav,
+                        RESOURCE_USAGE::READ_GENERIC);
+  }
+}
+}
+}
@@ -35,6 +35,9 @@ const auto skybox_frag_code = std::vector<uint32_t>
 #include <generatedShaders\skybox_frag.h>
     ;
 
+// constant_id of object.vert selecting vertex_format::compressed streams.
+constexpr uint32_t object_compressed_vertices_constant = 0;
+
 std::unique_ptr<pipeline_state_t>
 get_skinned_object_pipeline_state(device_t &dev, pipeline_layout_t &layout,
                                   render_pass_t &rp) {
@@ -113,6 +116,27 @@ get_skinned_object_pipeline_state(device_t &dev, pipeline_layout_t &layout,
   return dev.create_graphic_pso(pso_desc, rp, layout, 0);
 }
 
+std::unique_ptr<pipeline_state_t>
+get_compressed_object_pipeline_state(device_t &dev, pipeline_layout_t &layout,
+                                     render_pass_t &rp) {
+  graphic_pipeline_state_description pso_desc =
+      graphic_pipeline_state_description::get()
+          .set_vertex_shader(skinnedobject_code)
+          .set_fragment_shader(object_gbuffer_code)
+          .set_specialization_constant(object_compressed_vertices_constant, 1)
+          .set_vertex_attributes(std::vector<pipeline_vertex_attributes>{
+              pipeline_vertex_attributes{0, irr::video::ECF_R16G16B16A16_UNORM,
+                                         0, 4 * sizeof(uint16_t), 0},
+              pipeline_vertex_attributes{1, irr::video::ECF_R16G16_SNORM, 1,
+                                         2 * sizeof(uint16_t), 0},
+              pipeline_vertex_attributes{2, irr::video::ECF_R16G16F, 2,
+                                         2 * sizeof(uint16_t), 0}})
+          .set_color_outputs(
+              std::vector<color_output>{{false}, {false}, {false}});
+
+  return dev.create_graphic_pso(pso_desc, rp, layout, 0);
+}
+
 std::unique_ptr<pipeline_state_t>
 get_sunlight_pipeline_state(device_t &dev, pipeline_layout_t &layout,
                             render_pass_t &rp) {
@@ -3,6 +3,10 @@
 #include "..\include\Scene\Scene.h"
 #include <Scene\Scene.h>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
 
 struct ViewBuffer {
   float ViewProj[16];
@@ -14,27 +18,523 @@ Scene::Scene() {}
 
 Scene::~Scene() {}
 
-void Scene::update(device_t &dev) {
-  std::for_each(Nodes.begin(), Nodes.end(),
-                [&dev](std::unique_ptr<IMeshSceneNode> &node) {
-                  node->update_constant_buffers(dev);
-                });
+void Scene::update(device_t &dev, uint32_t frame) {
+  // The previous frame of this slot completed, objects it was the last to
+  // possibly read are destroyed.
+  if (gpu_culler != nullptr)
+    gpu_culler->release_retired(frame);
+  if (meshlet_culler != nullptr)
+    meshlet_culler->release_retired(frame);
+  retired_instance_buffers.release(frame);
+  transforms.update();
+  if ((gpu_culler != nullptr || meshlet_culler != nullptr) && gpu_draws_dirty)
+    upload_gpu_draws(dev);
+  if (instance_descriptor_set != nullptr && Nodes.size() > instance_capacity)
+    reserve_instances(dev);
+  ObjectData *instances = nullptr;
+  if (instance_descriptor_set != nullptr && !transforms.get_changed().empty())
+    instances = static_cast<ObjectData *>(instance_buffer->map_buffer());
+  for (const auto &id : transforms.get_changed()) {
+    if (id >= mesh_nodes_by_transform.size() ||
+        mesh_nodes_by_transform[id] == nullptr)
+      continue;
+    const auto &node = mesh_nodes_by_transform[id];
+    node->update_constant_buffers(dev);
+    const auto &world = node->getAbsoluteTransformation();
+    const auto &submesh_bounds = node->getSubmeshBoundingBoxes();
+    for (size_t i = 0; i < submesh_bounds.size(); i++)
+      world_bounds.set(first_bound_by_transform[id] + i,
+                       submesh_bounds[i].transform(world));
+    auto &item = bvh_item_by_transform[id];
+    if (item == bvh::invalid_item && !free_bvh_items.empty()) {
+      item = free_bvh_items.back();
+      free_bvh_items.pop_back();
+      bvh_nodes[item] = node;
+      node_bvh.update(item, get_world_bounds(*node));
+    } else if (item == bvh::invalid_item) {
+      item = node_bvh.insert(get_world_bounds(*node));
+      bvh_nodes.push_back(node);
+    } else {
+      node_bvh.update(item, get_world_bounds(*node));
+    }
+    if (gpu_culler != nullptr)
+      gpu_culler->set_instance(gpu_instance_by_transform[id], world);
+    if (meshlet_culler != nullptr)
+      meshlet_culler->set_instance(gpu_instance_by_transform[id], world);
+    if (instances != nullptr && id < instance_slot_by_transform.size() &&
+        instance_slot_by_transform[id] != invalid_instance_slot)
+      instances[instance_slot_by_transform[id]] = node->getObjectData();
+  }
+  if (instances != nullptr)
+    instance_buffer->unmap_buffer();
+  if (gpu_culler != nullptr) {
+    gpu_culler->update_instances(frame);
+    gpu_culler->update_draws(frame);
+  }
+  if (meshlet_culler != nullptr)
+    meshlet_culler->update_instances(frame);
+}
+
+float Scene::get_pixels_per_unit(const irr::scene::IMeshSceneNode &node,
+                                 const glm::vec3 &camera_position,
+                                 float projection_scale) const {
+  const auto &world = node.getAbsoluteTransformation();
+  const auto scale = std::max(std::max(glm::length(glm::vec3(world[0])),
+                                       glm::length(glm::vec3(world[1]))),
+                              glm::length(glm::vec3(world[2])));
+  // Distance to the closest point of the world bounds, 0 inside.
+  const auto &bounds = get_world_bounds(node);
+  const auto &closest = glm::clamp(camera_position, bounds.min, bounds.max);
+  const auto distance =
+      std::max(glm::length(camera_position - closest), 1e-3f);
+  return projection_scale * scale / distance;
+}
+
+lod_statistics Scene::select_lods(const glm::vec3 &camera_position,
+                                  float projection_scale) {
+  lod_statistics result;
+  for (auto &node : Nodes) {
+    if (node.select_lod(
+            get_pixels_per_unit(node, camera_position, projection_scale),
+            lod_threshold, lod_hysteresis) &&
+        gpu_culler != nullptr)
+      node.update_gpu_draws(*gpu_culler);
+    result.triangles += node.getTriangleCount(result.full_triangles);
+  }
+  return result;
+}
+
+void Scene::request_texture_levels(texture_cache &textures,
+                                   const glm::vec3 &camera_position,
+                                   float projection_scale) const {
+  for (const auto &node : Nodes) {
+    const auto pixels_per_unit =
+        get_pixels_per_unit(node, camera_position, projection_scale);
+    const auto &asset = *node.getMeshAsset();
+    const auto *visibility =
+        culling_enabled ? submesh_visibility.data() +
+                              first_bound_by_transform[node.getTransformId()]
+                        : nullptr;
+    for (size_t submesh = 0; submesh < asset.get_submesh_count(); submesh++) {
+      if (visibility != nullptr && visibility[submesh] == 0)
+        continue;
+      textures.request_density(
+          asset.get_material_texture(asset.get_material_index(submesh)),
+          asset.get_submesh_uv_density(submesh) / pixels_per_unit);
+    }
+  }
+}
+
+void Scene::enable_gpu_culling(device_t &dev, bool readback,
+                               uint32_t frame_count) {
+  meshlet_culler.reset();
+  gpu_culler = std::make_unique<gpu_culling>(dev, frame_count);
+  gpu_culling_readback = readback;
+  upload_gpu_draws(dev);
+}
+
+void Scene::enable_meshlet_culling(device_t &dev, bool readback,
+                                   uint32_t frame_count) {
+  gpu_culler.reset();
+  meshlet_culler = std::make_unique<meshlet_culling>(dev, frame_count);
+  gpu_culling_readback = readback;
+  upload_gpu_draws(dev);
+}
+
+void Scene::upload_gpu_draws(device_t &dev) {
+  if (meshlet_culler != nullptr) {
+    meshlet_culler->clear();
+    gpu_instance_by_transform.resize(transforms.size(), 0);
+    const mesh_asset *indexed = nullptr;
+    for (auto &node : Nodes) {
+      const auto &asset = node.getMeshAsset();
+      if (indexed != nullptr &&
+          &indexed->get_index_buffer() != &asset->get_index_buffer())
+        throw "Scene: meshlet culling needs nodes sharing a geometry arena";
+      indexed = asset.get();
+      const auto instance =
+          meshlet_culler->add_instance(node.getAbsoluteTransformation());
+      gpu_instance_by_transform[node.getTransformId()] = instance;
+      node.add_meshlet_draws(*meshlet_culler, instance);
+    }
+    // Nothing is culled nor drawn without nodes.
+    if (indexed != nullptr)
+      meshlet_culler->upload(dev, indexed->get_index_buffer(),
+                             indexed->get_index_buffer_size(),
+                             gpu_culling_readback);
+    gpu_draws_dirty = false;
+    return;
+  }
+  gpu_culler->clear();
+  gpu_instance_by_transform.resize(transforms.size(), 0);
+  for (auto &node : Nodes) {
+    const auto instance =
+        gpu_culler->add_instance(node.getAbsoluteTransformation());
+    gpu_instance_by_transform[node.getTransformId()] = instance;
+    node.add_gpu_draws(*gpu_culler, instance);
+  }
+  gpu_culler->upload(dev, gpu_culling_readback);
+  gpu_draws_dirty = false;
+}
+
+void Scene::fill_gpu_culling_command(command_list_t &cmd_list,
+                                     uint32_t frame) {
+  if (!culling_enabled)
+    throw "Scene: set_view_frustum must be called before GPU culling";
+  if (meshlet_culler != nullptr)
+    meshlet_culler->fill_culling_command(cmd_list, view_frustum,
+                                         view_projection, frame);
+  else if (occlusion_pyramid != nullptr)
+    gpu_culler->fill_occlusion_culling_command(
+        cmd_list, view_frustum, view_projection, culling_phase::early, frame);
+  else
+    gpu_culler->fill_culling_command(cmd_list, view_frustum, frame);
+}
+
+void Scene::enable_occlusion_culling(device_t &dev, image_t &depth_buffer,
+                                     irr::video::ECOLOR_FORMAT depth_format,
+                                     uint32_t width, uint32_t height) {
+  if (gpu_culler == nullptr && meshlet_culler == nullptr)
+    throw "Scene: GPU or meshlet culling must be enabled before occlusion "
+          "culling";
+  occlusion_pyramid = std::make_unique<hi_z_pyramid>(
+      dev, depth_buffer, depth_format, width, height);
+  if (meshlet_culler != nullptr)
+    meshlet_culler->enable_occlusion_culling(dev, *occlusion_pyramid);
+  else
+    gpu_culler->enable_occlusion_culling(dev, *occlusion_pyramid);
+  upload_gpu_draws(dev);
+}
+
+void Scene::enable_instancing(device_t &dev, descriptor_storage_t &heap,
+                              descriptor_set_layout *object_set,
+                              uint32_t frame_count) {
+  retired_instance_buffers = retired_objects(frame_count);
+  instance_descriptor_set =
+      heap.allocate_descriptor_set_from_cbv_srv_uav_heap(4, {object_set}, 1);
+  reserve_instances(dev);
+}
+
+void Scene::reserve_instances(device_t &dev) {
+  instance_capacity = std::max(
+      {static_cast<uint32_t>(Nodes.size()), 2 * instance_capacity, 1u});
+  // Recorded command lists of frames in flight may still read it.
+  retired_instance_buffers.retire(std::move(instance_buffer));
+  instance_buffer =
+      dev.create_buffer(instance_capacity * sizeof(ObjectData),
+                        irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
+                        usage_uav, memory_category::uniform_buffer,
+                        "scene instances");
+  dev.set_uav_buffer_view(*instance_descriptor_set, 0, 0, *instance_buffer, 0,
+                          instance_capacity * sizeof(ObjectData));
+  std::fill(instance_slot_by_transform.begin(),
+            instance_slot_by_transform.end(), invalid_instance_slot);
+}
+
+void Scene::fill_occlusion_culling_command(command_list_t &cmd_list,
+                                           uint32_t frame) {
+  if (!culling_enabled)
+    throw "Scene: set_view_frustum must be called before GPU culling";
+  occlusion_pyramid->fill_command_list(cmd_list);
+  if (meshlet_culler != nullptr) {
+    meshlet_culler->mark_pyramid_built(cmd_list);
+    return;
+  }
+  gpu_culler->fill_occlusion_culling_command(
+      cmd_list, view_frustum, view_projection, culling_phase::late, frame);
+}
+
+aabb Scene::get_world_bounds(const IMeshSceneNode &node) const {
+  return node.getBoundingBox().transform(node.getAbsoluteTransformation());
+}
+
+void Scene::rebuild_bvh() {
+  // Items of removed nodes are dropped, the others are renumbered.
+  bvh_nodes.erase(std::remove(bvh_nodes.begin(), bvh_nodes.end(), nullptr),
+                  bvh_nodes.end());
+  free_bvh_items.clear();
+  std::vector<aabb> boxes;
+  boxes.reserve(bvh_nodes.size());
+  for (uint32_t item = 0; item < bvh_nodes.size(); item++) {
+    boxes.push_back(get_world_bounds(*bvh_nodes[item]));
+    bvh_item_by_transform[bvh_nodes[item]->getTransformId()] = item;
+  }
+  node_bvh.build(boxes);
+}
+
+void Scene::get_nodes_in_frustum(const glm::mat4 &view_projection,
+                                 std::vector<IMeshSceneNode *> &nodes) const {
+  std::vector<uint32_t> items;
+  node_bvh.query_frustum(frustum::from_view_projection(view_projection),
+                         items);
+  for (const auto &item : items)
+    if (bvh_nodes[item] != nullptr)
+      nodes.push_back(bvh_nodes[item]);
+}
+
+void Scene::get_nodes_in_frustums(
+    gsl::span<const glm::mat4> view_projections,
+    gsl::span<std::vector<IMeshSceneNode *>> nodes) const {
+  std::vector<frustum> views;
+  for (const auto &view_projection : view_projections)
+    views.push_back(frustum::from_view_projection(view_projection));
+  std::vector<std::vector<uint32_t>> items(views.size());
+  node_bvh.query_frustums(views, items);
+  for (size_t view = 0; view < views.size(); view++) {
+    for (const auto &item : items[view])
+      if (bvh_nodes[item] != nullptr)
+        nodes[view].push_back(bvh_nodes[item]);
+  }
+}
+
+void Scene::get_nodes_in_box(const aabb &box,
+                             std::vector<IMeshSceneNode *> &nodes) const {
+  std::vector<uint32_t> items;
+  node_bvh.query_aabb(box, items);
+  for (const auto &item : items)
+    if (bvh_nodes[item] != nullptr)
+      nodes.push_back(bvh_nodes[item]);
+}
+
+IMeshSceneNode *Scene::pick(const glm::vec3 &origin,
+                            const glm::vec3 &direction,
+                            float &distance) const {
+  const auto item = node_bvh.query_ray(
+      origin, direction, distance,
+      [this](uint32_t item, float &) { return bvh_nodes[item] != nullptr; });
+  return item != bvh::invalid_item ? bvh_nodes[item] : nullptr;
+}
+
+void Scene::set_view_frustum(const glm::mat4 &matrix) {
+  view_projection = matrix;
+  view_frustum = frustum::from_view_projection(matrix);
+  culling_enabled = true;
+}
+
+uint16_t Scene::get_state_id(state_id_table &table, const void *object) {
+  if (object == nullptr)
+    return 0;
+  const auto &It = table.ids.find(object);
+  if (It != table.ids.end())
+    return It->second;
+  // Sharing an id only costs sort quality, binds are still compared by object.
+  const auto id = static_cast<uint16_t>(
+      std::min<size_t>(table.ids.size() + 1, table.max_id));
+  table.ids.emplace(object, id);
+  return id;
 }
 
 void irr::scene::Scene::fill_gbuffer_filling_command(
-    command_list_t &cmd_list, pipeline_layout_t &object_sig) {
-  std::for_each(
-      Nodes.begin(), Nodes.end(),
-      [&cmd_list, &object_sig](std::unique_ptr<IMeshSceneNode> &node) {
-        node->fill_draw_command(cmd_list, object_sig);
-      });
-}
-
-irr::scene::IMeshSceneNode *
-Scene::addMeshSceneNode(std::unique_ptr<irr::scene::IMeshSceneNode> &&mesh,
-                        irr::scene::ISceneNode *parent,
-                        const glm::vec3 &position, const glm::vec3 &rotation,
-                        const glm::vec3 &scale) {
-  Nodes.push_back(std::move(mesh));
-  return Nodes.back().get();
+    command_list_t &cmd_list, pipeline_layout_t &object_sig,
+    const glm::vec3 &camera_position) {
+  const auto start = std::chrono::high_resolution_clock::now();
+  const auto &&elapsed_ms = [&start]() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::high_resolution_clock::now() - start)
+        .count();
+  };
+  draw_statistics = command_stream_statistics{};
+  culling_stats = culling_statistics{};
+  if (meshlet_culler != nullptr) {
+    meshlet_culler->bind_index_buffer(cmd_list);
+    for (auto &node : Nodes)
+      node.fill_meshlet_draw_command(cmd_list, object_sig, *meshlet_culler);
+    gbuffer_recording_ms = elapsed_ms();
+    return;
+  }
+  if (gpu_culler != nullptr) {
+    for (auto &node : Nodes)
+      node.fill_indirect_draw_command(cmd_list, object_sig, *gpu_culler);
+    gbuffer_recording_ms = elapsed_ms();
+    return;
+  }
+  if (!sort_draws) {
+    std::for_each(Nodes.begin(), Nodes.end(),
+                  [&cmd_list, &object_sig](IMeshSceneNode &node) {
+                    node.fill_draw_command(cmd_list, object_sig);
+                  });
+    gbuffer_recording_ms = elapsed_ms();
+    return;
+  }
+
+  float max_distance = 0.f;
+  for (const auto &node : Nodes)
+    max_distance =
+        std::max(max_distance,
+                 glm::length(node.getAbsolutePosition() - camera_position));
+
+  if (culling_enabled) {
+    // Submeshes are only tested for the nodes the hierarchy finds visible.
+    std::fill(submesh_visibility.begin(), submesh_visibility.end(), 0);
+    visible_items.clear();
+    node_bvh.query_frustum(view_frustum, visible_items);
+    for (const auto &item : visible_items) {
+      const auto &node = bvh_nodes[item];
+      if (node == nullptr)
+        continue;
+      const auto &stats = cull_boxes(
+          view_frustum, world_bounds,
+          first_bound_by_transform[node->getTransformId()],
+          node->getSubmeshCount(), submesh_visibility);
+      culling_stats.visible += stats.visible;
+    }
+    culling_stats.tested = static_cast<uint32_t>(world_bounds.size() -
+                                                 bound_ranges.get_free_size());
+    culling_stats.culled = culling_stats.tested - culling_stats.visible;
+  }
+
+  draw_stream.clear();
+  pipeline_ids.ids.clear();
+  material_ids.ids.clear();
+  geometry_ids.ids.clear();
+  if (instance_descriptor_set != nullptr)
+    fill_instanced_draw_items(object_sig, camera_position, max_distance);
+  else
+    for (auto &node : Nodes) {
+      const auto pipeline_id = get_state_id(pipeline_ids, node.getPipeline());
+      const auto geometry_id = get_state_id(geometry_ids, node.getGeometry());
+      const auto depth = sort_key::make_depth_key(
+          max_distance > 0.f
+              ? glm::length(node.getAbsolutePosition() - camera_position) /
+                    max_distance
+              : 0.f);
+      node.fill_draw_items(
+          draw_stream, object_sig,
+          [&](const allocated_descriptor_set &material) {
+            return sort_key::make(0, pipeline_id,
+                                  get_state_id(material_ids, &material),
+                                  geometry_id, depth);
+          },
+          culling_enabled
+              ? submesh_visibility.data() +
+                    first_bound_by_transform[node.getTransformId()]
+              : nullptr);
+    }
+  const command_stream *streams[] = {&draw_stream};
+  draw_translator.sort(streams);
+  draw_statistics = draw_translator.translate(cmd_list);
+  gbuffer_recording_ms = elapsed_ms();
+}
+
+void Scene::fill_instanced_draw_items(pipeline_layout_t &object_sig,
+                                      const glm::vec3 &camera_position,
+                                      float max_distance) {
+  const auto &&get_visibility = [&](const IMeshSceneNode &node) {
+    return culling_enabled
+               ? submesh_visibility.data() +
+                     first_bound_by_transform[node.getTransformId()]
+               : nullptr;
+  };
+  for (auto &group : instance_groups)
+    group.second.clear();
+  for (auto &node : Nodes) {
+    const auto visibility = get_visibility(node);
+    if (visibility != nullptr &&
+        std::none_of(visibility, visibility + node.getSubmeshCount(),
+                     [](uint8_t visible) { return visible != 0; }))
+      continue;
+    instance_groups[std::make_tuple(node.getMeshAsset().get(), node.getLod(),
+                                    node.getPipeline())]
+        .push_back(&node);
+  }
+
+  instance_slot_by_transform.assign(transforms.size(), invalid_instance_slot);
+  auto *instances = static_cast<ObjectData *>(instance_buffer->map_buffer());
+  uint32_t slot = 0;
+  for (const auto &group : instance_groups) {
+    const auto &nodes = group.second;
+    if (nodes.empty())
+      continue;
+    if (slot + nodes.size() > instance_capacity) {
+      instance_buffer->unmap_buffer();
+      throw "Scene: update must be called after adding nodes";
+    }
+    const auto first_instance = slot;
+    float distance = std::numeric_limits<float>::max();
+    for (const auto &node : nodes) {
+      instances[slot] = node->getObjectData();
+      instance_slot_by_transform[node->getTransformId()] = slot++;
+      distance = std::min(
+          distance, glm::length(node->getAbsolutePosition() - camera_position));
+    }
+
+    const auto &asset = *std::get<0>(group.first);
+    const auto pipeline = std::get<2>(group.first);
+    const auto pipeline_id = get_state_id(pipeline_ids, pipeline);
+    const auto geometry_id =
+        get_state_id(geometry_ids, &asset.get_index_buffer());
+    const auto depth = sort_key::make_depth_key(
+        max_distance > 0.f ? distance / max_distance : 0.f);
+    for (size_t i = 0; i < asset.get_submesh_count(); i++) {
+      if (culling_enabled &&
+          std::none_of(nodes.begin(), nodes.end(), [&](const auto &node) {
+            return get_visibility(*node)[i] != 0;
+          }))
+        continue;
+      const auto &material = asset.get_material(asset.get_material_index(i));
+      draw_stream.begin_item(
+          sort_key::make(0, pipeline_id, get_state_id(material_ids, &material),
+                         geometry_id, depth));
+      if (pipeline != nullptr)
+        draw_stream.set_graphic_pipeline(*pipeline);
+      draw_stream.bind_graphic_descriptor(1, *instance_descriptor_set,
+                                          object_sig);
+      draw_stream.bind_index_buffer(asset.get_index_buffer(), 0,
+                                    asset.get_index_buffer_size(),
+                                    irr::video::E_INDEX_TYPE::EIT_16BIT);
+      draw_stream.bind_vertex_buffers(0, asset.get_vertex_buffers());
+      draw_stream.bind_graphic_descriptor(0, material, object_sig);
+      const auto &level = asset.get_lod(i, std::get<1>(group.first));
+      draw_stream.draw_indexed(level.index_count,
+                               static_cast<uint32_t>(nodes.size()),
+                               level.first_index, asset.get_vertex_offset(i),
+                               first_instance);
+    }
+  }
+  instance_buffer->unmap_buffer();
+}
+
+IMeshSceneNode &Scene::register_mesh_node(IMeshSceneNode &node) {
+  node.bindTransform(transforms);
+  mesh_nodes_by_transform.resize(transforms.size(), nullptr);
+  mesh_nodes_by_transform[node.getTransformId()] = &node;
+  // World bounds are filled by the next update(), the new transform is dirty.
+  const auto bound_count = static_cast<uint32_t>(node.getSubmeshCount());
+  auto first_bound = bound_ranges.allocate(bound_count);
+  if (first_bound == range_allocator::invalid_offset) {
+    bound_ranges.grow(bound_ranges.get_capacity() + bound_count);
+    first_bound = bound_ranges.allocate(bound_count);
+    world_bounds.resize(bound_ranges.get_capacity());
+    submesh_visibility.resize(bound_ranges.get_capacity());
+  }
+  std::fill_n(submesh_visibility.begin() + first_bound, bound_count, 1);
+  first_bound_by_transform.resize(transforms.size(), 0);
+  first_bound_by_transform[node.getTransformId()] = first_bound;
+  bvh_item_by_transform.resize(transforms.size(), bvh::invalid_item);
+  gpu_draws_dirty = true;
+  return node;
+}
+
+void Scene::remove_mesh_node(scene_node_handle handle) {
+  const auto node = Nodes.get(handle);
+  if (node == nullptr)
+    return;
+  const auto id = node->getTransformId();
+  mesh_nodes_by_transform[id] = nullptr;
+  auto &item = bvh_item_by_transform[id];
+  if (item != bvh::invalid_item) {
+    node_bvh.update(item, aabb{});
+    bvh_nodes[item] = nullptr;
+    free_bvh_items.push_back(item);
+    item = bvh::invalid_item;
+  }
+  const auto first_bound = first_bound_by_transform[id];
+  const auto bound_count = static_cast<uint32_t>(node->getSubmeshCount());
+  std::fill_n(submesh_visibility.begin() + first_bound, bound_count, 0);
+  bound_ranges.release(first_bound, bound_count);
+  if (id < instance_slot_by_transform.size())
+    instance_slot_by_transform[id] = invalid_instance_slot;
+  gpu_draws_dirty = true;
+  transforms.remove(id);
+  Nodes.remove(handle);
 }
@@ -0,0 +1,44 @@
+// Hi-Z test shared by the culling shaders, the including shader declares
+// view_projection, the pyramid texture and the nearest sampler.
+// A world space box is occluded if its closest depth is behind the farthest
+// depth of the pyramid texels it covers.
+
+bool is_occluded(vec3 center, vec3 extents)
+{
+  vec2 uv_min = vec2(1.);
+  vec2 uv_max = vec2(0.);
+  float depth = 1.;
+  for (int i = 0; i < 8; i++)
+  {
+    vec3 corner = center + extents * vec3(
+      (i & 1) != 0 ? 1. : -1.,
+      (i & 2) != 0 ? 1. : -1.,
+      (i & 4) != 0 ? 1. : -1.);
+    vec4 clip = view_projection * vec4(corner, 1.);
+    // Boxes crossing the near plane cover too much of the screen.
+    if (clip.w <= 0.)
+      return false;
+    vec3 ndc = clip.xyz / clip.w;
+    uv_min = min(uv_min, ndc.xy * .5 + .5);
+    uv_max = max(uv_max, ndc.xy * .5 + .5);
+    depth = min(depth, ndc.z);
+  }
+  uv_min = clamp(uv_min, 0., 1.);
+  uv_max = clamp(uv_max, 0., 1.);
+
+  // The level where the box spans at most 2x2 texels.
+  vec2 size = vec2(textureSize(sampler2D(pyramid, nearest), 0));
+  vec2 extent = (uv_max - uv_min) * size;
+  int level = int(ceil(log2(max(max(extent.x, extent.y), 1.))));
+  level = min(level, textureQueryLevels(sampler2D(pyramid, nearest)) - 1);
+  ivec2 level_size = textureSize(sampler2D(pyramid, nearest), level);
+  ivec2 first = min(ivec2(uv_min * vec2(level_size)), level_size - 1);
+  ivec2 last = min(ivec2(uv_max * vec2(level_size)), level_size - 1);
+
+  float occluder = max(
+    max(texelFetch(sampler2D(pyramid, nearest), first, level).x,
+      texelFetch(sampler2D(pyramid, nearest), ivec2(last.x, first.y), level).x),
+    max(texelFetch(sampler2D(pyramid, nearest), ivec2(first.x, last.y), level).x,
+      texelFetch(sampler2D(pyramid, nearest), last, level).x));
+  return depth > occluder;
+}
@@ -2,6 +2,12 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+// With compressed_vertices the streams are in vertex_format::compressed :
+// 16 bits unorm positions in the bounds of the mesh, octahedral snorm normals
+// and half float texture coordinates. Components missing from the full
+// format are filled by the vertex fetch.
+layout(constant_id = 0) const bool compressed_vertices = false;
+
 layout(set = 2, binding = 7, std140) uniform SceneData
 {
   mat4 ViewMatrix;
@@ -10,13 +16,22 @@ layout(set = 2, binding = 7, std140) uniform SceneData
   mat4 InverseProjectionMatrix;
 };
 
-layout(set = 1, binding = 0, std140) uniform ObjectData
+struct ObjectData
 {
   mat4 ModelMatrix;
   mat4 InverseModelMatrix;
+  vec4 PositionScale;
+  vec4 PositionOffset;
+};
+
+// A single instance for scene nodes, the instances of a mesh asset for
+// instanced draws whose base instance selects their range.
+layout(set = 1, binding = 0, std430) readonly buffer Instances
+{
+  ObjectData instances[];
 };
 
-layout(location = 0) in vec3 Position;
+layout(location = 0) in vec4 Position;
 layout(location = 1) in vec3 Normal;
 layout(location = 2) in vec2 Texcoord;
 //layout(location = 3) in vec4 Color;
@@ -44,13 +59,31 @@ out gl_PerVertex {
   vec4 gl_Position;
 };
 
+vec3 decode_octahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1. - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.);
+  n.xy += vec2(n.x >= 0. ? -t : t, n.y >= 0. ? -t : t);
+  return normalize(n);
+}
+
 void main()
 {
 //  color = Color.zyxw;
+  mat4 ModelMatrix = instances[gl_InstanceIndex].ModelMatrix;
+  mat4 InverseModelMatrix = instances[gl_InstanceIndex].InverseModelMatrix;
   mat4 ModelViewProjectionMatrix = ProjectionMatrix * ViewMatrix * ModelMatrix;
   mat4 TransposeInverseModelView = transpose(InverseModelMatrix * InverseViewMatrix);
-  gl_Position = ModelViewProjectionMatrix * vec4(Position.xyz, 1.);
-  nor = (TransposeInverseModelView * vec4(Normal, 0.)).xyz;
+  vec3 position = Position.xyz;
+  vec3 normal = Normal;
+  if (compressed_vertices)
+  {
+    position = instances[gl_InstanceIndex].PositionOffset.xyz +
+      Position.xyz * instances[gl_InstanceIndex].PositionScale.xyz;
+    normal = decode_octahedral(Normal.xy);
+  }
+  gl_Position = ModelViewProjectionMatrix * vec4(position, 1.);
+  nor = (TransposeInverseModelView * vec4(normal, 0.)).xyz;
   //  tangent = (TransposeInverseModelView * vec4(Tangent, 0.)).xyz;
   //  bitangent = (TransposeInverseModelView * vec4(Bitangent, 0.)).xyz;
   uv = Texcoord;
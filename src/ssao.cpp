@@ -248,19 +248,21 @@ ssao_utility::ssao_utility(device_t &dev, image_t *_depth_input, uint32_t w,
       irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE, usage_uniform);
   clear_value_t clear_value =
       get_clear_value(irr::video::ECF_R32F, {0., 0., 0., 0.});
-  linear_depth_buffer =
-      dev.create_image(irr::video::ECF_R32F, width, height, 1, 1,
-                       usage_render_target | usage_sampled, &clear_value);
+  linear_depth_buffer = dev.create_image(
+      irr::video::ECF_R32F, width, height, 1, 1,
+      usage_render_target | usage_sampled, &clear_value,
+      memory_category::render_target, "ssao linear depth");
   clear_value = get_clear_value(irr::video::ECF_R16F, {0., 0., 0., 0.});
-  ssao_result =
-      dev.create_image(irr::video::ECF_R16F, width, height, 1, 1,
-                       usage_render_target | usage_sampled, &clear_value);
-  gaussian_blurring_buffer =
-      dev.create_image(irr::video::ECF_R16F, width, height, 1, 1,
-                       usage_uav | usage_sampled, nullptr);
-  ssao_bilinear_result =
-      dev.create_image(irr::video::ECF_R16F, width, height, 1, 1,
-                       usage_uav | usage_sampled, nullptr);
+  ssao_result = dev.create_image(
+      irr::video::ECF_R16F, width, height, 1, 1,
+      usage_render_target | usage_sampled, &clear_value,
+      memory_category::render_target, "ssao result");
+  gaussian_blurring_buffer = dev.create_image(
+      irr::video::ECF_R16F, width, height, 1, 1, usage_uav | usage_sampled,
+      nullptr, memory_category::render_target, "ssao gaussian blur");
+  ssao_bilinear_result = dev.create_image(
+      irr::video::ECF_R16F, width, height, 1, 1, usage_uav | usage_sampled,
+      nullptr, memory_category::render_target, "ssao bilinear result");
 
   dev.set_constant_buffer_view(*linearize_input, 0, 0, *linearize_constant_data,
                                sizeof(linearize_input_constant_data));
@@ -0,0 +1,360 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/TextureCache.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+namespace irr {
+namespace scene {
+namespace {
+std::string canonical_path(const std::string &path) {
+  std::error_code error;
+  const auto &canonical = std::filesystem::weakly_canonical(path, error);
+  if (error)
+    return std::filesystem::path(path).lexically_normal().string();
+  return canonical.string();
+}
+
+// Offset in the texels of a single layer texture of the first byte of level.
+uint64_t get_level_offset(const decoded_texture &texture, uint16_t level) {
+  uint64_t result = 0;
+  for (uint16_t i = 0; i < level; i++)
+    result += get_level_size(texture.format, std::max(texture.width >> i, 1u),
+                             std::max(texture.height >> i, 1u));
+  return result;
+}
+
+// 64 bits FNV-1a of every level of texture, 8 bytes at a time.
+uint64_t hash_content(const decoded_texture &texture) {
+  uint64_t hash = 14695981039346656037ull;
+  const auto word_count = texture.size / sizeof(uint64_t);
+  for (uint64_t i = 0; i < word_count; i++) {
+    uint64_t word;
+    memcpy(&word, texture.texels + i * sizeof(uint64_t), sizeof(uint64_t));
+    hash = (hash ^ word) * 1099511628211ull;
+  }
+  for (auto i = word_count * sizeof(uint64_t); i < texture.size; i++)
+    hash = (hash ^ static_cast<unsigned char>(texture.texels[i])) *
+           1099511628211ull;
+  return hash;
+}
+}
+
+texture_cache::texture_cache(device_t &_dev, uint64_t _budget,
+                             bool _dedup_content, file_access _access)
+    : dev(_dev), budget(_budget), dedup_content(_dedup_content),
+      access(_access) {}
+
+std::shared_future<read_texture>
+texture_cache::read(const std::string &path) {
+  const auto &key = canonical_path(path);
+  std::promise<read_texture> promise;
+  std::shared_future<read_texture> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (by_path.count(key) != 0)
+      return result;
+    const auto &reading = in_flight.find(key);
+    if (reading != in_flight.end())
+      return reading->second;
+    result = promise.get_future().share();
+    in_flight.emplace(key, result);
+  }
+  const auto start = std::chrono::high_resolution_clock::now();
+  try {
+    auto &&texture = decode_texture(path, true, access);
+    const auto decoded = std::chrono::high_resolution_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(statistics_mutex);
+      statistics.read_bytes += texture.size;
+      statistics.read_ms +=
+          std::chrono::duration<double, std::milli>(decoded - start).count();
+    }
+    const auto block_format =
+        compresses ? choose_block_format(texture) : irr::video::ECF_UNKNOWN;
+    if (block_format != irr::video::ECF_UNKNOWN) {
+      texture = compress_texture(texture, block_format, compression_workers);
+      std::lock_guard<std::mutex> lock(statistics_mutex);
+      statistics.compressed++;
+      statistics.compression_ms +=
+          std::chrono::duration<double, std::milli>(
+              std::chrono::high_resolution_clock::now() - decoded)
+              .count();
+    }
+    // Hashed after compression, like the texels get uploads.
+    const auto content_hash = dedup_content ? hash_content(texture) : 0;
+    promise.set_value(read_texture{std::move(texture), content_hash});
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+  return result;
+}
+
+std::shared_ptr<const cached_texture>
+texture_cache::get(const std::string &path, command_list_t &upload_cmd_list) {
+  const auto &key = canonical_path(path);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto &found = by_path.find(key);
+    if (found != by_path.end()) {
+      statistics.hits++;
+      touch(*found->second);
+      return found->second->texture;
+    }
+  }
+  // Uploads are only done here, the texture can't become resident meanwhile.
+  const auto &decoded = read(path);
+  // Waits without the lock, the thread reading path may still need it.
+  decoded.wait();
+  std::lock_guard<std::mutex> lock(mutex);
+  in_flight.erase(key);
+  const auto &data = decoded.get().texture;
+  const auto content_hash = decoded.get().content_hash;
+
+  if (dedup_content) {
+    const auto &same_content = by_content.find(content_hash);
+    if (same_content != by_content.end()) {
+      auto &e = *same_content->second;
+      statistics.content_hits++;
+      e.paths.push_back(key);
+      by_path.emplace(key, &e);
+      touch(e);
+      return e.texture;
+    }
+  }
+
+  statistics.misses++;
+  const auto generates_mipmaps =
+      mipmaps != nullptr && data.mipmap_count == 1 &&
+      mipmaps->supports_format(data.format);
+  const auto mipmap_count =
+      generates_mipmaps ? get_full_mipmap_count(data.width, data.height)
+                        : data.mipmap_count;
+  const auto streamed =
+      streams && data.layer_count == 1 && data.mipmap_count > 1;
+  auto e = std::make_unique<entry>();
+  e->texture = std::make_shared<cached_texture>();
+  e->texture->width = data.width;
+  e->texture->height = data.height;
+  e->texture->mipmap_count = mipmap_count;
+  e->texture->size = 0;
+  if (streamed) {
+    while (e->tail_level + 1 < data.mipmap_count &&
+           std::max(data.width, data.height) >> e->tail_level >
+               streaming_extent)
+      e->tail_level++;
+    e->wanted_level = e->tail_level;
+    evict(data.size - get_level_offset(data, e->tail_level));
+    e->streamed = true;
+    e->source = data;
+    set_resident_level(*e, e->tail_level, upload_cmd_list);
+  } else {
+    uint64_t size = data.size;
+    for (uint16_t level = 1; level < mipmap_count; level++)
+      size += data.size / (uint64_t{1} << (2 * level));
+    evict(size);
+    std::tie(e->texture->image, e->upload_buffer) =
+        upload_texture(dev, data, upload_cmd_list, mipmap_count);
+    e->texture->view =
+        create_texture_view(dev, *e->texture->image, data, mipmap_count);
+    if (generates_mipmaps) {
+      mipmaps->add_image(*e->texture->image, data.format, data.width,
+                         data.height, mipmap_count, data.layer_count);
+      mipmaps->generate_mips(upload_cmd_list, *e->texture->image);
+      e->generating_mipmaps = true;
+      statistics.mipmapped++;
+    }
+    e->texture->size = size;
+    resident_size += size;
+  }
+  e->content_hash = content_hash;
+  e->paths.push_back(key);
+  e->use = lru.insert(lru.begin(), e.get());
+  by_path.emplace(key, e.get());
+  if (dedup_content)
+    by_content.emplace(content_hash, e.get());
+  entries.push_back(std::move(e));
+  return entries.back()->texture;
+}
+
+void texture_cache::enable_compression(worker_pool *workers) {
+  compresses = true;
+  compression_workers = workers;
+}
+
+void texture_cache::enable_mipmap_generation(mipmap_generator &generator) {
+  mipmaps = &generator;
+}
+
+void texture_cache::enable_streaming(uint32_t initial_extent) {
+  streams = true;
+  streaming_extent = initial_extent;
+}
+
+void texture_cache::request_density(const cached_texture &texture,
+                                    float uv_per_pixel) {
+  if (!(uv_per_pixel > 0.f))
+    return;
+  // A level is needed until its texels get smaller than a pixel.
+  const auto texels_per_pixel =
+      std::max(texture.width, texture.height) * uv_per_pixel;
+  const auto level = static_cast<uint16_t>(std::min<float>(
+      std::max(std::floor(std::log2(texels_per_pixel)), 0.f),
+      texture.mipmap_count - 1.f));
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto &inserted = requested_levels.emplace(&texture, level);
+  if (!inserted.second)
+    inserted.first->second = std::min(inserted.first->second, level);
+}
+
+void texture_cache::set_resident_level(entry &e, uint16_t level,
+                                       command_list_t &upload_cmd_list) {
+  auto &texture = *e.texture;
+  decoded_texture levels = e.source;
+  const auto offset = get_level_offset(e.source, level);
+  levels.width = std::max(e.source.width >> level, 1u);
+  levels.height = std::max(e.source.height >> level, 1u);
+  levels.mipmap_count = static_cast<uint16_t>(e.source.mipmap_count - level);
+  levels.texels = e.source.texels + offset;
+  levels.size = e.source.size - offset;
+
+  if (texture.image != nullptr) {
+    retired_images.push_back(std::move(texture.image));
+    retired_views.push_back(std::move(texture.view));
+  }
+  std::unique_ptr<buffer_t> upload_buffer;
+  std::tie(texture.image, upload_buffer) =
+      upload_texture(dev, levels, upload_cmd_list);
+  streaming_buffers.push_back(std::move(upload_buffer));
+  texture.view = create_texture_view(dev, *texture.image, levels);
+  resident_size = resident_size - texture.size + levels.size;
+  texture.size = levels.size;
+  texture.resident_level = level;
+  texture.generation++;
+}
+
+std::vector<const cached_texture *>
+texture_cache::stream(command_list_t &upload_cmd_list,
+                      uint64_t max_upload_bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<entry *> upgrades;
+  for (auto &e : entries) {
+    if (!e->streamed)
+      continue;
+    const auto &requested = requested_levels.find(e->texture.get());
+    e->wanted_level = requested != requested_levels.end()
+                          ? std::min(requested->second, e->tail_level)
+                          : e->tail_level;
+    // Released textures aren't worth uploading, evict may remove them.
+    if (e->wanted_level < e->texture->resident_level &&
+        e->texture.use_count() > 1)
+      upgrades.push_back(e.get());
+  }
+  requested_levels.clear();
+  // The blurriest textures first.
+  std::sort(upgrades.begin(), upgrades.end(), [](entry *a, entry *b) {
+    return a->texture->resident_level - a->wanted_level >
+           b->texture->resident_level - b->wanted_level;
+  });
+
+  std::vector<const cached_texture *> result;
+  const auto &&drop_unneeded_levels = [&](uint64_t incoming_size) {
+    // Least recently used first, like evict.
+    for (auto it = lru.rbegin(); it != lru.rend(); ++it) {
+      if (!is_over_budget(incoming_size))
+        return;
+      auto &e = **it;
+      if (!e.streamed || e.wanted_level <= e.texture->resident_level)
+        continue;
+      const auto previous_size = e.texture->size;
+      set_resident_level(e, e.wanted_level, upload_cmd_list);
+      statistics.dropped_bytes += previous_size - e.texture->size;
+      result.push_back(e.texture.get());
+    }
+  };
+
+  uint64_t uploaded = 0;
+  for (auto *e : upgrades) {
+    const auto size =
+        e->source.size - get_level_offset(e->source, e->wanted_level);
+    if (max_upload_bytes != 0 && uploaded + size > max_upload_bytes)
+      continue;
+    const auto incoming_size = size - e->texture->size;
+    evict(incoming_size);
+    drop_unneeded_levels(incoming_size);
+    if (is_over_budget(incoming_size))
+      continue;
+    set_resident_level(*e, e->wanted_level, upload_cmd_list);
+    uploaded += size;
+    statistics.streamed_bytes += size;
+    result.push_back(e->texture.get());
+  }
+  return result;
+}
+
+void texture_cache::touch(entry &e) { lru.splice(lru.begin(), lru, e.use); }
+
+std::list<texture_cache::entry *>::iterator
+texture_cache::remove(std::list<entry *>::iterator use) {
+  entry *e = *use;
+  for (const auto &key : e->paths)
+    by_path.erase(key);
+  const auto &same_content = by_content.find(e->content_hash);
+  if (same_content != by_content.end() && same_content->second == e)
+    by_content.erase(same_content);
+  resident_size -= e->texture->size;
+  statistics.evictions++;
+  if (e->generating_mipmaps)
+    mipmaps->remove_image(*e->texture->image);
+  entries.erase(std::find_if(
+      entries.begin(), entries.end(),
+      [e](const std::unique_ptr<entry> &other) { return other.get() == e; }));
+  return lru.erase(use);
+}
+
+bool texture_cache::is_over_budget(uint64_t incoming_size) {
+  return (budget != 0 && resident_size + incoming_size > budget) ||
+         dev.get_remaining_memory_budget(
+             irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL) < incoming_size;
+}
+
+void texture_cache::evict(uint64_t incoming_size) {
+  auto it = lru.end();
+  while (it != lru.begin() && is_over_budget(incoming_size)) {
+    --it;
+    // Textures with handles stay resident even over budget.
+    if ((*it)->texture.use_count() == 1)
+      it = remove(it);
+  }
+}
+
+void texture_cache::release_staging_buffers() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &e : entries) {
+    e->upload_buffer.reset();
+    if (e->generating_mipmaps)
+      mipmaps->remove_image(*e->texture->image);
+    e->generating_mipmaps = false;
+  }
+  retired_views.clear();
+  retired_images.clear();
+  streaming_buffers.clear();
+}
+
+texture_cache_statistics texture_cache::get_statistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::lock_guard<std::mutex> statistics_lock(statistics_mutex);
+  return statistics;
+}
+
+void texture_cache::trim() {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = lru.begin();
+  while (it != lru.end())
+    it = (*it)->texture.use_count() == 1 ? remove(it) : std::next(it);
+}
+}
+}
@@ -1,78 +1,625 @@
 // Copyright (C) 2015 Vincent Lejeune
 // For conditions of distribution and use, see copyright notice in License.txt
 #include <Scene/textures.h>
+#include <Util/BlockCompression.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
 #include <gli/gli.hpp>
 
-std::tuple<std::unique_ptr<image_t>, std::unique_ptr<buffer_t>>
-load_texture(device_t &dev, std::string &&texture_name,
-             command_list_t &upload_command_list) {
-  const auto &DDSPic = gli::load(texture_name);
+namespace {
+irr::video::ECOLOR_FORMAT get_color_format(gli::format format) {
+  switch (format) {
+  case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:
+  case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+    return irr::video::ECF_BC1_UNORM;
+  case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8:
+  case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+    return irr::video::ECF_BC1_UNORM_SRGB;
+  case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+    return irr::video::ECF_BC2_UNORM;
+  case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+    return irr::video::ECF_BC2_UNORM_SRGB;
+  case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+    return irr::video::ECF_BC3_UNORM;
+  case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+    return irr::video::ECF_BC3_UNORM_SRGB;
+  case gli::FORMAT_R_ATI1N_UNORM_BLOCK8:
+    return irr::video::ECF_BC4_UNORM;
+  case gli::FORMAT_R_ATI1N_SNORM_BLOCK8:
+    return irr::video::ECF_BC4_SNORM;
+  case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+    return irr::video::ECF_BC5_UNORM;
+  case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+    return irr::video::ECF_BC5_SNORM;
+  case gli::FORMAT_RGB_BP_UFLOAT_BLOCK16:
+    return irr::video::ECF_BC6H_UF16;
+  case gli::FORMAT_RGB_BP_SFLOAT_BLOCK16:
+    return irr::video::ECF_BC6H_SF16;
+  case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+    return irr::video::ECF_BC7_UNORM;
+  case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+    return irr::video::ECF_BC7_UNORM_SRGB;
+  case gli::FORMAT_RGBA8_UNORM_PACK8:
+    return irr::video::ECF_R8G8B8A8_UNORM;
+  case gli::FORMAT_RGBA8_SRGB_PACK8:
+    return irr::video::ECF_R8G8B8A8_UNORM_SRGB;
+  case gli::FORMAT_BGRA8_UNORM_PACK8:
+    return irr::video::ECF_B8G8R8A8_UNORM;
+  case gli::FORMAT_BGRA8_SRGB_PACK8:
+    return irr::video::ECF_B8G8R8A8_UNORM_SRGB;
+  case gli::FORMAT_R8_UNORM_PACK8:
+    return irr::video::ECF_R8;
+  case gli::FORMAT_RG8_UNORM_PACK8:
+    return irr::video::ECF_R8G8;
+  case gli::FORMAT_R16_SFLOAT_PACK16:
+    return irr::video::ECF_R16F;
+  case gli::FORMAT_RG16_SFLOAT_PACK16:
+    return irr::video::ECF_R16G16F;
+  case gli::FORMAT_RGBA16_UNORM_PACK16:
+    return irr::video::ECF_R16G16B16A16_UNORM;
+  case gli::FORMAT_RGBA16_SFLOAT_PACK16:
+    return irr::video::ECF_R16G16B16A16F;
+  case gli::FORMAT_R32_SFLOAT_PACK32:
+    return irr::video::ECF_R32F;
+  case gli::FORMAT_RG32_SFLOAT_PACK32:
+    return irr::video::ECF_R32G32F;
+  case gli::FORMAT_RGBA32_SFLOAT_PACK32:
+    return irr::video::ECF_R32G32B32A32F;
+  default:
+    throw "decode_texture: unsupported format";
+  }
+}
 
-  const auto &width = static_cast<uint32_t>(DDSPic.extent().x);
-  const auto &height = static_cast<uint32_t>(DDSPic.extent().y);
-  const auto &mipmap_count = static_cast<uint16_t>(DDSPic.levels());
+constexpr uint32_t four_cc(char a, char b, char c, char d) {
+  return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 |
+         uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
 
-  const auto &is_cubemap = gli::is_target_cube(DDSPic.target());
-  uint16_t layer_count = is_cubemap ? 6 : 1;
+// Layout of the file, see DDS_HEADER, DDS_PIXELFORMAT and DDS_HEADER_DXT10 of
+// the DirectX documentation.
+struct dds_pixel_format {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t bit_count;
+  uint32_t r_mask;
+  uint32_t g_mask;
+  uint32_t b_mask;
+  uint32_t a_mask;
+};
 
-  auto &&upload_buffer = dev.create_buffer(
-      width * height * 3 * 6, irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
-      usage_buffer_transfer_src);
+struct dds_header {
+  uint32_t magic;
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitch_or_linear_size;
+  uint32_t depth;
+  uint32_t mipmap_count;
+  uint32_t reserved[11];
+  dds_pixel_format pixel_format;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};
 
-  void *pointer = upload_buffer->map_buffer();
+struct dds_header_dx10 {
+  uint32_t dxgi_format;
+  uint32_t resource_dimension;
+  uint32_t misc_flag;
+  uint32_t array_size;
+  uint32_t misc_flags2;
+};
 
-  size_t offset_in_texram = 0;
+static_assert(sizeof(dds_header) == 128, "DDS header is 128 bytes");
+static_assert(sizeof(dds_header_dx10) == 20, "DX10 header is 20 bytes");
 
-  uint32_t block_height = 4;
-  uint32_t block_width = 4;
-  uint32_t block_size = 8;
-  std::vector<MipLevelData> Mips;
-  for (unsigned face = 0; face < layer_count; face++) {
+constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDPF_RGB = 0x40;
+constexpr uint32_t DDPF_LUMINANCE = 0x20000;
+constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+constexpr uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+constexpr uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+constexpr uint32_t D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+irr::video::ECOLOR_FORMAT get_color_format_from_dxgi(uint32_t dxgi_format) {
+  switch (dxgi_format) {
+  case 2:
+    return irr::video::ECF_R32G32B32A32F;
+  case 10:
+    return irr::video::ECF_R16G16B16A16F;
+  case 11:
+    return irr::video::ECF_R16G16B16A16_UNORM;
+  case 16:
+    return irr::video::ECF_R32G32F;
+  case 28:
+    return irr::video::ECF_R8G8B8A8_UNORM;
+  case 29:
+    return irr::video::ECF_R8G8B8A8_UNORM_SRGB;
+  case 34:
+    return irr::video::ECF_R16G16F;
+  case 41:
+    return irr::video::ECF_R32F;
+  case 49:
+    return irr::video::ECF_R8G8;
+  case 54:
+    return irr::video::ECF_R16F;
+  case 61:
+    return irr::video::ECF_R8;
+  case 71:
+    return irr::video::ECF_BC1_UNORM;
+  case 72:
+    return irr::video::ECF_BC1_UNORM_SRGB;
+  case 74:
+    return irr::video::ECF_BC2_UNORM;
+  case 75:
+    return irr::video::ECF_BC2_UNORM_SRGB;
+  case 77:
+    return irr::video::ECF_BC3_UNORM;
+  case 78:
+    return irr::video::ECF_BC3_UNORM_SRGB;
+  case 80:
+    return irr::video::ECF_BC4_UNORM;
+  case 81:
+    return irr::video::ECF_BC4_SNORM;
+  case 83:
+    return irr::video::ECF_BC5_UNORM;
+  case 84:
+    return irr::video::ECF_BC5_SNORM;
+  case 87:
+    return irr::video::ECF_B8G8R8A8_UNORM;
+  case 91:
+    return irr::video::ECF_B8G8R8A8_UNORM_SRGB;
+  case 95:
+    return irr::video::ECF_BC6H_UF16;
+  case 96:
+    return irr::video::ECF_BC6H_SF16;
+  case 98:
+    return irr::video::ECF_BC7_UNORM;
+  case 99:
+    return irr::video::ECF_BC7_UNORM_SRGB;
+  default:
+    throw "decode_texture: unsupported DDS format";
+  }
+}
+
+irr::video::ECOLOR_FORMAT
+get_color_format_from_legacy(const dds_pixel_format &pixel_format,
+                             bool is_color) {
+  if (pixel_format.flags & DDPF_FOURCC) {
+    switch (pixel_format.four_cc) {
+    case four_cc('D', 'X', 'T', '1'):
+      return is_color ? irr::video::ECF_BC1_UNORM_SRGB
+                      : irr::video::ECF_BC1_UNORM;
+    case four_cc('D', 'X', 'T', '2'):
+    case four_cc('D', 'X', 'T', '3'):
+      return is_color ? irr::video::ECF_BC2_UNORM_SRGB
+                      : irr::video::ECF_BC2_UNORM;
+    case four_cc('D', 'X', 'T', '4'):
+    case four_cc('D', 'X', 'T', '5'):
+      return is_color ? irr::video::ECF_BC3_UNORM_SRGB
+                      : irr::video::ECF_BC3_UNORM;
+    case four_cc('A', 'T', 'I', '1'):
+    case four_cc('B', 'C', '4', 'U'):
+      return irr::video::ECF_BC4_UNORM;
+    case four_cc('B', 'C', '4', 'S'):
+      return irr::video::ECF_BC4_SNORM;
+    case four_cc('A', 'T', 'I', '2'):
+    case four_cc('B', 'C', '5', 'U'):
+      return irr::video::ECF_BC5_UNORM;
+    case four_cc('B', 'C', '5', 'S'):
+      return irr::video::ECF_BC5_SNORM;
+    // D3DFORMAT values stored as four_cc.
+    case 36:
+      return irr::video::ECF_R16G16B16A16_UNORM;
+    case 111:
+      return irr::video::ECF_R16F;
+    case 112:
+      return irr::video::ECF_R16G16F;
+    case 113:
+      return irr::video::ECF_R16G16B16A16F;
+    case 114:
+      return irr::video::ECF_R32F;
+    case 115:
+      return irr::video::ECF_R32G32F;
+    case 116:
+      return irr::video::ECF_R32G32B32A32F;
+    default:
+      throw "decode_texture: unsupported DDS format";
+    }
+  }
+  if (pixel_format.flags & (DDPF_RGB | DDPF_LUMINANCE)) {
+    if (pixel_format.bit_count == 32 && pixel_format.r_mask == 0xff &&
+        pixel_format.g_mask == 0xff00 && pixel_format.b_mask == 0xff0000)
+      return is_color ? irr::video::ECF_R8G8B8A8_UNORM_SRGB
+                      : irr::video::ECF_R8G8B8A8_UNORM;
+    if (pixel_format.bit_count == 32 && pixel_format.r_mask == 0xff0000 &&
+        pixel_format.g_mask == 0xff00 && pixel_format.b_mask == 0xff)
+      return is_color ? irr::video::ECF_B8G8R8A8_UNORM_SRGB
+                      : irr::video::ECF_B8G8R8A8_UNORM;
+    if (pixel_format.bit_count == 16 && pixel_format.r_mask == 0xff &&
+        pixel_format.g_mask == 0xff00)
+      return irr::video::ECF_R8G8;
+    if (pixel_format.bit_count == 8 && pixel_format.r_mask == 0xff)
+      return irr::video::ECF_R8;
+  }
+  throw "decode_texture: unsupported DDS format";
+}
+
+bool has_dds_extension(const std::string &texture_name) {
+  if (texture_name.size() < 4)
+    return false;
+  std::string extension = texture_name.substr(texture_name.size() - 4);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return static_cast<char>(std::tolower(c)); });
+  return extension == ".dds";
+}
+
+// Parses the header in place, texels point into the file.
+decoded_texture decode_dds(const std::string &texture_name, bool is_color,
+                           file_access access) {
+  auto &&file = std::make_shared<const mapped_file>(texture_name, access);
+  if (file->size() < sizeof(dds_header))
+    throw "decode_texture: truncated DDS file";
+  dds_header header;
+  memcpy(&header, file->data(), sizeof(dds_header));
+  if (header.magic != four_cc('D', 'D', 'S', ' ') || header.size != 124)
+    throw "decode_texture: not a DDS file";
+
+  decoded_texture result;
+  result.name = texture_name;
+  result.width = std::max(header.width, 1u);
+  result.height = std::max(header.height, 1u);
+  result.mipmap_count = static_cast<uint16_t>(
+      (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mipmap_count, 1u)
+                                        : 1u);
+  size_t texels_offset = sizeof(dds_header);
+  uint32_t array_size = 1;
+  if (header.pixel_format.flags & DDPF_FOURCC &&
+      header.pixel_format.four_cc == four_cc('D', 'X', '1', '0')) {
+    if (file->size() < sizeof(dds_header) + sizeof(dds_header_dx10))
+      throw "decode_texture: truncated DDS file";
+    dds_header_dx10 header_dx10;
+    memcpy(&header_dx10, file->data() + sizeof(dds_header),
+           sizeof(dds_header_dx10));
+    if (header_dx10.resource_dimension != D3D10_RESOURCE_DIMENSION_TEXTURE2D)
+      throw "decode_texture: only 2D DDS textures are supported";
+    texels_offset += sizeof(dds_header_dx10);
+    result.format = get_color_format_from_dxgi(header_dx10.dxgi_format);
+    result.is_cubemap =
+        (header_dx10.misc_flag & D3D10_RESOURCE_MISC_TEXTURECUBE) != 0;
+    array_size = std::max(header_dx10.array_size, 1u);
+  } else {
+    if (header.caps2 & DDSCAPS2_VOLUME)
+      throw "decode_texture: only 2D DDS textures are supported";
+    result.format = get_color_format_from_legacy(header.pixel_format, is_color);
+    result.is_cubemap = (header.caps2 & DDSCAPS2_CUBEMAP) != 0;
+    if (result.is_cubemap && (header.caps2 & DDSCAPS2_CUBEMAP_ALLFACES) !=
+                                 DDSCAPS2_CUBEMAP_ALLFACES)
+      throw "decode_texture: partial cubemaps are not supported";
+  }
+  result.layer_count =
+      static_cast<uint16_t>(array_size * (result.is_cubemap ? 6 : 1));
+
+  uint64_t layer_size = 0;
+  for (unsigned i = 0; i < result.mipmap_count; i++)
+    layer_size +=
+        get_level_size(result.format, std::max(result.width >> i, 1u),
+                       std::max(result.height >> i, 1u));
+  result.size = layer_size * result.layer_count;
+  if (texels_offset + result.size > file->size())
+    throw "decode_texture: truncated DDS file";
+  // Faults the mapping in on the calling thread, not in upload_texture.
+  file->prefetch();
+  result.texels = file->data() + texels_offset;
+  result.storage = std::move(file);
+  return result;
+}
+
+// Texels of a level of an 8 bits channels format as RGBA, missing channels are
+// 0 and alpha 255.
+std::vector<uint8_t> to_rgba(irr::video::ECOLOR_FORMAT format,
+                             const char *texels, size_t texel_count) {
+  const auto source = reinterpret_cast<const uint8_t *>(texels);
+  std::vector<uint8_t> rgba(texel_count * 4);
+  for (size_t i = 0; i < texel_count; i++) {
+    auto out = &rgba[i * 4];
+    switch (format) {
+    case irr::video::ECF_R8G8B8A8_UNORM:
+    case irr::video::ECF_R8G8B8A8_UNORM_SRGB:
+      memcpy(out, source + i * 4, 4);
+      break;
+    case irr::video::ECF_B8G8R8A8_UNORM:
+    case irr::video::ECF_B8G8R8A8_UNORM_SRGB:
+      out[0] = source[i * 4 + 2];
+      out[1] = source[i * 4 + 1];
+      out[2] = source[i * 4];
+      out[3] = source[i * 4 + 3];
+      break;
+    case irr::video::ECF_R8:
+      out[0] = source[i];
+      out[1] = out[2] = 0;
+      out[3] = 255;
+      break;
+    default:
+      out[0] = source[i * 2];
+      out[1] = source[i * 2 + 1];
+      out[2] = 0;
+      out[3] = 255;
+      break;
+    }
+  }
+  return rgba;
+}
+
+float srgb_to_linear(uint8_t value) {
+  const auto c = value / 255.f;
+  return c <= .04045f ? c / 12.92f : std::pow((c + .055f) / 1.055f, 2.4f);
+}
+
+uint8_t linear_to_srgb(float value) {
+  const auto c = value <= .0031308f
+                     ? value * 12.92f
+                     : 1.055f * std::pow(value, 1.f / 2.4f) - .055f;
+  return static_cast<uint8_t>(std::min(std::max(c, 0.f), 1.f) * 255.f + .5f);
+}
+
+// Next level of a mipmap chain, averages 2x2 texels, or 2x1 at odd edges.
+std::vector<uint8_t> downsample(const std::vector<uint8_t> &rgba,
+                                uint32_t width, uint32_t height, bool srgb) {
+  static const auto &&linear = []() {
+    std::array<float, 256> table;
+    for (int i = 0; i < 256; i++)
+      table[i] = srgb_to_linear(static_cast<uint8_t>(i));
+    return table;
+  }();
+  const auto next_width = std::max(width / 2, 1u);
+  const auto next_height = std::max(height / 2, 1u);
+  std::vector<uint8_t> next(size_t(next_width) * next_height * 4);
+  for (uint32_t y = 0; y < next_height; y++) {
+    const uint32_t rows[] = {std::min(y * 2, height - 1),
+                             std::min(y * 2 + 1, height - 1)};
+    for (uint32_t x = 0; x < next_width; x++) {
+      const uint32_t columns[] = {std::min(x * 2, width - 1),
+                                  std::min(x * 2 + 1, width - 1)};
+      for (int c = 0; c < 4; c++) {
+        const auto is_linear = !srgb || c == 3;
+        float sum = 0.f;
+        for (const auto row : rows)
+          for (const auto column : columns) {
+            const auto value = rgba[(size_t(row) * width + column) * 4 + c];
+            sum += is_linear ? value : linear[value];
+          }
+        next[(size_t(y) * next_width + x) * 4 + c] =
+            is_linear ? static_cast<uint8_t>(sum / 4.f + .5f)
+                      : linear_to_srgb(sum / 4.f);
+      }
+    }
+  }
+  return next;
+}
+}
+
+decoded_texture decode_texture(const std::string &texture_name, bool is_color,
+                               file_access access) {
+  if (has_dds_extension(texture_name))
+    return decode_dds(texture_name, is_color, access);
+
+  auto &&texture =
+      std::make_shared<const gli::texture>(gli::load(texture_name));
+  if (texture->empty())
+    throw "decode_texture: can't read file";
+  decoded_texture result;
+  result.name = texture_name;
+  result.format = get_color_format(texture->format());
+  result.width = static_cast<uint32_t>(texture->extent().x);
+  result.height = static_cast<uint32_t>(texture->extent().y);
+  result.mipmap_count = static_cast<uint16_t>(texture->levels());
+  result.layer_count =
+      static_cast<uint16_t>(texture->layers() * texture->faces());
+  result.is_cubemap = gli::is_target_cube(texture->target());
+  result.texels = static_cast<const char *>(texture->data());
+  result.size = static_cast<uint64_t>(texture->size());
+  result.storage = std::move(texture);
+  return result;
+}
+
+irr::video::ECOLOR_FORMAT choose_block_format(const decoded_texture &texture) {
+  switch (texture.format) {
+  case irr::video::ECF_R8:
+    return irr::video::ECF_BC4_UNORM;
+  case irr::video::ECF_R8G8:
+    return irr::video::ECF_BC5_UNORM;
+  case irr::video::ECF_R8G8B8A8_UNORM:
+  case irr::video::ECF_R8G8B8A8_UNORM_SRGB:
+  case irr::video::ECF_B8G8R8A8_UNORM:
+  case irr::video::ECF_B8G8R8A8_UNORM_SRGB: {
+    const auto srgb =
+        texture.format == irr::video::ECF_R8G8B8A8_UNORM_SRGB ||
+        texture.format == irr::video::ECF_B8G8R8A8_UNORM_SRGB;
+    for (uint64_t i = 3; i < texture.size; i += 4)
+      if (static_cast<uint8_t>(texture.texels[i]) != 255)
+        return srgb ? irr::video::ECF_BC3_UNORM_SRGB
+                    : irr::video::ECF_BC3_UNORM;
+    return srgb ? irr::video::ECF_BC1_UNORM_SRGB : irr::video::ECF_BC1_UNORM;
+  }
+  default:
+    return irr::video::ECF_UNKNOWN;
+  }
+}
+
+decoded_texture compress_texture(const decoded_texture &texture,
+                                 irr::video::ECOLOR_FORMAT format,
+                                 worker_pool *workers) {
+  switch (texture.format) {
+  case irr::video::ECF_R8G8B8A8_UNORM:
+  case irr::video::ECF_R8G8B8A8_UNORM_SRGB:
+  case irr::video::ECF_B8G8R8A8_UNORM:
+  case irr::video::ECF_B8G8R8A8_UNORM_SRGB:
+  case irr::video::ECF_R8:
+  case irr::video::ECF_R8G8:
+    break;
+  default:
+    throw "compress_texture: source must have 8 bits channels";
+  }
+  const auto srgb = format == irr::video::ECF_BC1_UNORM_SRGB ||
+                    format == irr::video::ECF_BC3_UNORM_SRGB;
+  const auto generates_mipmaps = texture.mipmap_count == 1;
+  const auto mipmap_count =
+      generates_mipmaps ? get_full_mipmap_count(texture.width, texture.height)
+                        : texture.mipmap_count;
+
+  decoded_texture result = texture;
+  result.format = format;
+  result.mipmap_count = mipmap_count;
+  uint64_t layer_size = 0;
+  for (unsigned i = 0; i < mipmap_count; i++)
+    layer_size += get_level_size(format, std::max(texture.width >> i, 1u),
+                                 std::max(texture.height >> i, 1u));
+  result.size = layer_size * texture.layer_count;
+  auto &&blocks = std::make_shared<std::vector<uint8_t>>(result.size);
+
+  const char *source = texture.texels;
+  auto destination = blocks->data();
+  for (uint32_t layer = 0; layer < texture.layer_count; layer++) {
+    std::vector<uint8_t> rgba;
     for (unsigned i = 0; i < mipmap_count; i++) {
+      const auto width = std::max(texture.width >> i, 1u);
+      const auto height = std::max(texture.height >> i, 1u);
+      if (i == 0 || !generates_mipmaps) {
+        rgba = to_rgba(texture.format, source, size_t(width) * height);
+        source += get_level_size(texture.format, width, height);
+      } else
+        rgba = downsample(rgba, std::max(texture.width >> (i - 1), 1u),
+                          std::max(texture.height >> (i - 1), 1u), srgb);
+      compress_blocks(format, rgba.data(), width, height, width * 4,
+                      destination, workers);
+      destination += get_level_size(format, width, height);
+    }
+  }
+  result.texels = reinterpret_cast<const char *>(blocks->data());
+  result.storage = std::move(blocks);
+  return result;
+}
+
+uint64_t get_level_size(irr::video::ECOLOR_FORMAT format, uint32_t width,
+                        uint32_t height) {
+  const auto block_extent = irr::video::formatBlockExtent(format);
+  return uint64_t((width + block_extent - 1) / block_extent) *
+         ((height + block_extent - 1) / block_extent) *
+         irr::video::formatBlockByteCount(format);
+}
+
+uint16_t get_full_mipmap_count(uint32_t width, uint32_t height) {
+  uint16_t result = 1;
+  while (std::max(width, height) >> result)
+    result++;
+  return result;
+}
+
+std::tuple<std::unique_ptr<image_t>, std::unique_ptr<buffer_t>>
+upload_texture(device_t &dev, const decoded_texture &texture,
+               command_list_t &upload_command_list,
+               uint16_t image_mipmap_count) {
+  const auto format = texture.format;
+  const auto block_extent = irr::video::formatBlockExtent(format);
+  const auto block_size = irr::video::formatBlockByteCount(format);
+
+  // Subresources are in layer then level order, like the subresource indexes
+  // of copy_buffer_to_image_subresource and like texels.
+  std::vector<MipLevelData> Mips;
+  uint64_t offset_in_texram = 0;
+  for (uint32_t layer = 0; layer < texture.layer_count; layer++) {
+    for (unsigned i = 0; i < texture.mipmap_count; i++) {
       // Offset needs to be aligned to 512 bytes
-      offset_in_texram = (offset_in_texram + 511) & ~511;
+      offset_in_texram = (offset_in_texram + 511) & ~uint64_t(511);
+      const auto &mip_width = std::max(texture.width >> i, 1u);
+      const auto &mip_height = std::max(texture.height >> i, 1u);
+      const auto &height_in_blocks =
+          (mip_height + block_extent - 1) / block_extent;
+      const auto &width_in_blocks =
+          (mip_width + block_extent - 1) / block_extent;
       // Row pitch is always a multiple of 256
-      uint32_t height_in_blocks =
-          static_cast<uint32_t>(DDSPic.extent(i).y + block_height - 1) /
-          block_height;
-      uint32_t width_in_blocks =
-          static_cast<uint32_t>(DDSPic.extent(i).x + block_width - 1) /
-          block_width;
-      uint32_t height_in_texram = height_in_blocks * block_height;
-      uint32_t width_in_texram = width_in_blocks * block_width;
-      uint32_t rowPitch = width_in_blocks * block_size;
-      rowPitch = (rowPitch + 255) & ~255;
-      const auto &mml = MipLevelData{offset_in_texram, width_in_texram,
-                                     height_in_texram, rowPitch};
-      Mips.push_back(mml);
-      for (unsigned row = 0; row < height_in_blocks; row++) {
-        memcpy(((char *)pointer) + offset_in_texram,
-               (char *)DDSPic.data(0, face, i) +
-                   row * width_in_blocks * block_size,
-               width_in_blocks * block_size);
-        offset_in_texram += rowPitch;
-      }
+      const auto &rowPitch = (width_in_blocks * block_size + 255) & ~255u;
+      Mips.push_back(
+          MipLevelData{offset_in_texram, mip_width, mip_height, rowPitch});
+      offset_in_texram += rowPitch * height_in_blocks;
     }
   }
+
+  auto &&upload_buffer = dev.create_buffer(
+      offset_in_texram, irr::video::E_MEMORY_POOL::EMP_CPU_WRITEABLE,
+      usage_buffer_transfer_src, memory_category::staging,
+      texture.name + " upload");
+  auto pointer = static_cast<char *>(upload_buffer->map_buffer());
+  const char *source = texture.texels;
+  for (const MipLevelData &mml : Mips) {
+    const auto &row_size =
+        (mml.Width + block_extent - 1) / block_extent * block_size;
+    const auto &height_in_blocks =
+        (mml.Height + block_extent - 1) / block_extent;
+    // Levels whose rows are already aligned are copied at once.
+    if (row_size == mml.RowPitch)
+      memcpy(pointer + mml.Offset, source, row_size * height_in_blocks);
+    else
+      for (unsigned row = 0; row < height_in_blocks; row++)
+        memcpy(pointer + mml.Offset + row * mml.RowPitch,
+               source + row * row_size, row_size);
+    source += row_size * height_in_blocks;
+  }
   upload_buffer->unmap_buffer();
 
-  std::unique_ptr<image_t> texture = dev.create_image(
-      irr::video::ECF_BC1_UNORM_SRGB, width, height, mipmap_count, layer_count,
-      usage_sampled | usage_transfer_dst | (is_cubemap ? usage_cube : 0),
-      nullptr);
+  // Levels past the uploaded ones are written by a mipmap_generator.
+  const auto generated_levels = image_mipmap_count > texture.mipmap_count;
+  const auto level_count =
+      std::max<uint16_t>(image_mipmap_count, texture.mipmap_count);
+  std::unique_ptr<image_t> image = dev.create_image(
+      format, texture.width, texture.height, level_count, texture.layer_count,
+      usage_sampled | usage_transfer_dst |
+          (generated_levels ? usage_uav : 0) |
+          (texture.is_cubemap ? usage_cube : 0),
+      nullptr, memory_category::texture, texture.name);
 
-  uint32_t miplevel = 0;
-  for (const MipLevelData &mipmapData : Mips) {
+  for (size_t i = 0; i < Mips.size(); i++) {
+    const MipLevelData &mipmapData = Mips[i];
+    const auto &subresource = static_cast<uint32_t>(
+        i / texture.mipmap_count * level_count + i % texture.mipmap_count);
     upload_command_list.set_pipeline_barrier(
-        *texture, RESOURCE_USAGE::undefined, RESOURCE_USAGE::COPY_DEST,
-        miplevel, irr::video::E_ASPECT::EA_COLOR);
+        *image, RESOURCE_USAGE::undefined, RESOURCE_USAGE::COPY_DEST,
+        subresource, irr::video::E_ASPECT::EA_COLOR);
     upload_command_list.copy_buffer_to_image_subresource(
-        *texture, miplevel, *upload_buffer, mipmapData.Offset, mipmapData.Width,
-        mipmapData.Height, mipmapData.RowPitch, irr::video::ECF_BC1_UNORM_SRGB);
+        *image, subresource, *upload_buffer, mipmapData.Offset,
+        mipmapData.Width, mipmapData.Height, mipmapData.RowPitch, format);
     upload_command_list.set_pipeline_barrier(
-        *texture, RESOURCE_USAGE::COPY_DEST, RESOURCE_USAGE::READ_GENERIC,
-        miplevel, irr::video::E_ASPECT::EA_COLOR);
-    miplevel++;
+        *image, RESOURCE_USAGE::COPY_DEST, RESOURCE_USAGE::READ_GENERIC,
+        subresource, irr::video::E_ASPECT::EA_COLOR);
   }
-  return std::make_tuple(std::move(texture), std::move(upload_buffer));
-}
\ No newline at end of file
+  return std::make_tuple(std::move(image), std::move(upload_buffer));
+}
+
+std::unique_ptr<image_view_t>
+create_texture_view(device_t &dev, image_t &image,
+                    const decoded_texture &texture, uint16_t mipmap_count) {
+  const auto &type =
+      texture.is_cubemap
+          ? irr::video::E_TEXTURE_TYPE::ETT_CUBE
+          : (texture.layer_count > 1 ? irr::video::E_TEXTURE_TYPE::ETT_2D_ARRAY
+                                     : irr::video::E_TEXTURE_TYPE::ETT_2D);
+  return dev.create_image_view(
+      image, texture.format, 0,
+      std::max<uint16_t>(mipmap_count, texture.mipmap_count), 0,
+      texture.layer_count, type);
+}
+
+std::tuple<std::unique_ptr<image_t>, std::unique_ptr<buffer_t>>
+load_texture(device_t &dev, std::string &&texture_name,
+             command_list_t &upload_command_list) {
+  return upload_texture(dev, decode_texture(texture_name), upload_command_list);
+}
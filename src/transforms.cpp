@@ -0,0 +1,222 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Scene/TransformSystem.h>
+#include <algorithm>
+#include <future>
+#include <glm/gtx/euler_angles.hpp>
+#include <glm/gtx/transform.hpp>
+#include <thread>
+#if defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define YAGF_SSE_TRANSFORMS
+#endif
+
+namespace irr {
+namespace scene {
+namespace {
+// Same convention as ISceneNode::getRelativeTransformation.
+glm::mat4 compute_local_matrix(const glm::vec3 &translation,
+                               const glm::vec3 &rotation,
+                               const glm::vec3 &scale) {
+  return glm::scale(scale) * glm::translate(translation) *
+         glm::eulerAngleYXZ(rotation.y, rotation.x, rotation.z);
+}
+
+// out = a * b, glm matrixes are column major.
+void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out) {
+#ifdef YAGF_SSE_TRANSFORMS
+  const auto &a0 = _mm_loadu_ps(&a[0][0]);
+  const auto &a1 = _mm_loadu_ps(&a[1][0]);
+  const auto &a2 = _mm_loadu_ps(&a[2][0]);
+  const auto &a3 = _mm_loadu_ps(&a[3][0]);
+  for (int col = 0; col < 4; col++) {
+    auto result = _mm_mul_ps(a0, _mm_set1_ps(b[col][0]));
+    result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b[col][1])));
+    result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b[col][2])));
+    result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b[col][3])));
+    _mm_storeu_ps(&out[col][0], result);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+// Calls f(first, last) on chunks of [0, count), on several threads when
+// there is enough work to amortize them.
+template <typename F> void parallel_for(size_t count, F &&f) {
+  constexpr size_t min_chunk_size = 1024;
+  const auto thread_count =
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  const auto chunk_count = std::min<size_t>(
+      thread_count, (count + min_chunk_size - 1) / min_chunk_size);
+  if (chunk_count <= 1) {
+    f(size_t(0), count);
+    return;
+  }
+  std::vector<std::future<void>> tasks;
+  for (size_t chunk = 1; chunk < chunk_count; chunk++) {
+    const auto first = count * chunk / chunk_count;
+    const auto last = count * (chunk + 1) / chunk_count;
+    tasks.push_back(std::async(std::launch::async,
+                               [&f, first, last]() { f(first, last); }));
+  }
+  f(size_t(0), count / chunk_count);
+  for (auto &task : tasks)
+    task.get();
+}
+}
+
+transform_id transform_system::add(transform_id parent,
+                                   const glm::vec3 &translation,
+                                   const glm::vec3 &rotation,
+                                   const glm::vec3 &scale) {
+  transform_id id;
+  if (free_ids.empty()) {
+    id = static_cast<transform_id>(parents.size());
+    translations.emplace_back();
+    rotations.emplace_back();
+    scales.emplace_back();
+    local_matrices.emplace_back(1.f);
+    world_matrices.emplace_back(1.f);
+    parents.push_back(invalid_transform);
+    first_children.push_back(invalid_transform);
+    next_siblings.push_back(invalid_transform);
+    levels.push_back(0);
+    dirty.push_back(0);
+    local_dirty.push_back(0);
+  } else {
+    id = free_ids.back();
+    free_ids.pop_back();
+  }
+  translations[id] = translation;
+  rotations[id] = rotation;
+  scales[id] = scale;
+  parents[id] = parent;
+  levels[id] = parent != invalid_transform ? levels[parent] + 1 : 0;
+  if (parent != invalid_transform) {
+    next_siblings[id] = first_children[parent];
+    first_children[parent] = id;
+  }
+  mark_dirty(id);
+  return id;
+}
+
+void transform_system::remove(transform_id id) {
+  const auto parent = parents[id];
+  if (parent != invalid_transform) {
+    auto *link = &first_children[parent];
+    while (*link != id)
+      link = &next_siblings[*link];
+    *link = next_siblings[id];
+  }
+  for (auto child = first_children[id]; child != invalid_transform;) {
+    const auto next = next_siblings[child];
+    parents[child] = invalid_transform;
+    next_siblings[child] = invalid_transform;
+    set_level(child, 0);
+    mark_dirty(child);
+    child = next;
+  }
+  if (dirty[id])
+    dirty_list.erase(std::find(dirty_list.begin(), dirty_list.end(), id));
+  parents[id] = invalid_transform;
+  first_children[id] = invalid_transform;
+  next_siblings[id] = invalid_transform;
+  dirty[id] = 0;
+  local_dirty[id] = 0;
+  free_ids.push_back(id);
+}
+
+void transform_system::set_level(transform_id id, uint32_t level) {
+  std::vector<transform_id> stack{id};
+  levels[id] = level;
+  while (!stack.empty()) {
+    const auto current = stack.back();
+    stack.pop_back();
+    for (auto child = first_children[current]; child != invalid_transform;
+         child = next_siblings[child]) {
+      levels[child] = levels[current] + 1;
+      stack.push_back(child);
+    }
+  }
+}
+
+void transform_system::mark_dirty(transform_id id) {
+  local_dirty[id] = 1;
+  // Once a transform is dirty its whole subtree is.
+  if (dirty[id])
+    return;
+  std::vector<transform_id> stack{id};
+  while (!stack.empty()) {
+    const auto current = stack.back();
+    stack.pop_back();
+    if (dirty[current])
+      continue;
+    dirty[current] = 1;
+    dirty_list.push_back(current);
+    for (auto child = first_children[current]; child != invalid_transform;
+         child = next_siblings[child])
+      stack.push_back(child);
+  }
+}
+
+void transform_system::set_translation(transform_id id,
+                                       const glm::vec3 &translation) {
+  translations[id] = translation;
+  mark_dirty(id);
+}
+
+void transform_system::set_rotation(transform_id id,
+                                    const glm::vec3 &rotation) {
+  rotations[id] = rotation;
+  mark_dirty(id);
+}
+
+void transform_system::set_scale(transform_id id, const glm::vec3 &scale) {
+  scales[id] = scale;
+  mark_dirty(id);
+}
+
+size_t transform_system::update() {
+  changed.clear();
+  if (dirty_list.empty())
+    return 0;
+
+  std::sort(dirty_list.begin(), dirty_list.end(),
+            [this](transform_id a, transform_id b) {
+              return levels[a] != levels[b] ? levels[a] < levels[b] : a < b;
+            });
+
+  // Parents of a level are either clean or in a previous level.
+  for (auto level_begin = dirty_list.begin();
+       level_begin != dirty_list.end();) {
+    const auto level = levels[*level_begin];
+    const auto level_end =
+        std::find_if(level_begin, dirty_list.end(),
+                     [&](transform_id id) { return levels[id] != level; });
+    const auto ids = &*level_begin;
+    parallel_for(static_cast<size_t>(level_end - level_begin),
+                 [&](size_t first, size_t last) {
+                   for (auto i = first; i < last; i++) {
+                     const auto id = ids[i];
+                     if (local_dirty[id])
+                       local_matrices[id] = compute_local_matrix(
+                           translations[id], rotations[id], scales[id]);
+                     if (parents[id] != invalid_transform)
+                       multiply(world_matrices[parents[id]],
+                                local_matrices[id], world_matrices[id]);
+                     else
+                       world_matrices[id] = local_matrices[id];
+                     dirty[id] = 0;
+                     local_dirty[id] = 0;
+                   }
+                 });
+    level_begin = level_end;
+  }
+
+  changed.swap(dirty_list);
+  dirty_list.clear();
+  return changed.size();
+}
+}
+}
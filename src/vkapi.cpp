@@ -2,6 +2,7 @@
 // For conditions of distribution and use, see copyright notice in License.txt
 #include <range\v3\all.hpp>
 #include "../include/API/vkapi.h"
+#include <iomanip>
 #include <set>
 #include <sstream>
 
@@ -66,6 +67,10 @@ auto get_vk_format(irr::video::ECOLOR_FORMAT format) {
     return vk::Format::eR16Sfloat;
   case irr::video::ECF_R16G16F:
     return vk::Format::eR16G16Sfloat;
+  case irr::video::ECF_R16G16_SNORM:
+    return vk::Format::eR16G16Snorm;
+  case irr::video::ECF_R16G16B16A16_UNORM:
+    return vk::Format::eR16G16B16A16Unorm;
   case irr::video::ECF_R16G16B16A16F:
     return vk::Format::eR16G16B16A16Sfloat;
   case irr::video::ECF_R32F:
@@ -97,6 +102,18 @@ auto get_vk_format(irr::video::ECOLOR_FORMAT format) {
     return vk::Format::eBc5UnormBlock;
   case irr::video::ECF_BC5_SNORM:
     return vk::Format::eBc5SnormBlock;
+  case irr::video::ECF_BC6H_UF16:
+    return vk::Format::eBc6HUfloatBlock;
+  case irr::video::ECF_BC6H_SF16:
+    return vk::Format::eBc6HSfloatBlock;
+  case irr::video::ECF_BC7_UNORM:
+    return vk::Format::eBc7UnormBlock;
+  case irr::video::ECF_BC7_UNORM_SRGB:
+    return vk::Format::eBc7SrgbBlock;
+  case irr::video::ECF_R8:
+    return vk::Format::eR8Unorm;
+  case irr::video::ECF_R8G8:
+    return vk::Format::eR8G8Unorm;
   case irr::video::D24U8:
     return vk::Format::eD24UnormS8Uint;
   case irr::video::D32U8:
@@ -114,24 +131,89 @@ auto get_vk_format(irr::video::ECOLOR_FORMAT format) {
 }
 }
 
-std::tuple<std::unique_ptr<device_t>, std::unique_ptr<swap_chain_t>,
-           std::unique_ptr<command_queue_t>, uint32_t, uint32_t,
-           irr::video::ECOLOR_FORMAT>
-create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
-                                                      bool debug_marker,
-                                                      bool debug_layer) {
-  const auto &layers =
-      debug_layer
-          ? std::vector<const char *>{"VK_LAYER_LUNARG_standard_validation"}
-          : std::vector<const char *>{};
+namespace {
+bool has_extension(const std::vector<vk::ExtensionProperties> &extensions,
+                   const char *name) {
+  return std::any_of(extensions.begin(), extensions.end(),
+                     [&](const vk::ExtensionProperties &ext) {
+                       return strcmp(ext.extensionName, name) == 0;
+                     });
+}
+
+//! Enables VK_EXT_memory_budget if the physical device and the instance
+//! support it and returns vkGetPhysicalDeviceMemoryProperties2KHR.
+PFN_vkGetPhysicalDeviceMemoryProperties2KHR
+enable_memory_budget(vk::Instance instance, vk::PhysicalDevice physical_device,
+                     std::vector<const char *> &device_extension) {
+  const auto get_memory_properties2 =
+      (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(
+          instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+  if (get_memory_properties2 == nullptr ||
+      !has_extension(physical_device.enumerateDeviceExtensionProperties(),
+                     VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    return nullptr;
+  device_extension.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  return get_memory_properties2;
+}
+
+//! Enables VK_KHR_draw_indirect_count if the physical device supports it.
+bool enable_draw_indirect_count(vk::PhysicalDevice physical_device,
+                                std::vector<const char *> &device_extension) {
+  if (!has_extension(physical_device.enumerateDeviceExtensionProperties(),
+                     VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    return false;
+  device_extension.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  return true;
+}
+
+//! Enables VK_KHR_maintenance2 if the physical device supports it, sRGB
+//! images then get storage views through their UNORM equivalent.
+bool enable_maintenance2(vk::PhysicalDevice physical_device,
+                         std::vector<const char *> &device_extension) {
+  if (!has_extension(physical_device.enumerateDeviceExtensionProperties(),
+                     VK_KHR_MAINTENANCE2_EXTENSION_NAME))
+    return false;
+  device_extension.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+  return true;
+}
+
+//! Optional features used by command lists, when supported.
+vk::PhysicalDeviceFeatures
+get_enabled_features(vk::PhysicalDevice physical_device) {
+  const auto &supported = physical_device.getFeatures();
+  return vk::PhysicalDeviceFeatures{}
+      .setMultiDrawIndirect(supported.multiDrawIndirect)
+      .setShaderStorageImageWriteWithoutFormat(
+          supported.shaderStorageImageWriteWithoutFormat);
+}
+
+vk_command_features
+get_command_features(vk::Device dev,
+                     const vk::PhysicalDeviceFeatures &enabled_features,
+                     bool draw_indirect_count) {
+  vk_command_features result;
+  result.multi_draw_indirect = enabled_features.multiDrawIndirect == VK_TRUE;
+  if (draw_indirect_count)
+    result.draw_indexed_indirect_count =
+        (PFN_vkCmdDrawIndexedIndirectCountKHR)dev.getProcAddr(
+            "vkCmdDrawIndexedIndirectCountKHR");
+  return result;
+}
 
-  const auto &instance_extension =
-      debug_layer
-          ? std::vector<const char *>{VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
-                                      VK_KHR_SURFACE_EXTENSION_NAME,
+vk::Instance create_instance(const std::vector<const char *> &layers,
+                             bool debug_layer, bool with_surface) {
+  auto &&instance_extension =
+      with_surface
+          ? std::vector<const char *>{VK_KHR_SURFACE_EXTENSION_NAME,
                                       VK_KHR_WIN32_SURFACE_EXTENSION_NAME}
-          : std::vector<const char *>{VK_KHR_SURFACE_EXTENSION_NAME,
-                                      VK_KHR_WIN32_SURFACE_EXTENSION_NAME};
+          : std::vector<const char *>{};
+  if (debug_layer)
+    instance_extension.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+  // Required by VK_EXT_memory_budget
+  if (has_extension(vk::enumerateInstanceExtensionProperties(),
+                    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    instance_extension.push_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
   const auto app_info = vk::ApplicationInfo{}
                             .setApiVersion(VK_MAKE_VERSION(1, 0, 0))
@@ -177,6 +259,22 @@ create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
     /* Clean up callback */
     //	dbgDestroyDebugReportCallback(instance, debug_report_callback, NULL);
   }
+  return instance;
+}
+}
+
+std::tuple<std::unique_ptr<device_t>, std::unique_ptr<swap_chain_t>,
+           std::unique_ptr<command_queue_t>, uint32_t, uint32_t,
+           irr::video::ECOLOR_FORMAT>
+create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
+                                                      bool debug_marker,
+                                                      bool debug_layer) {
+  const auto &layers =
+      debug_layer
+          ? std::vector<const char *>{"VK_LAYER_LUNARG_standard_validation"}
+          : std::vector<const char *>{};
+
+  const auto instance = create_instance(layers, debug_layer, true);
 
   const auto &devices = instance.enumeratePhysicalDevices();
   const auto &queue_family_properties = devices[0].getQueueFamilyProperties();
@@ -218,6 +316,12 @@ create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
       std::vector<const char *>{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
   if (has_extension && debug_marker)
     device_extension.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
+  const auto get_memory_properties2 =
+      enable_memory_budget(instance, devices[0], device_extension);
+  const auto draw_indirect_count =
+      enable_draw_indirect_count(devices[0], device_extension);
+  const auto maintenance2 = enable_maintenance2(devices[0], device_extension);
+  const auto &enabled_features = get_enabled_features(devices[0]);
   auto dev = devices[0].createDevice(
       vk::DeviceCreateInfo{}
           .setEnabledExtensionCount(
@@ -226,7 +330,8 @@ create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
           .setEnabledLayerCount(static_cast<uint32_t>(layers.size()))
           .setPpEnabledLayerNames(layers.data())
           .setPQueueCreateInfos(queue_infos.data())
-          .setQueueCreateInfoCount(static_cast<uint32_t>(queue_infos.size())));
+          .setQueueCreateInfoCount(static_cast<uint32_t>(queue_infos.size()))
+          .setPEnabledFeatures(&enabled_features));
 
   auto mem_properties = devices[0].getMemoryProperties();
 
@@ -252,8 +357,13 @@ create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
   auto chain = dev.createSwapchainKHR(swap_chain);
 
   auto &&wrapped_dev = std::make_unique<vk_device_t>(dev);
+  wrapped_dev->physical_device = devices[0];
   wrapped_dev->mem_properties = devices[0].getMemoryProperties();
+  wrapped_dev->get_memory_properties2 = get_memory_properties2;
+  wrapped_dev->command_features =
+      get_command_features(dev, enabled_features, draw_indirect_count);
   wrapped_dev->queue_family_index = queue_family_index;
+  wrapped_dev->extended_image_usage = maintenance2;
 
   auto queue = dev.getQueue(queue_infos[0].queueFamilyIndex, 0);
   const auto &fmt = [&]() {
@@ -277,6 +387,178 @@ create_device_swapchain_and_graphic_presentable_queue(GLFWwindow *window,
       surface_capabilities.currentExtent.height, fmt);
 }
 
+std::tuple<std::unique_ptr<device_t>, std::unique_ptr<swap_chain_t>,
+           std::unique_ptr<command_queue_t>, uint32_t, uint32_t,
+           irr::video::ECOLOR_FORMAT>
+create_headless_device_swapchain_and_graphic_queue(
+    uint32_t width, uint32_t height, uint32_t image_count,
+    const std::string &dump_prefix, bool debug_layer) {
+  const auto &layers =
+      debug_layer
+          ? std::vector<const char *>{"VK_LAYER_LUNARG_standard_validation"}
+          : std::vector<const char *>{};
+
+  const auto instance = create_instance(layers, debug_layer, false);
+
+  const auto &devices = instance.enumeratePhysicalDevices();
+  if (devices.empty())
+    throw "No Vulkan physical device available";
+  const auto &queue_family_properties = devices[0].getQueueFamilyProperties();
+
+  // No surface to query : any graphic queue will do.
+  const auto queue_family_index = [&]() {
+    for (unsigned int i = 0; i < queue_family_properties.size(); i++) {
+      if (queue_family_properties[i].queueFlags & vk::QueueFlagBits::eGraphics)
+        return i;
+    }
+    throw;
+  }();
+  const auto &queue_priorities = 0.f;
+  const auto queue_infos = std::array<vk::DeviceQueueCreateInfo, 1>{
+      vk::DeviceQueueCreateInfo{}
+          .setQueueFamilyIndex(queue_family_index)
+          .setQueueCount(1)
+          .setPQueuePriorities(&queue_priorities)};
+
+  auto &&device_extension = std::vector<const char *>{};
+  const auto get_memory_properties2 =
+      enable_memory_budget(instance, devices[0], device_extension);
+  const auto draw_indirect_count =
+      enable_draw_indirect_count(devices[0], device_extension);
+  const auto maintenance2 = enable_maintenance2(devices[0], device_extension);
+  const auto &enabled_features = get_enabled_features(devices[0]);
+  auto dev = devices[0].createDevice(
+      vk::DeviceCreateInfo{}
+          .setEnabledExtensionCount(
+              static_cast<uint32_t>(device_extension.size()))
+          .setPpEnabledExtensionNames(device_extension.data())
+          .setEnabledLayerCount(static_cast<uint32_t>(layers.size()))
+          .setPpEnabledLayerNames(layers.data())
+          .setPQueueCreateInfos(queue_infos.data())
+          .setQueueCreateInfoCount(static_cast<uint32_t>(queue_infos.size()))
+          .setPEnabledFeatures(&enabled_features));
+
+  auto &&wrapped_dev = std::make_unique<vk_device_t>(dev);
+  wrapped_dev->physical_device = devices[0];
+  wrapped_dev->mem_properties = devices[0].getMemoryProperties();
+  wrapped_dev->get_memory_properties2 = get_memory_properties2;
+  wrapped_dev->command_features =
+      get_command_features(dev, enabled_features, draw_indirect_count);
+  wrapped_dev->queue_family_index = queue_family_index;
+  wrapped_dev->extended_image_usage = maintenance2;
+  wrapped_dev->present_layout = vk::ImageLayout::eTransferSrcOptimal;
+
+  auto queue = dev.getQueue(queue_infos[0].queueFamilyIndex, 0);
+  const auto &fmt = irr::video::ECF_R8G8B8A8_UNORM;
+  auto &&chain = std::unique_ptr<swap_chain_t>(new vk_offscreen_swap_chain_t(
+      *wrapped_dev, queue, fmt, width, height, image_count, dump_prefix));
+  return std::make_tuple(
+      std::move(wrapped_dev), std::move(chain),
+      std::unique_ptr<command_queue_t>(new vk_command_queue_t(queue)), width,
+      height, fmt);
+}
+
+vk_offscreen_swap_chain_t::vk_offscreen_swap_chain_t(
+    vk_device_t &_dev, vk::Queue _queue, irr::video::ECOLOR_FORMAT _format,
+    uint32_t _width, uint32_t _height, uint32_t image_count,
+    const std::string &_dump_prefix)
+    : dev(_dev.object), queue(_queue), format(_format), width(_width),
+      height(_height), dump_prefix(_dump_prefix) {
+  for (uint32_t i = 0; i < image_count; i++)
+    images.push_back(_dev.create_image(
+        format, width, height, 1, 1,
+        usage_render_target | usage_transfer_src | usage_sampled, nullptr,
+        memory_category::render_target, "offscreen back buffer"));
+  if (dump_prefix.empty())
+    return;
+  readback_buffer = _dev.create_buffer(
+      width * height * 4, irr::video::E_MEMORY_POOL::EMP_CPU_READABLE,
+      usage_transfer_dst, memory_category::staging, "frame dump readback");
+  readback_storage = _dev.create_command_storage();
+  readback_command_list = readback_storage->create_command_list();
+}
+
+vk_offscreen_swap_chain_t::~vk_offscreen_swap_chain_t() { queue.waitIdle(); }
+
+std::vector<std::unique_ptr<image_t>>
+vk_offscreen_swap_chain_t::get_image_view_from_swap_chain() {
+  // Like swap chain images, returned images don't own their memory.
+  return images | ranges::view::transform([this](const auto &img) {
+           return std::unique_ptr<image_t>(new vk_image_t(
+               dev, backend_cast<vk_image_t>(*img).object,
+               vk::DeviceMemory{}, 1));
+         });
+}
+
+uint32_t
+vk_offscreen_swap_chain_t::get_next_backbuffer_id(semaphore_t &semaphore) {
+  // Nothing to acquire, signal the semaphore so that callers waiting on it
+  // behave as with a real swap chain.
+  const auto &casted_semaphore = backend_cast<vk_semaphore_t>(semaphore);
+  queue.submit({vk::SubmitInfo{}
+                    .setSignalSemaphoreCount(1)
+                    .setPSignalSemaphores(&casted_semaphore.object)},
+               vk::Fence());
+  const auto result = current_image;
+  current_image = (current_image + 1) % static_cast<uint32_t>(images.size());
+  return result;
+}
+
+void vk_offscreen_swap_chain_t::present(command_queue_t &cmdqueue,
+                                        uint32_t backbuffer_index) {
+  if (!dump_prefix.empty())
+    dump_image(backbuffer_index);
+  presented_frames++;
+}
+
+void vk_offscreen_swap_chain_t::dump_image(uint32_t backbuffer_index) {
+  // Presentable images are left in eTransferSrcOptimal by the render passes.
+  readback_command_list->start_command_list_recording(*readback_storage);
+  auto &cmd = backend_cast<vk_command_list_t>(*readback_command_list).object;
+  cmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eColorAttachmentOutput,
+      vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {},
+      {vk::ImageMemoryBarrier{}
+           .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+           .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+           .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+           .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+           .setImage(backend_cast<vk_image_t>(*images[backbuffer_index]).object)
+           .setSubresourceRange(vk::ImageSubresourceRange(
+               vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))});
+  cmd.copyImageToBuffer(
+      backend_cast<vk_image_t>(*images[backbuffer_index]).object,
+      vk::ImageLayout::eTransferSrcOptimal,
+      backend_cast<vk_buffer_t>(*readback_buffer).object,
+      {vk::BufferImageCopy(
+          0, width, height,
+          vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+          vk::Offset3D(), vk::Extent3D(width, height, 1))});
+  cmd.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+      vk::DependencyFlags(),
+      {vk::MemoryBarrier{}
+           .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+           .setDstAccessMask(vk::AccessFlagBits::eHostRead)},
+      {}, {});
+  readback_command_list->make_command_list_executable();
+  const auto command_buffer = cmd;
+  queue.submit({vk::SubmitInfo{}.setCommandBufferCount(1).setPCommandBuffers(
+                   &command_buffer)},
+               vk::Fence());
+  queue.waitIdle();
+
+  std::ostringstream filename;
+  filename << dump_prefix << std::setw(5) << std::setfill('0')
+           << presented_frames << ".ppm";
+  std::ofstream file(filename.str(), std::ios::out | std::ios::binary);
+  file << "P6\n" << width << " " << height << "\n255\n";
+  const auto pixels = static_cast<const uint8_t *>(readback_buffer->map_buffer());
+  for (uint32_t i = 0; i < width * height; i++)
+    file.write(reinterpret_cast<const char *>(pixels + 4 * i), 3);
+  readback_buffer->unmap_buffer();
+}
+
 std::vector<std::unique_ptr<image_t>>
 vk_swap_chain_t::get_image_view_from_swap_chain() {
   const auto &swapchain_images = dev.getSwapchainImagesKHR(object);
@@ -294,7 +576,18 @@ vk_command_list_storage_t::create_command_list() {
           .setCommandPool(object)
           .setLevel(vk::CommandBufferLevel::ePrimary));
   return std::unique_ptr<command_list_t>(
-      new vk_command_list_t(dev, buffers[0]));
+      new vk_command_list_t(dev, buffers[0], present_layout, features));
+}
+
+std::unique_ptr<command_list_t>
+vk_command_list_storage_t::create_secondary_command_list() {
+  const auto &buffers = dev.allocateCommandBuffers(
+      vk::CommandBufferAllocateInfo{}
+          .setCommandBufferCount(1)
+          .setCommandPool(object)
+          .setLevel(vk::CommandBufferLevel::eSecondary));
+  return std::unique_ptr<command_list_t>(
+      new vk_command_list_t(dev, buffers[0], present_layout, features));
 }
 
 std::unique_ptr<command_list_storage_t> vk_device_t::create_command_storage() {
@@ -303,7 +596,8 @@ std::unique_ptr<command_list_storage_t> vk_device_t::create_command_storage() {
       object.createCommandPool(
           vk::CommandPoolCreateInfo{}
               .setQueueFamilyIndex(queue_family_index)
-              .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer))));
+              .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)),
+      present_layout, command_features));
 }
 
 namespace {
@@ -338,25 +632,61 @@ auto get_buffer_usage_flags(uint32_t flags) {
     result |= vk::BufferUsageFlagBits::eIndexBuffer;
   if (flags & usage_vertex)
     result |= vk::BufferUsageFlagBits::eVertexBuffer;
+  if (flags & usage_indirect)
+    result |= vk::BufferUsageFlagBits::eIndirectBuffer;
+  if (flags & usage_buffer_transfer_dst)
+    result |= vk::BufferUsageFlagBits::eTransferDst;
   return result;
 }
 }
 
+namespace {
+memory_category get_buffer_category(irr::video::E_MEMORY_POOL memory_pool,
+                                    uint32_t flags) {
+  if (memory_pool == irr::video::E_MEMORY_POOL::EMP_CPU_READABLE)
+    return memory_category::staging;
+  if (flags & usage_vertex)
+    return memory_category::vertex_buffer;
+  if (flags & usage_index)
+    return memory_category::index_buffer;
+  if (flags & usage_uniform)
+    return memory_category::uniform_buffer;
+  if (flags & usage_buffer_transfer_src)
+    return memory_category::staging;
+  return memory_category::other;
+}
+
+memory_category get_image_category(uint32_t flags) {
+  if (flags & (usage_render_target | usage_depth_stencil))
+    return memory_category::render_target;
+  return memory_category::texture;
+}
+}
+
 std::unique_ptr<buffer_t>
 vk_device_t::create_buffer(size_t size, irr::video::E_MEMORY_POOL memory_pool,
-                           uint32_t flags) {
+                           uint32_t flags, memory_category category,
+                           const std::string &debug_name) {
   const auto &buffer =
       object.createBuffer(vk::BufferCreateInfo{}.setSize(size).setUsage(
           get_buffer_usage_flags(flags)));
   const auto &mem_req = object.getBufferMemoryRequirements(buffer);
+  const auto &memory_type_index =
+      getMemoryTypeIndex(mem_req.memoryTypeBits, mem_properties,
+                         vk::MemoryPropertyFlagBits::eHostCoherent);
   const auto &memory = object.allocateMemory(
       vk::MemoryAllocateInfo{}
           .setAllocationSize(mem_req.size)
-          .setMemoryTypeIndex(
-              getMemoryTypeIndex(mem_req.memoryTypeBits, mem_properties,
-                                 vk::MemoryPropertyFlagBits::eHostCoherent)));
+          .setMemoryTypeIndex(memory_type_index));
   object.bindBufferMemory(buffer, memory, 0);
-  return std::unique_ptr<buffer_t>(new vk_buffer_t(object, buffer, memory));
+  const auto &allocation_id = this->memory.register_allocation(
+      mem_properties.memoryTypes[memory_type_index].heapIndex,
+      category == memory_category::automatic
+          ? get_buffer_category(memory_pool, flags)
+          : category,
+      mem_req.size, debug_name);
+  return std::unique_ptr<buffer_t>(new vk_buffer_t(
+      object, buffer, memory, &this->memory, allocation_id));
 }
 
 std::unique_ptr<descriptor_storage_t> vk_device_t::create_descriptor_storage(
@@ -388,7 +718,7 @@ vk_device_t::create_buffer_view(buffer_t &buffer,
       object,
       object.createBufferView(
           vk::BufferViewCreateInfo{}
-              .setBuffer(dynamic_cast<vk_buffer_t &>(buffer).object)
+              .setBuffer(backend_cast<vk_buffer_t>(buffer).object)
               .setFormat(get_vk_format(format))
               .setOffset(offset)
               .setRange(size))));
@@ -397,7 +727,7 @@ vk_device_t::create_buffer_view(buffer_t &buffer,
 void vk_device_t::set_uniform_texel_buffer_view(
     const allocated_descriptor_set &descriptor_set, uint32_t,
     uint32_t binding_location, buffer_view_t &buffer_view) {
-  const auto bv = dynamic_cast<vk_buffer_view_t &>(buffer_view).object;
+  const auto bv = backend_cast<vk_buffer_view_t>(buffer_view).object;
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
            .setDstSet(
@@ -415,7 +745,7 @@ void vk_device_t::set_uav_buffer_view(
     uint32_t binding_location, buffer_t &buffer, uint64_t offset,
     uint32_t size) {
   const auto buffer_descriptor = vk::DescriptorBufferInfo(
-      dynamic_cast<vk_buffer_t &>(buffer).object, 0, size);
+      backend_cast<vk_buffer_t>(buffer).object, 0, size);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
            .setDstSet(
@@ -433,7 +763,7 @@ void vk_device_t::set_constant_buffer_view(
     uint32_t binding_location, buffer_t &buffer, uint32_t buffer_size,
     uint64_t offset) {
   const auto buffer_descriptor = vk::DescriptorBufferInfo(
-      dynamic_cast<vk_buffer_t &>(buffer).object, offset, buffer_size);
+      backend_cast<vk_buffer_t>(buffer).object, offset, buffer_size);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
            .setDstSet(
@@ -459,11 +789,20 @@ clear_value_t get_clear_value(irr::video::ECOLOR_FORMAT format,
 std::unique_ptr<image_t>
 vk_device_t::create_image(irr::video::ECOLOR_FORMAT format, uint32_t width,
                           uint32_t height, uint16_t mipmap, uint32_t layers,
-                          uint32_t flags, clear_value_t *) {
-  const auto &get_image_create_flag = [](auto flags) {
+                          uint32_t flags, clear_value_t *,
+                          memory_category category,
+                          const std::string &debug_name) {
+  const auto &get_image_create_flag = [&](auto flags) {
     auto result = vk::ImageCreateFlags();
     if (flags & usage_cube)
       result |= vk::ImageCreateFlagBits::eCubeCompatible;
+    // sRGB formats have no storage support, storage views use the UNORM one.
+    if ((flags & usage_uav) && irr::video::isSRGB(format)) {
+      if (!extended_image_usage)
+        throw "create_image: sRGB storage images need VK_KHR_maintenance2";
+      result |= vk::ImageCreateFlagBits::eMutableFormat |
+                vk::ImageCreateFlagBits::eExtendedUsageKHR;
+    }
     return result;
   };
 
@@ -499,15 +838,21 @@ vk_device_t::create_image(irr::video::ECOLOR_FORMAT format, uint32_t width,
                              .setUsage(get_image_usage())
                              .setSamples(vk::SampleCountFlagBits::e1));
   const auto &mem_req = object.getImageMemoryRequirements(image);
+  const auto &memory_type_index =
+      getMemoryTypeIndex(mem_req.memoryTypeBits, mem_properties,
+                         vk::MemoryPropertyFlagBits::eDeviceLocal);
   const auto &memory =
       object.allocateMemory(vk::MemoryAllocateInfo{}
                                 .setAllocationSize(mem_req.size)
-                                .setMemoryTypeIndex(getMemoryTypeIndex(
-                                    mem_req.memoryTypeBits, mem_properties,
-                                    vk::MemoryPropertyFlagBits::eDeviceLocal)));
+                                .setMemoryTypeIndex(memory_type_index));
   object.bindImageMemory(image, memory, 0);
-  return std::unique_ptr<image_t>(
-      new vk_image_t(object, image, memory, mipmap));
+  const auto &allocation_id = this->memory.register_allocation(
+      mem_properties.memoryTypes[memory_type_index].heapIndex,
+      category == memory_category::automatic ? get_image_category(flags)
+                                             : category,
+      mem_req.size, debug_name);
+  return std::unique_ptr<image_t>(new vk_image_t(
+      object, image, memory, mipmap, &this->memory, allocation_id));
 }
 
 namespace {
@@ -517,6 +862,8 @@ auto get_image_type(irr::video::E_TEXTURE_TYPE texture_type) {
     return vk::ImageViewType::e2D;
   case irr::video::E_TEXTURE_TYPE::ETT_CUBE:
     return vk::ImageViewType::eCube;
+  case irr::video::E_TEXTURE_TYPE::ETT_2D_ARRAY:
+    return vk::ImageViewType::e2DArray;
   }
   throw;
 }
@@ -544,7 +891,7 @@ std::unique_ptr<image_view_t> vk_device_t::create_image_view(
       vk::ImageViewCreateInfo{}
           .setViewType(get_image_type(texture_type))
           .setFormat(get_vk_format(fmt))
-          .setImage(dynamic_cast<vk_image_t &>(img).object)
+          .setImage(backend_cast<vk_image_t>(img).object)
           .setComponents(vk::ComponentMapping())
           .setSubresourceRange(vk::ImageSubresourceRange(
               get_image_aspect(aspect), base_mipmap, mipmap_count, base_layer,
@@ -556,7 +903,7 @@ void vk_device_t::set_image_view(const allocated_descriptor_set &descriptor_set,
                                  uint32_t offset, uint32_t binding_location,
                                  image_view_t &img_view) {
   const auto image_descriptor = vk::DescriptorImageInfo(
-      vk::Sampler(), dynamic_cast<vk_image_view_t &>(img_view).object,
+      vk::Sampler(), backend_cast<vk_image_view_t>(img_view).object,
       vk::ImageLayout::eShaderReadOnlyOptimal);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
@@ -574,7 +921,7 @@ void vk_device_t::set_input_attachment(
     const allocated_descriptor_set &descriptor_set, uint32_t offset,
     uint32_t binding_location, image_view_t &img_view) {
   const auto image_descriptor = vk::DescriptorImageInfo(
-      vk::Sampler(), dynamic_cast<vk_image_view_t &>(img_view).object,
+      vk::Sampler(), backend_cast<vk_image_view_t>(img_view).object,
       vk::ImageLayout::eShaderReadOnlyOptimal);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
@@ -592,7 +939,7 @@ void vk_device_t::set_uav_image_view(
     const allocated_descriptor_set &descriptor_set, uint32_t offset,
     uint32_t binding_location, image_view_t &img_view) {
   const auto image_descriptor = vk::DescriptorImageInfo(
-      vk::Sampler(), dynamic_cast<vk_image_view_t &>(img_view).object,
+      vk::Sampler(), backend_cast<vk_image_view_t>(img_view).object,
       vk::ImageLayout::eGeneral);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
@@ -662,7 +1009,7 @@ void vk_device_t::set_sampler(const allocated_descriptor_set &descriptor_set,
                               uint32_t offset, uint32_t binding_location,
                               sampler_t &sampler) {
   const auto sampler_descriptor = vk::DescriptorImageInfo(
-      dynamic_cast<vk_sampler_t &>(sampler).object, vk::ImageView(),
+      backend_cast<vk_sampler_t>(sampler).object, vk::ImageView(),
       vk::ImageLayout::eShaderReadOnlyOptimal);
   object.updateDescriptorSets(
       {vk::WriteDescriptorSet{}
@@ -682,17 +1029,22 @@ void vk_command_list_t::copy_buffer_to_image_subresource(
     uint32_t height, uint32_t row_pitch, irr::video::ECOLOR_FORMAT format) {
   const auto &mipLevel =
       destination_subresource %
-      max(dynamic_cast<vk_image_t &>(destination_image).mip_levels, 1);
+      max(backend_cast<vk_image_t>(destination_image).mip_levels, 1);
   const auto &baseArrayLayer =
       destination_subresource /
-      max(dynamic_cast<vk_image_t &>(destination_image).mip_levels, 1);
+      max(backend_cast<vk_image_t>(destination_image).mip_levels, 1);
 
+  // Vulkan counts buffer rows in texels, a row of blocks of compressed
+  // formats covers formatBlockExtent texels.
+  const auto &row_length = row_pitch /
+                           irr::video::formatBlockByteCount(format) *
+                           irr::video::formatBlockExtent(format);
   object.copyBufferToImage(
-      dynamic_cast<vk_buffer_t &>(source).object,
-      dynamic_cast<vk_image_t &>(destination_image).object,
+      backend_cast<vk_buffer_t>(source).object,
+      backend_cast<vk_image_t>(destination_image).object,
       vk::ImageLayout::eTransferDstOptimal,
       {vk::BufferImageCopy(
-          offset_in_buffer, width, height,
+          offset_in_buffer, row_length, 0,
           vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mipLevel,
                                      baseArrayLayer, 1),
           vk::Offset3D(), vk::Extent3D(width, height, 1))});
@@ -703,6 +1055,34 @@ void vk_command_list_t::start_command_list_recording(command_list_storage_t &) {
       vk::CommandBufferUsageFlagBits::eSimultaneousUse));
 }
 
+void vk_command_list_t::start_secondary_command_list_recording(
+    command_list_storage_t &, render_pass_t &rp, uint32_t subpass,
+    framebuffer_t *fbo) {
+  const auto &inheritance_info =
+      vk::CommandBufferInheritanceInfo{}
+          .setRenderPass(backend_cast<vk_render_pass_t>(rp).object)
+          .setSubpass(subpass)
+          .setFramebuffer(fbo != nullptr
+                              ? backend_cast<vk_framebuffer>(fbo)->object
+                              : vk::Framebuffer());
+  object.begin(vk::CommandBufferBeginInfo{}
+                   .setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse |
+                             vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+                   .setPInheritanceInfo(&inheritance_info));
+}
+
+namespace {
+auto get_subpass_contents(subpass_contents contents) {
+  switch (contents) {
+  case subpass_contents::inline_commands:
+    return vk::SubpassContents::eInline;
+  case subpass_contents::secondary_command_lists:
+    return vk::SubpassContents::eSecondaryCommandBuffers;
+  }
+  throw;
+}
+}
+
 struct clear_value_visitor {
   auto operator()(const std::array<float, 4> &colors) const {
     return vk::ClearValue(vk::ClearColorValue(colors));
@@ -716,7 +1096,8 @@ struct clear_value_visitor {
 
 void vk_command_list_t::begin_renderpass(render_pass_t &rp, framebuffer_t &fbo,
                                          gsl::span<clear_value_t> clear_values,
-                                         uint32_t width, uint32_t height) {
+                                         uint32_t width, uint32_t height,
+                                         subpass_contents contents) {
   const auto &clearValues = std::vector<vk::ClearValue>{
       clear_values | ranges::view::transform([&](const auto &v) {
         return std::visit(clear_value_visitor(), v);
@@ -724,20 +1105,20 @@ void vk_command_list_t::begin_renderpass(render_pass_t &rp, framebuffer_t &fbo,
 
   object.beginRenderPass(
       vk::RenderPassBeginInfo{}
-          .setFramebuffer(dynamic_cast<vk_framebuffer &>(fbo).object)
-          .setRenderPass(dynamic_cast<vk_render_pass_t &>(rp).object)
+          .setFramebuffer(backend_cast<vk_framebuffer>(fbo).object)
+          .setRenderPass(backend_cast<vk_render_pass_t>(rp).object)
           .setRenderArea(
               vk::Rect2D(vk::Offset2D(), vk::Extent2D(width, height)))
           .setPClearValues(clearValues.data())
           .setClearValueCount(static_cast<uint32_t>(clearValues.size())),
-      vk::SubpassContents::eInline);
+      get_subpass_contents(contents));
 }
 
 void vk_command_list_t::clear_depth_stencil(image_t &img, float depth) {
   vk::ClearDepthStencilValue clear_values{};
   clear_values.depth = depth;
   object.clearDepthStencilImage(
-      dynamic_cast<vk_image_t &>(img).object,
+      backend_cast<vk_image_t>(img).object,
       vk::ImageLayout::eTransferDstOptimal, clear_values,
       {vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1)});
 }
@@ -746,7 +1127,7 @@ void vk_command_list_t::clear_depth_stencil(image_t &img, uint8_t stencil) {
   vk::ClearDepthStencilValue clear_values{};
   clear_values.stencil = stencil;
   object.clearDepthStencilImage(
-      dynamic_cast<vk_image_t &>(img).object,
+      backend_cast<vk_image_t>(img).object,
       vk::ImageLayout::eTransferDstOptimal, clear_values,
       {vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eStencil, 0, 1, 0,
                                  1)});
@@ -758,7 +1139,7 @@ void vk_command_list_t::clear_depth_stencil(image_t &img, float depth,
   clear_values.depth = depth;
   clear_values.stencil = stencil;
   object.clearDepthStencilImage(
-      dynamic_cast<vk_image_t &>(img).object,
+      backend_cast<vk_image_t>(img).object,
       vk::ImageLayout::eTransferDstOptimal, clear_values,
       {vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth |
                                      vk::ImageAspectFlagBits::eStencil,
@@ -770,7 +1151,7 @@ void vk_command_list_t::clear_color(image_t &img,
   vk::ClearColorValue clear_values{};
   clear_values.setFloat32(clear_colors);
   object.clearColorImage(
-      dynamic_cast<vk_image_t &>(img).object,
+      backend_cast<vk_image_t>(img).object,
       vk::ImageLayout::eTransferDstOptimal, clear_values,
       {vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)});
 }
@@ -788,15 +1169,22 @@ void vk_command_list_t::set_pipeline_barrier(image_t &resource,
                                              RESOURCE_USAGE after,
                                              uint32_t subresource,
                                              irr::video::E_ASPECT aspect) {
-  const auto &baseMipLevel =
-      subresource % max(dynamic_cast<vk_image_t &>(resource).mip_levels, 1);
-  const auto &baseArrayLayer =
-      subresource / max(dynamic_cast<vk_image_t &>(resource).mip_levels, 1);
+  set_pipeline_barrier(backend_cast<vk_image_t>(resource), before, after,
+                       subresource, aspect);
+}
 
-  const auto &get_image_layout = [](auto &&usage) {
+void vk_command_list_t::set_pipeline_barrier(vk_image_t &resource,
+                                             RESOURCE_USAGE before,
+                                             RESOURCE_USAGE after,
+                                             uint32_t subresource,
+                                             irr::video::E_ASPECT aspect) {
+  const auto &baseMipLevel = subresource % max(resource.mip_levels, 1);
+  const auto &baseArrayLayer = subresource / max(resource.mip_levels, 1);
+
+  const auto &get_image_layout = [this](auto &&usage) {
     switch (usage) {
     case RESOURCE_USAGE::PRESENT:
-      return vk::ImageLayout::ePresentSrcKHR;
+      return present_layout;
     case RESOURCE_USAGE::RENDER_TARGET:
       return vk::ImageLayout::eColorAttachmentOptimal;
     case RESOURCE_USAGE::READ_GENERIC:
@@ -805,6 +1193,8 @@ void vk_command_list_t::set_pipeline_barrier(image_t &resource,
       return vk::ImageLayout::eDepthStencilAttachmentOptimal;
     case RESOURCE_USAGE::COPY_DEST:
       return vk::ImageLayout::eTransferDstOptimal;
+    case RESOURCE_USAGE::COPY_SRC:
+      return vk::ImageLayout::eTransferSrcOptimal;
     case RESOURCE_USAGE::uav:
       return vk::ImageLayout::eGeneral;
     case RESOURCE_USAGE::undefined:
@@ -862,7 +1252,7 @@ void vk_command_list_t::set_pipeline_barrier(image_t &resource,
            .setNewLayout(get_image_layout(after))
            .setSrcAccessMask(src)
            .setDstAccessMask(dst)
-           .setImage(dynamic_cast<vk_image_t &>(resource).object)
+           .setImage(resource.object)
            .setSubresourceRange(vk::ImageSubresourceRange(
                get_image_aspect(aspect), baseMipLevel, 1, baseArrayLayer, 1))});
 }
@@ -874,7 +1264,7 @@ void vk_command_list_t::set_uav_flush(image_t &resource) {
       {vk::ImageMemoryBarrier{}
            .setOldLayout(vk::ImageLayout::eGeneral)
            .setNewLayout(vk::ImageLayout::eGeneral)
-           .setImage(dynamic_cast<vk_image_t &>(resource).object)
+           .setImage(backend_cast<vk_image_t>(resource).object)
            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite |
                              vk::AccessFlagBits::eShaderRead)
            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite |
@@ -884,8 +1274,7 @@ void vk_command_list_t::set_uav_flush(image_t &resource) {
 }
 
 void vk_command_list_t::set_graphic_pipeline(pipeline_state_t &pipeline) {
-  object.bindPipeline(vk::PipelineBindPoint::eGraphics,
-                      static_cast<vk_pipeline_state_t &>(pipeline).object);
+  set_graphic_pipeline(backend_cast<vk_pipeline_state_t>(pipeline));
 }
 
 void vk_command_list_t::set_compute_pipeline(
@@ -920,7 +1309,7 @@ vk_descriptor_storage_t::allocate_descriptor_set_from_cbv_srv_uav_heap(
     uint32_t, const std::vector<descriptor_set_layout *> layout, uint32_t) {
   const auto &set_layouts = std::vector<vk::DescriptorSetLayout>{
       layout | ranges::view::transform([](auto &&tmp) {
-        return dynamic_cast<vk_descriptor_set_layout *>(tmp)->object;
+        return backend_cast<vk_descriptor_set_layout>(tmp)->object;
       })};
   return std::unique_ptr<allocated_descriptor_set>(
       new vk_allocated_descriptor_set(dev.allocateDescriptorSets(
@@ -939,11 +1328,10 @@ vk_descriptor_storage_t::allocate_descriptor_set_from_sampler_heap(
 void vk_command_list_t::bind_graphic_descriptor(
     uint32_t bindpoint, const allocated_descriptor_set &descriptor_set,
     pipeline_layout_t &sig) {
-  object.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      dynamic_cast<vk_pipeline_layout_t &>(sig).object, bindpoint,
-      {static_cast<const vk_allocated_descriptor_set &>(descriptor_set).object},
-      {});
+  bind_graphic_descriptor(
+      bindpoint,
+      static_cast<const vk_allocated_descriptor_set &>(descriptor_set),
+      backend_cast<vk_pipeline_layout_t>(sig));
 }
 
 void vk_command_list_t::bind_compute_descriptor(
@@ -951,7 +1339,7 @@ void vk_command_list_t::bind_compute_descriptor(
     pipeline_layout_t &sig) {
   object.bindDescriptorSets(
       vk::PipelineBindPoint::eCompute,
-      dynamic_cast<vk_pipeline_layout_t &>(sig).object, bindpoint,
+      backend_cast<vk_pipeline_layout_t>(sig).object, bindpoint,
       {static_cast<const vk_allocated_descriptor_set &>(descriptor_set).object},
       {});
 }
@@ -971,8 +1359,12 @@ auto get_index_type(irr::video::E_INDEX_TYPE type) {
 void vk_command_list_t::bind_index_buffer(buffer_t &buffer, uint64_t offset,
                                           uint32_t size,
                                           irr::video::E_INDEX_TYPE type) {
-  object.bindIndexBuffer(dynamic_cast<vk_buffer_t &>(buffer).object, offset,
-                         get_index_type(type));
+  bind_index_buffer(backend_cast<vk_buffer_t>(buffer), offset, type);
+}
+
+void vk_command_list_t::bind_index_buffer(vk_buffer_t &buffer, uint64_t offset,
+                                          irr::video::E_INDEX_TYPE type) {
+  object.bindIndexBuffer(buffer.object, offset, get_index_type(type));
 }
 
 void vk_command_list_t::bind_vertex_buffers(
@@ -986,70 +1378,163 @@ void vk_command_list_t::bind_vertex_buffers(
   for (const auto &infos : buffer_offset_stride_size) {
     uint64_t offset;
     std::tie(std::ignore, offset, std::ignore, std::ignore) = infos;
-    pbuffers[idx] = dynamic_cast<vk_buffer_t &>(std::get<0>(infos)).object;
+    pbuffers[idx] = backend_cast<vk_buffer_t>(std::get<0>(infos)).object;
     poffsets[idx] = offset;
     idx++;
   }
   object.bindVertexBuffers(first_bind, pbuffers, poffsets);
 }
 
+void vk_command_list_t::bind_vertex_buffers(
+    uint32_t first_bind, gsl::span<vk_buffer_t *const> buffers,
+    gsl::span<const uint64_t> offsets) {
+  // Vertex input bindings are limited to 16 by the pipeline state helpers.
+  std::array<vk::Buffer, 16> pbuffers;
+  if (buffers.size() > pbuffers.size())
+    throw "bind_vertex_buffers: too many vertex buffers";
+  if (offsets.size() != buffers.size())
+    throw "bind_vertex_buffers: one offset per buffer is needed";
+  for (size_t idx = 0; idx < buffers.size(); idx++)
+    pbuffers[idx] = buffers[idx]->object;
+  object.bindVertexBuffers(first_bind, static_cast<uint32_t>(buffers.size()),
+                           pbuffers.data(), offsets.data());
+}
+
 void vk_command_queue_t::submit_executable_command_list(
     command_list_t &command_list, semaphore_t *wait_sem) {
-  std::array<vk::CommandBuffer, 1> command_buffers{
-      dynamic_cast<vk_command_list_t &>(command_list).object};
-  const auto &wait_semaphores =
-      wait_sem != nullptr
-          ? std::vector<vk::Semaphore>{dynamic_cast<vk_semaphore_t *>(wait_sem)
-                                           ->object}
-          : std::vector<vk::Semaphore>{};
-  const auto &wait_stages =
-      wait_sem != nullptr
-          ? std::vector<
-                vk::PipelineStageFlags>{vk::PipelineStageFlagBits::eTopOfPipe}
-          : std::vector<vk::PipelineStageFlags>{};
+  submit_executable_command_list(backend_cast<vk_command_list_t>(command_list),
+                                 backend_cast<vk_semaphore_t>(wait_sem));
+}
+
+void vk_command_queue_t::submit_executable_command_list(
+    vk_command_list_t &command_list, vk_semaphore_t *wait_sem) {
+  const auto wait_stage =
+      vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
   object.submit(
       {vk::SubmitInfo{}
-           .setCommandBufferCount(static_cast<uint32_t>(command_buffers.size()))
-           .setPCommandBuffers(command_buffers.data())
-           .setWaitSemaphoreCount(static_cast<uint32_t>(wait_semaphores.size()))
-           .setPWaitSemaphores(wait_semaphores.data())
-           .setPWaitDstStageMask(wait_stages.data())},
+           .setCommandBufferCount(1)
+           .setPCommandBuffers(&command_list.object)
+           .setWaitSemaphoreCount(wait_sem != nullptr ? 1 : 0)
+           .setPWaitSemaphores(wait_sem != nullptr ? &wait_sem->object
+                                                   : nullptr)
+           .setPWaitDstStageMask(&wait_stage)},
       vk::Fence());
 }
 
-void vk_command_list_t::draw_indexed(uint32_t index_count,
-                                     uint32_t instance_count,
-                                     uint32_t base_index, int32_t base_vertex,
-                                     uint32_t base_instance) {
-  object.drawIndexed(index_count, instance_count, base_index, base_vertex,
-                     base_instance);
+void vk_command_list_t::copy_buffer(buffer_t &src, uint64_t src_offset,
+                                    buffer_t &dst, uint64_t dst_offset,
+                                    uint64_t size) {
+  object.copyBuffer(backend_cast<vk_buffer_t>(src).object,
+                    backend_cast<vk_buffer_t>(dst).object,
+                    {vk::BufferCopy(src_offset, dst_offset, size)});
 }
 
-void vk_command_list_t::draw_non_indexed(uint32_t vertex_count,
-                                         uint32_t instance_count,
-                                         int32_t base_vertex,
-                                         uint32_t base_instance) {
-  object.draw(vertex_count, instance_count, base_vertex, base_instance);
+void vk_command_list_t::fill_buffer(buffer_t &buffer, uint64_t offset,
+                                    uint64_t size, uint32_t value) {
+  object.fillBuffer(backend_cast<vk_buffer_t>(buffer).object, offset, size,
+                    value);
 }
 
-void vk_command_list_t::dispatch(uint32_t x, uint32_t y, uint32_t z) {
-  object.dispatch(x, y, z);
+namespace {
+vk::AccessFlags get_buffer_access(RESOURCE_USAGE usage) {
+  switch (usage) {
+  case RESOURCE_USAGE::COPY_DEST:
+    return vk::AccessFlagBits::eTransferWrite;
+  case RESOURCE_USAGE::COPY_SRC:
+    return vk::AccessFlagBits::eTransferRead;
+  case RESOURCE_USAGE::READ_GENERIC:
+    return vk::AccessFlagBits::eShaderRead;
+  case RESOURCE_USAGE::uav:
+    return vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+  case RESOURCE_USAGE::indirect_argument:
+    return vk::AccessFlagBits::eIndirectCommandRead;
+  case RESOURCE_USAGE::index_buffer:
+    return vk::AccessFlagBits::eIndexRead;
+  case RESOURCE_USAGE::undefined:
+    return vk::AccessFlags();
+  }
+  throw;
 }
 
-void vk_command_list_t::copy_buffer(buffer_t &src, uint64_t src_offset,
-                                    buffer_t &dst, uint64_t dst_offset,
-                                    uint64_t size) {
-  object.copyBuffer(dynamic_cast<vk_buffer_t &>(src).object,
-                    dynamic_cast<vk_buffer_t &>(dst).object,
-                    {vk::BufferCopy(src_offset, dst_offset, size)});
+vk::PipelineStageFlags get_buffer_stage(RESOURCE_USAGE usage) {
+  switch (usage) {
+  case RESOURCE_USAGE::COPY_DEST:
+  case RESOURCE_USAGE::COPY_SRC:
+    return vk::PipelineStageFlagBits::eTransfer;
+  case RESOURCE_USAGE::READ_GENERIC:
+  case RESOURCE_USAGE::uav:
+    return vk::PipelineStageFlagBits::eComputeShader |
+           vk::PipelineStageFlagBits::eVertexShader |
+           vk::PipelineStageFlagBits::eFragmentShader;
+  case RESOURCE_USAGE::indirect_argument:
+    return vk::PipelineStageFlagBits::eDrawIndirect;
+  case RESOURCE_USAGE::index_buffer:
+    return vk::PipelineStageFlagBits::eVertexInput;
+  case RESOURCE_USAGE::undefined:
+    return vk::PipelineStageFlagBits::eTopOfPipe;
+  }
+  throw;
+}
+}
+
+void vk_command_list_t::set_buffer_barrier(buffer_t &buffer,
+                                           RESOURCE_USAGE before,
+                                           RESOURCE_USAGE after) {
+  object.pipelineBarrier(
+      get_buffer_stage(before), get_buffer_stage(after), vk::DependencyFlags(),
+      {},
+      {vk::BufferMemoryBarrier{}
+           .setSrcAccessMask(get_buffer_access(before))
+           .setDstAccessMask(get_buffer_access(after))
+           .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+           .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+           .setBuffer(backend_cast<vk_buffer_t>(buffer).object)
+           .setOffset(0)
+           .setSize(VK_WHOLE_SIZE)},
+      {});
+}
+
+void vk_command_list_t::draw_indexed_indirect(buffer_t &arguments,
+                                              uint64_t offset,
+                                              uint32_t draw_count,
+                                              uint32_t stride) {
+  const auto &buffer = backend_cast<vk_buffer_t>(arguments).object;
+  if (features.multi_draw_indirect) {
+    object.drawIndexedIndirect(buffer, offset, draw_count, stride);
+    return;
+  }
+  for (uint32_t i = 0; i < draw_count; i++)
+    object.drawIndexedIndirect(buffer, offset + uint64_t(i) * stride, 1,
+                               stride);
+}
+
+void vk_command_list_t::draw_indexed_indirect_count(
+    buffer_t &arguments, uint64_t offset, buffer_t &count_buffer,
+    uint64_t count_offset, uint32_t max_draw_count, uint32_t stride) {
+  if (features.draw_indexed_indirect_count == nullptr)
+    throw "draw_indexed_indirect_count requires VK_KHR_draw_indirect_count";
+  features.draw_indexed_indirect_count(
+      object, backend_cast<vk_buffer_t>(arguments).object, offset,
+      backend_cast<vk_buffer_t>(count_buffer).object, count_offset,
+      max_draw_count, stride);
+}
+
+void vk_command_list_t::next_subpass(subpass_contents contents) {
+  object.nextSubpass(get_subpass_contents(contents));
 }
 
-void vk_command_list_t::next_subpass() {
-  object.nextSubpass(vk::SubpassContents::eInline);
+void vk_command_list_t::execute_secondary_command_lists(
+    gsl::span<command_list_t *const> command_lists) {
+  std::vector<vk::CommandBuffer> command_buffers;
+  command_buffers.reserve(command_lists.size());
+  for (const auto &command_list : command_lists)
+    command_buffers.push_back(
+        backend_cast<vk_command_list_t>(command_list)->object);
+  object.executeCommands(command_buffers);
 }
 
 uint32_t vk_swap_chain_t::get_next_backbuffer_id(semaphore_t &semaphore) {
-  const auto &casted_semaphore = dynamic_cast<vk_semaphore_t &>(semaphore);
+  const auto &casted_semaphore = backend_cast<vk_semaphore_t>(semaphore);
   return dev
       .acquireNextImageKHR(object, UINT64_MAX, casted_semaphore.object,
                            vk::Fence())
@@ -1062,7 +1547,7 @@ void vk_swap_chain_t::present(command_queue_t &cmdqueue,
                                .setPSwapchains(&object)
                                .setSwapchainCount(1)
                                .setPImageIndices(&backbuffer_index);
-  dynamic_cast<vk_command_queue_t &>(cmdqueue).object.presentKHR(&presentInfo);
+  backend_cast<vk_command_queue_t>(cmdqueue).object.presentKHR(&presentInfo);
 }
 
 vk_framebuffer::vk_framebuffer(vk::Device _dev, vk::RenderPass render_pass,
@@ -1085,10 +1570,10 @@ vk_device_t::create_frame_buffer(gsl::span<const image_view_t *> render_targets,
                                  render_pass_t *render_pass) {
   const auto &attachments = std::vector<vk::ImageView>{
       render_targets | ranges::view::transform([&](const auto &input) {
-        return dynamic_cast<const vk_image_view_t *>(input)->object;
+        return backend_cast<const vk_image_view_t>(input)->object;
       })};
   return std::unique_ptr<framebuffer_t>(new vk_framebuffer(
-      object, dynamic_cast<vk_render_pass_t *>(render_pass)->object,
+      object, backend_cast<vk_render_pass_t>(render_pass)->object,
       attachments, width, height, 1));
 }
 
@@ -1099,13 +1584,13 @@ vk_device_t::create_frame_buffer(gsl::span<const image_view_t *> render_targets,
                                  render_pass_t *render_pass) {
   const auto &attachments = std::vector<vk::ImageView>{ranges::view::concat(
       render_targets | ranges::view::transform([&](const auto input) {
-        return dynamic_cast<const vk_image_view_t *>(input)->object;
+        return backend_cast<const vk_image_view_t>(input)->object;
       }),
       ranges::view::single(
-          dynamic_cast<const vk_image_view_t &>(depth_stencil_texture)
+          backend_cast<const vk_image_view_t>(depth_stencil_texture)
               .object))};
   return std::unique_ptr<framebuffer_t>(new vk_framebuffer(
-      object, dynamic_cast<vk_render_pass_t *>(render_pass)->object,
+      object, backend_cast<vk_render_pass_t>(render_pass)->object,
       attachments, width, height, 1));
 }
 
@@ -1147,6 +1632,35 @@ struct shader_module {
   shader_module(shader_module &&) = delete;
   shader_module(const shader_module &) = delete;
 };
+
+// Values are stored contiguously, info points to them.
+struct specialization_data {
+  std::vector<vk::SpecializationMapEntry> entries;
+  std::vector<uint32_t> values;
+  vk::SpecializationInfo info;
+
+  specialization_data(gsl::span<const specialization_constant> constants) {
+    for (const auto &constant : constants) {
+      entries.push_back(vk::SpecializationMapEntry{
+          constant.id,
+          static_cast<uint32_t>(values.size() * sizeof(uint32_t)),
+          sizeof(uint32_t)});
+      values.push_back(constant.value);
+    }
+    info = vk::SpecializationInfo{}
+               .setMapEntryCount(static_cast<uint32_t>(entries.size()))
+               .setPMapEntries(entries.data())
+               .setDataSize(values.size() * sizeof(uint32_t))
+               .setPData(values.data());
+  }
+
+  const vk::SpecializationInfo *get() const {
+    return entries.empty() ? nullptr : &info;
+  }
+
+  specialization_data(specialization_data &&) = delete;
+  specialization_data(const specialization_data &) = delete;
+};
 }
 
 std::unique_ptr<pipeline_state_t> vk_device_t::create_graphic_pso(
@@ -1208,16 +1722,20 @@ std::unique_ptr<pipeline_state_t> vk_device_t::create_graphic_pso(
 
   shader_module module_vert(object, pso_desc.vertex_binary);
   shader_module module_frag(object, pso_desc.fragment_binary);
+  const auto &specialization =
+      specialization_data(pso_desc.specialization_constants);
 
   auto shader_stages = std::vector<vk::PipelineShaderStageCreateInfo>{
       vk::PipelineShaderStageCreateInfo{}
           .setStage(vk::ShaderStageFlagBits::eVertex)
           .setModule(module_vert.object)
-          .setPName("main"),
+          .setPName("main")
+          .setPSpecializationInfo(specialization.get()),
       vk::PipelineShaderStageCreateInfo{}
           .setStage(vk::ShaderStageFlagBits::eFragment)
           .setModule(module_frag.object)
-          .setPName("main")};
+          .setPName("main")
+          .setPSpecializationInfo(specialization.get())};
 
   const auto &vertex_input_binding = [&]() {
     auto &&result = std::vector<vk::VertexInputBindingDescription>{};
@@ -1318,8 +1836,8 @@ std::unique_ptr<pipeline_state_t> vk_device_t::create_graphic_pso(
           .setPRasterizationState(&rasterization)
           .setPMultisampleState(&multisample)
           .setRenderPass(
-              dynamic_cast<const vk_render_pass_t &>(render_pass).object)
-          .setLayout(dynamic_cast<const vk_pipeline_layout_t &>(layout).object)
+              backend_cast<const vk_render_pass_t>(render_pass).object)
+          .setLayout(backend_cast<const vk_pipeline_layout_t>(layout).object)
           //.setPTessellationState(&tesselation_info)
           .setPDynamicState(&dynamic_state_info)
           .setSubpass(subpass)
@@ -1337,15 +1855,18 @@ std::unique_ptr<compute_pipeline_state_t> vk_device_t::create_compute_pso(
     const compute_pipeline_state_description &pso_desc,
     const pipeline_layout_t &layout) {
   const auto &module = shader_module(object, pso_desc.compute_binary);
+  const auto &specialization =
+      specialization_data(pso_desc.specialization_constants);
   auto &&result = object.createComputePipeline(
       vk::PipelineCache{},
       vk::ComputePipelineCreateInfo{}
           .setStage(vk::PipelineShaderStageCreateInfo{}
                         .setModule(module.object)
                         .setPName("main")
-                        .setStage(vk::ShaderStageFlagBits::eCompute))
+                        .setStage(vk::ShaderStageFlagBits::eCompute)
+                        .setPSpecializationInfo(specialization.get()))
           .setLayout(
-              dynamic_cast<const vk_pipeline_layout_t &>(layout).object));
+              backend_cast<const vk_pipeline_layout_t>(layout).object));
   return std::unique_ptr<compute_pipeline_state_t>(
       new vk_compute_pipeline_state_t(object, result));
 }
@@ -1354,7 +1875,7 @@ std::unique_ptr<pipeline_layout_t> vk_device_t::create_pipeline_layout(
     gsl::span<const descriptor_set_layout *> sets) {
   const auto &descriptor_layout = std::vector<vk::DescriptorSetLayout>{
       sets | ranges::view::transform([](const auto &input) {
-        return dynamic_cast<const vk_descriptor_set_layout *>(input)->object;
+        return backend_cast<const vk_descriptor_set_layout>(input)->object;
       })};
   const auto &result = object.createPipelineLayout(
       vk::PipelineLayoutCreateInfo{}
@@ -1374,7 +1895,7 @@ vk_device_t::create_ibl_sky_pass(const irr::video::ECOLOR_FORMAT &fmt) {
           .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
           .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
           .setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
-          .setFinalLayout(vk::ImageLayout::ePresentSrcKHR),
+          .setFinalLayout(present_layout),
       vk::AttachmentDescription{}
           .setFormat(vk::Format::eD24UnormS8Uint)
           .setLoadOp(vk::AttachmentLoadOp::eLoad)
@@ -1433,12 +1954,20 @@ vk_device_t::create_ibl_sky_pass(const irr::video::ECOLOR_FORMAT &fmt) {
 }
 
 std::unique_ptr<render_pass_t>
-vk_device_t::create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT &fmt) {
+vk_device_t::create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT &fmt,
+                                         bool loads_object_attachments) {
+  // Attachment load operations and layouts don't affect compatibility.
+  const auto &object_load = loads_object_attachments
+                                ? vk::AttachmentLoadOp::eLoad
+                                : vk::AttachmentLoadOp::eClear;
+  const auto &surface_layout = loads_object_attachments
+                                   ? vk::ImageLayout::eColorAttachmentOptimal
+                                   : present_layout;
   const auto &attachments = std::array<vk::AttachmentDescription, 5>{
       // color
       vk::AttachmentDescription{
           vk::AttachmentDescriptionFlagBits{}, vk::Format::eR8G8B8A8Unorm,
-          vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear,
+          vk::SampleCountFlagBits::e1, object_load,
           vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare,
           vk::AttachmentStoreOp::eDontCare,
           vk::ImageLayout::eColorAttachmentOptimal,
@@ -1446,7 +1975,7 @@ vk_device_t::create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT &fmt) {
       // normal
       vk::AttachmentDescription{
           vk::AttachmentDescriptionFlagBits{}, vk::Format::eR16G16Sfloat,
-          vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear,
+          vk::SampleCountFlagBits::e1, object_load,
           vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare,
           vk::AttachmentStoreOp::eDontCare,
           vk::ImageLayout::eColorAttachmentOptimal,
@@ -1454,7 +1983,7 @@ vk_device_t::create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT &fmt) {
       // roughness and metalness
       vk::AttachmentDescription{
           vk::AttachmentDescriptionFlagBits{}, vk::Format::eR8G8B8A8Unorm,
-          vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear,
+          vk::SampleCountFlagBits::e1, object_load,
           vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare,
           vk::AttachmentStoreOp::eDontCare,
           vk::ImageLayout::eColorAttachmentOptimal,
@@ -1464,13 +1993,13 @@ vk_device_t::create_object_sunlight_pass(const irr::video::ECOLOR_FORMAT &fmt) {
           vk::AttachmentDescriptionFlagBits{}, get_vk_format(fmt),
           vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear,
           vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eClear,
-          vk::AttachmentStoreOp::eStore, vk::ImageLayout::ePresentSrcKHR,
+          vk::AttachmentStoreOp::eStore, surface_layout,
           vk::ImageLayout::eColorAttachmentOptimal},
       // depth
       vk::AttachmentDescription{
           vk::AttachmentDescriptionFlagBits{}, vk::Format::eD24UnormS8Uint,
-          vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear,
-          vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eClear,
+          vk::SampleCountFlagBits::e1, object_load,
+          vk::AttachmentStoreOp::eStore, object_load,
           vk::AttachmentStoreOp::eStore,
           vk::ImageLayout::eDepthStencilAttachmentOptimal,
           vk::ImageLayout::eDepthStencilAttachmentOptimal},
@@ -1610,8 +2139,8 @@ vk_device_t::create_blit_pass(const irr::video::ECOLOR_FORMAT &color_format) {
           .setLoadOp(vk::AttachmentLoadOp::eDontCare)
           .setStoreOp(vk::AttachmentStoreOp::eStore)
           .setSamples(vk::SampleCountFlagBits::e1)
-          .setInitialLayout(vk::ImageLayout::ePresentSrcKHR)
-          .setFinalLayout(vk::ImageLayout::ePresentSrcKHR)};
+          .setInitialLayout(present_layout)
+          .setFinalLayout(present_layout)};
 
   const auto &att_ref = std::array<vk::AttachmentReference, 1>{
       vk::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal}};
@@ -1638,3 +2167,54 @@ std::unique_ptr<semaphore_t> vk_device_t::create_semaphore() {
   auto &&semaphore = object.createSemaphore(vk::SemaphoreCreateInfo{});
   return std::unique_ptr<semaphore_t>(new vk_semaphore_t(object, semaphore));
 }
+
+std::vector<memory_heap_budget> vk_device_t::get_memory_heap_budgets() const {
+  auto &&result = std::vector<memory_heap_budget>{};
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{};
+  budget_properties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  if (get_memory_properties2 != nullptr) {
+    VkPhysicalDeviceMemoryProperties2KHR properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+    properties.pNext = &budget_properties;
+    get_memory_properties2(physical_device, &properties);
+  }
+  for (uint32_t i = 0; i < mem_properties.memoryHeapCount; i++) {
+    const auto &heap = mem_properties.memoryHeaps[i];
+    const auto &device_local =
+        !!(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    if (get_memory_properties2 != nullptr)
+      result.push_back({heap.size, budget_properties.heapBudget[i],
+                        budget_properties.heapUsage[i], device_local});
+    else
+      result.push_back(
+          {heap.size, heap.size, memory.get_heap_usage(i), device_local});
+  }
+  return result;
+}
+
+uint64_t vk_device_t::get_remaining_memory_budget(
+    irr::video::E_MEMORY_POOL memory_pool) {
+  // Remaining budget of the heap of the first memory type with the pool
+  // properties, whatever the resource. Images are allocated from the first
+  // device local type and buffers from the first host coherent one, so this is
+  // the heap of images for EMP_GPU_LOCAL and of buffers otherwise.
+  const auto &properties =
+      memory_pool == irr::video::E_MEMORY_POOL::EMP_GPU_LOCAL
+          ? vk::MemoryPropertyFlagBits::eDeviceLocal
+          : vk::MemoryPropertyFlagBits::eHostCoherent;
+  const auto &heap_index =
+      mem_properties
+          .memoryTypes[getMemoryTypeIndex(~0u, mem_properties, properties)]
+          .heapIndex;
+  const auto &heap = get_memory_heap_budgets()[heap_index];
+  return heap.budget > heap.usage ? heap.budget - heap.usage : 0;
+}
+
+void vk_device_t::dump_memory_usage(std::ostream &out, bool json) {
+  const auto &heaps = get_memory_heap_budgets();
+  if (json)
+    memory.write_json(out, heaps);
+  else
+    memory.write_table(out, heaps);
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2015 Vincent Lejeune
+// For conditions of distribution and use, see copyright notice in License.txt
+#include <Util\WorkerPool.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+worker_pool::worker_pool(size_t thread_count) {
+  if (thread_count == 0)
+    thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  for (size_t i = 0; i < thread_count; i++)
+    workers.emplace_back([this]() { run(); });
+}
+
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    tasks.clear();
+  }
+  task_added.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void worker_pool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  task_added.notify_one();
+}
+
+void worker_pool::parallel_for(size_t count, std::function<void(size_t)> f) {
+  // Helpers may start after the call returned, they only find no work then.
+  struct shared_state {
+    std::function<void(size_t)> f;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t running = 0;
+  };
+  auto state = std::make_shared<shared_state>();
+  state->f = std::move(f);
+  state->count = count;
+  const auto &&work = [](shared_state &s) {
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      s.running++;
+    }
+    for (size_t i = s.next++; i < s.count; i = s.next++)
+      s.f(i);
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      s.running--;
+    }
+    s.done.notify_all();
+  };
+  const auto helper_count = std::min(workers.size(), count);
+  for (size_t i = 1; i < helper_count; i++)
+    submit([state, work]() { work(*state); });
+  work(*state);
+  // Every index was taken, wait for the helpers still running one.
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&]() { return state->running == 0; });
+}
+
+void worker_pool::run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      task_added.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (stopping)
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}